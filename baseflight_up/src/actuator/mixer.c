@@ -13,6 +13,9 @@
 static uint8_t numberMotor = 0;
 uint8_t useServo = 0;
 
+mixTableFuncPtr mixTable = mixGeneric;
+static int16_t lowThrottleMotor;    // motor output with the throttle stick down
+
 int16_t motor[MAX_MOTORS];
 int16_t servo[8] = { 1500, 1500, 1500, 1500, 1500, 1500, 1500, 1500 };
 int16_t gimbal[2] = { 1500, 1500 };
@@ -153,7 +156,9 @@ void mixerInit(void)
         useServo = 1;
 
     if (cfg.mixerConfiguration == MULTITYPE_CUSTOM) {
-        // load custom mixer into currentMixer
+        // load custom mixer into currentMixer, counting from scratch as the
+        // CLI bench runs this again
+        numberMotor = 0;
         for (i = 0; i < MAX_MOTORS; i++) {
             // check if done
             if (cfg.customMixer[i].throttle == 0.0f)
@@ -169,6 +174,8 @@ void mixerInit(void)
                 currentMixer[i] = mixers[cfg.mixerConfiguration].motor[i];
         }
     }
+
+    mixerSelect();
 }
 
 void mixerLoadMix(int index)
@@ -310,7 +317,9 @@ static void airplaneMixer(void)
 #endif
 }
 
-void mixTable(void)
+// Any mixer, servos, gimbal and AUX forwarding included. The CLI bench also
+// times it against the specialised variants.
+void mixGeneric(void)
 {
     int16_t maxMotor;
     uint32_t i;
@@ -337,6 +346,7 @@ void mixTable(void)
             break;
 
         case MULTITYPE_GIMBAL:
+            updateEulerAngles();
             gimbal[0] = cfg.gimbalPitchServoMid + cfg.gimbalPitchServoGain * stateData.pitch * 128 + command[PITCH];
             gimbal[1] = cfg.gimbalRollServoMid + cfg.gimbalRollServoGain * stateData.roll * 128 + command[ROLL];
             break;
@@ -374,6 +384,7 @@ void mixTable(void)
         gimbal[1] = cfg.gimbalRollServoMid + aux[1];
 
         if (auxOptions[OPT_CAMSTAB]) {
+            updateEulerAngles();
             gimbal[0] += cfg.gimbalPitchServoGain * stateData.pitch * 128;
             gimbal[1] += cfg.gimbalRollServoGain * stateData.roll * 128;
         }
@@ -411,4 +422,61 @@ void mixTable(void)
         if (!mode.ARMED)
             motor[i] = cfg.minCommand;
     }
-}
\ No newline at end of file
+}
+
+// Motors only with more than three of them, QUADX and the like, armed
+static FAST_CODE void mixMotors(void)
+{
+    int16_t maxMotor;
+    uint32_t i;
+
+    // prevent "yaw jump" during yaw correction
+    axisPID[YAW] = constrain(axisPID[YAW], -100 - abs(command[YAW]), +100 + abs(command[YAW]));
+
+    maxMotor = motor[0] = command[THROTTLE] * currentMixer[0].throttle + axisPID[PITCH] * currentMixer[0].pitch + axisPID[ROLL] * currentMixer[0].roll + cfg.yawDirection * axisPID[YAW] * currentMixer[0].yaw;
+    for (i = 1; i < numberMotor; i++) {
+        motor[i] = command[THROTTLE] * currentMixer[i].throttle + axisPID[PITCH] * currentMixer[i].pitch + axisPID[ROLL] * currentMixer[i].roll + cfg.yawDirection * axisPID[YAW] * currentMixer[i].yaw;
+        if (motor[i] > maxMotor)
+            maxMotor = motor[i];
+    }
+
+    if ((rcData[THROTTLE]) < cfg.minCheck) {
+        for (i = 0; i < numberMotor; i++)
+            motor[i] = lowThrottleMotor;
+        return;
+    }
+
+    if (maxMotor > cfg.maxThrottle) {   // this is a way to still have good gyro corrections if at least one motor reaches its max.
+        maxMotor -= cfg.maxThrottle;
+        for (i = 0; i < numberMotor; i++)
+            motor[i] -= maxMotor;
+    }
+    for (i = 0; i < numberMotor; i++)
+        motor[i] = constrain(motor[i], cfg.minThrottle, cfg.maxThrottle);
+}
+
+// Motors only, disarmed
+static void mixMotorsDisarmed(void)
+{
+    uint32_t i;
+
+    axisPID[YAW] = constrain(axisPID[YAW], -100 - abs(command[YAW]), +100 + abs(command[YAW]));
+
+    for (i = 0; i < numberMotor; i++)
+        motor[i] = cfg.minCommand;
+}
+
+// Points mixTable at the variant for the mixer, features and arming state.
+// Called from mixerInit() and whenever the modes may have changed, which also
+// picks up features and limits changed from the CLI.
+void mixerSelect(void)
+{
+    lowThrottleMotor = featureGet(FEATURE_MOTOR_STOP) ? cfg.minCommand : cfg.minThrottle;
+
+    if (useServo || numberMotor <= 3 || (cfg.gimbalFlags & GIMBAL_FORWARDAUX))
+        mixTable = mixGeneric;
+    else if (mode.ARMED)
+        mixTable = mixMotors;
+    else
+        mixTable = mixMotorsDisarmed;
+}
@@ -47,6 +47,8 @@ typedef struct mixer_t {
     const motorMixer_t *motor;
 } mixer_t;
 
+typedef void (* mixTableFuncPtr)(void);
+
 ///////////////////////////////////////////////////////////////////////////////
 // External Variables
 ///////////////////////////////////////////////////////////////////////////////
@@ -59,6 +61,8 @@ extern int16_t servo[MAX_SERVOS];
 
 extern uint8_t useServo;
 
+extern mixTableFuncPtr mixTable;    // variant for the mixer and arming state, see mixerSelect()
+
 ///////////////////////////////////////////////////////////////////////////////
 // Functions
 ///////////////////////////////////////////////////////////////////////////////
@@ -67,7 +71,9 @@ void mixerInit(void);
 
 void mixerLoadMix(int index);
 
-void mixTable(void);
+void mixerSelect(void);
+
+void mixGeneric(void);
 
 void writeServos(void);
 
@@ -18,17 +18,33 @@
 
 pidData pids[NUM_PIDS];
 
-// Load PIDs from cfg
+// Load PIDs from the active profile
 void initPIDs(void)
 {
     uint8_t i;
+    loadPIDGains();
+    // Designed at the rate each loop runs at, the outer loops run slower
+    for(i = 0; i < NUM_PIDS; ++i)
+        filterChainInit(&pids[i].dFilter, &cfg.dtermFilter,
+                        1e6f / (i <= YAW_RATE_PID ? ACTUATOR_PERIOD : ATTITUDE_PERIOD));
+    zeroPIDs();
+}
+
+// Swap in the active profile's gains without touching the loop state. The
+// integrators hold output units so keeping them avoids a step on a profile
+// change, they only get clipped to the new limits.
+void loadPIDGains(void)
+{
+    uint8_t i;
+    float limit;
     for(i = 0; i < NUM_PIDS; ++i) {
-        pids[i].p = cfg.pids[i].p;
-        pids[i].i = cfg.pids[i].i;
-        pids[i].d = cfg.pids[i].d;
-        pids[i].iLim = cfg.pids[i].iLim;
+        pids[i].p = profile.pids[i].p;
+        pids[i].i = profile.pids[i].i;
+        pids[i].d = profile.pids[i].d;
+        pids[i].iLim = profile.pids[i].iLim;
+        limit = pids[i].iLim * 1000.0f;
+        pids[i].iAccum = constrain(pids[i].iAccum, -limit, limit);
     }
-    zeroPIDs();
 }
 
 // Reset integrators and error for all PIDs
@@ -38,7 +54,7 @@ void zeroPIDs(void)
     for (i = 0; i < NUM_PIDS; ++i) {
         pids[i].iAccum = 0.0f;
         pids[i].lastErr = 0.0f;
-        pids[i].lastDer = 0.0f;
+        filterChainReset(&pids[i].dFilter);
     }
 }
 
@@ -47,14 +63,11 @@ void zeroPID(pidData *pid)
 {
     pid->iAccum = 0.0f;
     pid->lastErr = 0.0f;
-    pids->lastDer = 0.0f;
+    filterChainReset(&pid->dFilter);
 }
 
-#define F_CUT   20.0f
-#define RC      1.0f / (TWO_PI * F_CUT)
-
 // Pretty much the Openpilot PID code
-float applyPID(pidData *pid, const float err, float dT)
+FAST_CODE float applyPID(pidData *pid, const float err, float dT)
 {
     float diff = (err - pid->lastErr);
     float dTerm = 0.0f;
@@ -67,12 +80,10 @@ float applyPID(pidData *pid, const float err, float dT)
         pid->iAccum = constrain(pid->iAccum, -pid->iLim * 1000.0f, pid->iLim * 1000.0f);
     }
     
-    // Calculate DT1 term, fixed T1 timeconstant
+    // Calculate D term through the configured filter chain, cuts out the
+    // high frequency noise that can drive controller crazy
     if(pid->d != 0.0f) {
-        // Discrete low pass filter, cuts out the
-        // high frequency noise that can drive controller crazy
-        dTerm = pid->lastDer + (( dT / ( dT + 7.9577e-3)) * ((diff * pid->d / dT) - pid->lastDer));
-        pid->lastDer = dTerm;
+        dTerm = filterChainApply(&pid->dFilter, diff * pid->d / dT);
     }
     
     return ((pid->p * err) + pid->iAccum / 1000.0f + dTerm);
@@ -15,6 +15,8 @@
 
 #pragma once
 
+#include "core/filters.h"
+
 // PID Definitions
 
 #define ROLL_RATE_PID       0
@@ -38,7 +40,7 @@ typedef struct {
     float iLim;
     float iAccum;
     float lastErr;
-    float lastDer;
+    filterChain_t dFilter;
 } pidData;
 
 // External Variables
@@ -49,6 +51,8 @@ extern pidData pids[NUM_PIDS];
 
 void initPIDs(void);
 
+void loadPIDGains(void);
+
 void zeroPIDs(void);
 
 void zeroPID(pidData *pid);
@@ -16,83 +16,186 @@
 #include "board.h"
 
 #include "actuator/pid.h"
+#include "actuator/stabilisation.h"
 
 #include "core/command.h"
+#include "core/fastmath.h"
 #include "core/filters.h"
 
-#define RATE_SCALING     0.005  // Stick to rate scaling (5 radians/sec)/(500 RX PWM Steps) = 0.005
-#define ATTITUDE_SCALING 0.002  // Stick to att scaling (1 radian)/(500 RX PWM Steps) = 0.001
+#define RATE_SCALING     0.005f // Stick to rate scaling (5 radians/sec)/(500 RX PWM Steps) = 0.005
+#define ATTITUDE_SCALING 0.002f // Stick to att scaling (1 radian)/(500 RX PWM Steps) = 0.001
 
 float axisPID[4];
+float axisSetpoint[3];
 
 /*
  * First we get the scaled desired commands
  * Using the desired command we apply relevant higher level PIDs onto the each axis.
  * Rate PID is always applied, this is nothing novel
  * - Need a stable rate mode before you even think of stabilising attitude/altitude
+ *
+ * The cascade runs at three rates. updateRateSetpoints() turns the sticks,
+ * through the level, headfree or heading hold loops, into axisSetpoint right
+ * after each attitude update. updateThrottleSetpoint() runs altitude hold
+ * into axisPID[THROTTLE] each time the altitude is updated. stabilisation()
+ * is only the rate loop, run every actuator cycle on the gyro averaged over
+ * that cycle, faster than both. No outer loop runs faster than its input
+ * or the loop it feeds.
+ *
+ * Each combination of outer loops is its own straight line function, built
+ * from the inline stages below. stabilisationSelect() picks the one the
+ * current modes need, so no loop tests a mode flag.
  */
 
-void stabilisation(void)
+typedef void (* setpointFuncPtr)(float dT);
+
+static filterChain_t gyroFilter[3];
+
+static setpointFuncPtr rateSetpoints;
+
+void initStabilisation(void)
 {
-    static uint32_t now, last;
-    static float gyroFiltered[3] = {0.0f, 0.0f, 0.0f};
-    now = micros();
-    float dT = (float)(now - last) * 1e-6f;
-    last = now;
-    
-    float desired[3];
-    
-    // Apply outer PID loops
+    uint8_t i;
     
-    // First look at Roll and Pitch
-    if (mode.LEVEL_MODE) {
-        desired[ROLL]    = command[ROLL] * ATTITUDE_SCALING;
-        desired[PITCH]   = command[PITCH] * ATTITUDE_SCALING;
-        desired[ROLL]  = standardRadianFormat(applyPID(&pids[ROLL_LEVEL_PID], 
-                            standardRadianFormat(desired[ROLL] - stateData.roll - cfg.angleTrim[ROLL]), 
+    for(i = 0; i < 3; ++i)
+        filterChainInit(&gyroFilter[i], &cfg.gyroFilter, 1e6f / ACTUATOR_PERIOD);
+
+    stabilisationSelect();
+}
+
+static inline float loopTime(uint32_t *last)
+{
+    uint32_t now = micros();
+    float dT = (float)(now - *last) * 1e-6f;
+    *last = now;
+    return dT;
+}
+
+// Roll and Pitch
+
+static inline void rollPitchRate(float dT)
+{
+    (void)dT;
+    axisSetpoint[ROLL]  = command[ROLL] * RATE_SCALING;
+    axisSetpoint[PITCH] = command[PITCH] * RATE_SCALING;
+}
+
+static inline void rollPitchLevel(float dT)
+{
+    float tilt[2];
+    Quaternion2Tilt(stateData.q, &tilt[ROLL], &tilt[PITCH]);
+    axisSetpoint[ROLL]  = standardRadianFormat(applyPID(&pids[ROLL_LEVEL_PID], 
+                            standardRadianFormat(command[ROLL] * ATTITUDE_SCALING - tilt[ROLL] - cfg.angleTrim[ROLL]), 
                             dT));
-        desired[PITCH] = standardRadianFormat(applyPID(&pids[PITCH_LEVEL_PID], 
-                            standardRadianFormat(desired[PITCH] - stateData.pitch - cfg.angleTrim[PITCH]), 
+    axisSetpoint[PITCH] = standardRadianFormat(applyPID(&pids[PITCH_LEVEL_PID], 
+                            standardRadianFormat(command[PITCH] * ATTITUDE_SCALING - tilt[PITCH] - cfg.angleTrim[PITCH]), 
                             dT));
-    } else if(mode.HEADFREE_MODE) {
-        float radDiff       = stateData.heading - headfreeReference;
-        float cosDiff       = cosf(radDiff);
-        float sinDiff       = sinf(radDiff);
-        desired[ROLL]       = command[ROLL] * cosDiff - command[PITCH] * sinDiff;
-        desired[PITCH]      = command[PITCH] * cosDiff + command[ROLL] * sinDiff;
-    } else { // Default to rates
-        desired[ROLL]   = command[ROLL] * RATE_SCALING;
-        desired[PITCH]  = command[PITCH] * RATE_SCALING;
-    }
-    
-    // Now Yaw
-    if(mode.HEADING_MODE && commandInDetent[YAW]) {
+}
+
+static inline void rollPitchHeadfree(float dT)
+{
+    (void)dT;
+    updateEulerAngles();
+    float radDiff       = stateData.heading - headfreeReference;
+    float cosDiff       = fastCos(radDiff);
+    float sinDiff       = fastSin(radDiff);
+    axisSetpoint[ROLL]  = command[ROLL] * cosDiff - command[PITCH] * sinDiff;
+    axisSetpoint[PITCH] = command[PITCH] * cosDiff + command[ROLL] * sinDiff;
+}
+
+// Yaw
+
+static inline void yawRate(float dT)
+{
+    (void)dT;
+    axisSetpoint[YAW]   = command[YAW] * RATE_SCALING;
+}
+
+// The stick leaving its detent hands yaw back to rates, that is per run
+static inline void yawHeading(float dT)
+{
+    if(commandInDetent[YAW]) {
+        updateEulerAngles();
         if(!lastCommandInDetent[YAW]) {
             zeroPID(&pids[HEADING_PID]); // We have a new heading zero integrators
+            headingHold = stateData.heading; // Hold where the stick was released
         }
-        desired[YAW] = standardRadianFormat(applyPID(&pids[HEADING_PID], standardRadianFormat(headingHold - stateData.heading), dT));
+        axisSetpoint[YAW] = standardRadianFormat(applyPID(&pids[HEADING_PID], standardRadianFormat(headingHold - stateData.heading), dT));
     } else { // Default to rates
-        desired[YAW]    = command[YAW] * RATE_SCALING;
-        headingHold     = stateData.heading; // Get our new heading
+        axisSetpoint[YAW] = command[YAW] * RATE_SCALING;
     }
-    
-    // And Throttle
+}
+
+#define SETPOINT_VARIANT(rollPitch, yaw) \
+    static void setpoints_##rollPitch##_##yaw(float dT) \
+    { \
+        rollPitch(dT); \
+        yaw(dT); \
+    }
+
+SETPOINT_VARIANT(rollPitchRate, yawRate)
+SETPOINT_VARIANT(rollPitchRate, yawHeading)
+SETPOINT_VARIANT(rollPitchLevel, yawRate)
+SETPOINT_VARIANT(rollPitchLevel, yawHeading)
+SETPOINT_VARIANT(rollPitchHeadfree, yawRate)
+SETPOINT_VARIANT(rollPitchHeadfree, yawHeading)
+
+// [roll and pitch][heading hold]
+static const setpointFuncPtr setpointVariants[3][2] = {
+    { setpoints_rollPitchRate_yawRate, setpoints_rollPitchRate_yawHeading },
+    { setpoints_rollPitchLevel_yawRate, setpoints_rollPitchLevel_yawHeading },
+    { setpoints_rollPitchHeadfree_yawRate, setpoints_rollPitchHeadfree_yawHeading },
+};
+
+// Level takes precedence over headfree, as it always has. Called whenever
+// the modes may have changed.
+void stabilisationSelect(void)
+{
+    uint8_t rollPitch = mode.LEVEL_MODE ? 1 : mode.HEADFREE_MODE ? 2 : 0;
+
+    rateSetpoints = setpointVariants[rollPitch][mode.HEADING_MODE != 0];
+
+    // Don't hold the last correction until the next altitude update
+    if (!mode.ALTITUDE_MODE)
+        axisPID[THROTTLE] = 0.0f;
+}
+
+// Outer attitude loops, every ATTITUDE_PERIOD after updateAttitude()
+void updateRateSetpoints(void)
+{
+    static uint32_t last;
+
+    rateSetpoints(loopTime(&last));
+}
+
+// Outer altitude loop, every ALTITUDE_PERIOD
+void updateThrottleSetpoint(void)
+{
+    static uint32_t last;
+    float dT = loopTime(&last);
+
     if(mode.ALTITUDE_MODE) {
         axisPID[THROTTLE]   = applyPID(&pids[ALTITUDE_PID], (altitudeHold - stateData.altitude) / 10.0f, dT); // 0.1m
         axisPID[THROTTLE]   = constrain(axisPID[THROTTLE], -200.0f, 200.0f);
     } else {
         axisPID[THROTTLE]   = 0.0f;
     }
-    
-    // Apply inner PID loops
-    
+}
+
+// Inner rate loop, every ACTUATOR_PERIOD
+void stabilisation(void)
+{
+    static uint32_t last;
+    float gyroFiltered[3];
+    float dT = loopTime(&last);
+
     // Filter the gyros
-    gyroFiltered[ROLL]  = filterSmooth(stateData.gyro[ROLL], gyroFiltered[ROLL], cfg.gyroSmoothFactor);
-    gyroFiltered[PITCH] = filterSmooth(stateData.gyro[PITCH], gyroFiltered[PITCH], cfg.gyroSmoothFactor);
-    gyroFiltered[YAW]   = filterSmooth(stateData.gyro[YAW], gyroFiltered[YAW], cfg.gyroSmoothFactor);
+    gyroFiltered[ROLL]  = filterChainApply(&gyroFilter[ROLL], stateData.gyro[ROLL]);
+    gyroFiltered[PITCH] = filterChainApply(&gyroFilter[PITCH], stateData.gyro[PITCH]);
+    gyroFiltered[YAW]   = filterChainApply(&gyroFilter[YAW], stateData.gyro[YAW]);
     
     // Rate PID - Always
-    axisPID[ROLL]   = applyPID(&pids[ROLL_RATE_PID], desired[ROLL] - stateData.gyro[ROLL], dT);
-    axisPID[PITCH]  = applyPID(&pids[PITCH_RATE_PID], desired[PITCH] - stateData.gyro[PITCH], dT);
-    axisPID[YAW]    = applyPID(&pids[YAW_RATE_PID], desired[YAW] - stateData.gyro[YAW], dT);
-}
\ No newline at end of file
+    axisPID[ROLL]   = applyPID(&pids[ROLL_RATE_PID], axisSetpoint[ROLL] - gyroFiltered[ROLL], dT);
+    axisPID[PITCH]  = applyPID(&pids[PITCH_RATE_PID], axisSetpoint[PITCH] - gyroFiltered[PITCH], dT);
+    axisPID[YAW]    = applyPID(&pids[YAW_RATE_PID], axisSetpoint[YAW] - gyroFiltered[YAW], dT);
+}
@@ -18,7 +18,16 @@
 // External Variables
 
 extern float axisPID[4];
+extern float axisSetpoint[3];   // rate loop setpoints, rad/s, from updateRateSetpoints()
 
 // Functions
 
+void initStabilisation(void);
+
+void stabilisationSelect(void);
+
+void updateRateSetpoints(void);
+
+void updateThrottleSetpoint(void);
+
 void stabilisation(void);
@@ -39,6 +39,15 @@
 #define Y       1
 #define Z       2
 
+// Scheduler periods (us), filters are designed against these rates
+#define GYRO_PERIOD         500
+#define ATTITUDE_PERIOD     3000
+#define ACTUATOR_PERIOD     2000    // rate loop, faster than the attitude loops
+#define ALTITUDE_PERIOD     40000
+
+// MSP/CLI link, telemetry streams are budgeted against this
+#define SERIAL_BAUD         115200
+
 #define MINCOMMAND  1000
 #define MIDCOMMAND  1500
 #define MAXCOMMAND  2000
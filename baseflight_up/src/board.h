@@ -40,6 +40,15 @@
 #define set(value, mask)    value |= mask
 #define clear(value, mask)  value &= ~mask
 
+// Runs from RAM, copied there by the startup code, so it misses the flash
+// wait states. Costs its size in RAM, keep it to the control path and the
+// busiest interrupts. OPTIONS=NO_FAST_CODE leaves it all in flash.
+#ifdef NO_FAST_CODE
+#define FAST_CODE
+#else
+#define FAST_CODE           __attribute__((section(".fastcode")))
+#endif
+
 ///////////////////////////////////////////////////////////////////////////////
 // Hardware definitions and GPIO
 ///////////////////////////////////////////////////////////////////////////////
@@ -72,6 +81,7 @@
 #include "baseflight_proto.h"
 
 #include "core/config.h"
+#include "core/perf.h"
 #include "core/utilities.h"
 #include "core/printf_min.h"
 
@@ -80,6 +90,9 @@
 #include "drivers/pwm_ppm.h"
 #include "drivers/spektrum.h"
 
+// Markers read DWT_CYCCNT from drivers/system.h
+#include "core/trace.h"
+
 #include "sensors/accel.h"
 #include "sensors/baro.h"
 #include "sensors/battery.h"
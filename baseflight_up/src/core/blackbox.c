@@ -0,0 +1,362 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#include "board.h"
+
+#include "actuator/mixer.h"
+#include "actuator/pid.h"
+#include "actuator/stabilisation.h"
+
+#include "core/blackbox.h"
+#include "core/store.h"
+
+#include "drivers/flash.h"
+
+#include "sensors/bus_sched.h"
+
+/*
+ * Frames are encoded into one of two RAM chunk buffers from the control loop.
+ * A full buffer is handed to blackboxProgram(), which programs it while the
+ * other one fills. Every flash fetch, interrupts included, stalls while a
+ * half word programs, so each one is only started when no sensor read is
+ * running in the background and it will be done before the next bus tick is
+ * due. The log region is only ever erased while
+ * disarmed, one page at a time, as an erase stalls the CPU for about 20 ms.
+ */
+
+#define CHUNK_HEADER        2
+#define CHUNK_EMPTY         0xFFFF
+#define FRAME_MAX           (1 + 5 * BLACKBOX_FIELDS)
+
+#define PROGRAM_HALF_US     80      // stall of one half word, 70 us worst case plus the call
+#define ERASE_INTERVAL      20      // blackboxUpdate() calls between page erases
+
+extern uint32_t _eimage;            // end of the image in flash, from the linker script
+
+blackboxStats_t blackboxStats;
+
+static uintptr_t regionStart, regionEnd;
+static uintptr_t head;              // next chunk to program
+static blackboxState_e state;
+
+static uint8_t buffer[2][BLACKBOX_CHUNK_SIZE];
+static uint8_t fill;                // buffer taking frames
+static uint16_t fillPos;
+static bool needIntra;
+static bool closing;                // session over, close the chunk once the writer is free
+
+static int8_t flushing = -1;        // buffer being programmed, -1 when idle
+static uint16_t flushPos, flushLen;
+static uintptr_t flushAddr;
+
+static uintptr_t eraseAddr;
+static uint8_t eraseCountdown;
+
+static int32_t previous[BLACKBOX_FIELDS];
+
+static uint8_t *putVarint(uint8_t *p, int32_t value)
+{
+    uint32_t zigzag = ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+
+    while (zigzag >= 0x80) {
+        *p++ = zigzag | 0x80;
+        zigzag >>= 7;
+    }
+    *p++ = zigzag;
+    return p;
+}
+
+static void sample(int32_t *v)
+{
+    uint8_t i;
+    float p, iTerm;
+
+    *v++ = micros();
+    for (i = 0; i < 3; i++)
+        *v++ = stateData.gyro[i] * 1000.0f;
+    for (i = 0; i < 3; i++)
+        *v++ = stateData.accel[i] * 100.0f;
+    for (i = 0; i < 3; i++)
+        *v++ = axisSetpoint[i] * 1000.0f;
+
+    // applyPID() only returns the sum, split it back up from the PID state
+    for (i = 0; i < 3; i++) {
+        p = pids[ROLL_RATE_PID + i].p * pids[ROLL_RATE_PID + i].lastErr;
+        iTerm = pids[ROLL_RATE_PID + i].iAccum / 1000.0f;
+        *v++ = p * 10.0f;
+        *v++ = iTerm * 10.0f;
+        *v++ = (axisPID[i] - p - iTerm) * 10.0f;
+    }
+
+    for (i = 0; i < MAX_MOTORS; i++)
+        *v++ = motor[i];
+    for (i = 0; i < 8; i++)
+        *v++ = rcData[i];
+}
+
+// Hands the filled buffer to the writer, false while it is still busy
+static bool closeChunk(void)
+{
+    uint16_t used = fillPos - CHUNK_HEADER;
+
+    if (flushing >= 0)
+        return false;
+
+    if (head >= regionEnd) {
+        state = BLACKBOX_FULL;
+        return false;
+    }
+
+    buffer[fill][0] = used;
+    buffer[fill][1] = used >> 8;
+    flushing = fill;
+    flushPos = 0;
+    flushLen = (fillPos + 1) & ~1;
+    flushAddr = head;
+    head += BLACKBOX_CHUNK_SIZE;
+
+    fill ^= 1;
+    fillPos = CHUNK_HEADER;
+    needIntra = true;
+    return true;
+}
+
+static bool put(const uint8_t *frame, uint8_t len)
+{
+    if (fillPos + len > BLACKBOX_CHUNK_SIZE && !closeChunk())
+        return false;
+
+    memcpy(&buffer[fill][fillPos], frame, len);
+    fillPos += len;
+    return true;
+}
+
+static void putFrame(const int32_t *values)
+{
+    uint8_t frame[FRAME_MAX], *p;
+    uint8_t i;
+    bool intra;
+
+    for (;;) {
+        intra = needIntra || fillPos == CHUNK_HEADER;
+        p = frame;
+        *p++ = intra ? 'I' : 'P';
+        for (i = 0; i < BLACKBOX_FIELDS; i++)
+            p = putVarint(p, intra ? values[i] : (int32_t)((uint32_t)values[i] - (uint32_t)previous[i]));
+
+        if (fillPos + (p - frame) <= BLACKBOX_CHUNK_SIZE || intra)
+            break;
+
+        // Does not fit, a fresh chunk starts with an intra frame
+        if (!closeChunk()) {
+            blackboxStats.dropped++;
+            return;
+        }
+    }
+
+    if (!put(frame, p - frame)) {
+        blackboxStats.dropped++;
+        return;
+    }
+
+    needIntra = false;
+    memcpy(previous, values, sizeof(previous));
+    blackboxStats.frames++;
+    blackboxStats.bytes += p - frame;
+}
+
+static void startSession(void)
+{
+    uint8_t header[6] = { 'H', BLACKBOX_VERSION, BLACKBOX_FIELDS, cfg.blackboxDivider,
+                          ACTUATOR_PERIOD & 0xFF, ACTUATOR_PERIOD >> 8 };
+
+    if (state != BLACKBOX_IDLE || !cfg.blackboxDivider)
+        return;
+
+    closing = false;
+    if (put(header, sizeof(header))) {
+        needIntra = true;
+        state = BLACKBOX_RECORDING;
+    }
+}
+
+static void endSession(void)
+{
+    uint8_t end = 'E';
+
+    if (state != BLACKBOX_RECORDING)
+        return;
+
+    put(&end, 1);
+    closing = true;
+    if (state == BLACKBOX_RECORDING)
+        state = BLACKBOX_IDLE;
+}
+
+void blackboxInit(void)
+{
+    uint16_t used;
+
+    regionStart = ((uintptr_t)&_eimage + FLASH_PAGE_BYTES - 1) & ~(uintptr_t)(FLASH_PAGE_BYTES - 1);
+    regionEnd = STORE_BASE;
+    if (regionStart > regionEnd)
+        regionStart = regionEnd;
+    fillPos = CHUNK_HEADER;
+
+    // Carry on after the last chunk, anything that is not a chunk header
+    // means the region needs erasing before it can be used
+    for (head = regionStart; head < regionEnd; head += BLACKBOX_CHUNK_SIZE) {
+        used = *(const uint16_t *)head;
+        if (used == CHUNK_EMPTY)
+            break;
+        if (used > BLACKBOX_CHUNK_SIZE - CHUNK_HEADER) {
+            head = regionEnd;
+            break;
+        }
+    }
+
+    state = head < regionEnd ? BLACKBOX_IDLE : BLACKBOX_FULL;
+}
+
+blackboxState_e blackboxState(void)
+{
+    return state;
+}
+
+uint32_t blackboxSize(void)
+{
+    return regionEnd - regionStart;
+}
+
+uint32_t blackboxUsed(void)
+{
+    return head - regionStart;
+}
+
+// Points data at up to len bytes of the log from offset, returns how many
+uint8_t blackboxRead(uint32_t offset, uint8_t len, const uint8_t **data)
+{
+    uint32_t used = blackboxUsed();
+
+    if (offset >= used)
+        return 0;
+
+    *data = (const uint8_t *)(regionStart + offset);
+    return min(len, used - offset);
+}
+
+// Starts a background erase of the whole log, refused while armed
+void blackboxErase(void)
+{
+    if (mode.ARMED)
+        return;
+
+    state = BLACKBOX_ERASING;
+    eraseAddr = regionStart;
+    eraseCountdown = 0;
+    fillPos = CHUNK_HEADER;
+    closing = false;
+}
+
+// Called at the end of every control loop
+void blackboxLog(void)
+{
+    static bool armed;
+    static uint8_t countdown;
+    int32_t values[BLACKBOX_FIELDS];
+    uint32_t start;
+
+    if (mode.ARMED != armed) {
+        armed = mode.ARMED;
+        countdown = 0;
+        if (armed)
+            startSession();
+        else
+            endSession();
+    }
+
+    if (state != BLACKBOX_RECORDING)
+        return;
+
+    if (countdown) {
+        countdown--;
+        return;
+    }
+    countdown = cfg.blackboxDivider - 1;
+
+    start = cycleCount();
+    sample(values);
+    putFrame(values);
+    blackboxStats.cycles = cycleCount() - start;
+    blackboxStats.maxCycles = max(blackboxStats.maxCycles, blackboxStats.cycles);
+}
+
+// Programs the chunk being flushed, polled on every pass of the main loop.
+// One half word a call, whenever the bus leaves room for it. A timed task
+// polled at a fixed period would keep coming back at the same point in the
+// tick and miss the room every time.
+void blackboxProgram(void)
+{
+    static bool waiting;
+
+    if (flushing < 0)
+        return;
+
+    if (busSchedUntilDue() < PROGRAM_HALF_US) {
+        if (!waiting)
+            blackboxStats.deferred++;
+        waiting = true;
+        return;
+    }
+    waiting = false;
+
+    if (!flashProgram(flushAddr + flushPos, &buffer[flushing][flushPos], 2)) {
+        // Leave the rest of the chunk, the next one carries on
+        flushPos = flushLen;
+    } else {
+        flushPos += 2;
+    }
+    if (flushPos == flushLen)
+        flushing = -1;
+}
+
+// Background flash work, scheduled every BLACKBOX_PERIOD
+void blackboxUpdate(void)
+{
+    if (flushing >= 0)
+        return;
+
+    if (closing) {
+        closing = false;
+        if (fillPos > CHUNK_HEADER)
+            closeChunk();
+        return;
+    }
+
+    if (state == BLACKBOX_ERASING && !mode.ARMED) {
+        if (eraseCountdown) {
+            eraseCountdown--;
+            return;
+        }
+        eraseCountdown = ERASE_INTERVAL;
+
+        flashErase(eraseAddr, FLASH_PAGE_BYTES);
+        eraseAddr += FLASH_PAGE_BYTES;
+        if (eraseAddr >= regionEnd) {
+            head = regionStart;
+            state = BLACKBOX_IDLE;
+        }
+    }
+}
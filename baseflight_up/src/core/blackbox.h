@@ -0,0 +1,92 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+// Flight recorder. While armed every cfg.blackboxDivider'th control loop is
+// logged to the free flash between the end of the firmware image and the
+// config store (_eimage in stm32_flash.ld up to STORE_BASE).
+//
+// That region is small. It is the 120 KB below the store less the image,
+// which was 55 KB before the recorder went in. A frame is about 52 bytes
+// with 12 motors, so at the default divider of 8 the log takes 3.3 KB/s
+// and 50 KB of free flash holds about 15 s. The cli 'blackbox' command
+// works it out for the build and divider in use. Programming that much
+// stalls the CPU for about 9% of the time, see blackbox.c.
+//
+// The log is a run of BLACKBOX_CHUNK_SIZE byte chunks from the start of that
+// region. A chunk is a u16 count of the frame bytes that follow, 0xFFFF where
+// nothing has been written yet, then the frames. Frames never span chunks and
+// each starts with a type byte:
+//
+//   'H'  session start: format version, field count, divider (u8 each) and
+//        loop period in us (u16)
+//   'I'  every field as a zig-zag varint
+//   'P'  every field as a zig-zag varint of its change since the last frame,
+//        differences wrap modulo 2^32
+//   'E'  session end
+//
+// The first data frame in a chunk and after an 'H' is always an 'I', so
+// decoding can start at any chunk. Varints are little endian base 128,
+// zig-zag maps 0, -1, 1, -2 .. to 0, 1, 2, 3 .. The fields, in order:
+//
+//   time (us)
+//   gyro (mrad/s), accel (cm/s/s), rate setpoint (mrad/s), each roll, pitch, yaw
+//   rate loop P, I and D terms (x10) for roll, then pitch, then yaw
+//   motor[MAX_MOTORS]
+//   rcData[8]
+
+#define BLACKBOX_VERSION        1
+#define BLACKBOX_FIELDS         (1 + 3 * 3 + 3 * 3 + MAX_MOTORS + 8)
+#define BLACKBOX_CHUNK_SIZE     512
+#define BLACKBOX_PERIOD         2000    // us, blackboxUpdate()
+
+typedef enum {
+    BLACKBOX_IDLE = 0,
+    BLACKBOX_RECORDING,
+    BLACKBOX_ERASING,
+    BLACKBOX_FULL,      // also when the region holds something that is not a log
+} blackboxState_e;
+
+typedef struct {
+    uint32_t frames;        // data frames logged since boot
+    uint32_t bytes;         // bytes of them
+    uint32_t dropped;       // frames lost to a busy writer or a full log
+    uint32_t deferred;      // times programming waited for room on the bus
+    uint16_t cycles;        // cost of logging the last frame
+    uint16_t maxCycles;
+} blackboxStats_t;
+
+extern blackboxStats_t blackboxStats;
+
+// Functions
+
+void blackboxInit(void);
+
+blackboxState_e blackboxState(void);
+
+uint32_t blackboxSize(void);
+
+uint32_t blackboxUsed(void);
+
+uint8_t blackboxRead(uint32_t offset, uint8_t len, const uint8_t **data);
+
+void blackboxErase(void);
+
+void blackboxLog(void);
+
+void blackboxProgram(void);
+
+void blackboxUpdate(void);
@@ -7,22 +7,44 @@
 #include "board.h"
 
 #include "actuator/mixer.h"
+#include "actuator/pid.h"
+#include "actuator/stabilisation.h"
+#include "core/blackbox.h"
+#include "core/crashlog.h"
+#include "core/fastmath.h"
+#include "core/latency.h"
+#include "core/params.h"
 #include "core/printf_min.h"
+#include "core/serial.h"
+#include "core/stack.h"
+#include "core/store.h"
+#include "drivers/crc.h"
+#include "sensors/bus_sched.h"
+#include "sensors/dyn_notch.h"
 
 #include "drivers/i2c.h"
 
 // we unset this on 'exit'
 uint8_t cliMode;
+static void cliBench(char *cmdline);
+static void cliBlackbox(char *cmdline);
+static void cliBus(char *cmdline);
 static void cliCMix(char *cmdline);
+static void cliCrashlog(char *cmdline);
 static void cliDefaults(char *cmdline);
 static void cliExit(char *cmdline);
 static void cliFeature(char *cmdline);
 static void cliHelp(char *cmdline);
+static void cliLatency(char *cmdline);
 static void cliMap(char *cmdline);
 static void cliMixer(char *cmdline);
+static void cliPerf(char *cmdline);
+static void cliProfile(char *cmdline);
 static void cliSave(char *cmdline);
 static void cliSet(char *cmdline);
+static void cliStack(char *cmdline);
 static void cliStatus(char *cmdline);
+static void cliTrace(char *cmdline);
 static void cliVersion(char *cmdline);
 static void cliCalibrate(char *cmdline);
 static void telemetryOn(char *cmdline);
@@ -30,16 +52,6 @@ static void telemetryOn(char *cmdline);
 static void telemetry(void);
 static void calibHelp(void);
 
-typedef enum {
-    VAR_UINT8,
-    VAR_INT8,
-    VAR_UINT16,
-    VAR_INT16,
-    VAR_UINT32,
-    VAR_FLOAT
-} vartype_e;
-
-
 // buffer
 
 static char cliBuffer[48];
@@ -78,18 +90,27 @@ typedef struct {
 
 // should be sorted a..z for bsearch()
 const clicmd_t cmdTable[] = {
+    { "bench", "blank for all, or control, crc, filters, loops, math or sensors", cliBench },
+    { "blackbox", "blank for status or erase", cliBlackbox },
+    { "bus", "show the I2C sensor schedule", cliBus },
     { "calibrate", "sensor calibration", cliCalibrate },
     { "cmix", "design custom mixer", cliCMix },
+    { "crashlog", "blank for status, freeze or clear", cliCrashlog },
     { "defaults", "reset to defaults and reboot", cliDefaults },
     { "exit", "", cliExit },
     { "feature", "list or -val or val", cliFeature },
     { "help", "", cliHelp },
+    { "latency", "gyro and rc to motor output since the last read", cliLatency },
     { "map", "mapping of rc channel order", cliMap },
     { "mixer", "mixer name or list", cliMixer },
+    { "perf", "counters since the last read", cliPerf },
+    { "profile", "index or blank, set edits the selected one", cliProfile },
     { "save", "save and reboot", cliSave },
     { "set", "name=value or blank or * for list", cliSet },
+    { "stack", "blank for headroom and last fault, or clear", cliStack },
     { "status", "show system status", cliStatus },
     { "telemetry", "", telemetryOn },
+    { "trace", "blank for status, ring, once or stop", cliTrace },
     { "version", "", cliVersion },
 };
 #define CMD_COUNT (sizeof(cmdTable) / sizeof(cmdTable[0]))
@@ -114,112 +135,34 @@ const calibcmd_t calibCmdTable[] = {
 
 #define CALIB_CMD_COUNT (sizeof(calibCmdTable) / sizeof(calibCmdTable[0]))
 
-// CLI Value
+// CLI benchmarks
+
+static void benchControl(void);
+static void benchCrc(void);
+static void benchFilters(void);
+static void benchLoops(void);
+static void benchMath(void);
+static void benchSensors(void);
 
 typedef struct {
-    const char *name;
-    const uint8_t type; // vartype_e
-    void *ptr;
-    const int32_t min;
-    const int32_t max;
-} clivalue_t;
-
-const clivalue_t valueTable[] = {
-    { "escPwmRate", VAR_UINT16, &cfg.escPwmRate, 50, 498},
-    { "servoPwmRate", VAR_UINT16, &cfg.servoPwmRate, 50, 498},
-    { "failsafeOnDelay",    VAR_UINT16, &cfg.failsafeOnDelay, 0, 1000 },
-    { "dailsafeOffDelay",   VAR_UINT16, &cfg.failsafeOffDelay, 0, 100000 },
-    { "failsafeThrottle",   VAR_UINT16, &cfg.failsafeThrottle, 1000, 2000 },
-    { "minCommand", VAR_UINT16, &cfg.minCommand, 0, 2000 },
-    { "midCommand", VAR_UINT16, &cfg.midCommand, 1200, 1700 },
-    { "maxCommand", VAR_UINT16, &cfg.maxCommand, 0, 2000 },
-    { "minCheck", VAR_UINT16, &cfg.minCheck, 0, 2000 },
-    { "maxCheck", VAR_UINT16, &cfg.maxCheck, 0, 2000 },
-    { "minThrottle", VAR_UINT16, &cfg.minThrottle, 0, 2000 },
-    { "maxThrottle", VAR_UINT16, &cfg.maxThrottle, 0, 2000 },
-    { "spektrumHiRes", VAR_UINT8, &cfg.spektrumHiRes, 0, 1 },
-    { "rollDeadband",   VAR_UINT8, &cfg.deadBand[ROLL], 0, 32 },
-    { "pitchDeadband",  VAR_UINT8, &cfg.deadBand[PITCH], 0, 32 },
-    { "yawDeadband",    VAR_UINT8, &cfg.deadBand[YAW], 0, 32 },
-    { "yawDirection", VAR_INT8, &cfg.yawDirection, -1, 1 },
-    { "triYawServoMin", VAR_UINT16, &cfg.triYawServoMin, 0, 2000 },
-    { "triYawServoMid", VAR_UINT16, &cfg.triYawServoMid, 0, 2000 },
-    { "triYawServoMax", VAR_UINT16, &cfg.triYawServoMax, 0, 2000 },
-    { "biLeftServoMin", VAR_UINT16, &cfg.biLeftServoMin, 0, 2000 },
-    { "biLeftServoMid", VAR_UINT16, &cfg.biLeftServoMid, 0, 2000 },
-    { "biLeftServoMax", VAR_UINT16, &cfg.biLeftServoMax, 0, 2000 },
-    { "biRightServoMin", VAR_UINT16, &cfg.biRightServoMin, 0, 2000 },
-    { "biRightServoMid", VAR_UINT16, &cfg.biRightServoMid, 0, 2000 },
-    { "biRightServoMax", VAR_UINT16, &cfg.biRightServoMax, 0, 2000 },
-    { "wingLeftMin", VAR_UINT16, &cfg.wingLeftMin, 0, 2000 },
-    { "wingLeftMid", VAR_UINT16, &cfg.wingLeftMid, 0, 2000 },
-    { "wingLeftMax", VAR_UINT16, &cfg.wingLeftMax, 0, 2000 },
-    { "wingRightMin", VAR_UINT16, &cfg.wingRightMin, 0, 2000 },
-    { "wingRightMid", VAR_UINT16, &cfg.wingRightMid, 0, 2000 },
-    { "wingRightMax", VAR_UINT16, &cfg.wingRightMax, 0, 2000 },
-    { "pitchDirectionLeft", VAR_INT8, &cfg.pitchDirectionLeft, -1, 1 },
-    { "pitchDirectionRight", VAR_INT8, &cfg.pitchDirectionRight, -1, 1 },
-    { "rollDirectionLeft", VAR_INT8, &cfg.rollDirectionLeft, -1, 1 },
-    { "rollDirectionRight", VAR_INT8, &cfg.rollDirectionRight, -1, 1 },
-    { "gimbalFlags", VAR_UINT8, &cfg.gimbalFlags, 0, 255},
-    { "gimbalSmoothFactor",  VAR_FLOAT, &cfg.gimbalSmoothFactor, 0, 1},
-    { "gimbalRollServoMin", VAR_UINT16, &cfg.gimbalRollServoMin, 0, 2000 },
-    { "gimbalRollServoMid", VAR_UINT16, &cfg.gimbalRollServoMid, 0, 2000 },
-    { "gimbalRollServoMax", VAR_UINT16, &cfg.gimbalRollServoMax, 0, 2000 },
-    { "gimbalRollServoGain", VAR_FLOAT, &cfg.gimbalRollServoGain, -100, 100 },
-    { "gimbalPitchServoMin", VAR_UINT16, &cfg.gimbalPitchServoMin, 0, 2000 },
-    { "gimbalPitchServoMid", VAR_UINT16, &cfg.gimbalPitchServoMid, 0, 2000 },
-    { "gimbalPitchServoMax", VAR_UINT16, &cfg.gimbalPitchServoMax, 0, 2000 },
-    { "gimbalPitchServoGain", VAR_FLOAT, &cfg.gimbalPitchServoGain, -100, 100 },
-    { "p_roll_rate",        VAR_FLOAT, &cfg.pids[ROLL_RATE_PID].p,     0, 400 },
-    { "i_roll_rate",        VAR_FLOAT, &cfg.pids[ROLL_RATE_PID].i,     0, 400 },
-    { "d_roll_rate",        VAR_FLOAT, &cfg.pids[ROLL_RATE_PID].d,     0, 400 },
-    { "ilim_roll_rate",     VAR_FLOAT, &cfg.pids[ROLL_RATE_PID].iLim,   0, 200},
-    { "p_pitch_rate",       VAR_FLOAT, &cfg.pids[PITCH_RATE_PID].p,    0, 400 },
-    { "i_pitch_rate",       VAR_FLOAT, &cfg.pids[PITCH_RATE_PID].i,    0, 400 },
-    { "d_pitch_rate",       VAR_FLOAT, &cfg.pids[PITCH_RATE_PID].d,    0, 400 },
-    { "ilim_pitch_rate",    VAR_FLOAT, &cfg.pids[PITCH_RATE_PID].iLim, 0, 200},
-    { "p_yaw_rate",         VAR_FLOAT, &cfg.pids[YAW_RATE_PID].p,      0, 400 },
-    { "i_yaw_rate",         VAR_FLOAT, &cfg.pids[YAW_RATE_PID].i,      0, 400 },
-    { "d_yaw_rate",         VAR_FLOAT, &cfg.pids[YAW_RATE_PID].d,      0, 400 },
-    { "ilim_yaw_rate",      VAR_FLOAT, &cfg.pids[YAW_RATE_PID].iLim,    0, 200},
-    { "p_roll_level",       VAR_FLOAT, &cfg.pids[ROLL_LEVEL_PID].p,      0, 400 },
-    { "i_roll_level",       VAR_FLOAT, &cfg.pids[ROLL_LEVEL_PID].i,      0, 400 },
-    { "d_roll_level",       VAR_FLOAT, &cfg.pids[ROLL_LEVEL_PID].d,      0, 400 },
-    { "ilim_roll_level",    VAR_FLOAT, &cfg.pids[ROLL_LEVEL_PID].iLim,    0, 200},
-    { "p_pitch_level",      VAR_FLOAT, &cfg.pids[PITCH_LEVEL_PID].p,      0, 400 },
-    { "i_pitch_level",      VAR_FLOAT, &cfg.pids[PITCH_LEVEL_PID].i,      0, 400 },
-    { "d_pitch_level",      VAR_FLOAT, &cfg.pids[PITCH_LEVEL_PID].d,      0, 400 },
-    { "ilim_pitch_level",   VAR_FLOAT, &cfg.pids[PITCH_LEVEL_PID].iLim,    0, 200},
-    { "p_heading",     VAR_FLOAT, &cfg.pids[HEADING_PID].p,      0, 400 },
-    { "i_heading",     VAR_FLOAT, &cfg.pids[HEADING_PID].i,      0, 400 },
-    { "d_heading",     VAR_FLOAT, &cfg.pids[HEADING_PID].d,      0, 400 },
-    { "ilim_heading",  VAR_FLOAT, &cfg.pids[HEADING_PID].iLim,    0, 200},
-    { "p_altitude",     VAR_FLOAT, &cfg.pids[ALTITUDE_PID].p ,      0, 400 },
-    { "i_altitude",     VAR_FLOAT, &cfg.pids[ALTITUDE_PID].i,      0, 400 },
-    { "d_altitude",     VAR_FLOAT, &cfg.pids[ALTITUDE_PID].d,      0, 400 },
-    { "ilim_altitude",  VAR_FLOAT, &cfg.pids[ALTITUDE_PID].iLim,    0, 50000},
-    { "mpu6050Scale", VAR_UINT8, &cfg.mpu6050Scale, 0, 1 },   
-    { "accelKp",  VAR_FLOAT, &cfg.accelKp,    0, 50},
-    { "accelKi",  VAR_FLOAT, &cfg.accelKi,    0, 50},
-    { "magKp",  VAR_FLOAT, &cfg.magKp,    0, 50},
-    { "magKi",  VAR_FLOAT, &cfg.magKi,    0, 50},
-    { "magDriftCompensation",  VAR_UINT8, &cfg.magDriftCompensation,    0, 1},
-    { "magDeclination",  VAR_FLOAT, &cfg.magDeclination,    -18000, 18000},
-    { "accelLPF", VAR_UINT8, &cfg.accelLPF, 0, 1},
-    { "accelSmoothFactor",  VAR_FLOAT, &cfg.accelSmoothFactor, 0, 1},
-    { "gyroBiasOnStartup", VAR_UINT8, &cfg.gyroBiasOnStartup, 0, 1},
-    { "gyroSmoothFactor",  VAR_FLOAT, &cfg.gyroSmoothFactor, 0, 1},
-    { "batScale",  VAR_FLOAT, &cfg.batScale,    0, 50},
-    { "batMinCellVoltage",  VAR_FLOAT, &cfg.batMinCellVoltage,    0, 5},
-    { "batMaxCellVoltage",  VAR_FLOAT, &cfg.batMaxCellVoltage,    0, 5},
-    { "startupDelay", VAR_UINT16, &cfg.startupDelay, 0, 6000},
+    char *name;
+    char *param;
+    void (*func)(void);
+} benchcmd_t;
+
+const benchcmd_t benchCmdTable[] = {
+    { "control", "updateAttitude, applyPID and mixTable", benchControl },
+    { "crc", "config checksum, xor against the CRC unit", benchCrc },
+    { "filters", "pt1 and biquad per sample", benchFilters },
+    { "loops", "setpoints, rate loop and mix per flight mode", benchLoops },
+    { "math", "soft-float runtime and fastmath", benchMath },
+    { "sensors", "gyro sample and read", benchSensors },
 };
 
-#define VALUE_COUNT (sizeof(valueTable) / sizeof(valueTable[0]))
+#define BENCH_CMD_COUNT (sizeof(benchCmdTable) / sizeof(benchCmdTable[0]))
 
-static void cliSetVar(const clivalue_t *var, const char *value);
-static void cliPrintVar(const clivalue_t *var, uint32_t full);
+static void cliSetVar(const param_t *var, const char *value);
+static void cliPrintVar(const param_t *var, uint32_t full);
 
 static void cliPrompt(void)
 {
@@ -232,6 +175,396 @@ static int cliCompare(const void *a, const void *b)
     return strncasecmp(ca->name, cb->name, strlen(cb->name));
 }
 
+#define BENCH_LOOPS 100
+
+// From stm32_flash.ld
+extern uint32_t _sfastcode, _efastcode;
+
+// What the control path benches touch: the attitude estimate with its
+// filters and integrators, the sensor accumulators and the PID state. The
+// bus tick is held off from benchSave() to benchRestore().
+typedef struct {
+    attitudeSnapshot_t attitude;
+    RawSensorData sensors;
+    pidData pids[NUM_PIDS];
+    uint32_t held;
+} benchState_t;
+
+static void benchSave(benchState_t *state)
+{
+    state->held = tickHold();
+    attitudeSave(&state->attitude);
+    memcpy(&state->sensors, &sensorData, sizeof(sensorData));
+    memcpy(state->pids, pids, sizeof(pids));
+}
+
+static void benchRestore(const benchState_t *state)
+{
+    memcpy(pids, state->pids, sizeof(pids));
+    memcpy(&sensorData, &state->sensors, sizeof(sensorData));
+    attitudeRestore(&state->attitude);
+    tickRelease(state->held);
+}
+
+static void benchControl(void)
+{
+    benchState_t state;
+    uint32_t start, attitude, pid, mix, i;
+
+    benchSave(&state);
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        updateAttitude();
+    attitude = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        applyPID(&pids[ROLL_RATE_PID], 0.1f, 0.004f);
+    pid = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        mixTable();
+    mix = (cycleCount() - start) / BENCH_LOOPS;
+
+    benchRestore(&state);
+
+    printf_min("%u bytes of FAST_CODE run from RAM\r\n", (uint32_t)&_efastcode - (uint32_t)&_sfastcode);
+    printf_min("updateAttitude: %u, applyPID: %u, mixTable: %u cycles\r\n", attitude, pid, mix);
+}
+
+typedef struct {
+    uint32_t setpoints;     // updateRateSetpoints()
+    uint32_t altitude;      // updateThrottleSetpoint()
+    uint32_t rate;          // stabilisation() and mixTable()
+    uint32_t rateGeneric;   // stabilisation() and mixGeneric()
+} loopCycles_t;
+
+static void benchLoopCycles(loopCycles_t *cycles)
+{
+    uint32_t start, i;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        updateRateSetpoints();
+    cycles->setpoints = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        updateThrottleSetpoint();
+    cycles->altitude = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++) {
+        stabilisation();
+        mixTable();
+    }
+    cycles->rate = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++) {
+        stabilisation();
+        mixGeneric();
+    }
+    cycles->rateGeneric = (cycleCount() - start) / BENCH_LOOPS;
+}
+
+// Times the loop variants a flight mode selects with the cascade armed on a
+// QUADX, whatever the mixer set, so figures from different setups compare.
+// Everything changed here is put back before returning. Motors are only
+// written by writeMotors().
+static void benchArmed(uint8_t flightMode, loopCycles_t *cycles)
+{
+    modeFlags_t savedMode = mode;
+    uint32_t savedFeatures = cfg.enabledFeatures;
+    uint8_t savedMixer = cfg.mixerConfiguration, savedGimbal = cfg.gimbalFlags;
+    float savedAxisPID[4], savedSetpoint[3];
+    int16_t savedMotor[MAX_MOTORS], savedServo[MAX_SERVOS];
+
+    memcpy(savedAxisPID, axisPID, sizeof(axisPID));
+    memcpy(savedSetpoint, axisSetpoint, sizeof(axisSetpoint));
+    memcpy(savedMotor, motor, sizeof(motor));
+    memcpy(savedServo, servo, sizeof(servo));
+
+    cfg.mixerConfiguration = MULTITYPE_QUADX;
+    featureClear(FEATURE_SERVO_TILT);
+    cfg.gimbalFlags &= ~GIMBAL_FORWARDAUX;
+    memset(&mode, 0, sizeof(mode));
+    mode.ARMED = 1;
+    mode.LEVEL_MODE = flightMode == 1;
+    mode.ALTITUDE_MODE = flightMode == 2;
+    mixerInit();
+    stabilisationSelect();
+
+    benchLoopCycles(cycles);
+
+    mode = savedMode;
+    cfg.mixerConfiguration = savedMixer;
+    cfg.enabledFeatures = savedFeatures;
+    cfg.gimbalFlags = savedGimbal;
+    mixerInit();
+    stabilisationSelect();
+    memcpy(axisPID, savedAxisPID, sizeof(axisPID));
+    memcpy(axisSetpoint, savedSetpoint, sizeof(axisSetpoint));
+    memcpy(motor, savedMotor, sizeof(motor));
+    memcpy(servo, savedServo, sizeof(servo));
+}
+
+// The outer attitude and altitude loops and one rate loop and mix for each
+// flight mode, then the same rate loop through mixGeneric(), which every
+// mixer took before the variants
+static void benchLoops(void)
+{
+    static const char * const flightModes[] = { "acro", "level", "altitude" };
+    benchState_t state;
+    loopCycles_t cycles;
+    uint32_t load;
+    uint8_t i;
+
+    for (i = 0; i < 3; i++) {
+        benchSave(&state);
+        benchArmed(i, &cycles);
+        benchRestore(&state);
+
+        // CPU share at the task rates, in 0.01%
+        load = (cycles.setpoints * (1000000 / ATTITUDE_PERIOD) + cycles.altitude * (1000000 / ALTITUDE_PERIOD) +
+                cycles.rate * (1000000 / ACTUATOR_PERIOD)) / 7200;
+        printf_min("QUADX %s: setpoints %u, altitude %u, rate loop and mix %u (generic mix %u) cycles, %u.%02u%% CPU\r\n",
+                   flightModes[i], cycles.setpoints, cycles.altitude, cycles.rate, cycles.rateGeneric,
+                   load / 100, load % 100);
+        while (!uartTransmitEmpty());
+    }
+}
+
+// What the tick does with a gyro read once it is in, then the read itself,
+// mostly I2C time, bound against through gyro_t. They only differ with
+// FIXED_SENSORS.
+static void benchSensors(void)
+{
+    benchState_t state;
+    uint32_t start, sample, readBound, readIndirect, i;
+    int16_t raw[3];
+
+    benchSave(&state);
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        gyroSample();
+    sample = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        gyroRead(raw);
+    readBound = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        gyro.read(raw);
+    readIndirect = (cycleCount() - start) / BENCH_LOOPS;
+
+    benchRestore(&state);
+
+    printf_min("gyroSample: %u, gyro read: %u, through gyro_t: %u cycles\r\n", sample, readBound, readIndirect);
+}
+
+// Per sample filter cost
+static void benchFilters(void)
+{
+    pt1Filter_t pt1;
+    biquadFilter_t biquad;
+    biquadFilterQ_t biquadQ;
+    uint32_t start, pt1Cycles, biquadCycles, biquadQCycles, i;
+
+    pt1FilterInit(&pt1, 90.0f, 250.0f);
+    biquadFilterInitLPF(&biquad, 90.0f, 250.0f);
+    biquadFilterInitQ(&biquadQ, &biquad);
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        pt1FilterApply(&pt1, (float)i);
+    pt1Cycles = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        biquadFilterApply(&biquad, (float)i);
+    biquadCycles = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        biquadFilterApplyQ(&biquadQ, i);
+    biquadQCycles = (cycleCount() - start) / BENCH_LOOPS;
+
+    printf_min("pt1: %u, biquad: %u, biquad fixed: %u cycles/sample\r\n", pt1Cycles, biquadCycles, biquadQCycles);
+}
+
+// The soft-float runtime, including the loop and the volatile loads, then
+// core/fastmath.h against the newlib calls it replaced. A NO_SOFTFLOAT
+// build gives the libgcc helpers core/softfloat.c replaces.
+static void benchMath(void)
+{
+    volatile float a = 1.2345f, b = 6.789f, r;
+    uint32_t fadd, fmul, fdiv, fsqrt;
+    uint32_t invSqrtCycles, libInvSqrtCycles, atanCycles, libAtanCycles, sinCycles;
+    uint32_t start, i;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        r = a + b;
+    fadd = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        r = a * b;
+    fmul = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        r = a / b;
+    fdiv = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        r = sqrtf(b);
+    fsqrt = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        r = fastInvSqrt(b);
+    invSqrtCycles = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        r = 1.0f / sqrtf(b);
+    libInvSqrtCycles = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        r = fastAtan2(a, b);
+    atanCycles = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        r = atan2f(a, b);
+    libAtanCycles = (cycleCount() - start) / BENCH_LOOPS;
+
+    start = cycleCount();
+    for (i = 0; i < BENCH_LOOPS; i++)
+        r = fastSin(a);
+    sinCycles = (cycleCount() - start) / BENCH_LOOPS;
+    (void)r;
+
+    printf_min("fadd: %u, fmul: %u, fdiv: %u, sqrtf: %u cycles\r\n", fadd, fmul, fdiv, fsqrt);
+    printf_min("fastInvSqrt: %u (1/sqrtf %u), fastAtan2: %u (atan2f %u), fastSin: %u cycles\r\n",
+               invSqrtCycles, libInvSqrtCycles, atanCycles, libAtanCycles, sinCycles);
+}
+
+// Checksumming the whole config, byte XOR against the CRC unit
+static void benchCrc(void)
+{
+    volatile uint32_t check;
+    const uint8_t *p;
+    uint32_t start, xorCycles, crcCycles;
+    uint8_t chk;
+
+    start = cycleCount();
+    for (p = (const uint8_t *)&cfg, chk = 0; p < (const uint8_t *)&cfg + sizeof(cfg); p++)
+        chk ^= *p;
+    check = chk;
+    xorCycles = cycleCount() - start;
+
+    start = cycleCount();
+    check = crc32(&cfg, sizeof(cfg));
+    crcCycles = cycleCount() - start;
+    (void)check;
+
+    printf_min("%u bytes, xor: %u, crc32: %u bytes/us\r\n", (uint32_t)sizeof(cfg),
+               sizeof(cfg) * 72 / xorCycles, sizeof(cfg) * 72 / crcCycles);
+}
+
+// Average cycles per call, of one part or blank for all of them. The
+// control path parts put back what they touch, so this is safe while
+// disarmed, only the gyro filters see a burst of samples. Comparing against
+// a NO_FAST_CODE build gives what running from RAM saves.
+static void cliBench(char *cmdline)
+{
+    uint32_t len = strlen(cmdline);
+    uint8_t i;
+
+    if (mode.ARMED) {
+        uartPrint("Disarm first\r\n");
+        return;
+    }
+
+    for (i = 0; i < BENCH_CMD_COUNT; i++) {
+        if (len == 0 || strncasecmp(cmdline, benchCmdTable[i].name, len) == 0) {
+            benchCmdTable[i].func();
+            while (!uartTransmitEmpty());
+            if (len)
+                return;
+        }
+    }
+
+    if (len) {
+        uartPrint("Available benchmarks:\r\n");
+        for (i = 0; i < BENCH_CMD_COUNT; i++) {
+            printf_min("%s\t%s\r\n", benchCmdTable[i].name, benchCmdTable[i].param);
+            while (!uartTransmitEmpty());
+        }
+    }
+}
+
+static void cliBlackbox(char *cmdline)
+{
+    const char *states[] = { "idle", "recording", "erasing", "full" };
+    
+    if (strncasecmp(cmdline, "erase", 5) == 0) {
+        if (mode.ARMED) {
+            uartPrint("Disarm first\r\n");
+            return;
+        }
+        blackboxErase();
+        uartPrint("Erasing in the background\r\n");
+        return;
+    }
+    
+    printf_min("Blackbox %s: %u of %u bytes used, divider %u\r\n", states[blackboxState()],
+               blackboxUsed(), blackboxSize(), cfg.blackboxDivider);
+    printf_min("%u frames, %u bytes/frame, %u dropped, %u cycles/frame (max %u), %u waits for the bus\r\n",
+               blackboxStats.frames, blackboxStats.frames ? blackboxStats.bytes / blackboxStats.frames : 0,
+               blackboxStats.dropped, blackboxStats.cycles, blackboxStats.maxCycles, blackboxStats.deferred);
+    // Log length at the frame size seen so far
+    if (blackboxStats.bytes && cfg.blackboxDivider)
+        printf_min("Holds %u s at %u Hz\r\n", (uint32_t)((uint64_t)blackboxSize() * blackboxStats.frames * 1000000 /
+                   blackboxStats.bytes / ((uint32_t)ACTUATOR_PERIOD * cfg.blackboxDivider)),
+                   1000000 / (ACTUATOR_PERIOD * cfg.blackboxDivider));
+}
+
+// The planned I2C schedule, cost is the bus time of one read. How late the
+// ticks started is since the last time this was asked.
+static void cliBus(char *cmdline)
+{
+    const busClient_t *client;
+    uint16_t used = busSchedUtilisation(), peak = 0;
+    uint8_t i;
+
+    for (i = 0; i < BUS_FRAME_TICKS; i++)
+        peak = max(peak, busSchedTickLoad(i));
+
+    // A busiest tick over the room left by the guard means some read fitted nowhere
+    printf_min("%u ticks of %u us, %u.%u%% used, busiest tick %u of %u us\r\n", BUS_FRAME_TICKS, GYRO_PERIOD,
+               used / 10, used % 10, peak, GYRO_PERIOD - BUS_GUARD_US);
+    for (i = 0; i < busSchedClients(); i++) {
+        client = busSchedClient(i);
+        printf_min("%s: every %u us from tick %u, %u us\r\n", client->name,
+                   client->ticks * GYRO_PERIOD, client->offset, client->cost);
+        while (!uartTransmitEmpty());
+    }
+    printf_min("ticks started up to %u us late, %u skipped, %u I2C errors\r\n", busSchedStats.latePeak,
+               busSchedStats.skipped, i2cGetErrorCounter());
+    busSchedStats.latePeak = 0;
+}
+
 static void cliCMix(char *cmdline)
 {
     int i, check = 0;
@@ -252,6 +585,7 @@ static void cliCMix(char *cmdline)
             printf_min("#%d:\t", i + 1);
             printf_min("%f\t%f\t%f\t%f\r\n", cfg.customMixer[i].throttle, 
                             cfg.customMixer[i].roll, cfg.customMixer[i].pitch, cfg.customMixer[i].yaw);
+            while (!uartTransmitEmpty());
         }
         for (i = 0; i < num_motors; i++) {
             mixsum[0] += cfg.customMixer[i].roll;
@@ -315,6 +649,25 @@ static void cliCMix(char *cmdline)
     }
 }
 
+static void cliCrashlog(char *cmdline)
+{
+    const char *states[] = { "recording", "triggered", "frozen" };
+    const char *triggers[] = { "arm", "disarm", "failsafe", "i2c", "msp", "reset" };
+    uint8_t i;
+    
+    if (strncasecmp(cmdline, "freeze", 6) == 0) {
+        crashlogFreeze(CRASH_TRIGGER_MSP);
+    } else if (strncasecmp(cmdline, "clear", 5) == 0) {
+        crashlogClear();
+    }
+    
+    printf_min("Crash recorder %s, %u of %u frames", states[crashlogState()], crashlogFrames(), CRASHLOG_FRAMES);
+    for (i = 0; i < 6; i++)
+        if (crashlogTrigger() & (1 << i))
+            printf_min(", %s trigger at %u ms", triggers[i], crashlogTriggerTime());
+    uartPrint("\r\n");
+}
+
 static void cliDefaults(char *cmdline)
 {
     uartPrint("Resetting to defaults...\r\n");
@@ -403,6 +756,19 @@ static void cliHelp(char *cmdline)
     }
 }
 
+static void cliLatency(char *cmdline)
+{
+    static const char * const paths[LATENCY_PATHS] = { "gyro", "rc" };
+    latencyStats_t stats[LATENCY_PATHS];
+    uint8_t i;
+
+    latencyReadAll(stats);
+    uartPrint("to motors     count    min   mean    max us\r\n");
+    for (i = 0; i < LATENCY_PATHS; i++)
+        printf_min("%-8s %10u %6u %6u %6u\r\n", paths[i], stats[i].count, stats[i].min,
+                   stats[i].count ? stats[i].sum / stats[i].count : 0, stats[i].max);
+}
+
 static void cliMap(char *cmdline)
 {
     uint32_t len;
@@ -464,6 +830,41 @@ static void cliMixer(char *cmdline)
     }
 }
 
+static void cliPerf(char *cmdline)
+{
+    uint32_t values[PERF_COUNT];
+    uint32_t elapsed = perfReadAll(values);
+    uint8_t i;
+
+    printf_min("Over %u ms\r\n", elapsed);
+    for (i = 0; i < PERF_COUNT; i++) {
+        printf_min("%-16s %10u", perfInfo[i].name, values[i]);
+        if (perfInfo[i].kind == PERF_EVENTS && elapsed)
+            printf_min("  %u/s", (uint32_t)(values[i] * 1000.0f / elapsed));
+        uartPrint("\r\n");
+        while (!uartTransmitEmpty());
+    }
+}
+
+static void cliProfile(char *cmdline)
+{
+    uint8_t i;
+    
+    if (strlen(cmdline) == 0) {
+        printf_min("Current profile: %u of %u\r\n", cfg.pidProfileIndex, PID_PROFILES);
+        return;
+    }
+    
+    i = atoi(cmdline);
+    if (i >= PID_PROFILES || cfg.pidProfileAux) {
+        printf_min("Profile must be below %u and pidProfileAux 0\r\n", PID_PROFILES);
+        return;
+    }
+    
+    selectProfile(i);
+    printf_min("Profile set to %u\r\n", i);
+}
+
 static void cliSave(char *cmdline)
 {
     uartPrint("Saving...");
@@ -473,7 +874,7 @@ static void cliSave(char *cmdline)
     systemReset(false);
 }
 
-static void cliPrintVar(const clivalue_t *var, uint32_t full)
+static void cliPrintVar(const param_t *var, uint32_t full)
 {
     char buf[16];
 
@@ -511,43 +912,20 @@ static void cliPrintVar(const clivalue_t *var, uint32_t full)
 
 // Set
 
-static void cliSetVar(const clivalue_t *var, const char *eqptr)
+static void cliSetVar(const param_t *var, const char *eqptr)
 {   
-    int32_t value = 0;
-    float fvalue = 0.0f;
+    bool ok;
     
-    if(var->type == VAR_FLOAT) {
-        fvalue = stringToFloat(eqptr);
-    } else {
-        value = atoi(eqptr);
-    }
+    if(var->type == VAR_FLOAT)
+        ok = paramSetFloat(var, stringToFloat(eqptr));
+    else
+        ok = paramSetInt(var, atoi(eqptr));
     
-    if ((var->type != VAR_FLOAT && (value < var->min || value > var->max)) ||
-        (var->type == VAR_FLOAT && (fvalue < var->min || fvalue > var->max))) {
+    if (!ok) {
         uartPrint("ERR: Value assignment out of range\r\n");
         return;
     }
     
-    switch (var->type) {
-        case VAR_UINT8:
-        case VAR_INT8:
-            *(uint8_t *)var->ptr = (uint8_t)value;
-            break;
-            
-        case VAR_UINT16:
-        case VAR_INT16:
-            *(uint16_t *)var->ptr = (uint16_t)value;
-            break;
-            
-        case VAR_UINT32:
-            *(uint32_t *)var->ptr = (uint32_t)value;
-            break;
-            
-        case VAR_FLOAT:
-            *(float *)var->ptr = fvalue;
-            break;
-    }
-    
     uartPrint((char *)var->name);
     uartPrint(" set to ");
     cliPrintVar(var, 0);
@@ -557,36 +935,52 @@ static void cliSet(char *cmdline)
 {
     uint32_t i;
     uint32_t len;
-    const clivalue_t *val;
+    const param_t *val;
     char *eqptr = NULL;
 
     len = strlen(cmdline);
 
     if (len == 0 || (len == 1 && cmdline[0] == '*')) {
         uartPrint("Current settings: \r\n");
-        for (i = 0; i < VALUE_COUNT; i++) {
-            val = &valueTable[i];
-            printf_min("%s = ", valueTable[i].name);
+        for (i = 0; i < PARAM_COUNT; i++) {
+            val = &paramTable[i];
+            printf_min("%s = ", val->name);
             cliPrintVar(val, len); // when len is 1 (when * is passed as argument), it will print min/max values as well, for gui
             uartPrint("\r\n");
             while (!uartTransmitEmpty());
         }
     } else if ((eqptr = strstr(cmdline, "="))) {
         // has equal, set var
-        eqptr++;
-        len--;
-        for (i = 0; i < VALUE_COUNT; i++) {
-            val = &valueTable[i];
-            if (strncasecmp(cmdline, valueTable[i].name, strlen(valueTable[i].name)) == 0) {
-                // found
-                cliSetVar(val, eqptr);
-                return;
-            }
+        len = eqptr - cmdline;
+        while (len && cmdline[len - 1] == ' ')
+            len--;
+        val = paramFind(cmdline, len);
+        if (val) {
+            cliSetVar(val, eqptr + 1);
+            return;
         }
         uartPrint("ERR: Unknown variable name\r\n");
     }
 }
 
+static void cliStack(char *cmdline)
+{
+    static const char * const kinds[] = { "none", "hard fault", "stack overflow" };
+    const faultRecord_t *record = faultRecord();
+    uint32_t data, bss, noinit;
+
+    if (strncasecmp(cmdline, "clear", 5) == 0)
+        faultClear();
+
+    ramUsage(&data, &bss, &noinit);
+    printf_min("Stack %u bytes, %u never used\r\n", stackSize(), stackFree());
+    printf_min("RAM data %u, bss %u, noinit %u bytes\r\n", data, bss, noinit);
+    printf_min("Last fault: %s\r\n", kinds[faultKind()]);
+    if (faultKind() != FAULT_NONE)
+        printf_min("pc %08x lr %08x sp %08x cfsr %08x hfsr %08x bfar %08x\r\n",
+                   record->pc, record->lr, record->sp, record->cfsr, record->hfsr, record->bfar);
+}
+
 static void cliStatus(char *cmdline)
 {
     uint8_t i;
@@ -618,6 +1012,16 @@ static void cliStatus(char *cmdline)
     printf_min("Cycle Time: %u", cycleTime);
     printf_min(", i2c Errors: %u", i2cGetErrorCounter());
     uartPrint("\r\n");
+    while (!uartTransmitEmpty());
+
+    if (cfg.dynNotchEnable)
+        printf_min("Dyn notch slice: %u cycles (max %u, budget %u), %u over budget\r\n", dynNotchStats.cycles,
+                   dynNotchStats.maxCycles, DYN_NOTCH_SLICE_BUDGET, dynNotchStats.overBudget);
+
+    printf_min("MSP frames: %u sent, %u dropped (no space), %u dropped (bad size)\r\n",
+               mspTxStats.framesSent, mspTxStats.droppedNoSpace, mspTxStats.droppedBadSize);
+    printf_min("Config store: %u%% used, %u records, %u erases, %u failures\r\n",
+               storeUsage(), storeStats.records, storeStats.erases, storeStats.failures);
 }
 
 
@@ -664,6 +1068,21 @@ static void cliCalibrate(char *cmdline)
     }
 }
 
+static void cliTrace(char *cmdline)
+{
+    const char *modes[] = { "stopped", "recording", "recording once" };
+    
+    if (strncasecmp(cmdline, "ring", 4) == 0)
+        traceStart(TRACE_RING);
+    else if (strncasecmp(cmdline, "once", 4) == 0)
+        traceStart(TRACE_ONCE);
+    else if (strncasecmp(cmdline, "stop", 4) == 0)
+        traceStop();
+    
+    printf_min("Trace %s, %u of %u entries, %u cycles per marker\r\n",
+               modes[traceMode], traceEntries(), TRACE_ON ? TRACE_ENTRIES : 0, traceOverhead());
+}
+
 static void cliVersion(char *cmdline)
 {
     uartPrint("Baseflight U.P. CLI version 1.0 " __DATE__ " / " __TIME__);
@@ -791,6 +1210,7 @@ static void telemetry(void)
             printf_min("%f,%f,%f\n", stateData.mag[ROLL], stateData.mag[PITCH], stateData.mag[YAW]);
             break;
         case 'q':
+            updateEulerAngles();
             printf_min("%f,%f,%f\n", stateData.roll * RAD2DEG, stateData.pitch * RAD2DEG, stateData.heading * RAD2DEG);
             break;
         case 't':
@@ -16,6 +16,7 @@
 #include "board.h"
 
 #include "actuator/mixer.h"
+#include "actuator/stabilisation.h"
 
 #include "core/command.h"
 
@@ -26,6 +27,9 @@ readRawRCFuncPtr readRawRC;
 int16_t rcData[8] = { 1502, 1502, 1502, 1502, 1502, 1502, 1502, 1502 }; // interval [1000;2000]
 int16_t failsafeCnt;
 
+volatile uint32_t rcFrameTime;  // micros() of the last complete frame, set by the receiver drivers
+uint32_t rcDataTime;            // rcFrameTime of the frame rcData was last computed from
+
 uint8_t auxOptions[AUX_OPTIONS];
 modeFlags_t mode;
 
@@ -38,6 +42,14 @@ float headingHold;
 float altitudeThrottleHold;
 float altitudeHold;
 
+// For the transitions that latch the heading. Euler angles are only derived
+// on demand, see updateEulerAngles().
+static float currentHeading(void)
+{
+    updateEulerAngles();
+    return stateData.heading;
+}
+
 // From Multiwii
 static void computeRC(void)
 {
@@ -45,6 +57,7 @@ static void computeRC(void)
     static uint8_t rc4ValuesIndex = 0;
     uint8_t chan, a;
 
+    rcDataTime = rcFrameTime;
     rc4ValuesIndex++;
     for (chan = 0; chan < 8; chan++) {
         rcData4Values[chan][rc4ValuesIndex % 4] = readRawRC(chan);
@@ -75,14 +88,14 @@ void updateCommands(void)
         if(cfg.auxActivate[OPT_ARM] > 0) {
             if(auxOptions[OPT_ARM] && mode.OK_TO_ARM) { // AUX Arming
                 mode.ARMED = 1;
-                headfreeReference = stateData.heading;
+                headfreeReference = currentHeading();
             } else if(mode.ARMED){ // AUX Disarming
                 mode.ARMED = 0;
             }
         } else if(rcData[YAW] > cfg.maxCheck && !mode.ARMED) { // Stick Arming
             if(commandDelay++ == 20) {
                 mode.ARMED = 1;
-                headfreeReference = stateData.heading;
+                headfreeReference = currentHeading();
             }
         } else if(rcData[YAW] < cfg.minCheck && mode.ARMED) { // Stick Disarming
             if(commandDelay++ == 20) {
@@ -109,16 +122,16 @@ void updateCommands(void)
             }
         } else if (rcData[PITCH] > cfg.maxCheck) {
                 cfg.angleTrim[PITCH] += 0.01;
-                writeParams();
+                saveParams();
         } else if (rcData[PITCH] < cfg.minCheck) {
                 cfg.angleTrim[PITCH] -= 0.01;
-                writeParams();
+                saveParams();
         } else if (rcData[ROLL] > cfg.maxCheck) {
                 cfg.angleTrim[ROLL] += 0.01;
-                writeParams();
+                saveParams();
         } else if (rcData[ROLL] < cfg.minCheck) {
                 cfg.angleTrim[ROLL] -= 0.01;
-                writeParams();
+                saveParams();
         } else {
             commandDelay = 0;
         }
@@ -189,7 +202,7 @@ void updateCommands(void)
     if(auxOptions[OPT_HEADING]) {
         if(!mode.HEADING_MODE) {
             mode.HEADING_MODE = 1;
-            headingHold = stateData.heading;
+            headingHold = currentHeading();
         }
     } else {
         mode.HEADING_MODE = 0;
@@ -199,14 +212,14 @@ void updateCommands(void)
     if(auxOptions[OPT_HEADFREE]) {
         if(!mode.HEADFREE_MODE) {
             mode.HEADFREE_MODE = 1;
-            headfreeReference = stateData.heading;
+            headfreeReference = currentHeading();
         }
     } else {
         mode.HEADFREE_MODE = 0;
     }
     
     if(auxOptions[OPT_HEADFREE_REF]) {
-        headfreeReference = stateData.heading;
+        headfreeReference = currentHeading();
     }
     
     // GPS GOES HERE
@@ -258,6 +271,10 @@ void updateCommands(void)
     } else {
         mode.ALTITUDE_MODE = 0;
     }
+
+    // Swap in the loops for the modes above
+    stabilisationSelect();
+    mixerSelect();
 }
 
 
@@ -56,6 +56,9 @@ typedef uint16_t (* readRawRCFuncPtr)(uint8_t chan);
 extern int16_t rcData[8];
 extern int16_t failsafeCnt;
 
+extern volatile uint32_t rcFrameTime;
+extern uint32_t rcDataTime;
+
 extern uint8_t auxOptions[AUX_OPTIONS];
 extern modeFlags_t mode;
 
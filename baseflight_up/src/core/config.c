@@ -6,24 +6,39 @@
 
 #include "board.h"
 #include "core/command.h"
+#include "core/params.h"
+#include "core/store.h"
 
 #define FLASH_PAGE_COUNT 128
 
 #define FLASH_PAGE_SIZE                 ((uint16_t)0x400)
 
-// use the last KB for config storage
-#define FLASH_WRITE_ADDR  (0x08000000 + (uint32_t)FLASH_PAGE_SIZE * (FLASH_PAGE_COUNT - 1))
+// Where the whole config used to be rewritten on every save, only read to
+// carry an old config over into the store. It lies inside the store's last
+// sector, which is the last one the store gets round to erasing.
+#define LEGACY_CONFIG_ADDR  (0x08000000 + (uint32_t)FLASH_PAGE_SIZE * (FLASH_PAGE_COUNT - 1))
 
 config_t cfg;
+pidProfile_t profile;
+
+// Fails to compile when config_t has outgrown the store
+typedef char configFitsStore[(sizeof(config_t) <= STORE_MAX_SIZE) ? 1 : -1];
 
 int16_t lookupPitchRollRC[6];   // lookup table for expo & RC rate PITCH+ROLL
 int16_t lookupThrottleRC[11];   // lookup table for expo & mid THROTTLE
 
 const char rcChannelLetters[] = "AERT1234";
 
-static uint8_t EEPROM_CONF_VERSION = 1;
+static uint8_t EEPROM_CONF_VERSION = 6;
 static void resetConf(void);
 
+// Saves made while armed, or coalesced by saveParams(), wait here
+static bool paramsDirty = false;
+static uint32_t paramsDirtyTime;
+
+// Profile asked for by MSP or the AUX switch, swapped in by updateProfile()
+static uint8_t requestedProfile;
+
 void parseRcChannels(const char *input)
 {
     const char *c, *s;
@@ -36,18 +51,20 @@ void parseRcChannels(const char *input)
     }
 }
 
+static bool validConfig(const config_t *temp)
+{
+    return temp->version == EEPROM_CONF_VERSION && temp->size == sizeof(config_t) &&
+           temp->magic_be == 0xBE && temp->magic_ef == 0xEF;
+}
+
 static uint8_t validEEPROM(void)
 {
-    const config_t *temp = (const config_t *)FLASH_WRITE_ADDR;
+    const config_t *temp = (const config_t *)LEGACY_CONFIG_ADDR;
     const uint8_t *p;
     uint8_t chk = 0;
     
-    // check version number
-    if (EEPROM_CONF_VERSION != temp->version)
-        return 0;
-        
-    // check size and magic numbers
-    if (temp->size != sizeof(config_t) || temp->magic_be != 0xBE || temp->magic_ef != 0xEF)
+    // check version, size and magic numbers
+    if (!validConfig(temp))
         return 0;
     
     for (p = (const uint8_t *)temp; p < ((const uint8_t *)temp + sizeof(config_t)); ++p)
@@ -61,14 +78,13 @@ static uint8_t validEEPROM(void)
     return 1;
 }
 
+// Rebuilds the rc lookup tables from cfg, which checkFirstTime() has loaded
 void readEEPROM(void)
 {
     uint8_t i;
-    // Read flash
-    memcpy(&cfg, (char *)FLASH_WRITE_ADDR, sizeof(config_t));
     
     for (i = 0; i < 6; i++)
-        lookupPitchRollRC[i] = (2500 + cfg.commandExpo * (i * i - 25)) * i * (int32_t) cfg.commandRate / 2500;
+        lookupPitchRollRC[i] = (2500 + profile.commandExpo * (i * i - 25)) * i * (int32_t) profile.commandRate / 2500;
 
     for (i = 0; i < 11; i++) {
         int16_t tmp = 10 * i - cfg.throttleMid;
@@ -82,56 +98,120 @@ void readEEPROM(void)
     }
 }
 
-void writeParams(void)
+static bool commitParams(void)
 {
-    FLASH_Status status;
-    uint32_t i;
-    uint8_t chk = 0;
-    const uint8_t *p;
-    
     cfg.version = EEPROM_CONF_VERSION;
     cfg.size = sizeof(config_t);
     cfg.magic_be = 0xBE;
     cfg.magic_ef = 0xEF;
-    cfg.chk = 0;
-    // recalculate checksum before writing
-    for (p = (const uint8_t *)&cfg; p < ((const uint8_t *)&cfg + sizeof(config_t)); ++p)
-        chk ^= *p;
-    cfg.chk = chk;
+    cfg.chk = 0;    // the store's CRC32 covers every record, chk is legacy only
+    cfg.pidProfiles[cfg.pidProfileIndex] = profile;
     
-    // write it
-    FLASH_Unlock();
-    FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
-
-    if (FLASH_ErasePage(FLASH_WRITE_ADDR) == FLASH_COMPLETE) {
-        for (i = 0; i < sizeof(config_t); i += 4) {
-            status = FLASH_ProgramWord(FLASH_WRITE_ADDR + i, *(uint32_t *)((char *)&cfg + i));
-            if (status != FLASH_COMPLETE)
-                while(1);//break; // TODO: fail
-        }
+    // Only what changed is appended, a failed write is retried by updateParams()
+    paramsDirty = !storeWrite(&cfg, sizeof(config_t));
+    paramsDirtyTime = millis();
+    
+    return !paramsDirty;
+}
+
+// Saves now, unless armed when the save waits until disarm
+void writeParams(void)
+{
+    readEEPROM();
+    
+    if (mode.ARMED) {
+        paramsDirty = true;
+        return;
     }
+    
+    commitParams();
+}
 
-    FLASH_Lock();
+// Saves once changes have settled, for callers that change cfg every loop
+void saveParams(void)
+{
+    paramsDirty = true;
+    paramsDirtyTime = millis();
+}
 
-    readEEPROM();
+// Background flash work, only while disarmed as erases stall the CPU
+void updateParams(void)
+{
+    if (mode.ARMED)
+        return;
+    
+    if (paramsDirty) {
+        if (millis() - paramsDirtyTime >= PARAMS_COMMIT_DELAY)
+            commitParams();
+    } else if (storeUsage() >= PARAMS_COMPACT_USAGE) {
+        storeCompact();
+    }
+}
+
+// Takes the working copy from the selected bank after cfg has been loaded
+static void loadProfile(void)
+{
+    if (cfg.pidProfileIndex >= PID_PROFILES)
+        cfg.pidProfileIndex = 0;
+    
+    profile = cfg.pidProfiles[cfg.pidProfileIndex];
+    requestedProfile = cfg.pidProfileIndex;
 }
 
 void checkFirstTime(bool reset)
 {
-    // check the EEPROM integrity before resetting the values
-    if (!validEEPROM() || reset)
-        resetConf();
+    if (!reset) {
+        if (storeLoad(&cfg, sizeof(config_t)) && validConfig(&cfg)) {
+            loadProfile();
+            return;
+        }
+        
+        // Carry over a config saved by older firmware
+        if (validEEPROM()) {
+            memcpy(&cfg, (const void *)LEGACY_CONFIG_ADDR, sizeof(config_t));
+            loadProfile();
+            commitParams();
+            return;
+        }
+    }
+    
+    resetConf();
 }
 
-// Default settings
+void selectProfile(uint8_t index)
+{
+    if (index < PID_PROFILES)
+        requestedProfile = index;
+}
+
+// Runs between control loop iterations. A switch only copies RAM banks, the
+// edits made to the old profile stay in its bank until the next save.
+void updateProfile(void)
+{
+    int16_t position;
+    
+    if (cfg.pidProfileAux) {
+        position = rcData[AUX1 + cfg.pidProfileAux - 1];
+        selectProfile(position < cfg.minCheck ? 0 : position > cfg.maxCheck ? 2 : 1);
+    }
+    
+    if (requestedProfile == cfg.pidProfileIndex)
+        return;
+    
+    cfg.pidProfiles[cfg.pidProfileIndex] = profile;
+    cfg.pidProfileIndex = requestedProfile;
+    profile = cfg.pidProfiles[cfg.pidProfileIndex];
+    
+    readEEPROM();
+    loadPIDGains();
+}
+
+// Default settings, tunables take theirs from the parameter registry
 static void resetConf(void)
 {
     int32_t i;
     memset(&cfg, 0, sizeof(config_t));
     
-    cfg.version = EEPROM_CONF_VERSION;
-
-	// Default settings
     cfg.version = EEPROM_CONF_VERSION;
     cfg.mixerConfiguration                 = MULTITYPE_QUADX;
     
@@ -141,131 +221,26 @@ static void resetConf(void)
     
     parseRcChannels("AETR1234");
     
-    // Motor/ESC
-    cfg.escPwmRate                     = 400;
-    cfg.servoPwmRate                   = 50;
+    paramResetDefaults();
     
-    // Failsafe
-    cfg.failsafeOnDelay                = 50; // Number of command loops (50Hz) until failsafe kicks in
-    cfg.failsafeOffDelay               = 20000; // Number of command loops until failsafe stops
-    cfg.failsafeThrottle               = 1200;
+    for (i = 0; i < PID_PROFILES; i++)
+        cfg.pidProfiles[i] = profile;
+    requestedProfile = 0;
     
-    cfg.commandRate             = 90;
-    cfg.commandExpo             = 65;
-    cfg.rollPitchRate           = 0;
-    cfg.yawRate                 = 0;
-    //cfg.dynThrPID             = 0;
-    cfg.throttleMid             = 50;
-    cfg.throttleExpo            = 0;
+    // Everything below is calibration or set through its own command
     
     // Command Settings
     for(i = 0; i < AUX_OPTIONS; ++i)
         cfg.auxActivate[i] = 0;
-
-    cfg.minCommand                         = 1000;
-    cfg.midCommand                         = 1500;
-    cfg.maxCommand                         = 2000;
-    cfg.minCheck                           = 1100;
-    cfg.maxCheck                           = 1900;
-    cfg.minThrottle                        = 1150;
-    cfg.maxThrottle                        = 1850;
-    cfg.spektrumHiRes                      = false;
-    
-    cfg.deadBand[ROLL]                     = 12;
-    cfg.deadBand[PITCH]                    = 12;
-    cfg.deadBand[YAW]                      = 12;
-    
-    // Servos
-    
-    // Tricopter
-    cfg.yawDirection                       = 1;
-    cfg.triYawServoMin                     = 1000;
-    cfg.triYawServoMid                     = 1500;
-    cfg.triYawServoMax                     = 2000;
-    
-    // Bicopter
-    cfg.biLeftServoMin                     = 1000;
-    cfg.biLeftServoMid                     = 1500;
-    cfg.biLeftServoMax                     = 2000;
-
-    cfg.biRightServoMin                    = 1000;
-    cfg.biRightServoMid                    = 1500;
-    cfg.biRightServoMax                    = 2000;
-    
-    // Flying wing
-    cfg.wingLeftMin             = 1020;
-    cfg.wingLeftMid             = 1500;
-    cfg.wingLeftMax             = 2000;
-    cfg.wingRightMin            = 1020;
-    cfg.wingRightMid            = 1500;
-    cfg.wingRightMax            = 2000;
-    cfg.pitchDirectionLeft      = 1;
-    cfg.pitchDirectionRight     = -1;
-    cfg.rollDirectionLeft       = 1;
-    cfg.rollDirectionRight      = 1;
-    
-    cfg.gimbalFlags = GIMBAL_NORMAL;
-    cfg.gimbalSmoothFactor = 0.95f;
-
-    cfg.gimbalRollServoMin                 = 1000;
-	cfg.gimbalRollServoMid                 = 1500;
-	cfg.gimbalRollServoMax                 = 2000;
-	cfg.gimbalRollServoGain                = 1.0f;
-
-	cfg.gimbalPitchServoMin                = 1000;
-	cfg.gimbalPitchServoMid                = 1500;
-	cfg.gimbalPitchServoMax                = 2000;
-	cfg.gimbalPitchServoGain               = 1.0f;
-
-    // PIDs
-    cfg.pids[ROLL_RATE_PID].p               = 100.0f;
-    cfg.pids[ROLL_RATE_PID].i               =   0.0f;
-    cfg.pids[ROLL_RATE_PID].d               =   0.0f;
-    cfg.pids[ROLL_RATE_PID].iLim            = 100.0f;  // PWMs
-
-    cfg.pids[PITCH_RATE_PID].p              = 100.0f;
-    cfg.pids[PITCH_RATE_PID].i              =   0.0f;
-    cfg.pids[PITCH_RATE_PID].d              =   0.0f;
-    cfg.pids[PITCH_RATE_PID].iLim           = 100.0f;  // PWMs
-
-    cfg.pids[YAW_RATE_PID].p                = 200.0f;
-    cfg.pids[YAW_RATE_PID].i                =   0.0f;
-    cfg.pids[YAW_RATE_PID].d                =   0.0f;
-    cfg.pids[YAW_RATE_PID].iLim             = 100.0f;  // PWMs
-
-    cfg.pids[ROLL_LEVEL_PID].p                =   2.0f;
-    cfg.pids[ROLL_LEVEL_PID].i                =   0.0f;
-    cfg.pids[ROLL_LEVEL_PID].d                =   0.0f;
-    cfg.pids[ROLL_LEVEL_PID].iLim             =   0.5f;  // radians/sec
-
-    cfg.pids[PITCH_LEVEL_PID].p               =   2.0f;
-    cfg.pids[PITCH_LEVEL_PID].i               =   0.0f;
-    cfg.pids[PITCH_LEVEL_PID].d               =   0.0f;
-    cfg.pids[PITCH_LEVEL_PID].iLim            =   0.5f;  // radians/sec
-
-    cfg.pids[HEADING_PID].p                 =   1.5f;
-    cfg.pids[HEADING_PID].i                 =   0.0f;
-    cfg.pids[HEADING_PID].d                 =   0.0f;
-    cfg.pids[HEADING_PID].iLim              =   0.5f;  // radians/sec
-    
-    cfg.pids[ALTITUDE_PID].p                 =   20.0f;
-    cfg.pids[ALTITUDE_PID].i                 =   17.0f;
-    cfg.pids[ALTITUDE_PID].d                 =   7.0f;
-    cfg.pids[ALTITUDE_PID].iLim              =   30000.0f; // 0.1 m
     
     cfg.angleTrim[ROLL]         = 0.0f;
     cfg.angleTrim[PITCH]        = 0.0f;
     
-    cfg.accelLPF                = false;
-    cfg.accelSmoothFactor       = 0.75f;
-    
     cfg.accelCalibrated                 = false;
     cfg.accelBias[XAXIS]                = 0;
     cfg.accelBias[YAXIS]                = 0;
     cfg.accelBias[ZAXIS]                = 0;
 
-    cfg.gyroBiasOnStartup           = false;
-    cfg.gyroSmoothFactor            = 0.95f;
     cfg.gyroTCBiasSlope[ROLL]       = 0.0f;
     cfg.gyroTCBiasSlope[PITCH]      = 0.0f;
     cfg.gyroTCBiasSlope[YAW]        = 0.0f;
@@ -278,28 +253,6 @@ static void resetConf(void)
     cfg.magBias[PITCH]              = 0;
     cfg.magBias[YAW]                = 0;
     
-    cfg.mpu6050Scale                = false; // Shitty hack
-
-    // For Mahony AHRS
-    
-    cfg.accelKp                     = 2.0f;
-    cfg.accelKi                     = 0.01f;
-    
-    cfg.magKp                       = 1.0f;
-    cfg.magKi                       = 0.01f;
-    
-    cfg.magDriftCompensation        = false;
-
-    // Get your magnetic decliniation from here : http://magnetic-declination.com/
-    // For example, -6deg 37min, = -6.37 Japan, format is [sign]ddd.mm (degreesminutes)
-    cfg.magDeclination              = 10.59f; 
-
-    cfg.batScale                    = 11.0f;
-    cfg.batMinCellVoltage           = 3.3f;
-    cfg.batMaxCellVoltage           = 4.2f;
-    
-    cfg.startupDelay                = 1000;
-    
     // custom mixer. clear by defaults.
     for (i = 0; i < MAX_MOTORS; i++)
         cfg.customMixer[i].throttle = 0.0f;
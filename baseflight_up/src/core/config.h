@@ -19,6 +19,7 @@
 #include "actuator/pid.h"
 
 #include "core/command.h"
+#include "core/filters.h"
 
 // Config Typedefs
 
@@ -29,6 +30,17 @@ typedef struct {
     float iLim;
 } pidConfig;
 
+#define PID_PROFILES    3
+
+// A switchable tune, the gains and rates that go with them
+typedef struct {
+    pidConfig pids[NUM_PIDS];
+    uint8_t commandRate;
+    uint8_t commandExpo;
+    uint8_t rollPitchRate;
+    uint8_t yawRate;
+} pidProfile_t;
+
 typedef enum {
     FEATURE_PPM = 1 << 0,
     FEATURE_VBAT = 1 << 1,
@@ -57,12 +69,8 @@ typedef struct {
     uint16_t failsafeOffDelay;
     uint16_t failsafeThrottle;
     
-    uint8_t commandRate;
-    uint8_t commandExpo;
     uint8_t throttleMid;
     uint8_t throttleExpo;
-    uint8_t rollPitchRate;
-    uint8_t yawRate;
 
     //uint8_t dynThrPID;
 
@@ -126,18 +134,24 @@ typedef struct {
     uint16_t gimbalPitchServoMax;
     float gimbalPitchServoGain;
     
-    pidConfig pids[NUM_PIDS];
+    uint8_t pidProfileAux;                  // AUX channel picking the profile by switch position, 0 is off
+    uint8_t pidProfileIndex;
+    pidProfile_t pidProfiles[PID_PROFILES];
+    filterConfig_t dtermFilter;
     
     float angleTrim[2];
     
-    uint8_t accelLPF;
     //float accelCutout;
-    float accelSmoothFactor;
+    filterConfig_t accelFilter;
     uint8_t accelCalibrated;
     int32_t accelBias[3];
 
     uint8_t gyroBiasOnStartup;
-    float gyroSmoothFactor;
+    filterConfig_t gyroFilter;
+    uint8_t dynNotchEnable;         // Read at boot, takes a save and reboot to change
+    uint16_t dynNotchMinHz;
+    uint16_t dynNotchMaxHz;
+    uint8_t dynNotchCutoffPercent;  // Notch lower edge as a percentage of its centre
     float gyroTCBiasSlope[3];
     float gyroTCBiasIntercept[3];
 
@@ -164,6 +178,9 @@ typedef struct {
     
     uint16_t startupDelay;
     
+    uint8_t blackboxDivider;                // log every nth control loop while armed, 0 is off
+    uint8_t crashlogTriggers;               // crashTrigger_e mask of events that freeze the crash recorder
+    
     motorMixer_t customMixer[MAX_MOTORS];   // custom mixtable
     
     uint8_t magic_ef;        // magic number, should be 0xEF
@@ -173,16 +190,25 @@ typedef struct {
 // External Variables
 
 extern config_t cfg;
+extern pidProfile_t profile;           // working copy of cfg.pidProfiles[cfg.pidProfileIndex]
 extern int16_t lookupPitchRollRC[6];   // lookup table for expo & RC rate PITCH+ROLL
 extern int16_t lookupThrottleRC[11];   // lookup table for expo & mid THROTTLE
 extern const char rcChannelLetters[8];
 
+#define PARAMS_PERIOD           100000  // us, updateParams()
+#define PARAMS_COMMIT_DELAY     1000    // ms without changes before saveParams() writes
+#define PARAMS_COMPACT_USAGE    75      // % of the store sector that triggers compaction
+
 // Functions
 
 void parseRcChannels(const char *input);
 void readEEPROM(void);
 void writeParams(void);
+void saveParams(void);
+void updateParams(void);
 void checkFirstTime(bool reset);
+void selectProfile(uint8_t index);
+void updateProfile(void);
 bool featureGet(uint32_t mask);
 void featureSet(uint32_t mask);
 void featureClear(uint32_t mask);
@@ -0,0 +1,193 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#include "board.h"
+
+#include "actuator/mixer.h"
+#include "actuator/pid.h"
+#include "actuator/stabilisation.h"
+
+#include "core/crashlog.h"
+
+#include "drivers/i2c.h"
+
+#define CRASHLOG_MAGIC      0x48534352  // "RCSH"
+
+#define ROUTINE_TRIGGERS    (CRASH_TRIGGER_ARM | CRASH_TRIGGER_DISARM)
+
+typedef struct {
+    uint32_t magic;
+    uint16_t head;          // next slot to write
+    uint16_t count;         // frames held, up to CRASHLOG_FRAMES
+    uint16_t post;          // frames still to take after the trigger
+    uint8_t state;          // crashlogState_e
+    uint8_t trigger;        // crashTrigger_e that froze it, 0 while recording
+    uint32_t triggerTime;   // ms since boot at the trigger
+    crashFrame_t frames[CRASHLOG_FRAMES];
+} crashLog_t;
+
+// Left alone by the startup code so it outlives a soft reset
+static crashLog_t crashLog __attribute__((section(".noinit")));
+
+static bool armed, failsafe;
+static uint16_t i2cErrors;
+static uint8_t i2cWindow;
+
+static void restart(void)
+{
+    crashLog.magic = CRASHLOG_MAGIC;
+    crashLog.head = 0;
+    crashLog.count = 0;
+    crashLog.state = CRASHLOG_RECORDING;
+    crashLog.trigger = 0;
+}
+
+static bool lastFrameArmed(void)
+{
+    if (!crashLog.count)
+        return false;
+
+    return crashLog.frames[(crashLog.head + CRASHLOG_FRAMES - 1) % CRASHLOG_FRAMES].flags & 1;
+}
+
+// Keeps what the last run left behind if it makes sense, power on RAM won't.
+// A reset while disarmed is routine, the cli 'save' and 'defaults' reboot.
+void crashlogInit(void)
+{
+    if (crashLog.magic != CRASHLOG_MAGIC || crashLog.head >= CRASHLOG_FRAMES ||
+        crashLog.count > CRASHLOG_FRAMES || crashLog.state > CRASHLOG_FROZEN) {
+        restart();
+    } else if (crashLog.state == CRASHLOG_TRIGGERED || (crashLog.state == CRASHLOG_RECORDING && lastFrameArmed())) {
+        // Reset in flight or after a trigger, what led up to it is worth keeping
+        crashLog.state = CRASHLOG_FROZEN;
+        if (!crashLog.trigger)
+            crashLog.trigger = CRASH_TRIGGER_RESET;
+        crashLog.triggerTime = 0;
+    } else if (crashLog.state == CRASHLOG_RECORDING) {
+        restart();
+    }
+
+    i2cErrors = i2cGetErrorCounter();
+}
+
+crashlogState_e crashlogState(void)
+{
+    return crashLog.state;
+}
+
+uint8_t crashlogTrigger(void)
+{
+    return crashLog.trigger;
+}
+
+uint32_t crashlogTriggerTime(void)
+{
+    return crashLog.triggerTime;
+}
+
+uint16_t crashlogFrames(void)
+{
+    return crashLog.count;
+}
+
+// Frames counted from the oldest one held
+const crashFrame_t *crashlogFrame(uint16_t index)
+{
+    uint16_t slot = crashLog.head + CRASHLOG_FRAMES - crashLog.count + index;
+
+    if (index >= crashLog.count)
+        return NULL;
+
+    return &crashLog.frames[slot % CRASHLOG_FRAMES];
+}
+
+// Starts the post trigger countdown, the first trigger wins
+void crashlogFreeze(uint8_t trigger)
+{
+    if (crashLog.state != CRASHLOG_RECORDING)
+        return;
+
+    crashLog.state = CRASHLOG_TRIGGERED;
+    crashLog.trigger = trigger;
+    crashLog.triggerTime = millis();
+    crashLog.post = CRASHLOG_POST_FRAMES;
+}
+
+void crashlogClear(void)
+{
+    restart();
+}
+
+static void checkTriggers(void)
+{
+    uint8_t fired = 0;
+    uint16_t errors;
+
+    if (mode.ARMED != armed) {
+        armed = mode.ARMED;
+        if (armed && crashLog.state == CRASHLOG_FROZEN && (crashLog.trigger & ROUTINE_TRIGGERS))
+            restart();
+        fired |= armed ? CRASH_TRIGGER_ARM : CRASH_TRIGGER_DISARM;
+    }
+
+    if (mode.FAILSAFE && !failsafe)
+        fired |= CRASH_TRIGGER_FAILSAFE;
+    failsafe = mode.FAILSAFE;
+
+    if (++i2cWindow == CRASHLOG_I2C_WINDOW) {
+        errors = i2cGetErrorCounter();
+        if ((uint16_t)(errors - i2cErrors) >= CRASHLOG_I2C_BURST)
+            fired |= CRASH_TRIGGER_I2C;
+        i2cErrors = errors;
+        i2cWindow = 0;
+    }
+
+    fired &= cfg.crashlogTriggers;
+    if (fired)
+        crashlogFreeze(fired & -fired);     // lowest bit, one trigger per snapshot
+}
+
+// Called at the end of every control loop
+void crashlogRecord(void)
+{
+    crashFrame_t *frame;
+    uint8_t i;
+    int16_t m;
+
+    checkTriggers();
+
+    if (crashLog.state == CRASHLOG_FROZEN)
+        return;
+
+    frame = &crashLog.frames[crashLog.head];
+    for (i = 0; i < 3; i++) {
+        frame->gyro[i] = constrain(stateData.gyro[i] * 1000.0f, -32767.0f, 32767.0f);
+        frame->error[i] = constrain(pids[ROLL_RATE_PID + i].lastErr * 1000.0f, -32767.0f, 32767.0f);
+        frame->axisPID[i] = constrain(axisPID[i] * 10.0f, -32767.0f, 32767.0f);
+    }
+    for (i = 0; i < CRASHLOG_MOTORS; i++) {
+        m = (motor[i] - 1000) / 4;
+        frame->motor[i] = constrain(m, 0, 255);
+    }
+    frame->cycleTime = min(cycleTime / 32, 255);
+    frame->flags = mode.ARMED | mode.FAILSAFE << 1 | mode.LEVEL_MODE << 2;
+
+    crashLog.head = (crashLog.head + 1) % CRASHLOG_FRAMES;
+    if (crashLog.count < CRASHLOG_FRAMES)
+        crashLog.count++;
+
+    if (crashLog.state == CRASHLOG_TRIGGERED && !--crashLog.post)
+        crashLog.state = CRASHLOG_FROZEN;
+}
@@ -0,0 +1,87 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+// Pre-trigger crash recorder. Every control loop goes into a RAM ring of
+// CRASHLOG_FRAMES frames. A trigger lets CRASHLOG_POST_FRAMES more in and then
+// freezes the ring so the lead up to the event is kept. The ring lives in
+// .noinit, so a snapshot survives a soft reset, and a reset while recording
+// armed freezes what was there as a CRASH_TRIGGER_RESET snapshot. A reset
+// while recording disarmed, as the cli 'save' does, starts a new recording.
+//
+// cfg.crashlogTriggers picks the events that trigger. MSP_CRASHLOG_CONTROL and
+// the cli can always freeze it. Arming starts a new recording over an ARM or
+// DISARM snapshot, any other snapshot is kept until it is cleared.
+//
+// RAM is sizeof(crashFrame_t) * CRASHLOG_FRAMES plus a small header, set the
+// size with OPTIONS="CRASHLOG_FRAMES=n" (CRASHLOG_MOTORS likewise).
+
+#ifndef CRASHLOG_FRAMES
+#define CRASHLOG_FRAMES         192     // ~0.4 s at the 500 Hz loop
+#endif
+#define CRASHLOG_POST_FRAMES    (CRASHLOG_FRAMES / 4)
+
+#ifndef CRASHLOG_MOTORS
+#define CRASHLOG_MOTORS         4
+#endif
+
+#define CRASHLOG_I2C_BURST      5       // i2c errors within CRASHLOG_I2C_WINDOW frames
+#define CRASHLOG_I2C_WINDOW     25
+
+typedef enum {
+    CRASH_TRIGGER_ARM = 1 << 0,
+    CRASH_TRIGGER_DISARM = 1 << 1,
+    CRASH_TRIGGER_FAILSAFE = 1 << 2,
+    CRASH_TRIGGER_I2C = 1 << 3,
+    CRASH_TRIGGER_MSP = 1 << 4,
+    CRASH_TRIGGER_RESET = 1 << 5,
+} crashTrigger_e;
+
+typedef enum {
+    CRASHLOG_RECORDING = 0,
+    CRASHLOG_TRIGGERED,     // taking the post trigger frames
+    CRASHLOG_FROZEN,
+} crashlogState_e;
+
+// Little endian, no padding, this is also the MSP_CRASHLOG_READ layout
+typedef struct {
+    int16_t gyro[3];                    // mrad/s
+    int16_t error[3];                   // rate loop error, mrad/s
+    int16_t axisPID[3];                 // x10
+    uint8_t motor[CRASHLOG_MOTORS];     // (motor - 1000) / 4
+    uint8_t cycleTime;                  // 32 us units, 255 is 8 ms or more
+    uint8_t flags;                      // bit 0 armed, 1 failsafe, 2 level mode
+} crashFrame_t;
+
+// Functions
+
+void crashlogInit(void);
+
+crashlogState_e crashlogState(void);
+
+uint8_t crashlogTrigger(void);
+
+uint32_t crashlogTriggerTime(void);
+
+uint16_t crashlogFrames(void);
+
+const crashFrame_t *crashlogFrame(uint16_t index);
+
+void crashlogFreeze(uint8_t trigger);
+
+void crashlogClear(void);
+
+void crashlogRecord(void);
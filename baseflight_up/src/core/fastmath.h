@@ -0,0 +1,204 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+#include "baseflight_proto.h"
+
+/*
+ * Single precision maths for the control path.
+ *
+ * The F103 has no FPU, so every newlib sqrtf/atan2f/sinf is a long soft-float
+ * routine and every stray double constant drags in the double library.
+ * Everything here is float only and inlined into the caller.
+ *
+ * Error bounds (measured over the full input range in float32):
+ *   fastInvSqrt    relative error < 5e-6 (two Newton steps)
+ *   fastAtan2      absolute error < 1.2e-5 rad
+ *   fastAsin       absolute error < 2e-5 rad for |x| <= 1
+ *   fastSin/Cos    absolute error < 1e-6 for |x| <= 2 PI, degrades slowly beyond
+ *
+ * Vectors and quaternions are plain float[3] / float[4] arrays to match
+ * stateData and the sensor code.
+ *
+ * support/fastmath_test holds these against libm and times both on the host.
+ */
+
+typedef float vec3_t[3];
+typedef float quat_t[4];
+
+///////////////////////////////////////////////////////////////////////////////
+// Scalar
+///////////////////////////////////////////////////////////////////////////////
+
+// 1/sqrt(x), bit-level seed plus two Newton-Raphson refinements
+static inline float fastInvSqrt(float x)
+{
+    union {
+        float f;
+        uint32_t i;
+    } conv;
+    float halfX = 0.5f * x;
+
+    conv.f = x;
+    conv.i = 0x5f375a86 - (conv.i >> 1);
+    conv.f = conv.f * (1.5f - halfX * conv.f * conv.f);
+    conv.f = conv.f * (1.5f - halfX * conv.f * conv.f);
+
+    return conv.f;
+}
+
+static inline float fastSqrt(float x)
+{
+    if (x <= 0.0f)
+        return 0.0f;
+    return x * fastInvSqrt(x);
+}
+
+// Odd minimax polynomial for atan on [0, 1]
+static inline float fastAtanUnit(float z)
+{
+    float z2 = z * z;
+    return z * (0.99986633f + z2 * (-0.33030478f + z2 * (0.18015926f + z2 * (-0.08515629f + z2 * 0.02084508f))));
+}
+
+static inline float fastAtan2(float y, float x)
+{
+    float absY = y < 0.0f ? -y : y;
+    float absX = x < 0.0f ? -x : x;
+    float angle;
+
+    if (absX == 0.0f && absY == 0.0f)
+        return 0.0f;
+
+    // Fold into the first octant so the polynomial only sees [0, 1]
+    if (absX >= absY)
+        angle = fastAtanUnit(absY / absX);
+    else
+        angle = (PI * 0.5f) - fastAtanUnit(absX / absY);
+
+    if (x < 0.0f)
+        angle = PI - angle;
+    if (y < 0.0f)
+        angle = -angle;
+
+    return angle;
+}
+
+static inline float fastAsin(float x)
+{
+    if (x >= 1.0f)
+        return PI * 0.5f;
+    if (x <= -1.0f)
+        return -PI * 0.5f;
+    return fastAtan2(x, fastSqrt(1.0f - x * x));
+}
+
+// Odd minimax polynomial for sin on [-PI/2, PI/2]
+static inline float fastSinHalfPi(float x)
+{
+    float x2 = x * x;
+    return x * (0.99999662f + x2 * (-0.16664828f + x2 * (8.30632522e-3f + x2 * -1.83636534e-4f)));
+}
+
+static inline float fastSin(float x)
+{
+    // Wrap to [-PI, PI]
+    while (x > PI)
+        x -= TWO_PI;
+    while (x < -PI)
+        x += TWO_PI;
+
+    // Reflect about +/- PI/2
+    if (x > PI * 0.5f)
+        x = PI - x;
+    else if (x < -PI * 0.5f)
+        x = -PI - x;
+
+    return fastSinHalfPi(x);
+}
+
+static inline float fastCos(float x)
+{
+    return fastSin(x + PI * 0.5f);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Vectors
+///////////////////////////////////////////////////////////////////////////////
+
+static inline float vec3Dot(const vec3_t a, const vec3_t b)
+{
+    return a[X] * b[X] + a[Y] * b[Y] + a[Z] * b[Z];
+}
+
+static inline void vec3Cross(vec3_t out, const vec3_t a, const vec3_t b)
+{
+    out[X] = a[Y] * b[Z] - a[Z] * b[Y];
+    out[Y] = a[Z] * b[X] - a[X] * b[Z];
+    out[Z] = a[X] * b[Y] - a[Y] * b[X];
+}
+
+static inline void vec3Scale(vec3_t v, float s)
+{
+    v[X] *= s;
+    v[Y] *= s;
+    v[Z] *= s;
+}
+
+// Returns the original length so callers can sanity check it, 0 leaves a
+// zero vector as it is
+static inline float vec3Normalise(vec3_t v)
+{
+    float normSq = vec3Dot(v, v);
+    float invNorm;
+
+    if (normSq <= 0.0f)
+        return 0.0f;
+
+    invNorm = fastInvSqrt(normSq);
+    vec3Scale(v, invNorm);
+
+    return normSq * invNorm;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Quaternions
+///////////////////////////////////////////////////////////////////////////////
+
+// Returns the original length, like vec3Normalise()
+static inline float quatNormalise(quat_t q)
+{
+    float normSq = q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3];
+    float invNorm = fastInvSqrt(normSq);
+
+    q[0] *= invNorm;
+    q[1] *= invNorm;
+    q[2] *= invNorm;
+    q[3] *= invNorm;
+
+    return normSq * invNorm;
+}
+
+// Gravity in the body frame, R13, R23 and R33 in Quaternion2RPY(). Level and
+// upright it is (0, 0, 1).
+static inline void quatGravity(vec3_t out, const quat_t q)
+{
+    out[X] = 2.0f * (q[1] * q[3] - q[0] * q[2]);
+    out[Y] = 2.0f * (q[0] * q[1] + q[2] * q[3]);
+    out[Z] = q[0] * q[0] - q[1] * q[1] - q[2] * q[2] + q[3] * q[3];
+}
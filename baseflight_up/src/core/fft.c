@@ -0,0 +1,113 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#include "board.h"
+#include "core/fastmath.h"
+#include "core/fft.h"
+
+// Q15 twiddles e^(-j 2 pi k / N) for k = 0..N/2-1, cos and positive sin
+static int16_t twiddleCos[FFT_SIZE / 2];
+static int16_t twiddleSin[FFT_SIZE / 2];
+static uint8_t bitReverse[FFT_SIZE];
+
+void fftInit(void)
+{
+    uint16_t k, bit;
+    float angle;
+
+    for (k = 0; k < FFT_SIZE / 2; k++) {
+        angle = TWO_PI * k / FFT_SIZE;
+        twiddleCos[k] = (int16_t)(fastCos(angle) * 32767.0f);
+        twiddleSin[k] = (int16_t)(fastSin(angle) * 32767.0f);
+    }
+
+    for (k = 0; k < FFT_SIZE; k++) {
+        bitReverse[k] = 0;
+        for (bit = 0; bit < FFT_SIZE_LOG2; bit++)
+            if (k & (1 << bit))
+                bitReverse[k] |= 1 << (FFT_SIZE_LOG2 - 1 - bit);
+    }
+}
+
+// Hann window from the twiddle table, w[n] = (1 - cos(2 pi n / N)) / 2 in Q15
+static inline int32_t hann(uint16_t n)
+{
+    if (n > FFT_SIZE / 2)
+        n = FFT_SIZE - n;
+    if (n == FFT_SIZE / 2)
+        return 32767;
+    return (32768 - twiddleCos[n]) >> 1;
+}
+
+// Copies a ring buffer of FFT_SIZE samples, oldest first, removing the mean
+// and applying the window. Output is in bit reversed order ready for the stages.
+void fftLoad(int32_t *re, int32_t *im, const int16_t *samples, uint16_t oldest)
+{
+    int32_t mean = 0, x;
+    uint16_t n, idx;
+
+    for (n = 0; n < FFT_SIZE; n++)
+        mean += samples[n];
+    mean /= FFT_SIZE;
+
+    for (n = 0; n < FFT_SIZE; n++) {
+        idx = (oldest + n) & (FFT_SIZE - 1);
+        x = constrain(samples[idx] - mean, -32767, 32767);
+        re[bitReverse[n]] = (x * hann(n)) >> 7; // keep 8 fractional bits
+        im[bitReverse[n]] = 0;
+    }
+}
+
+// One decimation in time stage. Growth is at most one bit per stage so
+// samples in Q8 stay well inside 32 bits; products go through SMULL.
+void fftStage(int32_t *re, int32_t *im, uint8_t stage)
+{
+    uint16_t half = 1 << stage;
+    uint16_t step = FFT_SIZE / (half << 1);
+    uint16_t group, j, i1, i2;
+    int32_t c, s, tRe, tIm;
+
+    for (j = 0; j < half; j++) {
+        c = twiddleCos[j * step];
+        s = twiddleSin[j * step];
+        for (group = 0; group < FFT_SIZE; group += half << 1) {
+            i1 = group + j;
+            i2 = i1 + half;
+            // (a + jb)(c - js)
+            tRe = (int32_t)(((int64_t)re[i2] * c + (int64_t)im[i2] * s) >> 15);
+            tIm = (int32_t)(((int64_t)im[i2] * c - (int64_t)re[i2] * s) >> 15);
+            re[i2] = re[i1] - tRe;
+            im[i2] = im[i1] - tIm;
+            re[i1] += tRe;
+            im[i1] += tIm;
+        }
+    }
+}
+
+// Alpha max plus beta min, within 7% of the true magnitude which is plenty
+// for peak picking
+uint32_t fftMagnitude(int32_t re, int32_t im)
+{
+    uint32_t a = re < 0 ? -re : re;
+    uint32_t b = im < 0 ? -im : im;
+
+    if (a < b) {
+        uint32_t t = a;
+        a = b;
+        b = t;
+    }
+
+    return a + (b >> 2) + (b >> 3);
+}
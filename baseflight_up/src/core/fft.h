@@ -0,0 +1,36 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include <stdint.h>
+
+// Fixed point radix-2 FFT, split so each call fits in a scheduler slot.
+// Load the window with fftLoad(), then run fftStage() for stages
+// 0..FFT_SIZE_LOG2-1, then read bins 0..FFT_SIZE/2 with fftMagnitude().
+
+#define FFT_SIZE_LOG2   7
+#define FFT_SIZE        (1 << FFT_SIZE_LOG2)
+#define FFT_BINS        (FFT_SIZE / 2)
+
+// Functions
+
+void fftInit(void);
+
+void fftLoad(int32_t *re, int32_t *im, const int16_t *samples, uint16_t oldest);
+
+void fftStage(int32_t *re, int32_t *im, uint8_t stage);
+
+uint32_t fftMagnitude(int32_t re, int32_t im);
@@ -16,43 +16,194 @@
     http://code.google.com/p/aeroquad/source/browse/trunk/AeroQuad
  */
 
+// No board.h, this also builds on the host against support/filter_test
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "core/fastmath.h"
 #include "core/filters.h"
 
 // Low pass filter, kept as regular C function for speed
 
 float filterSmooth(float currentData, float previousData, float smoothFactor) 
 {
-  if (smoothFactor != 1.0) //only apply time compensated filter if smoothFactor is applied
+  if (smoothFactor != 1.0f) //only apply time compensated filter if smoothFactor is applied
   {
-    return (previousData * (1.0 - smoothFactor) + (currentData * smoothFactor)); 
+    return (previousData * (1.0f - smoothFactor) + (currentData * smoothFactor)); 
   }
   return currentData; //if smoothFactor == 1.0, do not calculate, just bypass!
 }
 
-//  4th Order IIR Filter
+// Coefficients are computed once at init from the cutoff and the rate the
+// filter is called at, second order sections follow the RBJ audio EQ cookbook
 
-// [b, a] = cheby2(4,60,12.5/100) cheby2(order, stopband_ripple, Wst)
-// Wst is cutoff frequency from 0.0 to 1.0 (1.0 corresponds to half the sampling rate)
+#define BUTTERWORTH_Q   0.70710678f
+#define NOTCH_CUTOFF    0.75f       // of the centre, when no cutoff is set
 
-float fourthOrderFilter(float input, fourthOrderData_t *filterData, float *A, float *B)
+void pt1FilterInit(pt1Filter_t *filter, float cutoffHz, float sampleHz)
 {
-    float output;
+    float dT = 1.0f / sampleHz;
+    float rc = 1.0f / (TWO_PI * cutoffHz);
 
-    output = B[0] * input + B[1] * filterData->input[1-1] + B[2] * filterData->input[2-1]
-                    + B[3] * filterData->input[3-1] + B[4] * filterData->input[4-1] - A[1-1] * filterData->output[1-1]
-                    - A[2-1] * filterData->output[2-1] - A[3-1] * filterData->output[3-1] - A[4-1] * filterData->output[4-1];
+    filter->k = dT / (rc + dT);
+    filter->state = 0.0f;
+}
 
-    filterData->input[4-1] = filterData->input[3-1];
-    filterData->input[3-1] = filterData->input[2-1];
-    filterData->input[2-1] = filterData->input[1-1];
-    filterData->input[1-1] = input;
+float pt1FilterApply(pt1Filter_t *filter, float input)
+{
+    filter->state += filter->k * (input - filter->state);
+    return filter->state;
+}
 
-    filterData->output[4-1] = filterData->output[3-1];
-    filterData->output[3-1] = filterData->output[2-1];
-    filterData->output[2-1] = filterData->output[1-1];
-    filterData->output[1-1] = output;
+static void biquadFilterInit(biquadFilter_t *filter, float b0, float b1, float b2, float a0, float a1, float a2)
+{
+    float invA0 = 1.0f / a0;
+
+    filter->b0 = b0 * invA0;
+    filter->b1 = b1 * invA0;
+    filter->b2 = b2 * invA0;
+    filter->a1 = a1 * invA0;
+    filter->a2 = a2 * invA0;
+    filter->d1 = 0.0f;
+    filter->d2 = 0.0f;
+}
+
+void biquadFilterInitLPF(biquadFilter_t *filter, float cutoffHz, float sampleHz)
+{
+    float omega = TWO_PI * cutoffHz / sampleHz;
+    float sn = fastSin(omega);
+    float cs = fastCos(omega);
+    float alpha = sn / (2.0f * BUTTERWORTH_Q);
+
+    biquadFilterInit(filter, (1.0f - cs) * 0.5f, 1.0f - cs, (1.0f - cs) * 0.5f,
+                     1.0f + alpha, -2.0f * cs, 1.0f - alpha);
+}
+
+// Frequency as the bilinear transform sees it
+static float prewarp(float hz, float sampleHz)
+{
+    float omega = PI * hz / sampleHz;
+
+    return fastSin(omega) / fastCos(omega);
+}
+
+// The cutoff must be above 0 and below the centre, q is 0 or negative
+// otherwise. Both edges are prewarped, the stop band would narrow towards
+// Nyquist if q were taken from the edges in Hz.
+void biquadFilterInitNotch(biquadFilter_t *filter, float centreHz, float cutoffHz, float sampleHz)
+{
+    float omega = TWO_PI * centreHz / sampleHz;
+    float sn = fastSin(omega);
+    float cs = fastCos(omega);
+    float centre = prewarp(centreHz, sampleHz);
+    float cutoff = prewarp(cutoffHz, sampleHz);
+    float q = centre * cutoff / (centre * centre - cutoff * cutoff);
+    float alpha = sn / (2.0f * q);
+
+    biquadFilterInit(filter, 1.0f, -2.0f * cs, 1.0f,
+                     1.0f + alpha, -2.0f * cs, 1.0f - alpha);
+}
+
+float biquadFilterApply(biquadFilter_t *filter, float input)
+{
+    float output = filter->b0 * input + filter->d1;
+
+    filter->d1 = filter->b1 * input - filter->a1 * output + filter->d2;
+    filter->d2 = filter->b2 * input - filter->a2 * output;
 
     return output;
 }
 
+#define Q29(x)  ((int32_t)((x) * 536870912.0f))
+
+// Coefficients only, the history is kept so a running filter can be retuned
+void biquadFilterUpdateQ(biquadFilterQ_t *filterQ, const biquadFilter_t *filter)
+{
+    filterQ->b0 = Q29(filter->b0);
+    filterQ->b1 = Q29(filter->b1);
+    filterQ->b2 = Q29(filter->b2);
+    filterQ->a1 = Q29(filter->a1);
+    filterQ->a2 = Q29(filter->a2);
+}
 
+void biquadFilterInitQ(biquadFilterQ_t *filterQ, const biquadFilter_t *filter)
+{
+    biquadFilterUpdateQ(filterQ, filter);
+    filterQ->x1 = filterQ->x2 = 0;
+    filterQ->y1 = filterQ->y2 = 0;
+}
+
+int32_t biquadFilterApplyQ(biquadFilterQ_t *filter, int32_t input)
+{
+    int64_t acc;
+    int32_t output;
+
+    acc  = (int64_t)filter->b0 * input;
+    acc += (int64_t)filter->b1 * filter->x1;
+    acc += (int64_t)filter->b2 * filter->x2;
+    acc -= (int64_t)filter->a1 * filter->y1;
+    acc -= (int64_t)filter->a2 * filter->y2;
+    output = (int32_t)((acc + (1 << 28)) >> 29);
+
+    filter->x2 = filter->x1;
+    filter->x1 = input;
+    filter->y2 = filter->y1;
+    filter->y1 = output;
+
+    return output;
+}
+
+// Builds [low pass] -> [notch] from the stored settings. Anything at or above
+// Nyquist is left out rather than producing an unstable section, and so is a
+// notch whose cutoff is not below its centre.
+void filterChainInit(filterChain_t *chain, const filterConfig_t *config, float sampleHz)
+{
+    float nyquist = sampleHz * 0.5f;
+    float notchCutoffHz = config->notchCutoffHz ? config->notchCutoffHz : config->notchHz * NOTCH_CUTOFF;
+    filterStage_t *stage;
+
+    chain->count = 0;
+
+    if (config->lpfType != FILTER_NONE && config->lpfHz > 0 && config->lpfHz < nyquist) {
+        stage = &chain->stage[chain->count++];
+        stage->type = config->lpfType;
+        if (config->lpfType == FILTER_PT1)
+            pt1FilterInit(&stage->pt1, config->lpfHz, sampleHz);
+        else
+            biquadFilterInitLPF(&stage->biquad, config->lpfHz, sampleHz);
+    }
+
+    if (config->notchHz > 0 && config->notchHz < nyquist && notchCutoffHz < config->notchHz) {
+        stage = &chain->stage[chain->count++];
+        stage->type = FILTER_NOTCH;
+        biquadFilterInitNotch(&stage->biquad, config->notchHz, notchCutoffHz, sampleHz);
+    }
+}
+
+void filterChainReset(filterChain_t *chain)
+{
+    uint8_t i;
+
+    for (i = 0; i < chain->count; i++) {
+        if (chain->stage[i].type == FILTER_PT1) {
+            chain->stage[i].pt1.state = 0.0f;
+        } else {
+            chain->stage[i].biquad.d1 = 0.0f;
+            chain->stage[i].biquad.d2 = 0.0f;
+        }
+    }
+}
+
+float filterChainApply(filterChain_t *chain, float input)
+{
+    uint8_t i;
+
+    for (i = 0; i < chain->count; i++) {
+        if (chain->stage[i].type == FILTER_PT1)
+            input = pt1FilterApply(&chain->stage[i].pt1, input);
+        else
+            input = biquadFilterApply(&chain->stage[i].biquad, input);
+    }
+
+    return input;
+}
@@ -15,16 +15,82 @@
 
 #pragma once
 
+#include <stdint.h>
+
 // Filter Typedefs
 
+typedef enum {
+    FILTER_NONE = 0,
+    FILTER_PT1,
+    FILTER_BIQUAD,
+    FILTER_NOTCH
+} filterType_e;
+
+// First order low pass
 typedef struct {
-    float input[4];
-    float output[4];
-} fourthOrderData_t;
+    float k;
+    float state;
+} pt1Filter_t;
 
-// Functions
+// Second order section, transposed direct form II
+typedef struct {
+    float b0, b1, b2, a1, a2;
+    float d1, d2;
+} biquadFilter_t;
+
+// Second order section for integer sensor samples, direct form I with
+// Q2.29 coefficients and 64 bit accumulation
+typedef struct {
+    int32_t b0, b1, b2, a1, a2;
+    int32_t x1, x2, y1, y2;
+} biquadFilterQ_t;
+
+#define FILTER_CHAIN_MAX 2
+
+typedef struct {
+    uint8_t type; // filterType_e
+    union {
+        pt1Filter_t pt1;
+        biquadFilter_t biquad;
+    };
+} filterStage_t;
+
+// Stages are applied in order, an empty chain passes the input through
+typedef struct {
+    uint8_t count;
+    filterStage_t stage[FILTER_CHAIN_MAX];
+} filterChain_t;
+
+// Per signal settings as stored in cfg
+typedef struct {
+    uint8_t lpfType;            // FILTER_NONE, FILTER_PT1 or FILTER_BIQUAD
+    uint16_t lpfHz;
+    uint16_t notchHz;           // 0 disables the notch
+    uint16_t notchCutoffHz;     // Lower edge of the stop band, below notchHz, 0 for 75% of it
+} filterConfig_t;
 
-float fourthOrderFilter(float input, fourthOrderData_t *filterData, float *A, float *B);
+// Functions
 
 float filterSmooth(float currentData, float previousData, float smoothFactor);
 
+void pt1FilterInit(pt1Filter_t *filter, float cutoffHz, float sampleHz);
+
+float pt1FilterApply(pt1Filter_t *filter, float input);
+
+void biquadFilterInitLPF(biquadFilter_t *filter, float cutoffHz, float sampleHz);
+
+void biquadFilterInitNotch(biquadFilter_t *filter, float centreHz, float cutoffHz, float sampleHz);
+
+float biquadFilterApply(biquadFilter_t *filter, float input);
+
+void biquadFilterInitQ(biquadFilterQ_t *filterQ, const biquadFilter_t *filter);
+
+void biquadFilterUpdateQ(biquadFilterQ_t *filterQ, const biquadFilter_t *filter);
+
+int32_t biquadFilterApplyQ(biquadFilterQ_t *filter, int32_t input);
+
+void filterChainInit(filterChain_t *chain, const filterConfig_t *config, float sampleHz);
+
+void filterChainReset(filterChain_t *chain);
+
+float filterChainApply(filterChain_t *chain, float input);
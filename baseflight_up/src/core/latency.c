@@ -0,0 +1,54 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#include "board.h"
+
+#include "core/command.h"
+#include "core/latency.h"
+
+static latencyStats_t latency[LATENCY_PATHS];
+static uint32_t lastRcDataTime;
+
+static void latencyAdd(latencyStats_t *stats, uint32_t us)
+{
+    if (!stats->count || us < stats->min)
+        stats->min = us;
+    if (us > stats->max)
+        stats->max = us;
+    stats->sum += us;
+    stats->count++;
+}
+
+// Called straight after writeMotors(), the outputs now hold the inputs
+// stamped in stateData and rcDataTime
+void latencyUpdate(void)
+{
+    uint32_t now = micros();
+
+    if (stateData.gyroTime)
+        latencyAdd(&latency[LATENCY_GYRO], now - stateData.gyroTime);
+
+    if (rcDataTime != lastRcDataTime) {
+        lastRcDataTime = rcDataTime;
+        latencyAdd(&latency[LATENCY_RC], now - rcDataTime);
+    }
+}
+
+// Copies every path into stats[LATENCY_PATHS] and starts them again
+void latencyReadAll(latencyStats_t *stats)
+{
+    memcpy(stats, latency, sizeof(latency));
+    memset(latency, 0, sizeof(latency));
+}
@@ -0,0 +1,47 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+// Input to output latency. Gyro samples and RC frames carry their micros()
+// stamp through the accumulator, updateRateGyro(), stabilisation() and
+// mixTable(), and once writeMotors() has loaded the timer compare registers
+// the age of what went into them is added to min/mean/max statistics.
+//
+// Gyro latency is taken on every output, from the middle of the samples
+// averaged into stateData.gyro. RC latency is taken on the first output
+// after each new frame. The delay a filter adds on top is not counted.
+//
+// Only micros() is used, so the same figures come out of any port that
+// provides it. Reading clears, like core/perf.h.
+
+typedef enum {
+    LATENCY_GYRO = 0,
+    LATENCY_RC,
+    LATENCY_PATHS
+} latencyPath_e;
+
+typedef struct {
+    uint32_t min;       // us
+    uint32_t max;
+    uint32_t sum;
+    uint32_t count;
+} latencyStats_t;
+
+// Functions
+
+void latencyUpdate(void);
+
+void latencyReadAll(latencyStats_t *stats);
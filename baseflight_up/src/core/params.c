@@ -0,0 +1,192 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#include "board.h"
+
+#include "core/params.h"
+#include "core/params_hash.h"
+
+#define PARAM_ENTRY(name, type, field, min, max, def) { #name, type, &field, min, max, def },
+
+const param_t paramTable[PARAM_COUNT] = {
+    PARAM_TABLE(PARAM_ENTRY)
+};
+
+#undef PARAM_ENTRY
+
+// Fails to compile when params_hash.h is older than the table
+typedef char paramHashIsCurrent[(PARAM_HASH_COUNT == PARAM_COUNT) ? 1 : -1];
+
+// FNV-1a over the lower cased name, must match support/params_hash.py
+static uint32_t paramHash(const char *name, uint8_t len, uint32_t seed)
+{
+    uint32_t h = 2166136261u ^ seed;
+
+    while (len--) {
+        h ^= (uint8_t)tolower((uint8_t)*name++);
+        h *= 16777619u;
+    }
+
+    return h;
+}
+
+// Hash and displace: the first hash picks a bucket, the bucket's seed gives a
+// second hash that lands every name on its own slot. Unknown names still land
+// somewhere, so the slot's name is compared before it is trusted.
+const param_t *paramFind(const char *name, uint8_t len)
+{
+    uint8_t bucket = paramHash(name, len, 0) % PARAM_HASH_BUCKETS;
+    uint8_t slot = paramHash(name, len, paramHashSeed[bucket]) % PARAM_HASH_COUNT;
+    const param_t *param = &paramTable[paramHashSlot[slot]];
+
+    if (strlen(param->name) != len || strncasecmp(name, param->name, len))
+        return NULL;
+
+    return param;
+}
+
+int32_t paramGetInt(const param_t *param)
+{
+    switch (param->type) {
+        case VAR_UINT8:
+            return *(uint8_t *)param->ptr;
+        case VAR_INT8:
+            return *(int8_t *)param->ptr;
+        case VAR_UINT16:
+            return *(uint16_t *)param->ptr;
+        case VAR_INT16:
+            return *(int16_t *)param->ptr;
+        case VAR_UINT32:
+            return *(uint32_t *)param->ptr;
+        case VAR_FLOAT:
+            return *(float *)param->ptr;
+    }
+
+    return 0;
+}
+
+float paramGetFloat(const param_t *param)
+{
+    if (param->type == VAR_FLOAT)
+        return *(float *)param->ptr;
+
+    return paramGetInt(param);
+}
+
+// Integers sign extended to 32 bits, floats as their IEEE bits
+uint32_t paramGetRaw(const param_t *param)
+{
+    uint32_t raw;
+
+    if (param->type == VAR_FLOAT) {
+        memcpy(&raw, param->ptr, sizeof(raw));
+        return raw;
+    }
+
+    return paramGetInt(param);
+}
+
+bool paramSetRaw(const param_t *param, uint32_t raw)
+{
+    float value;
+
+    if (param->type == VAR_FLOAT) {
+        memcpy(&value, &raw, sizeof(value));
+        return paramSetFloat(param, value);
+    }
+
+    return paramSetInt(param, (int32_t)raw);
+}
+
+// Limits between fields, which the table's min and max cannot express. A
+// notch cutoff of 0 takes the default width, otherwise it is below the centre.
+static bool filterConfigValid(const filterConfig_t *filter)
+{
+    return !filter->notchHz || !filter->notchCutoffHz || filter->notchCutoffHz < filter->notchHz;
+}
+
+static bool paramsValid(void)
+{
+    return filterConfigValid(&cfg.accelFilter) && filterConfigValid(&cfg.gyroFilter) &&
+           filterConfigValid(&cfg.dtermFilter);
+}
+
+static void paramWriteInt(const param_t *param, int32_t value)
+{
+    switch (param->type) {
+        case VAR_UINT8:
+        case VAR_INT8:
+            *(uint8_t *)param->ptr = (uint8_t)value;
+            break;
+
+        case VAR_UINT16:
+        case VAR_INT16:
+            *(uint16_t *)param->ptr = (uint16_t)value;
+            break;
+
+        case VAR_UINT32:
+            *(uint32_t *)param->ptr = (uint32_t)value;
+            break;
+    }
+}
+
+// A value that breaks a limit between fields is put back and refused. A
+// config loaded already broken can still be written, so it can be fixed.
+bool paramSetInt(const param_t *param, int32_t value)
+{
+    int32_t previous;
+    bool valid;
+
+    if (param->type == VAR_FLOAT)
+        return paramSetFloat(param, value);
+
+    if (value < param->min || value > param->max)
+        return false;
+
+    previous = paramGetInt(param);
+    valid = paramsValid();
+    paramWriteInt(param, value);
+    if (valid && !paramsValid()) {
+        paramWriteInt(param, previous);
+        return false;
+    }
+
+    return true;
+}
+
+bool paramSetFloat(const param_t *param, float value)
+{
+    if (param->type != VAR_FLOAT)
+        return paramSetInt(param, value);
+
+    // Also rejects NaN
+    if (!(value >= param->min && value <= param->max))
+        return false;
+
+    *(float *)param->ptr = value;
+    return true;
+}
+
+void paramResetDefaults(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < PARAM_COUNT; i++) {
+        if (paramTable[i].type == VAR_FLOAT)
+            *(float *)paramTable[i].ptr = paramTable[i].def;
+        else
+            paramWriteInt(&paramTable[i], paramTable[i].def);
+    }
+}
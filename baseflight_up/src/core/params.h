@@ -0,0 +1,185 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+// Parameter registry. Every tunable cfg field is described once here, the
+// CLI names, MSP IDs, defaults and range checks are all generated from it.
+//
+// An entry's ID is its position, so new entries go on the end and existing
+// ones are never reordered or removed. After editing the table the name hash
+// in params_hash.h is regenerated by the Makefile (support/params_hash.py).
+//
+//  P(name, type, field, min, max, default)
+
+#define PARAM_TABLE(P) \
+    P(escPwmRate,               VAR_UINT16, cfg.escPwmRate,                     50,     498,    400) \
+    P(servoPwmRate,             VAR_UINT16, cfg.servoPwmRate,                   50,     498,    50) \
+    P(failsafeOnDelay,          VAR_UINT16, cfg.failsafeOnDelay,                0,      1000,   50) \
+    P(failsafeOffDelay,         VAR_UINT16, cfg.failsafeOffDelay,               0,      65535,  20000) \
+    P(failsafeThrottle,         VAR_UINT16, cfg.failsafeThrottle,               1000,   2000,   1200) \
+    P(minCommand,               VAR_UINT16, cfg.minCommand,                     0,      2000,   1000) \
+    P(midCommand,               VAR_UINT16, cfg.midCommand,                     1200,   1700,   1500) \
+    P(maxCommand,               VAR_UINT16, cfg.maxCommand,                     0,      2000,   2000) \
+    P(minCheck,                 VAR_UINT16, cfg.minCheck,                       0,      2000,   1100) \
+    P(maxCheck,                 VAR_UINT16, cfg.maxCheck,                       0,      2000,   1900) \
+    P(minThrottle,              VAR_UINT16, cfg.minThrottle,                    0,      2000,   1150) \
+    P(maxThrottle,              VAR_UINT16, cfg.maxThrottle,                    0,      2000,   1850) \
+    P(spektrumHiRes,            VAR_UINT8,  cfg.spektrumHiRes,                  0,      1,      0) \
+    P(rollDeadband,             VAR_UINT16, cfg.deadBand[ROLL],                 0,      32,     12) \
+    P(pitchDeadband,            VAR_UINT16, cfg.deadBand[PITCH],                0,      32,     12) \
+    P(yawDeadband,              VAR_UINT16, cfg.deadBand[YAW],                  0,      32,     12) \
+    P(yawDirection,             VAR_INT8,   cfg.yawDirection,                   -1,     1,      1) \
+    P(triYawServoMin,           VAR_UINT16, cfg.triYawServoMin,                 0,      2000,   1000) \
+    P(triYawServoMid,           VAR_UINT16, cfg.triYawServoMid,                 0,      2000,   1500) \
+    P(triYawServoMax,           VAR_UINT16, cfg.triYawServoMax,                 0,      2000,   2000) \
+    P(biLeftServoMin,           VAR_UINT16, cfg.biLeftServoMin,                 0,      2000,   1000) \
+    P(biLeftServoMid,           VAR_UINT16, cfg.biLeftServoMid,                 0,      2000,   1500) \
+    P(biLeftServoMax,           VAR_UINT16, cfg.biLeftServoMax,                 0,      2000,   2000) \
+    P(biRightServoMin,          VAR_UINT16, cfg.biRightServoMin,                0,      2000,   1000) \
+    P(biRightServoMid,          VAR_UINT16, cfg.biRightServoMid,                0,      2000,   1500) \
+    P(biRightServoMax,          VAR_UINT16, cfg.biRightServoMax,                0,      2000,   2000) \
+    P(wingLeftMin,              VAR_UINT16, cfg.wingLeftMin,                    0,      2000,   1020) \
+    P(wingLeftMid,              VAR_UINT16, cfg.wingLeftMid,                    0,      2000,   1500) \
+    P(wingLeftMax,              VAR_UINT16, cfg.wingLeftMax,                    0,      2000,   2000) \
+    P(wingRightMin,             VAR_UINT16, cfg.wingRightMin,                   0,      2000,   1020) \
+    P(wingRightMid,             VAR_UINT16, cfg.wingRightMid,                   0,      2000,   1500) \
+    P(wingRightMax,             VAR_UINT16, cfg.wingRightMax,                   0,      2000,   2000) \
+    P(pitchDirectionLeft,       VAR_INT8,   cfg.pitchDirectionLeft,             -1,     1,      1) \
+    P(pitchDirectionRight,      VAR_INT8,   cfg.pitchDirectionRight,            -1,     1,      -1) \
+    P(rollDirectionLeft,        VAR_INT8,   cfg.rollDirectionLeft,              -1,     1,      1) \
+    P(rollDirectionRight,       VAR_INT8,   cfg.rollDirectionRight,             -1,     1,      1) \
+    P(gimbalFlags,              VAR_UINT8,  cfg.gimbalFlags,                    0,      255,    GIMBAL_NORMAL) \
+    P(gimbalSmoothFactor,       VAR_FLOAT,  cfg.gimbalSmoothFactor,             0,      1,      0.95f) \
+    P(gimbalRollServoMin,       VAR_UINT16, cfg.gimbalRollServoMin,             0,      2000,   1000) \
+    P(gimbalRollServoMid,       VAR_UINT16, cfg.gimbalRollServoMid,             0,      2000,   1500) \
+    P(gimbalRollServoMax,       VAR_UINT16, cfg.gimbalRollServoMax,             0,      2000,   2000) \
+    P(gimbalRollServoGain,      VAR_FLOAT,  cfg.gimbalRollServoGain,            -100,   100,    1.0f) \
+    P(gimbalPitchServoMin,      VAR_UINT16, cfg.gimbalPitchServoMin,            0,      2000,   1000) \
+    P(gimbalPitchServoMid,      VAR_UINT16, cfg.gimbalPitchServoMid,            0,      2000,   1500) \
+    P(gimbalPitchServoMax,      VAR_UINT16, cfg.gimbalPitchServoMax,            0,      2000,   2000) \
+    P(gimbalPitchServoGain,     VAR_FLOAT,  cfg.gimbalPitchServoGain,           -100,   100,    1.0f) \
+    P(p_roll_rate,              VAR_FLOAT,  profile.pids[ROLL_RATE_PID].p,      0,      400,    100.0f) \
+    P(i_roll_rate,              VAR_FLOAT,  profile.pids[ROLL_RATE_PID].i,      0,      400,    0.0f) \
+    P(d_roll_rate,              VAR_FLOAT,  profile.pids[ROLL_RATE_PID].d,      0,      400,    0.0f) \
+    P(ilim_roll_rate,           VAR_FLOAT,  profile.pids[ROLL_RATE_PID].iLim,   0,      200,    100.0f) \
+    P(p_pitch_rate,             VAR_FLOAT,  profile.pids[PITCH_RATE_PID].p,     0,      400,    100.0f) \
+    P(i_pitch_rate,             VAR_FLOAT,  profile.pids[PITCH_RATE_PID].i,     0,      400,    0.0f) \
+    P(d_pitch_rate,             VAR_FLOAT,  profile.pids[PITCH_RATE_PID].d,     0,      400,    0.0f) \
+    P(ilim_pitch_rate,          VAR_FLOAT,  profile.pids[PITCH_RATE_PID].iLim,  0,      200,    100.0f) \
+    P(p_yaw_rate,               VAR_FLOAT,  profile.pids[YAW_RATE_PID].p,       0,      400,    200.0f) \
+    P(i_yaw_rate,               VAR_FLOAT,  profile.pids[YAW_RATE_PID].i,       0,      400,    0.0f) \
+    P(d_yaw_rate,               VAR_FLOAT,  profile.pids[YAW_RATE_PID].d,       0,      400,    0.0f) \
+    P(ilim_yaw_rate,            VAR_FLOAT,  profile.pids[YAW_RATE_PID].iLim,    0,      200,    100.0f) \
+    P(p_roll_level,             VAR_FLOAT,  profile.pids[ROLL_LEVEL_PID].p,     0,      400,    2.0f) \
+    P(i_roll_level,             VAR_FLOAT,  profile.pids[ROLL_LEVEL_PID].i,     0,      400,    0.0f) \
+    P(d_roll_level,             VAR_FLOAT,  profile.pids[ROLL_LEVEL_PID].d,     0,      400,    0.0f) \
+    P(ilim_roll_level,          VAR_FLOAT,  profile.pids[ROLL_LEVEL_PID].iLim,  0,      200,    0.5f) \
+    P(p_pitch_level,            VAR_FLOAT,  profile.pids[PITCH_LEVEL_PID].p,    0,      400,    2.0f) \
+    P(i_pitch_level,            VAR_FLOAT,  profile.pids[PITCH_LEVEL_PID].i,    0,      400,    0.0f) \
+    P(d_pitch_level,            VAR_FLOAT,  profile.pids[PITCH_LEVEL_PID].d,    0,      400,    0.0f) \
+    P(ilim_pitch_level,         VAR_FLOAT,  profile.pids[PITCH_LEVEL_PID].iLim, 0,      200,    0.5f) \
+    P(p_heading,                VAR_FLOAT,  profile.pids[HEADING_PID].p,        0,      400,    1.5f) \
+    P(i_heading,                VAR_FLOAT,  profile.pids[HEADING_PID].i,        0,      400,    0.0f) \
+    P(d_heading,                VAR_FLOAT,  profile.pids[HEADING_PID].d,        0,      400,    0.0f) \
+    P(ilim_heading,             VAR_FLOAT,  profile.pids[HEADING_PID].iLim,     0,      200,    0.5f) \
+    P(p_altitude,               VAR_FLOAT,  profile.pids[ALTITUDE_PID].p,       0,      400,    20.0f) \
+    P(i_altitude,               VAR_FLOAT,  profile.pids[ALTITUDE_PID].i,       0,      400,    17.0f) \
+    P(d_altitude,               VAR_FLOAT,  profile.pids[ALTITUDE_PID].d,       0,      400,    7.0f) \
+    P(ilim_altitude,            VAR_FLOAT,  profile.pids[ALTITUDE_PID].iLim,    0,      50000,  30000.0f) \
+    P(mpu6050Scale,             VAR_UINT8,  cfg.mpu6050Scale,                   0,      1,      0) \
+    P(accelKp,                  VAR_FLOAT,  cfg.accelKp,                        0,      50,     2.0f) \
+    P(accelKi,                  VAR_FLOAT,  cfg.accelKi,                        0,      50,     0.01f) \
+    P(magKp,                    VAR_FLOAT,  cfg.magKp,                          0,      50,     1.0f) \
+    P(magKi,                    VAR_FLOAT,  cfg.magKi,                          0,      50,     0.01f) \
+    P(magDriftCompensation,     VAR_UINT8,  cfg.magDriftCompensation,           0,      1,      0) \
+    P(magDeclination,           VAR_FLOAT,  cfg.magDeclination,                 -18000, 18000,  10.59f) \
+    P(accelLpfType,             VAR_UINT8,  cfg.accelFilter.lpfType,            0,      2,      FILTER_PT1) \
+    P(accelLpfHz,               VAR_UINT16, cfg.accelFilter.lpfHz,              0,      500,    160) \
+    P(accelNotchHz,             VAR_UINT16, cfg.accelFilter.notchHz,            0,      500,    0) \
+    P(accelNotchCutoff,         VAR_UINT16, cfg.accelFilter.notchCutoffHz,      0,      500,    0) \
+    P(gyroBiasOnStartup,        VAR_UINT8,  cfg.gyroBiasOnStartup,              0,      1,      0) \
+    P(gyroLpfType,              VAR_UINT8,  cfg.gyroFilter.lpfType,             0,      2,      FILTER_NONE) \
+    P(gyroLpfHz,                VAR_UINT16, cfg.gyroFilter.lpfHz,               0,      500,    90) \
+    P(gyroNotchHz,              VAR_UINT16, cfg.gyroFilter.notchHz,             0,      500,    0) \
+    P(gyroNotchCutoff,          VAR_UINT16, cfg.gyroFilter.notchCutoffHz,       0,      500,    0) \
+    P(dynNotchEnable,           VAR_UINT8,  cfg.dynNotchEnable,                 0,      1,      0) \
+    P(dynNotchMinHz,            VAR_UINT16, cfg.dynNotchMinHz,                  20,     480,    80) \
+    P(dynNotchMaxHz,            VAR_UINT16, cfg.dynNotchMaxHz,                  20,     480,    400) \
+    P(dynNotchCutoffPercent,    VAR_UINT8,  cfg.dynNotchCutoffPercent,          50,     95,     75) \
+    P(dtermLpfType,             VAR_UINT8,  cfg.dtermFilter.lpfType,            0,      2,      FILTER_PT1) \
+    P(dtermLpfHz,               VAR_UINT16, cfg.dtermFilter.lpfHz,              0,      500,    20) \
+    P(dtermNotchHz,             VAR_UINT16, cfg.dtermFilter.notchHz,            0,      500,    0) \
+    P(dtermNotchCutoff,         VAR_UINT16, cfg.dtermFilter.notchCutoffHz,      0,      500,    0) \
+    P(batScale,                 VAR_FLOAT,  cfg.batScale,                       0,      50,     11.0f) \
+    P(batMinCellVoltage,        VAR_FLOAT,  cfg.batMinCellVoltage,              0,      5,      3.3f) \
+    P(batMaxCellVoltage,        VAR_FLOAT,  cfg.batMaxCellVoltage,              0,      5,      4.2f) \
+    P(startupDelay,             VAR_UINT16, cfg.startupDelay,                   0,      6000,   1000) \
+    P(commandRate,              VAR_UINT8,  profile.commandRate,                0,      250,    90) \
+    P(commandExpo,              VAR_UINT8,  profile.commandExpo,                0,      100,    65) \
+    P(rollPitchRate,            VAR_UINT8,  profile.rollPitchRate,              0,      100,    0) \
+    P(yawRate,                  VAR_UINT8,  profile.yawRate,                    0,      100,    0) \
+    P(throttleMid,              VAR_UINT8,  cfg.throttleMid,                    0,      100,    50) \
+    P(throttleExpo,             VAR_UINT8,  cfg.throttleExpo,                   0,      100,    0) \
+    P(pidProfileAux,            VAR_UINT8,  cfg.pidProfileAux,                  0,      4,      0) \
+    P(blackboxDivider,          VAR_UINT8,  cfg.blackboxDivider,                0,      250,    8) \
+    P(crashlogTriggers,         VAR_UINT8,  cfg.crashlogTriggers,               0,      15,     14) \
+
+typedef enum {
+    VAR_UINT8,
+    VAR_INT8,
+    VAR_UINT16,
+    VAR_INT16,
+    VAR_UINT32,
+    VAR_FLOAT
+} vartype_e;
+
+#define PARAM_ID(name, type, field, min, max, def) PARAM_##name,
+
+typedef enum {
+    PARAM_TABLE(PARAM_ID)
+    PARAM_COUNT
+} paramId_e;
+
+#undef PARAM_ID
+
+typedef struct {
+    const char *name;
+    uint8_t type;   // vartype_e
+    void *ptr;
+    int32_t min;
+    int32_t max;
+    float def;
+} param_t;
+
+extern const param_t paramTable[PARAM_COUNT];
+
+// Functions
+
+const param_t *paramFind(const char *name, uint8_t len);
+
+int32_t paramGetInt(const param_t *param);
+
+float paramGetFloat(const param_t *param);
+
+uint32_t paramGetRaw(const param_t *param);
+
+bool paramSetRaw(const param_t *param, uint32_t raw);
+
+bool paramSetInt(const param_t *param, int32_t value);
+
+bool paramSetFloat(const param_t *param, float value);
+
+void paramResetDefaults(void);
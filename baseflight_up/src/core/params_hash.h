@@ -0,0 +1,22 @@
+// Generated by support/params_hash.py from core/params.h, do not edit
+
+#pragma once
+
+#define PARAM_HASH_COUNT    111
+#define PARAM_HASH_BUCKETS  28
+
+static const uint16_t paramHashSeed[PARAM_HASH_BUCKETS] = {
+    44, 1, 8, 175, 24, 9, 3, 19, 4, 148, 2, 2,
+    210, 149, 6, 17, 23, 225, 13, 108, 172, 36, 4, 202,
+    19, 34, 65, 215,
+};
+
+static const uint8_t paramHashSlot[PARAM_HASH_COUNT] = {
+    60, 61, 83, 109, 70, 36, 73, 11, 66, 48, 30, 44, 59, 51, 32, 86,
+    96, 12, 104, 78, 8, 92, 100, 37, 103, 39, 65, 98, 38, 24, 102, 6,
+    42, 0, 43, 79, 62, 35, 33, 45, 18, 14, 31, 77, 72, 88, 13, 93,
+    4, 54, 64, 57, 56, 5, 16, 110, 52, 26, 40, 94, 106, 101, 25, 107,
+    34, 7, 20, 15, 81, 28, 55, 22, 29, 76, 3, 82, 9, 17, 75, 80,
+    67, 63, 21, 89, 99, 58, 41, 27, 85, 10, 105, 74, 47, 23, 46, 95,
+    90, 84, 87, 97, 71, 49, 19, 68, 50, 1, 2, 69, 108, 53, 91,
+};
@@ -0,0 +1,57 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#include "board.h"
+
+#define PERF_ENTRY(name, kind) { #name, kind },
+
+const perfInfo_t perfInfo[PERF_COUNT] = {
+    PERF_TABLE(PERF_ENTRY)
+};
+
+#undef PERF_ENTRY
+
+volatile uint32_t perfCounters[PERF_COUNT];
+
+static uint32_t lastReadAll;
+
+// Hands out a counter and clears it with interrupts off, a bump from an
+// interrupt between the two would be lost otherwise
+uint32_t perfRead(uint8_t id)
+{
+    uint32_t value;
+
+    __disable_irq();
+    value = perfCounters[id];
+    perfCounters[id] = 0;
+    __enable_irq();
+
+    return value;
+}
+
+// Reads and clears every counter into values[PERF_COUNT], returns the ms
+// they were gathered over
+uint32_t perfReadAll(uint32_t *values)
+{
+    uint32_t now = millis();
+    uint32_t elapsed = now - lastReadAll;
+    uint8_t i;
+
+    for (i = 0; i < PERF_COUNT; i++)
+        values[i] = perfRead(i);
+
+    lastReadAll = now;
+    return elapsed;
+}
@@ -0,0 +1,112 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+// Performance counters. Each driver bumps its own entries of one table of
+// 32 bit words, a bump is one exclusive load/store pair on a fixed address so
+// it is cheap enough for interrupt handlers and loses nothing when interrupt
+// and main context share a counter. Reading a counter clears it, so every
+// read covers the time since the one before, for the CLI and MSP_PERF alike.
+//
+// An entry's position is its index in MSP_PERF, so new entries go on the end.
+//
+//  C(name, kind)
+//
+//  PERF_EVENTS  number of events
+//  PERF_PEAK    largest value seen
+
+#define PERF_TABLE(C) \
+    C(i2cTransfers,         PERF_EVENTS) \
+    C(i2cErrors,            PERF_EVENTS)    /* bus error, arbitration lost or no ack */ \
+    C(i2cTimeouts,          PERF_EVENTS) \
+    C(i2cRecoveries,        PERF_EVENTS)    /* peripheral reset and bus clocked out */ \
+    C(uartRxRead,           PERF_EVENTS)    /* bytes taken by uartRead() */ \
+    C(uartTxBytes,          PERF_EVENTS) \
+    C(uartRxOverruns,       PERF_EVENTS)    /* bytes lost before the DMA took them */ \
+    C(uartTxOverflows,      PERF_EVENTS)    /* bytes and frames dropped for want of room */ \
+    C(uart2RxBytes,         PERF_EVENTS) \
+    C(uart2RxOverruns,      PERF_EVENTS) \
+    C(uart2TxOverflows,     PERF_EVENTS) \
+    C(rcFrames,             PERF_EVENTS) \
+    C(rcGlitches,           PERF_EVENTS)    /* pulse out of range or short PPM frame */ \
+    C(schedOverruns,        PERF_EVENTS)    /* periodic event a whole period late */ \
+    C(schedLatePeak,        PERF_PEAK)      /* us */ \
+    C(flashWrites,          PERF_EVENTS) \
+    C(flashErases,          PERF_EVENTS)    /* pages */ \
+    C(flashErrors,          PERF_EVENTS) \
+    C(isrI2c,               PERF_EVENTS) \
+    C(isrUart,              PERF_EVENTS) \
+    C(isrUart2,             PERF_EVENTS) \
+    C(isrRcInput,           PERF_EVENTS) \
+    C(isrExti,              PERF_EVENTS)
+
+typedef enum {
+    PERF_EVENTS = 0,
+    PERF_PEAK,
+} perfKind_e;
+
+#define PERF_ID(name, kind) PERF_##name,
+
+typedef enum {
+    PERF_TABLE(PERF_ID)
+    PERF_COUNT
+} perfId_e;
+
+#undef PERF_ID
+
+typedef struct {
+    const char *name;
+    uint8_t kind;   // perfKind_e
+} perfInfo_t;
+
+extern const perfInfo_t perfInfo[PERF_COUNT];
+extern volatile uint32_t perfCounters[PERF_COUNT];
+
+// An interrupt between the exclusive load and store clears the monitor on
+// return, the store fails and the update is retried with the new value
+static inline void perfAddId(uint8_t id, uint32_t n)
+{
+    uint32_t value, failed;
+
+    do {
+        __ASM volatile ("ldrex %0, [%1]" : "=r" (value) : "r" (&perfCounters[id]));
+        __ASM volatile ("strex %0, %2, [%1]" : "=&r" (failed) : "r" (&perfCounters[id]), "r" (value + n) : "memory");
+    } while (failed);
+}
+
+static inline void perfPeakId(uint8_t id, uint32_t value)
+{
+    uint32_t peak, failed;
+
+    do {
+        __ASM volatile ("ldrex %0, [%1]" : "=r" (peak) : "r" (&perfCounters[id]));
+        if (value <= peak) {
+            __ASM volatile ("clrex" ::: "memory");
+            return;
+        }
+        __ASM volatile ("strex %0, %2, [%1]" : "=&r" (failed) : "r" (&perfCounters[id]), "r" (value) : "memory");
+    } while (failed);
+}
+
+#define perfCount(name)         perfAddId(PERF_##name, 1)
+#define perfAdd(name, n)        perfAddId(PERF_##name, (n))
+#define perfPeak(name, value)   perfPeakId(PERF_##name, (value))
+
+// Functions
+
+uint32_t perfRead(uint8_t id);
+
+uint32_t perfReadAll(uint32_t *values);
@@ -6,11 +6,21 @@
 
 #include "actuator/mixer.h"
 
+#include "core/blackbox.h"
 #include "core/cli.h"
+#include "core/crashlog.h"
+#include "core/latency.h"
 #include "core/printf_min.h"
+#include "core/params.h"
+#include "core/serial.h"
+#include "core/stack.h"
+#include "core/telemetry.h"
 
+#include "drivers/crc.h"
 #include "drivers/i2c.h"
 
+#include "sensors/dyn_notch.h"
+
 // Multiwii Serial Protocol 0 
 #define VERSION                  210
 #define MSP_VERSION              0
@@ -35,6 +45,20 @@
 #define MSP_BOXNAMES             116    //out message         the aux switch names
 #define MSP_PIDNAMES             117    //out message         the PID names
 #define MSP_WP                   118    //out message         get a WP, WP# is in the payload, returns (WP#, lat, lon, alt, flags) WP#0-home, WP#16-poshold
+#define MSP_GYRO_SPECTRUM        119    //out message         dynamic notch FFT: axis, sample rate, bins, 3 notch centres, magnitudes
+//      MSP_STREAM               120    //pushed message      telemetry stream frame, see core/telemetry.h
+#define MSP_STREAMS              121    //out message         budget load, then requested divider, divider in use and drops per stream
+#define MSP_PARAM_INFO           122    //out message         param ID in, returns ID, type, min, max, default and name
+#define MSP_PARAM_GET            123    //out message         first ID and count in, returns first ID, count and 32 bit values
+#define MSP_BLACKBOX_INFO        124    //out message         state, log size and used bytes, frames, drops, last and max cycles per frame
+#define MSP_BLACKBOX_READ        125    //out message         offset (u32) and length in, returns offset, log bytes and their crc32
+#define MSP_CRASHLOG_INFO        126    //out message         state, trigger, trigger time, frames held, capacity, frame size, motors
+#define MSP_CRASHLOG_READ        127    //out message         first frame and count in, oldest first, returns first, count, frames and a crc32 of them, each zero padded to words
+#define MSP_PERF                 128    //out message         ms since the last read, count, then every core/perf.h counter (u32), cleared by the read
+#define MSP_TRACE_INFO           129    //out message         mode, entries held, capacity, cycles per marker, core MHz
+#define MSP_TRACE_READ           130    //out message         first entry and count in, oldest first, returns first, count, entries and their crc32
+#define MSP_LATENCY              131    //out message         count, min, mean, max in us for gyro then RC to motor output, cleared by the read
+#define MSP_STACK                132    //out message         stack size and never used bytes, data, bss and noinit bytes, last fault kind and its faultRecord_t
 
 #define MSP_SET_RAW_RC           200    //in message          8 rc chan
 #define MSP_SET_RAW_GPS          201    //in message          fix, numsat, lat, lon, alt, speed
@@ -46,12 +70,21 @@
 #define MSP_SET_MISC             207    //in message          powermeter trig + 8 free for future use
 #define MSP_RESET_CONF           208    //in message          no param
 #define MSP_WP_SET               209    //in message          sets a given WP (WP#,lat, lon, alt, flags)
+#define MSP_SELECT_SETTING       210    //in message          select PID profile (0-2), swapped in at the next loop
+#define MSP_SET_STREAMS          220    //in message          one rate divider per telemetry stream, 0 is off
+#define MSP_PARAM_SET            221    //in message          first ID, count and 32 bit values, returns how many were applied
+#define MSP_BLACKBOX_ERASE       222    //in message          no param, erases the log in the background while disarmed
+#define MSP_CRASHLOG_CONTROL     223    //in message          0 freezes the crash recorder, 1 clears it and records again
+#define MSP_TRACE_CONTROL        224    //in message          0 stops the event trace, 1 records until stopped, 2 records until full
+
+#define MSP_MULTIPLE             230    //in/out message      list of out message IDs, replies (cmd, size, payload) for each
 
 #define MSP_EEPROM_WRITE         250    //in message          no param
 
 #define MSP_DEBUG                254    //out message         debug1,debug2,debug3,debug4
 
-#define INBUF_SIZE 64
+#define INBUF_SIZE 64   // largest accepted request payload
+#define MSP_MULTIPLE_MAX 192    // largest MSP_MULTIPLE reply payload, leaves TX room for telemetry
 
 uint16_t debug[4];
 
@@ -80,47 +113,57 @@ static const char pidnames[] =
     "MAG;"
     "VEL;";
 
-static uint8_t checksum, indRX, inBuf[INBUF_SIZE];
+// Request payloads are read straight out of the UART RX ring
+static uint8_t checksum, indRX;
+static uint16_t payloadStart;
 static uint8_t cmdMSP;
 static bool guiConnected = false;
 
-void serialize32(uint32_t a)
+// Replies are built in place in the UART TX ring. The whole frame is claimed
+// by the header and only handed to the DMA by the tail, so a reply that does
+// not fit, or whose payload does not match its header, is never sent.
+#define MSP_FRAME_OVERHEAD  6   // '$' 'M' '>' size cmd ... checksum
+
+static enum {
+    REPLY_IDLE,
+    REPLY_BUILDING,
+    REPLY_NO_SPACE,
+    REPLY_BAD_SIZE,
+} replyState = REPLY_IDLE;
+static uint16_t replyRemaining;
+
+mspTxStats_t mspTxStats;
+
+void serialize8(uint8_t a)
 {
-    static uint8_t t;
-    t = a;
-    uartWrite(t);
-    checksum ^= t;
-    t = a >> 8;
-    uartWrite(t);
-    checksum ^= t;
-    t = a >> 16;
-    uartWrite(t);
-    checksum ^= t;
-    t = a >> 24;
-    uartWrite(t);
-    checksum ^= t;
+    if (replyState != REPLY_BUILDING)
+        return;
+    if (!replyRemaining) {
+        replyState = REPLY_BAD_SIZE;    // more payload than the header promised
+        return;
+    }
+    uartFramePut(a);
+    checksum ^= a;
+    replyRemaining--;
 }
 
 void serialize16(int16_t a)
 {
-    static uint8_t t;
-    t = a;
-    uartWrite(t);
-    checksum ^= t;
-    t = a >> 8 & 0xff;
-    uartWrite(t);
-    checksum ^= t;
+    serialize8(a);
+    serialize8(a >> 8);
 }
 
-void serialize8(uint8_t a)
+void serialize32(uint32_t a)
 {
-    uartWrite(a);
-    checksum ^= a;
+    serialize8(a);
+    serialize8(a >> 8);
+    serialize8(a >> 16);
+    serialize8(a >> 24);
 }
 
 uint8_t read8(void)
 {
-    return inBuf[indRX++] & 0xff;
+    return uartRxAt(payloadStart + indRX++);
 }
 
 uint16_t read16(void)
@@ -139,6 +182,14 @@ uint32_t read32(void)
 
 void headSerialResponse(uint8_t err, uint8_t s)
 {
+    replyRemaining = s + MSP_FRAME_OVERHEAD;
+    if (!uartFrameBegin(replyRemaining)) {
+        replyState = REPLY_NO_SPACE;
+        mspTxStats.droppedNoSpace++;
+        return;
+    }
+    replyState = REPLY_BUILDING;
+    
     serialize8('$');
     serialize8('M');
     serialize8(err ? '!' : '>');
@@ -159,7 +210,20 @@ void headSerialError(uint8_t s)
 
 void tailSerialReply(void)
 {
-    serialize8(checksum);
+    if (replyState == REPLY_BUILDING) {
+        serialize8(checksum);
+        if (replyRemaining)
+            replyState = REPLY_BAD_SIZE;    // less payload than the header promised
+    }
+    
+    if (replyState == REPLY_BUILDING) {
+        uartFrameCommit();
+        mspTxStats.framesSent++;
+    } else if (replyState == REPLY_BAD_SIZE) {
+        mspTxStats.droppedBadSize++;
+    }
+    
+    replyState = REPLY_IDLE;
 }
 
 void serializeNames(const char *s)
@@ -174,11 +238,513 @@ void serialInit(uint32_t baudrate)
     uartInit(baudrate);
 }
 
-static void evaluateCommand(void)
+// Out messages. Each serializer writes exactly size bytes of payload and
+// needs no request payload, so it can run on its own or inside MSP_MULTIPLE.
+
+static void mspIdent(void)
+{
+    serialize8(VERSION);                // multiwii version
+    serialize8(cfg.mixerConfiguration); // type of multicopter
+    serialize8(MSP_VERSION);            // MultiWii Serial Protocol Version
+    serialize32(PLATFORM_32BIT);        // "capability"
+}
+
+static void mspStatus(void)
+{
+    serialize16(cycleTime);
+    serialize16(i2cGetErrorCounter());
+    serialize16(sensorsGet(SENSOR_ACC) | sensorsGet(SENSOR_BARO) << 1 | sensorsGet(SENSOR_MAG) << 2 | sensorsGet(SENSOR_GPS) << 3 | sensorsGet(SENSOR_SONAR) << 4);
+    serialize32(mode.LEVEL_MODE << OPT_LEVEL | mode.ALTITUDE_MODE << OPT_ALTITUDE | mode.HEADING_MODE << OPT_HEADING | mode.ARMED << OPT_ARM | auxOptions[OPT_CAMSTAB] << OPT_CAMSTAB | auxOptions[OPT_CAMTRIG] << OPT_CAMTRIG | 
+                mode.GPS_HOME_MODE << OPT_GPSHOME | mode.GPS_HOLD_MODE << OPT_GPSHOLD | mode.HEADFREE_MODE << OPT_HEADFREE | mode.PASSTHRU_MODE << OPT_PASSTHRU | 
+                auxOptions[OPT_HEADFREE_REF] << OPT_HEADFREE_REF);
+    serialize8(cfg.pidProfileIndex);
+}
+
+static void mspRawImu(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < 3; i++)
+        serialize16(stateData.accel[i] * 10.0f);
+    for (i = 0; i < 3; i++)
+        serialize16(stateData.gyro[i] * 100.0f);
+    for (i = 0; i < 3; i++)
+        serialize16(stateData.mag[i]);
+}
+
+static void mspServo(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < 8; i++)
+        serialize16(servo[i]);
+}
+
+static void mspMotor(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < 8; i++)
+        serialize16(motor[i]);
+}
+
+static void mspRc(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < 8; i++)
+        serialize16(rcData[i]);
+}
+
+static void mspEmpty(void)
+{
+    /* MSP_RAW_GPS, 14 bytes
+    serialize8(f.GPS_FIX);
+    serialize8(GPS_numSat);
+    serialize32(GPS_coord[LAT]);
+    serialize32(GPS_coord[LON]);
+    serialize16(GPS_altitude);
+    serialize16(GPS_speed);
+
+    MSP_COMP_GPS, 5 bytes
+    serialize16(GPS_distanceToHome);
+    serialize16(GPS_directionToHome);
+    serialize8(GPS_update & 1); */
+}
+
+static void mspAttitude(void)
+{
+    updateEulerAngles();
+    serialize16(stateData.roll * RAD2DEG * 10);
+    serialize16(stateData.pitch * RAD2DEG * 10);
+    serialize16(stateData.heading * RAD2DEG);
+    serialize16(headfreeReference);
+}
+
+static void mspAltitude(void)
+{
+    serialize32(stateData.altitude);
+}
+
+static void mspBat(void)
+{
+    serialize8(sensorData.batteryVoltage * 10);
+    serialize16(0); // power meter trash
+}
+
+static void mspRcTuning(void)
+{
+    serialize8(profile.commandRate);
+    serialize8(profile.commandExpo);
+    serialize8(profile.rollPitchRate);
+    serialize8(profile.yawRate);
+    serialize8(0);//serialize8(cfg.dynThrPID);
+    serialize8(cfg.throttleMid);
+    serialize8(cfg.throttleExpo);
+}
+
+static void mspPid(void)
+{
+    uint8_t i;
+
+    for(i = 0; i < 3; ++i) {
+        serialize8(pids[i].p);
+        serialize8(pids[i].i);
+        serialize8(pids[i].d);
+    }
+    
+    serialize8(pids[ALTITUDE_PID].p);
+    serialize8(pids[ALTITUDE_PID].i);
+    serialize8(pids[ALTITUDE_PID].d);
+    
+    // POS, POSR, NAVR
+    for(i = 0; i < 3; ++i) {
+        serialize8(0);
+        serialize8(0);
+        serialize8(0);
+    }
+    serialize8(pids[ROLL_LEVEL_PID].p);
+    serialize8(pids[ROLL_LEVEL_PID].i);
+    serialize8(pids[ROLL_LEVEL_PID].d);
+    
+    serialize8(pids[HEADING_PID].p);
+    serialize8(pids[HEADING_PID].i);
+    serialize8(pids[HEADING_PID].d);
+    
+    // Velocity
+    serialize8(0);
+    serialize8(0);
+    serialize8(0);
+}
+
+static void mspBox(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < AUX_OPTIONS; i++)
+        serialize16(cfg.auxActivate[i]);
+}
+
+static void mspBoxNames(void)
+{
+    serializeNames(boxnames);
+}
+
+static void mspPidNames(void)
+{
+    serializeNames(pidnames);
+}
+
+static void mspMisc(void)
+{
+    serialize16(0); // intPowerTrigger1
+}
+
+static void mspMotorPins(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < 8; i++)
+        serialize8(i + 1);
+}
+
+static void mspGyroSpectrum(void)
+{
+    uint8_t i, axis;
+    const uint16_t *spectrum = dynNotchSpectrum(&axis);
+
+    serialize8(axis);
+    serialize16(FFT_SAMPLE_HZ);
+    serialize8(FFT_BINS);
+    for (i = 0; i < 3; i++)
+        serialize16(dynNotchCentre(i));
+    for (i = 0; i < FFT_BINS; i++)
+        serialize16(spectrum[i]);
+}
+
+static void mspStreams(void)
+{
+    uint8_t i;
+
+    serialize16(telemetryLoad());
+    serialize8(STREAM_COUNT);
+    for (i = 0; i < STREAM_COUNT; i++) {
+        serialize8(telemetryStreams[i].requested);
+        serialize16(telemetryStreams[i].divider);
+        serialize32(telemetryStreams[i].dropped);
+    }
+}
+
+static void mspBlackboxInfo(void)
+{
+    serialize8(blackboxState());
+    serialize32(blackboxSize());
+    serialize32(blackboxUsed());
+    serialize32(blackboxStats.frames);
+    serialize32(blackboxStats.dropped);
+    serialize16(blackboxStats.cycles);
+    serialize16(blackboxStats.maxCycles);
+}
+
+static void mspCrashlogInfo(void)
+{
+    serialize8(crashlogState());
+    serialize8(crashlogTrigger());
+    serialize32(crashlogTriggerTime());
+    serialize16(crashlogFrames());
+    serialize16(CRASHLOG_FRAMES);
+    serialize8(sizeof(crashFrame_t));
+    serialize8(CRASHLOG_MOTORS);
+}
+
+static void mspPerf(void)
+{
+    uint32_t values[PERF_COUNT];
+    uint8_t i;
+
+    serialize32(perfReadAll(values));
+    serialize8(PERF_COUNT);
+    for (i = 0; i < PERF_COUNT; i++)
+        serialize32(values[i]);
+}
+
+static void mspTraceInfo(void)
 {
+    serialize8(traceMode);
+    serialize16(traceEntries());
+    serialize16(TRACE_ON ? TRACE_ENTRIES : 0);
+    serialize8(traceOverhead());
+    serialize8(SystemCoreClock / 1000000);
+}
+
+static void mspLatency(void)
+{
+    latencyStats_t stats[LATENCY_PATHS];
+    uint8_t i;
+
+    latencyReadAll(stats);
+    for (i = 0; i < LATENCY_PATHS; i++) {
+        serialize16(min(stats[i].count, 0xFFFF));
+        serialize16(min(stats[i].min, 0xFFFF));
+        serialize16(stats[i].count ? min(stats[i].sum / stats[i].count, 0xFFFF) : 0);
+        serialize16(min(stats[i].max, 0xFFFF));
+    }
+}
+
+static void mspStack(void)
+{
+    const uint8_t *record = (const uint8_t *)faultRecord();
+    uint32_t data, bss, noinit;
+    uint8_t i;
+
+    ramUsage(&data, &bss, &noinit);
+    serialize16(stackSize());
+    serialize16(stackFree());
+    serialize16(data);
+    serialize16(bss);
+    serialize16(noinit);
+    serialize8(faultKind());
+    for (i = 0; i < sizeof(faultRecord_t); i++)
+        serialize8(record[i]);
+}
+
+static void mspDebug(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < 4; i++)
+        serialize16(debug[i]);      // 4 variables are here for general monitoring purpose
+}
+
+typedef struct {
+    uint8_t cmd;
+    uint8_t size;
+    void (*serialize)(void);
+} mspOutMessage_t;
+
+static const mspOutMessage_t mspOutMessages[] = {
+    { MSP_IDENT,            7,                      mspIdent },
+    { MSP_STATUS,           11,                     mspStatus },
+    { MSP_RAW_IMU,          18,                     mspRawImu },
+    { MSP_SERVO,            16,                     mspServo },
+    { MSP_MOTOR,            16,                     mspMotor },
+    { MSP_RC,               16,                     mspRc },
+    { MSP_RAW_GPS,          0,                      mspEmpty },
+    { MSP_COMP_GPS,         0,                      mspEmpty },
+    { MSP_ATTITUDE,         8,                      mspAttitude },
+    { MSP_ALTITUDE,         4,                      mspAltitude },
+    { MSP_BAT,              3,                      mspBat },
+    { MSP_RC_TUNING,        7,                      mspRcTuning },
+    { MSP_PID,              30,                     mspPid },
+    { MSP_BOX,              2 * AUX_OPTIONS,        mspBox },
+    { MSP_MISC,             2,                      mspMisc },
+    { MSP_MOTOR_PINS,       8,                      mspMotorPins },
+    { MSP_BOXNAMES,         sizeof(boxnames) - 1,   mspBoxNames },
+    { MSP_PIDNAMES,         sizeof(pidnames) - 1,   mspPidNames },
+    { MSP_GYRO_SPECTRUM,    10 + FFT_BINS * 2,      mspGyroSpectrum },
+    { MSP_STREAMS,          3 + STREAM_COUNT * 7,   mspStreams },
+    { MSP_BLACKBOX_INFO,    21,                     mspBlackboxInfo },
+    { MSP_CRASHLOG_INFO,    12,                     mspCrashlogInfo },
+    { MSP_PERF,             5 + PERF_COUNT * 4,     mspPerf },
+    { MSP_TRACE_INFO,       7,                      mspTraceInfo },
+    { MSP_LATENCY,          LATENCY_PATHS * 8,      mspLatency },
+    { MSP_STACK,            11 + sizeof(faultRecord_t), mspStack },
+    { MSP_DEBUG,            8,                      mspDebug },
+};
+
+#define MSP_OUT_MESSAGES    (sizeof(mspOutMessages) / sizeof(mspOutMessages[0]))
+
+static const mspOutMessage_t *findOutMessage(uint8_t cmd)
+{
+    uint8_t i;
+
+    for (i = 0; i < MSP_OUT_MESSAGES; i++)
+        if (mspOutMessages[i].cmd == cmd)
+            return &mspOutMessages[i];
+
+    return NULL;
+}
+
+// MSP_MULTIPLE: the request is a list of out message IDs, the reply is
+// (cmd, size, payload) for each in order. Unknown IDs are skipped and the
+// list is cut short rather than exceed MSP_MULTIPLE_MAX payload bytes, the
+// host can tell from the cmd bytes what it got.
+static void mspMultiple(uint8_t count)
+{
+    const mspOutMessage_t *msg[INBUF_SIZE];
+    uint8_t i, n = 0;
+    uint16_t size = 0;
+
+    for (i = 0; i < count; i++) {
+        const mspOutMessage_t *m = findOutMessage(read8());
+        if (!m)
+            continue;
+        if (size + 2 + m->size > MSP_MULTIPLE_MAX)
+            break;
+        size += 2 + m->size;
+        msg[n++] = m;
+    }
+
+    headSerialReply(size);
+    for (i = 0; i < n; i++) {
+        serialize8(msg[i]->cmd);
+        serialize8(msg[i]->size);
+        msg[i]->serialize();
+    }
+}
+
+// Parameter registry access by ID, see core/params.h. Values are 32 bits:
+// integers sign extended, floats as IEEE bits.
+#define MSP_PARAM_GET_MAX   ((MSP_MULTIPLE_MAX - 3) / 4)
+
+static void mspParamInfo(void)
+{
+    uint16_t id = read16();
+    const param_t *param;
+
+    if (id >= PARAM_COUNT) {
+        headSerialError(0);
+        return;
+    }
+
+    param = &paramTable[id];
+    headSerialReply(15 + strlen(param->name));
+    serialize16(id);
+    serialize8(param->type);
+    serialize32(param->min);
+    serialize32(param->max);
+    if (param->type == VAR_FLOAT) {
+        uint32_t raw;
+        memcpy(&raw, &param->def, sizeof(raw));
+        serialize32(raw);
+    } else {
+        serialize32((int32_t)param->def);
+    }
+    serializeNames(param->name);
+}
+
+static void mspParamGet(void)
+{
+    uint16_t first = read16();
+    uint8_t i, count = read8();
+
+    if (first > PARAM_COUNT)
+        first = PARAM_COUNT;
+    count = min(count, min(PARAM_COUNT - first, MSP_PARAM_GET_MAX));
+
+    headSerialReply(3 + count * 4);
+    serialize16(first);
+    serialize8(count);
+    for (i = 0; i < count; i++)
+        serialize32(paramGetRaw(&paramTable[first + i]));
+}
+
+#define MSP_BLACKBOX_READ_MAX   128
+
+// The crc32 lets the host retry a chunk the XOR checksum let through
+static void mspBlackboxRead(void)
+{
+    uint32_t offset = read32();
+    uint8_t i, len = read8();
+    const uint8_t *data;
+
+    // min() evaluates its arguments twice, read8() must only run once
+    len = blackboxRead(offset, min(len, MSP_BLACKBOX_READ_MAX), &data);
+
+    headSerialReply(8 + len);
+    serialize32(offset);
+    for (i = 0; i < len; i++)
+        serialize8(data[i]);
+    serialize32(len ? crc32(data, len) : 0);
+}
+
+#define MSP_CRASHLOG_READ_MAX   ((MSP_MULTIPLE_MAX - 7) / sizeof(crashFrame_t))
+
+static void mspCrashlogRead(void)
+{
+    uint16_t first = read16();
+    uint8_t i, count = read8();
+    const uint8_t *frame;
+    uint8_t j;
+
+    if (first > crashlogFrames())
+        first = crashlogFrames();
+    count = min(count, min(crashlogFrames() - first, MSP_CRASHLOG_READ_MAX));
+
+    headSerialReply(7 + count * sizeof(crashFrame_t));
+    serialize16(first);
+    serialize8(count);
+    crcReset();
+    for (i = 0; i < count; i++) {
+        frame = (const uint8_t *)crashlogFrame(first + i);
+        crcBytes(frame, sizeof(crashFrame_t));
+        for (j = 0; j < sizeof(crashFrame_t); j++)
+            serialize8(frame[j]);
+    }
+    serialize32(crcValue());
+}
+
+#define MSP_TRACE_READ_MAX      ((MSP_MULTIPLE_MAX - 7) / sizeof(traceEntry_t))
+
+static void mspTraceRead(void)
+{
+    uint16_t first = read16();
+    uint8_t i, count = read8();
+    const uint8_t *entry;
+    uint8_t j;
+
+    if (first > traceEntries())
+        first = traceEntries();
+    count = min(count, min(traceEntries() - first, MSP_TRACE_READ_MAX));
+
+    headSerialReply(7 + count * sizeof(traceEntry_t));
+    serialize16(first);
+    serialize8(count);
+    crcReset();
+    for (i = 0; i < count; i++) {
+        entry = (const uint8_t *)traceEntry(first + i);
+        crcBytes(entry, sizeof(traceEntry_t));
+        for (j = 0; j < sizeof(traceEntry_t); j++)
+            serialize8(entry[j]);
+    }
+    serialize32(crcValue());
+}
+
+// Applies values in order and stops at the first unknown ID or out of range
+// value, the reply says how many were taken
+static void mspParamSet(uint8_t dataSize)
+{
+    uint16_t first = read16();
+    uint8_t applied = 0, count = read8();
+
+    count = min(count, (dataSize - 3) / 4);
+    while (applied < count && first + applied < PARAM_COUNT) {
+        if (!paramSetRaw(&paramTable[first + applied], read32()))
+            break;
+        applied++;
+    }
+
+    // New gains without dropping the integrators, a GCS may write in flight
+    if (applied)
+        loadPIDGains();
+
+    headSerialReply(1);
+    serialize8(applied);
+}
+
+static void evaluateCommand(uint8_t dataSize)
+{
+    const mspOutMessage_t *out = findOutMessage(cmdMSP);
     uint32_t i;
     uint8_t wp_no;
 
+    if (out) {
+        headSerialReply(out->size);
+        out->serialize();
+        tailSerialReply();
+        return;
+    }
+
     switch (cmdMSP) {
     case MSP_SET_RAW_RC:
         for (i = 0; i < 8; i++)
@@ -204,14 +770,14 @@ static void evaluateCommand(void)
         break;
     case MSP_SET_PID:
         for(i = 0; i < 3; ++i) {
-            cfg.pids[i].p = read8();
-            cfg.pids[i].i = read8();
-            cfg.pids[i].d = read8();
+            profile.pids[i].p = read8();
+            profile.pids[i].i = read8();
+            profile.pids[i].d = read8();
         }
         
-        cfg.pids[ALTITUDE_PID].p = read8();
-        cfg.pids[ALTITUDE_PID].i = read8();
-        cfg.pids[ALTITUDE_PID].d = read8();
+        profile.pids[ALTITUDE_PID].p = read8();
+        profile.pids[ALTITUDE_PID].i = read8();
+        profile.pids[ALTITUDE_PID].d = read8();
         
         // POS, POSR, NAVR
         for(i = 0; i < 3; ++i) {
@@ -219,22 +785,22 @@ static void evaluateCommand(void)
             read8();
             read8();
         }
-        cfg.pids[ROLL_LEVEL_PID].p = read8();
-        cfg.pids[ROLL_LEVEL_PID].i = read8();
-        cfg.pids[ROLL_LEVEL_PID].d = read8();
-        cfg.pids[PITCH_LEVEL_PID].p = cfg.pids[ROLL_LEVEL_PID].p;
-        cfg.pids[PITCH_LEVEL_PID].i = cfg.pids[ROLL_LEVEL_PID].i;
-        cfg.pids[PITCH_LEVEL_PID].d = cfg.pids[ROLL_LEVEL_PID].d;
+        profile.pids[ROLL_LEVEL_PID].p = read8();
+        profile.pids[ROLL_LEVEL_PID].i = read8();
+        profile.pids[ROLL_LEVEL_PID].d = read8();
+        profile.pids[PITCH_LEVEL_PID].p = profile.pids[ROLL_LEVEL_PID].p;
+        profile.pids[PITCH_LEVEL_PID].i = profile.pids[ROLL_LEVEL_PID].i;
+        profile.pids[PITCH_LEVEL_PID].d = profile.pids[ROLL_LEVEL_PID].d;
     
-        cfg.pids[HEADING_PID].p = read8();
-        cfg.pids[HEADING_PID].i = read8();
-        cfg.pids[HEADING_PID].d = read8();
+        profile.pids[HEADING_PID].p = read8();
+        profile.pids[HEADING_PID].i = read8();
+        profile.pids[HEADING_PID].d = read8();
     
         // Velocity
         for(i = 0; i < 3; ++i)
             read8();
             
-        initPIDs();
+        loadPIDGains();
         headSerialReply(0);
         break;
     case MSP_SET_BOX:
@@ -243,10 +809,10 @@ static void evaluateCommand(void)
         headSerialReply(0);
         break;
     case MSP_SET_RC_TUNING:        
-        cfg.commandRate = read8();
-        cfg.commandExpo = read8();
-        cfg.rollPitchRate = read8();
-        cfg.yawRate = read8();
+        profile.commandRate = read8();
+        profile.commandExpo = read8();
+        profile.rollPitchRate = read8();
+        profile.yawRate = read8();
         read8();//cfg.dynThrPID = read8();
         cfg.throttleMid = read8();
         cfg.throttleExpo = read8();
@@ -255,142 +821,56 @@ static void evaluateCommand(void)
     case MSP_SET_MISC:
         headSerialReply(0);
         break;
-    case MSP_IDENT:
-        headSerialReply(7);
-        serialize8(VERSION);                // multiwii version
-        serialize8(cfg.mixerConfiguration); // type of multicopter
-        serialize8(MSP_VERSION);            // MultiWii Serial Protocol Version
-        serialize32(PLATFORM_32BIT);        // "capability"
-        break;
-    case MSP_STATUS:
-        headSerialReply(10);
-        serialize16(cycleTime);
-        serialize16(i2cGetErrorCounter());
-        serialize16(sensorsGet(SENSOR_ACC) | sensorsGet(SENSOR_BARO) << 1 | sensorsGet(SENSOR_MAG) << 2 | sensorsGet(SENSOR_GPS) << 3 | sensorsGet(SENSOR_SONAR) << 4);
-        serialize32(mode.LEVEL_MODE << OPT_LEVEL | mode.ALTITUDE_MODE << OPT_ALTITUDE | mode.HEADING_MODE << OPT_HEADING | mode.ARMED << OPT_ARM | auxOptions[OPT_CAMSTAB] << OPT_CAMSTAB | auxOptions[OPT_CAMTRIG] << OPT_CAMTRIG | 
-                    mode.GPS_HOME_MODE << OPT_GPSHOME | mode.GPS_HOLD_MODE << OPT_GPSHOLD | mode.HEADFREE_MODE << OPT_HEADFREE | mode.PASSTHRU_MODE << OPT_PASSTHRU | 
-                    auxOptions[OPT_HEADFREE_REF] << OPT_HEADFREE_REF);
-        break;
-    case MSP_RAW_IMU:
-        headSerialReply(18);
-        for (i = 0; i < 3; i++)
-            serialize16(stateData.accel[i] * 10.0f);
-        for (i = 0; i < 3; i++)
-            serialize16(stateData.gyro[i] * 100.0f);
-        for (i = 0; i < 3; i++)
-            serialize16(stateData.mag[i]);
-        break;
-    case MSP_SERVO:
-        headSerialReply(16);
-        for (i = 0; i < 8; i++)
-            serialize16(servo[i]);
-        break;
-    case MSP_MOTOR:
-        headSerialReply(16);
-        for (i = 0; i < 8; i++)
-            serialize16(motor[i]);
-        break;
-    case MSP_RC:
-        headSerialReply(16);
-        for (i = 0; i < 8; i++)
-            serialize16(rcData[i]);
-        break;
-    case MSP_RAW_GPS:
+    case MSP_SELECT_SETTING:
+        // The switch owns the profile while pidProfileAux is set, as in the cli
+        i = read8();
+        if (i >= PID_PROFILES || cfg.pidProfileAux) {
+            headSerialError(0);
+            break;
+        }
+        selectProfile(i);
         headSerialReply(0);
-        /*headSerialReply(14);
-        serialize8(f.GPS_FIX);
-        serialize8(GPS_numSat);
-        serialize32(GPS_coord[LAT]);
-        serialize32(GPS_coord[LON]);
-        serialize16(GPS_altitude);
-        serialize16(GPS_speed);*/
         break;
-    case MSP_COMP_GPS:
+    case MSP_SET_STREAMS:
+        for (i = 0; i < STREAM_COUNT; i++)
+            telemetrySubscribe(i, read8());
         headSerialReply(0);
-        /*
-        headSerialReply(5);
-        serialize16(GPS_distanceToHome);
-        serialize16(GPS_directionToHome);
-        serialize8(GPS_update & 1); */
         break;
-    case MSP_ATTITUDE:
-        headSerialReply(8);
-        serialize16(stateData.roll * RAD2DEG * 10);
-        serialize16(stateData.pitch * RAD2DEG * 10);
-        serialize16(stateData.heading * RAD2DEG);
-        serialize16(headfreeReference);
+    case MSP_MULTIPLE:
+        mspMultiple(dataSize);
         break;
-    case MSP_ALTITUDE:
-        headSerialReply(4);
-        serialize32(stateData.altitude);
+    case MSP_PARAM_INFO:
+        mspParamInfo();
         break;
-    case MSP_BAT:
-        headSerialReply(3);
-        serialize8(sensorData.batteryVoltage * 10);
-        serialize16(0); // power meter trash
+    case MSP_PARAM_GET:
+        mspParamGet();
         break;
-    case MSP_RC_TUNING:
-        headSerialReply(7);
-        serialize8(cfg.commandRate);
-        serialize8(cfg.commandExpo);
-        serialize8(cfg.rollPitchRate);
-        serialize8(cfg.yawRate);
-        serialize8(0);//serialize8(cfg.dynThrPID);
-        serialize8(cfg.throttleMid);
-        serialize8(cfg.throttleExpo);
+    case MSP_BLACKBOX_READ:
+        mspBlackboxRead();
         break;
-    case MSP_PID:
-        headSerialReply(30);
-        for(i = 0; i < 3; ++i) {
-            serialize8(pids[i].p);
-            serialize8(pids[i].i);
-            serialize8(pids[i].d);
-        }
-        
-        serialize8(pids[ALTITUDE_PID].p);
-        serialize8(pids[ALTITUDE_PID].i);
-        serialize8(pids[ALTITUDE_PID].d);
-        
-        // POS, POSR, NAVR
-        for(i = 0; i < 3; ++i) {
-            serialize8(0);
-            serialize8(0);
-            serialize8(0);
-        }
-        serialize8(pids[ROLL_LEVEL_PID].p);
-        serialize8(pids[ROLL_LEVEL_PID].i);
-        serialize8(pids[ROLL_LEVEL_PID].d);
-        
-        serialize8(pids[HEADING_PID].p);
-        serialize8(pids[HEADING_PID].i);
-        serialize8(pids[HEADING_PID].d);
-        
-        // Velocity
-        serialize8(0);
-        serialize8(0);
-        serialize8(0);
+    case MSP_BLACKBOX_ERASE:
+        blackboxErase();
+        headSerialReply(0);
         break;
-    case MSP_BOX:
-        headSerialReply(2 * AUX_OPTIONS);
-        for (i = 0; i < AUX_OPTIONS; i++)
-            serialize16(cfg.auxActivate[i]);
+    case MSP_CRASHLOG_READ:
+        mspCrashlogRead();
         break;
-    case MSP_BOXNAMES:
-        headSerialReply(sizeof(boxnames) - 1);
-        serializeNames(boxnames);
+    case MSP_CRASHLOG_CONTROL:
+        if (read8())
+            crashlogClear();
+        else
+            crashlogFreeze(CRASH_TRIGGER_MSP);
+        headSerialReply(0);
         break;
-    case MSP_PIDNAMES:
-        headSerialReply(sizeof(pidnames) - 1);
-        serializeNames(pidnames);
+    case MSP_TRACE_READ:
+        mspTraceRead();
         break;
-    case MSP_MISC:
-        headSerialReply(2);
-        serialize16(0); // intPowerTrigger1
+    case MSP_TRACE_CONTROL:
+        traceStart(read8());
+        headSerialReply(0);
         break;
-    case MSP_MOTOR_PINS:
-        headSerialReply(8);
-        for (i = 0; i < 8; i++)
-            serialize8(i + 1);
+    case MSP_PARAM_SET:
+        mspParamSet(dataSize);
         break;
     case MSP_WP:
         wp_no = read8();    // get the wp number
@@ -430,11 +910,6 @@ static void evaluateCommand(void)
         writeParams();
         headSerialReply(0);
         break;
-    case MSP_DEBUG:
-        headSerialReply(8);
-        for (i = 0; i < 4; i++)
-            serialize16(debug[i]);      // 4 variables are here for general monitoring purpose
-        break;
     default:                   // we do not know how to handle the (valid) message, indicate error MSP $M!
         headSerialError(0);
         break;
@@ -545,13 +1020,14 @@ void serialCom(void)
         } else if (c_state == HEADER_SIZE) {
             cmdMSP = c;
             checksum ^= c;
+            payloadStart = uartRxIndex();
             c_state = HEADER_CMD;
         } else if (c_state == HEADER_CMD && offset < dataSize) {
             checksum ^= c;
-            inBuf[offset++] = c;
+            offset++;
         } else if (c_state == HEADER_CMD && offset >= dataSize) {
             if (checksum == c) {        // compare calculated and transferred checksum
-                evaluateCommand();      // we got a valid packet, evaluate it
+                evaluateCommand(dataSize); // we got a valid packet, evaluate it
             }
             c_state = IDLE;
         }
@@ -1,3 +1,13 @@
+#pragma once
+
+typedef struct {
+    uint32_t framesSent;
+    uint32_t droppedNoSpace;    // TX ring too full for the whole reply
+    uint32_t droppedBadSize;    // payload did not match the header size
+} mspTxStats_t;
+
+extern mspTxStats_t mspTxStats;
+
 void serialCom(void);
 
 void currentDataReceive(uint16_t c);
\ No newline at end of file
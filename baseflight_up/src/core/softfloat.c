@@ -0,0 +1,521 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    Rounding and special case structure follows John Hauser's Berkeley
+    SoftFloat (release 3).
+*/
+
+#include <stdint.h>
+
+/*
+ * Single precision soft-float runtime.
+ *
+ * Replaces the libgcc __aeabi_f* add, sub, mul, div and int conversion
+ * helpers plus newlib's sqrtf. Everything works on the raw bit patterns so
+ * the compiler emits CLZ, UMULL and UDIV directly on the Cortex-M3 instead of
+ * the generic shift loops.
+ *
+ * Results are IEEE 754 single precision, round to nearest even, subnormals
+ * supported. Exception flags are not kept and NaN payloads are only
+ * propagated as quiet NaNs.
+ *
+ * Each libgcc object is replaced as a whole (for example add/sub also
+ * carries the int to float conversions) so the linker never pulls a
+ * duplicate definition out of libgcc.a.
+ */
+
+// As in board.h, which this file stays clear of. Every control path float
+// op lands here, so the whole runtime bar the 64 bit conversions runs from RAM.
+#ifdef NO_FAST_CODE
+#define FAST_CODE
+#else
+#define FAST_CODE   __attribute__((section(".fastcode")))
+#endif
+
+typedef union {
+    float f;
+    uint32_t u;
+} floatBits_t;
+
+#define SIGN_BIT    0x80000000u
+#define DEFAULT_NAN 0x7FC00000u
+
+#define EXP(ui)     ((int32_t)(((ui) >> 23) & 0xFF))
+#define FRAC(ui)    ((ui) & 0x007FFFFFu)
+#define IS_NAN(ui)  (((ui) & 0x7FFFFFFFu) > 0x7F800000u)
+
+// sign is the top bit, sig carries the implicit bit into the exponent
+#define PACK(sign, exp, sig) ((sign) + ((uint32_t)(exp) << 23) + (sig))
+
+static inline float toFloat(uint32_t ui)
+{
+    floatBits_t v;
+    v.u = ui;
+    return v.f;
+}
+
+static inline uint32_t toBits(float f)
+{
+    floatBits_t v;
+    v.f = f;
+    return v.u;
+}
+
+static inline uint32_t shiftRightJam(uint32_t a, int32_t dist)
+{
+    return (dist < 31) ? (a >> dist) | ((uint32_t)(a << (-dist & 31)) != 0) : (a != 0);
+}
+
+static FAST_CODE uint32_t propagateNaN(uint32_t uiA, uint32_t uiB)
+{
+    return (IS_NAN(uiA) ? uiA : uiB) | 0x00400000u;
+}
+
+// sig has the implicit bit at bit 30 and seven round bits, exp is biased minus one
+static FAST_CODE uint32_t roundPack(uint32_t sign, int32_t exp, uint32_t sig)
+{
+    uint32_t roundBits = sig & 0x7F;
+
+    if ((uint32_t)exp >= 0xFD) {
+        if (exp < 0) {
+            sig = shiftRightJam(sig, -exp);
+            exp = 0;
+            roundBits = sig & 0x7F;
+        } else if (exp > 0xFD || sig + 0x40 >= 0x80000000u) {
+            return sign | 0x7F800000u;
+        }
+    }
+
+    sig = (sig + 0x40) >> 7;
+    if (roundBits == 0x40)
+        sig &= ~1u; // ties to even
+    if (!sig)
+        exp = 0;
+
+    return PACK(sign, exp, sig);
+}
+
+static FAST_CODE uint32_t normRoundPack(uint32_t sign, int32_t exp, uint32_t sig)
+{
+    int32_t shift = __builtin_clz(sig) - 1;
+
+    exp -= shift;
+    if (shift >= 7 && (uint32_t)exp < 0xFD)
+        return PACK(sign, sig ? exp : 0, sig << (shift - 7));
+
+    return roundPack(sign, exp, sig << shift);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Add / Subtract
+///////////////////////////////////////////////////////////////////////////////
+
+static FAST_CODE uint32_t addMags(uint32_t uiA, uint32_t uiB)
+{
+    uint32_t sign = uiA & SIGN_BIT;
+    int32_t expA = EXP(uiA), expB = EXP(uiB);
+    uint32_t sigA = FRAC(uiA), sigB = FRAC(uiB);
+    int32_t expDiff = expA - expB;
+    int32_t expZ;
+    uint32_t sigZ;
+
+    if (!expDiff) {
+        if (!expA)
+            return uiA + sigB; // both subnormal, carry into the exponent is correct
+        if (expA == 0xFF)
+            return (sigA | sigB) ? propagateNaN(uiA, uiB) : uiA;
+
+        expZ = expA;
+        sigZ = 0x01000000 + sigA + sigB;
+        if (!(sigZ & 1) && expZ < 0xFE)
+            return PACK(sign, expZ, sigZ >> 1);
+        sigZ <<= 6;
+    } else {
+        sigA <<= 6;
+        sigB <<= 6;
+        if (expDiff < 0) {
+            if (expB == 0xFF)
+                return sigB ? propagateNaN(uiA, uiB) : (sign | 0x7F800000u);
+            expZ = expB;
+            sigA += expA ? 0x20000000 : sigA;
+            sigA = shiftRightJam(sigA, -expDiff);
+        } else {
+            if (expA == 0xFF)
+                return sigA ? propagateNaN(uiA, uiB) : uiA;
+            expZ = expA;
+            sigB += expB ? 0x20000000 : sigB;
+            sigB = shiftRightJam(sigB, expDiff);
+        }
+        sigZ = 0x20000000 + sigA + sigB;
+        if (sigZ < 0x40000000) {
+            --expZ;
+            sigZ <<= 1;
+        }
+    }
+
+    return roundPack(sign, expZ, sigZ);
+}
+
+static FAST_CODE uint32_t subMags(uint32_t uiA, uint32_t uiB)
+{
+    uint32_t sign = uiA & SIGN_BIT;
+    int32_t expA = EXP(uiA), expB = EXP(uiB);
+    uint32_t sigA = FRAC(uiA), sigB = FRAC(uiB);
+    int32_t expDiff = expA - expB;
+    int32_t expZ, shift, sigDiff;
+    uint32_t sigX, sigY;
+
+    if (!expDiff) {
+        if (expA == 0xFF)
+            return (sigA | sigB) ? propagateNaN(uiA, uiB) : DEFAULT_NAN;
+
+        sigDiff = (int32_t)sigA - (int32_t)sigB;
+        if (!sigDiff)
+            return 0;
+        if (expA)
+            --expA;
+        if (sigDiff < 0) {
+            sign ^= SIGN_BIT;
+            sigDiff = -sigDiff;
+        }
+        shift = __builtin_clz(sigDiff) - 8;
+        expZ = expA - shift;
+        if (expZ < 0) {
+            shift = expA;
+            expZ = 0;
+        }
+        return PACK(sign, expZ, (uint32_t)sigDiff << shift);
+    }
+
+    sigA <<= 7;
+    sigB <<= 7;
+    if (expDiff < 0) {
+        sign ^= SIGN_BIT;
+        if (expB == 0xFF)
+            return sigB ? propagateNaN(uiA, uiB) : (sign | 0x7F800000u);
+        expZ = expB - 1;
+        sigX = sigB | 0x40000000;
+        sigY = sigA + (expA ? 0x40000000 : sigA);
+        expDiff = -expDiff;
+    } else {
+        if (expA == 0xFF)
+            return sigA ? propagateNaN(uiA, uiB) : uiA;
+        expZ = expA - 1;
+        sigX = sigA | 0x40000000;
+        sigY = sigB + (expB ? 0x40000000 : sigB);
+    }
+
+    return normRoundPack(sign, expZ, sigX - shiftRightJam(sigY, expDiff));
+}
+
+FAST_CODE float __aeabi_fadd(float a, float b)
+{
+    uint32_t uiA = toBits(a), uiB = toBits(b);
+
+    if ((uiA ^ uiB) & SIGN_BIT)
+        return toFloat(subMags(uiA, uiB));
+    return toFloat(addMags(uiA, uiB));
+}
+
+FAST_CODE float __aeabi_fsub(float a, float b)
+{
+    uint32_t uiA = toBits(a), uiB = toBits(b) ^ SIGN_BIT;
+
+    if ((uiA ^ uiB) & SIGN_BIT)
+        return toFloat(subMags(uiA, uiB));
+    return toFloat(addMags(uiA, uiB));
+}
+
+FAST_CODE float __aeabi_frsub(float a, float b)
+{
+    return __aeabi_fsub(b, a);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Integer to float, these live in the same libgcc object as add/sub
+///////////////////////////////////////////////////////////////////////////////
+
+static FAST_CODE uint32_t fromU32(uint32_t sign, uint32_t a)
+{
+    if (!a)
+        return sign;
+    if (a & 0x80000000u)
+        return roundPack(sign, 0x9D, (a >> 1) | (a & 1));
+    return normRoundPack(sign, 0x9C, a);
+}
+
+static uint32_t fromU64(uint32_t sign, uint64_t a)
+{
+    int32_t shift;
+    uint32_t sig;
+
+    if (!(a >> 32))
+        return fromU32(sign, (uint32_t)a);
+
+    // Upper word is non zero so this is always a right shift with jamming
+    shift = 33 - __builtin_clz((uint32_t)(a >> 32));
+    sig = (uint32_t)(a >> shift) | ((a & ((1ull << shift) - 1)) != 0);
+
+    return roundPack(sign, 0x9C + shift, sig);
+}
+
+FAST_CODE float __aeabi_ui2f(uint32_t a)
+{
+    return toFloat(fromU32(0, a));
+}
+
+FAST_CODE float __aeabi_i2f(int32_t a)
+{
+    if (a < 0)
+        return toFloat(fromU32(SIGN_BIT, -(uint32_t)a));
+    return toFloat(fromU32(0, a));
+}
+
+float __aeabi_ul2f(uint64_t a)
+{
+    return toFloat(fromU64(0, a));
+}
+
+float __aeabi_l2f(int64_t a)
+{
+    if (a < 0)
+        return toFloat(fromU64(SIGN_BIT, -(uint64_t)a));
+    return toFloat(fromU64(0, a));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Multiply / Divide
+///////////////////////////////////////////////////////////////////////////////
+
+FAST_CODE float __aeabi_fmul(float a, float b)
+{
+    uint32_t uiA = toBits(a), uiB = toBits(b);
+    uint32_t sign = (uiA ^ uiB) & SIGN_BIT;
+    int32_t expA = EXP(uiA), expB = EXP(uiB);
+    uint32_t sigA = FRAC(uiA), sigB = FRAC(uiB);
+    uint64_t sig64;
+    int32_t shift, expZ;
+    uint32_t sigZ;
+
+    if (expA == 0xFF || expB == 0xFF) {
+        if ((expA == 0xFF && sigA) || (expB == 0xFF && sigB))
+            return toFloat(propagateNaN(uiA, uiB));
+        if (!((expA | sigA) && (expB | sigB)))
+            return toFloat(DEFAULT_NAN); // inf * 0
+        return toFloat(sign | 0x7F800000u);
+    }
+
+    if (!expA) {
+        if (!sigA)
+            return toFloat(sign);
+        shift = __builtin_clz(sigA) - 8;
+        sigA <<= shift;
+        expA = 1 - shift;
+    }
+    if (!expB) {
+        if (!sigB)
+            return toFloat(sign);
+        shift = __builtin_clz(sigB) - 8;
+        sigB <<= shift;
+        expB = 1 - shift;
+    }
+
+    expZ = expA + expB - 0x7F;
+    sigA = (sigA | 0x00800000) << 7;
+    sigB = (sigB | 0x00800000) << 8;
+    sig64 = (uint64_t)sigA * sigB;
+    sigZ = (uint32_t)(sig64 >> 32) | ((uint32_t)sig64 != 0);
+    if (sigZ < 0x40000000) {
+        --expZ;
+        sigZ <<= 1;
+    }
+
+    return toFloat(roundPack(sign, expZ, sigZ));
+}
+
+FAST_CODE float __aeabi_fdiv(float a, float b)
+{
+    uint32_t uiA = toBits(a), uiB = toBits(b);
+    uint32_t sign = (uiA ^ uiB) & SIGN_BIT;
+    int32_t expA = EXP(uiA), expB = EXP(uiB);
+    uint32_t sigA = FRAC(uiA), sigB = FRAC(uiB);
+    int32_t shift, expZ;
+    uint32_t rem, quo;
+
+    if (expA == 0xFF) {
+        if (sigA || (expB == 0xFF && sigB))
+            return toFloat(propagateNaN(uiA, uiB));
+        if (expB == 0xFF)
+            return toFloat(DEFAULT_NAN); // inf / inf
+        return toFloat(sign | 0x7F800000u);
+    }
+    if (expB == 0xFF) {
+        if (sigB)
+            return toFloat(propagateNaN(uiA, uiB));
+        return toFloat(sign);
+    }
+
+    if (!expB) {
+        if (!sigB)
+            return toFloat((expA | sigA) ? (sign | 0x7F800000u) : DEFAULT_NAN);
+        shift = __builtin_clz(sigB) - 8;
+        sigB <<= shift;
+        expB = 1 - shift;
+    }
+    if (!expA) {
+        if (!sigA)
+            return toFloat(sign);
+        shift = __builtin_clz(sigA) - 8;
+        sigA <<= shift;
+        expA = 1 - shift;
+    }
+
+    expZ = expA - expB + 0x7E;
+    sigA |= 0x00800000;
+    sigB |= 0x00800000;
+
+    // Long division 8 bits at a time using the hardware 32/32 divider. The
+    // remainder stays below sigB (< 2^24) so each step fits in 32 bits.
+    if (sigA < sigB) {
+        --expZ;
+        shift = 31;
+    } else {
+        shift = 30;
+    }
+
+    quo = sigA / sigB;
+    rem = sigA - quo * sigB;
+    while (shift > 0) {
+        int32_t step = shift > 8 ? 8 : shift;
+        uint32_t q;
+
+        rem <<= step;
+        q = rem / sigB;
+        rem -= q * sigB;
+        quo = (quo << step) | q;
+        shift -= step;
+    }
+
+    return toFloat(roundPack(sign, expZ, quo | (rem != 0)));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Float to integer, round toward zero and saturate
+///////////////////////////////////////////////////////////////////////////////
+
+FAST_CODE int32_t __aeabi_f2iz(float a)
+{
+    uint32_t uiA = toBits(a);
+    int32_t exp = EXP(uiA);
+    int32_t shift = 0x9E - exp;
+    uint32_t absZ;
+
+    if (shift >= 32)
+        return 0;
+    if (shift <= 0) {
+        if (IS_NAN(uiA))
+            return 0;
+        return (uiA & SIGN_BIT) ? INT32_MIN : INT32_MAX;
+    }
+
+    absZ = ((FRAC(uiA) | 0x00800000) << 8) >> shift;
+
+    return (uiA & SIGN_BIT) ? -(int32_t)absZ : (int32_t)absZ;
+}
+
+FAST_CODE uint32_t __aeabi_f2uiz(float a)
+{
+    uint32_t uiA = toBits(a);
+    int32_t exp = EXP(uiA);
+    int32_t shift = 0x9E - exp;
+
+    if ((uiA & SIGN_BIT) || shift > 31)
+        return 0;
+    if (shift < 0)
+        return IS_NAN(uiA) ? 0 : 0xFFFFFFFFu;
+
+    return ((FRAC(uiA) | 0x00800000) << 8) >> shift;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Square root
+///////////////////////////////////////////////////////////////////////////////
+
+// Bit by bit integer root, 25 result bits then round. Skips newlib's errno
+// wrapper, which would otherwise cost two soft-float compares per call.
+FAST_CODE float sqrtf(float x)
+{
+    uint32_t ix = toBits(x);
+    int32_t exp = EXP(ix);
+    uint32_t m = FRAC(ix);
+    uint32_t q, s, r, t;
+
+    if (exp == 0xFF) {
+        if (m)
+            return toFloat(ix | 0x00400000u);
+        return toFloat((ix & SIGN_BIT) ? DEFAULT_NAN : ix);
+    }
+    if (!(ix & 0x7FFFFFFFu))
+        return x; // +-0
+    if (ix & SIGN_BIT)
+        return toFloat(DEFAULT_NAN);
+
+    if (!exp) {
+        int32_t shift = __builtin_clz(m) - 8;
+        m <<= shift;
+        exp = 1 - shift;
+    }
+    m |= 0x00800000;
+    exp -= 0x7F;
+
+    if (exp & 1)
+        m <<= 1;
+    exp >>= 1;
+
+    m <<= 1;
+    q = s = 0;
+    r = 0x01000000;
+    while (r) {
+        t = s + r;
+        if (t <= m) {
+            s = t + r;
+            m -= t;
+            q += r;
+        }
+        m <<= 1;
+        r >>= 1;
+    }
+
+    // An exact tie is impossible for a square root, any remainder rounds up
+    // when the round bit is set
+    if (m)
+        q += q & 1;
+
+    return toFloat((q >> 1) + 0x3F000000u + ((uint32_t)exp << 23));
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// GNU names for the same helpers
+///////////////////////////////////////////////////////////////////////////////
+
+float __addsf3(float a, float b) __attribute__((alias("__aeabi_fadd")));
+float __subsf3(float a, float b) __attribute__((alias("__aeabi_fsub")));
+float __mulsf3(float a, float b) __attribute__((alias("__aeabi_fmul")));
+float __divsf3(float a, float b) __attribute__((alias("__aeabi_fdiv")));
+float __floatsisf(int32_t a) __attribute__((alias("__aeabi_i2f")));
+float __floatunsisf(uint32_t a) __attribute__((alias("__aeabi_ui2f")));
+float __floatdisf(int64_t a) __attribute__((alias("__aeabi_l2f")));
+float __floatundisf(uint64_t a) __attribute__((alias("__aeabi_ul2f")));
+int32_t __fixsfsi(float a) __attribute__((alias("__aeabi_f2iz")));
+uint32_t __fixunssfsi(float a) __attribute__((alias("__aeabi_f2uiz")));
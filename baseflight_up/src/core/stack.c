@@ -0,0 +1,147 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#include "board.h"
+
+#include "core/stack.h"
+
+#define FAULT_MAGIC         0x544C4146  // "FALT"
+
+// From stm32_flash.ld
+extern uint32_t _sdata, _edata, _sbss, _ebss, _enoinit, _end, _estack;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t kind;          // faultKind_e
+    faultRecord_t record;
+} fault_t;
+
+// Left alone by the startup code so it outlives the reset after the fault
+static fault_t fault __attribute__((section(".noinit")));
+
+static uint32_t *low;       // lowest word found overwritten
+static uint32_t *scan;
+
+// Paints from the bottom of the stack up to just under the caller's frame,
+// call first thing in main()
+void stackInit(void)
+{
+    uint32_t *top = (uint32_t *)__get_MSP() - 16;
+    uint32_t *p;
+
+    for (p = &_end; p < top; p++)
+        *p = STACK_PAINT;
+
+    low = top;
+    scan = &_end;
+
+    if (fault.magic != FAULT_MAGIC || fault.kind > FAULT_STACK_OVERFLOW)
+        faultClear();
+}
+
+// Walks up from the bottom a few words at a time, the first overwritten
+// word below the mark so far becomes the new mark
+void stackCheck(void)
+{
+    uint8_t i;
+
+    for (i = 0; i < STACK_SCAN_WORDS; i++) {
+        if (scan >= low || *scan != STACK_PAINT) {
+            if (scan < low)
+                low = scan;
+            scan = &_end;
+            return;
+        }
+        scan++;
+    }
+}
+
+uint32_t stackSize(void)
+{
+    return (uint32_t)&_estack - (uint32_t)&_end;
+}
+
+// Bytes at the bottom of the stack never written since boot
+uint32_t stackFree(void)
+{
+    return (uint32_t)low - (uint32_t)&_end;
+}
+
+void ramUsage(uint32_t *data, uint32_t *bss, uint32_t *noinit)
+{
+    *data = (uint32_t)&_edata - (uint32_t)&_sdata;
+    *bss = (uint32_t)&_ebss - (uint32_t)&_sbss;
+    *noinit = (uint32_t)&_enoinit - (uint32_t)&_ebss;
+}
+
+faultKind_e faultKind(void)
+{
+    return fault.kind;
+}
+
+const faultRecord_t *faultRecord(void)
+{
+    return &fault.record;
+}
+
+void faultClear(void)
+{
+    memset(&fault, 0, sizeof(fault));
+    fault.magic = FAULT_MAGIC;
+}
+
+// Called from HardFault_Handler with the stacked r0-r3, r12, lr, pc, psr
+void stackFault(uint32_t *frame)
+{
+    uint32_t lr = 0, pc = 0;
+
+    // An overflowed frame can sit on top of the record, read it out first
+    if ((uint32_t)frame >= SRAM_BASE && (uint32_t)(frame + 8) <= (uint32_t)&_estack) {
+        lr = frame[5];
+        pc = frame[6];
+    }
+
+    fault.kind = (uint32_t)frame < (uint32_t)&_end ? FAULT_STACK_OVERFLOW : FAULT_HARD;
+    fault.record.pc = pc;
+    fault.record.lr = lr;
+    fault.record.sp = (uint32_t)frame;
+    fault.record.cfsr = SCB->CFSR;
+    fault.record.hfsr = SCB->HFSR;
+    fault.record.bfar = SCB->BFAR;
+    fault.magic = FAULT_MAGIC;
+
+    NVIC_SystemReset();
+}
+
+// Finds the stack the fault was taken on. Past the bottom of the stack there
+// is nothing safe to run on, so start again from the top, the frame is down
+// at the bottom and stays clear of it.
+void HardFault_Handler(void) __attribute__((naked));
+void HardFault_Handler(void)
+{
+    __ASM volatile (
+        "tst    lr, #4          \n"
+        "ite    eq              \n"
+        "mrseq  r0, msp         \n"
+        "mrsne  r0, psp         \n"
+        "ldr    r1, =_end       \n"
+        "cmp    r0, r1          \n"
+        "bhs    1f              \n"
+        "ldr    r1, =_estack    \n"
+        "mov    sp, r1          \n"
+        "1:                     \n"
+        "b      stackFault      \n"
+    );
+}
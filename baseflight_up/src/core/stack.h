@@ -0,0 +1,66 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+// Stack headroom and fault record. RAM between the end of .noinit and the
+// top of the stack is painted at boot, the main loop scans a few words of it
+// on every pass, and the lowest word found overwritten is the deepest the
+// stack has been. Nothing uses the heap, so the whole gap is stack.
+//
+// A hard fault keeps the stacked registers and fault status in .noinit and
+// resets, the record is there to read after the reboot until it is cleared.
+// A fault with the stack pointer below the painted area is flagged as a
+// stack overflow, the handler moves to a fresh stack before going on.
+//
+// Static RAM per module is not known to the firmware, the build writes it
+// from the map file, see support/ram_report.py.
+
+#define STACK_PAINT         0xC5C5C5C5
+#define STACK_SCAN_WORDS    32      // words checked per main loop pass
+
+typedef enum {
+    FAULT_NONE = 0,
+    FAULT_HARD,
+    FAULT_STACK_OVERFLOW,
+} faultKind_e;
+
+// Little endian, this is also the tail of MSP_STACK
+typedef struct {
+    uint32_t pc;            // stacked by the fault, 0 if the frame was unreadable
+    uint32_t lr;
+    uint32_t sp;            // where the frame was stacked
+    uint32_t cfsr;          // SCB->CFSR, which fault
+    uint32_t hfsr;          // SCB->HFSR, forced from a disabled fault if bit 30
+    uint32_t bfar;          // SCB->BFAR, address of a precise bus fault
+} faultRecord_t;
+
+// Functions
+
+void stackInit(void);
+
+void stackCheck(void);
+
+uint32_t stackSize(void);
+
+uint32_t stackFree(void);
+
+void ramUsage(uint32_t *data, uint32_t *bss, uint32_t *noinit);
+
+faultKind_e faultKind(void);
+
+const faultRecord_t *faultRecord(void);
+
+void faultClear(void);
@@ -0,0 +1,343 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+// No board.h, this also builds on the host against support/store_sim
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "core/store.h"
+#include "drivers/crc.h"
+#include "drivers/flash.h"
+
+/*
+ * Sector layout, everything word aligned:
+ *
+ *   header   magic (u32), sequence (u32), blob size (u16), 0xFFFF
+ *   records  offset (u16), length (u16), data padded to words, crc32 (u32)
+ *
+ * The first record is the snapshot, offset 0 and the whole blob. Records
+ * end at the first erased offset. The valid sector with the highest
+ * sequence is the live one. One update can take several records, all but
+ * the last have RECORD_MORE set in the length and none of them apply
+ * until the last one is in.
+ */
+
+#define STORE_MAGIC         0x32474643  // "CFG2"
+#define HEADER_SIZE         12
+#define RECORD_OVERHEAD     8
+#define ERASED              0xFFFF
+#define RECORD_MORE         0x8000
+
+// Unchanged runs shorter than this are folded into the surrounding record
+#define MERGE_GAP           RECORD_OVERHEAD
+
+typedef struct {
+    uint32_t magic;
+    uint32_t sequence;
+    uint16_t size;
+    uint16_t reserved;
+} sectorHeader_t;
+
+storeStats_t storeStats;
+
+static uint8_t shadow[STORE_MAX_SIZE];  // blob as it is in flash
+static uint16_t shadowSize;
+static int8_t sector = -1;              // live sector, -1 for none
+static uint32_t sequence;
+static uint16_t writePos;               // next record, from the sector start
+static bool torn;                       // live sector has a damaged record
+
+static inline uintptr_t sectorAddr(uint8_t s)
+{
+    return STORE_BASE + (uintptr_t)s * STORE_SECTOR_SIZE;
+}
+
+static inline uint16_t read16(uintptr_t addr)
+{
+    const uint8_t *p = (const uint8_t *)addr;
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t read32(uintptr_t addr)
+{
+    return read16(addr) | ((uint32_t)read16(addr + 2) << 16);
+}
+
+static uint32_t recordCrc(uint16_t offset, uint16_t flags, const uint8_t *data)
+{
+    uint32_t head = offset | ((uint32_t)flags << 16);
+
+    crcReset();
+    crcWords(&head, 1);
+    crcBytes(data, flags & ~RECORD_MORE);
+    return crcValue();
+}
+
+static inline uint16_t recordSize(uint16_t len)
+{
+    return RECORD_OVERHEAD + ((len + 3) & ~3);
+}
+
+// Checks the record at pos and returns its size, 0 at the end of the log or
+// for a record that cannot be trusted
+static uint16_t checkRecord(uintptr_t base, uint16_t pos, uint16_t size, bool *damaged)
+{
+    uint16_t offset, flags, len, total;
+
+    *damaged = false;
+    if (pos + RECORD_OVERHEAD > STORE_SECTOR_SIZE)
+        return 0;
+
+    offset = read16(base + pos);
+    flags = read16(base + pos + 2);
+    if (offset == ERASED && flags == ERASED)
+        return 0;
+
+    len = flags & ~RECORD_MORE;
+    total = recordSize(len);
+    if (offset >= size || len > size - offset || pos + total > STORE_SECTOR_SIZE ||
+        read32(base + pos + total - 4) != recordCrc(offset, flags, (const uint8_t *)base + pos + 4)) {
+        *damaged = true;
+        return 0;
+    }
+
+    return total;
+}
+
+static bool sectorValid(uint8_t s, uint16_t size, uint32_t *seq)
+{
+    const sectorHeader_t *header = (const sectorHeader_t *)sectorAddr(s);
+    uintptr_t base = sectorAddr(s);
+    bool damaged;
+
+    if (header->magic != STORE_MAGIC)
+        return false;
+
+    // Snapshot must be complete. A header whose snapshot never made it in
+    // may hold a half programmed sequence, so it is left out of the ordering.
+    if (read16(base + HEADER_SIZE) != 0 || read16(base + HEADER_SIZE + 2) != header->size ||
+        !checkRecord(base, HEADER_SIZE, header->size, &damaged))
+        return false;
+
+    // Sequence carries on past sectors left by another blob size
+    if ((int32_t)(header->sequence - sequence) > 0)
+        sequence = header->sequence;
+    if (header->size != size)
+        return false;
+
+    *seq = header->sequence;
+    return true;
+}
+
+// Finds the live sector and replays its records into data, which also holds
+// the last complete update while a multi record one is replayed
+bool storeLoad(void *data, uint16_t size)
+{
+    uintptr_t base;
+    uint32_t seq, liveSeq = 0;
+    uint16_t pos, total, offset, flags;
+    uint8_t s;
+
+    if (size > STORE_MAX_SIZE)
+        return false;
+
+    sector = -1;
+    sequence = 0;
+    for (s = 0; s < STORE_SECTORS; s++) {
+        if (sectorValid(s, size, &seq) && (sector < 0 || (int32_t)(seq - liveSeq) > 0)) {
+            sector = s;
+            liveSeq = seq;
+        }
+    }
+
+    shadowSize = size;
+    torn = false;
+    if (sector < 0)
+        return false;
+
+    base = sectorAddr(sector);
+    pos = HEADER_SIZE;
+    flags = 0;
+    while ((total = checkRecord(base, pos, size, &torn))) {
+        offset = read16(base + pos);
+        flags = read16(base + pos + 2);
+        memcpy(shadow + offset, (const uint8_t *)base + pos + 4, flags & ~RECORD_MORE);
+        if (!(flags & RECORD_MORE))
+            memcpy(data, shadow, size);
+        pos += total;
+    }
+    writePos = pos;
+
+    // An update that never got its last record is dropped, and nothing more
+    // can go after it in this sector
+    if (flags & RECORD_MORE) {
+        memcpy(shadow, data, size);
+        torn = true;
+    }
+
+    return true;
+}
+
+static bool appendRecord(uintptr_t base, uint16_t pos, uint16_t offset, uint16_t flags, const uint8_t *data)
+{
+    uint8_t head[4] = { offset, offset >> 8, flags, flags >> 8 };
+    uint8_t tail[4];
+    uint32_t crc = recordCrc(offset, flags, data);
+    uint16_t len = flags & ~RECORD_MORE;
+    uint16_t even = len & ~1;
+    bool ok;
+
+    // Data first and the CRC last, a cut anywhere leaves a record that fails
+    ok = flashProgram(base + pos, head, 4) && flashProgram(base + pos + 4, data, even);
+    if (ok && (len & 1)) {
+        tail[0] = data[len - 1];
+        tail[1] = 0xFF;
+        ok = flashProgram(base + pos + 4 + even, tail, 2);
+    }
+    if (ok) {
+        tail[0] = crc;
+        tail[1] = crc >> 8;
+        tail[2] = crc >> 16;
+        tail[3] = crc >> 24;
+        ok = flashProgram(base + pos + recordSize(len) - 4, tail, 4);
+    }
+
+    if (!ok)
+        storeStats.failures++;
+    return ok;
+}
+
+// Writes data as a fresh snapshot into the next sector that takes it
+static bool compactFrom(const uint8_t *data)
+{
+    sectorHeader_t header;
+    uint8_t attempt, next;
+    uintptr_t base;
+
+    header.magic = STORE_MAGIC;
+    header.sequence = sequence + 1;
+    header.size = shadowSize;
+    header.reserved = ERASED;
+
+    next = sector;
+    for (attempt = 0; attempt < STORE_SECTORS - 1 + (sector < 0); attempt++) {
+        next = (next + 1) % STORE_SECTORS;
+        base = sectorAddr(next);
+
+        storeStats.erases++;
+        if (!flashErase(base, STORE_SECTOR_SIZE)) {
+            storeStats.failures++;
+            continue;
+        }
+
+        // The old sector stays live until this snapshot is complete
+        if (!flashProgram(base, &header, HEADER_SIZE)) {
+            storeStats.failures++;
+            continue;
+        }
+        if (!appendRecord(base, HEADER_SIZE, 0, shadowSize, data))
+            continue;       // counted by appendRecord()
+
+        sector = next;
+        sequence = header.sequence;
+        writePos = HEADER_SIZE + recordSize(shadowSize);
+        torn = false;
+        if (data != shadow)
+            memcpy(shadow, data, shadowSize);
+        return true;
+    }
+
+    return false;
+}
+
+bool storeCompact(void)
+{
+    if (sector < 0)
+        return false;
+
+    return compactFrom(shadow);
+}
+
+// Appends what changed since the last write, compacting when the sector is
+// full or damaged. Only blocks for an erase when it compacts.
+bool storeWrite(const void *data, uint16_t size)
+{
+    const uint8_t *src = data;
+    uintptr_t base;
+    uint16_t i, start, end, need = 0, runs = 0;
+
+    if (size > STORE_MAX_SIZE)
+        return false;
+
+    if (sector < 0 || torn || size != shadowSize) {
+        shadowSize = size;
+        return compactFrom(src);
+    }
+
+    // Size the changed runs first so the whole update goes in one sector
+    for (i = 0; i < size; ) {
+        if (src[i] == shadow[i]) {
+            i++;
+            continue;
+        }
+        start = end = i;
+        for (i++; i < size && i - end <= MERGE_GAP; i++)
+            if (src[i] != shadow[i])
+                end = i;
+        need += recordSize(end - start + 1);
+        runs++;
+        i = end + 1;
+    }
+
+    if (!need)
+        return true;
+    if (writePos + need > STORE_SECTOR_SIZE)
+        return compactFrom(src);
+
+    base = sectorAddr(sector);
+    for (i = 0; i < size; ) {
+        if (src[i] == shadow[i]) {
+            i++;
+            continue;
+        }
+        start = end = i;
+        for (i++; i < size && i - end <= MERGE_GAP; i++)
+            if (src[i] != shadow[i])
+                end = i;
+
+        runs--;
+        if (!appendRecord(base, writePos, start, (end - start + 1) | (runs ? RECORD_MORE : 0), src + start)) {
+            // Whatever got programmed is skipped at the next load
+            torn = true;
+            return compactFrom(src);
+        }
+        memcpy(shadow + start, src + start, end - start + 1);
+        writePos += recordSize(end - start + 1);
+        storeStats.records++;
+        i = end + 1;
+    }
+
+    return true;
+}
+
+// Live sector fill in %
+uint8_t storeUsage(void)
+{
+    if (sector < 0)
+        return 100;
+
+    return (uint32_t)writePos * 100 / STORE_SECTOR_SIZE;
+}
@@ -0,0 +1,52 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+// Log structured config store. The top of flash is split into sectors used
+// in rotation. A sector holds a header, a snapshot of the whole blob, then
+// records of only the bytes that changed since. A full sector is compacted
+// into the next one as a fresh snapshot, so erases are spread over all of
+// them. Every record carries a CRC and is written before anything refers to
+// it, so a write cut short by power loss is dropped on the next boot and the
+// previous state is used.
+
+#ifdef STORE_SIM
+extern uintptr_t simFlashBase;      // support/store_sim
+#define STORE_BASE          simFlashBase
+#else
+#define STORE_BASE          (0x08000000 + 128 * 1024 - STORE_SECTORS * STORE_SECTOR_SIZE)
+#endif
+#define STORE_SECTORS       4
+#define STORE_SECTOR_SIZE   2048    // two flash pages
+#define STORE_MAX_SIZE      1024    // largest blob, must cover config_t
+
+typedef struct {
+    uint32_t erases;        // sectors erased since boot
+    uint32_t records;       // delta records written since boot
+    uint32_t failures;      // erase or program failures since boot
+} storeStats_t;
+
+extern storeStats_t storeStats;
+
+// Functions
+
+bool storeLoad(void *data, uint16_t size);
+
+bool storeWrite(const void *data, uint16_t size);
+
+bool storeCompact(void);
+
+uint8_t storeUsage(void);
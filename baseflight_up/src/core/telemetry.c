@@ -0,0 +1,201 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#include "board.h"
+
+#include "actuator/mixer.h"
+#include "actuator/pid.h"
+#include "actuator/stabilisation.h"
+
+#include "core/telemetry.h"
+
+#include "drivers/i2c.h"
+
+#define TICK_HZ             (1000000 / TELEMETRY_PERIOD)
+#define BUDGET_BYTES        (SERIAL_BAUD / 10 * TELEMETRY_BUDGET / 100)     // per second, 10 bits per byte
+
+#define FRAME_OVERHEAD      6   // '$' 'M' '>' size cmd ... checksum
+#define STREAM_HEADER       7   // id, sequence, timestamp
+
+extern uint8_t cliMode;
+
+// Stream data sizes, the frame adds FRAME_OVERHEAD + STREAM_HEADER
+static const uint8_t streamSize[STREAM_COUNT] = {
+    6,                          // STREAM_ATTITUDE
+    18,                         // STREAM_RAW_IMU
+    16,                         // STREAM_MOTORS
+    16,                         // STREAM_RC
+    14,                         // STREAM_PIDS
+    2,                          // STREAM_BATTERY
+    4 + 2 * TIMER_MAX_EVENTS,   // STREAM_TASKS
+};
+
+telemetryStream_t telemetryStreams[STREAM_COUNT];
+
+static uint8_t checksum;
+
+static inline uint16_t frameSize(uint8_t stream)
+{
+    return FRAME_OVERHEAD + STREAM_HEADER + streamSize[stream];
+}
+
+static void put8(uint8_t a)
+{
+    uartFramePut(a);
+    checksum ^= a;
+}
+
+static void put16(int16_t a)
+{
+    put8(a);
+    put8(a >> 8);
+}
+
+static void put32(uint32_t a)
+{
+    put16(a);
+    put16(a >> 16);
+}
+
+// Bytes per second the current subscriptions would need at their requested rates
+static uint32_t demand(void)
+{
+    uint32_t bytes = 0;
+    uint8_t i;
+
+    for (i = 0; i < STREAM_COUNT; i++)
+        if (telemetryStreams[i].requested)
+            bytes += (uint32_t)frameSize(i) * TICK_HZ / telemetryStreams[i].requested;
+
+    return bytes;
+}
+
+// Stretch every divider by the same factor until the total fits the budget,
+// so the streams keep their relative rates
+static void rebudget(void)
+{
+    uint32_t bytes = demand();
+    uint8_t i;
+
+    for (i = 0; i < STREAM_COUNT; i++) {
+        telemetryStream_t *s = &telemetryStreams[i];
+
+        s->divider = s->requested;
+        if (s->requested && bytes > BUDGET_BYTES)
+            s->divider = ((uint32_t)s->requested * bytes + BUDGET_BYTES - 1) / BUDGET_BYTES;
+        s->countdown = s->divider;
+    }
+}
+
+void telemetrySubscribe(uint8_t stream, uint8_t divider)
+{
+    if (stream >= STREAM_COUNT)
+        return;
+
+    telemetryStreams[stream].requested = divider;
+    rebudget();
+}
+
+// Line usage of the requested rates in % of the budget, over 100 means the
+// dividers have been stretched
+uint32_t telemetryLoad(void)
+{
+    return demand() * 100 / BUDGET_BYTES;
+}
+
+static void sendStream(uint8_t stream)
+{
+    telemetryStream_t *s = &telemetryStreams[stream];
+    uint8_t i;
+
+    if (!uartFrameBegin(frameSize(stream))) {
+        s->dropped++;
+        return;
+    }
+
+    put8('$');
+    put8('M');
+    put8('>');
+    checksum = 0;
+    put8(STREAM_HEADER + streamSize[stream]);
+    put8(MSP_STREAM);
+
+    put8(stream);
+    put16(s->sequence++);
+    put32(micros());
+
+    switch (stream) {
+    case STREAM_ATTITUDE:
+        updateEulerAngles();
+        put16(stateData.roll * RAD2DEG * 10);
+        put16(stateData.pitch * RAD2DEG * 10);
+        put16(stateData.heading * RAD2DEG);
+        break;
+    case STREAM_RAW_IMU:
+        for (i = 0; i < 3; i++)
+            put16(stateData.accel[i] * 10.0f);
+        for (i = 0; i < 3; i++)
+            put16(stateData.gyro[i] * 100.0f);
+        for (i = 0; i < 3; i++)
+            put16(stateData.mag[i]);
+        break;
+    case STREAM_MOTORS:
+        for (i = 0; i < 8; i++)
+            put16(motor[i]);
+        break;
+    case STREAM_RC:
+        for (i = 0; i < 8; i++)
+            put16(rcData[i]);
+        break;
+    case STREAM_PIDS:
+        for (i = 0; i < 3; i++)
+            put16(pids[ROLL_RATE_PID + i].lastErr * 1000.0f);
+        for (i = 0; i < 4; i++)
+            put16(axisPID[i]);
+        break;
+    case STREAM_BATTERY:
+        put16(sensorData.batteryVoltage * 100.0f);
+        break;
+    case STREAM_TASKS:
+        put16(cycleTime);
+        put16(i2cGetErrorCounter());
+        for (i = 0; i < TIMER_MAX_EVENTS; i++)
+            put16(min(periodicEventDelta(i), 0xFFFF));
+        break;
+    }
+
+    uartFramePut(checksum);
+    uartFrameCommit();
+}
+
+// Scheduler tick, see TELEMETRY_PERIOD
+void telemetryUpdate(void)
+{
+    uint8_t i;
+
+    // Binary frames would land in the middle of the CLI's text
+    if (cliMode)
+        return;
+
+    for (i = 0; i < STREAM_COUNT; i++) {
+        telemetryStream_t *s = &telemetryStreams[i];
+
+        if (!s->divider || --s->countdown)
+            continue;
+
+        s->countdown = s->divider;
+        sendStream(i);
+    }
+}
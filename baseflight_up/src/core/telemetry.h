@@ -0,0 +1,55 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+// Push telemetry. The host subscribes to streams with MSP_SET_STREAMS, giving
+// a divider of the TELEMETRY_PERIOD tick for each. Every frame is an MSP
+// reply with command MSP_STREAM and a payload of
+//   stream id (u8), sequence (u16), timestamp us (u32), stream data
+
+#define MSP_STREAM              120     // pushed, never requested
+
+#define TELEMETRY_PERIOD        5000    // base tick, dividers count these
+#define TELEMETRY_BUDGET        75      // % of the line rate streams may use
+
+typedef enum {
+    STREAM_ATTITUDE = 0,    // roll, pitch (0.1 deg), heading (deg)
+    STREAM_RAW_IMU,         // accel (x10), gyro (x100), mag, as MSP_RAW_IMU
+    STREAM_MOTORS,          // 8 motor outputs
+    STREAM_RC,              // 8 rc channels
+    STREAM_PIDS,            // rate errors (mrad/s), 4 axis outputs
+    STREAM_BATTERY,         // voltage (0.01 V)
+    STREAM_TASKS,           // cycle time, i2c errors, periodic event deltas (us)
+    STREAM_COUNT
+} telemetryStream_e;
+
+typedef struct {
+    uint8_t requested;      // divider asked for by the host, 0 is off
+    uint16_t divider;       // divider in use after budgeting
+    uint16_t countdown;
+    uint16_t sequence;
+    uint32_t dropped;       // frames skipped for lack of TX space
+} telemetryStream_t;
+
+extern telemetryStream_t telemetryStreams[STREAM_COUNT];
+
+// Functions
+
+void telemetrySubscribe(uint8_t stream, uint8_t divider);
+
+uint32_t telemetryLoad(void);
+
+void telemetryUpdate(void);
@@ -0,0 +1,89 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#include "board.h"
+
+#define TRACE_CAPACITY      (TRACE_ON ? TRACE_ENTRIES : 0)
+
+// Fails to compile when TRACE_ENTRIES is not a power of two
+typedef char traceEntriesPowerOfTwo[(TRACE_ENTRIES & (TRACE_ENTRIES - 1)) ? -1 : 1];
+
+traceEntry_t traceRing[TRACE_ON ? TRACE_ENTRIES : 1];
+volatile uint32_t traceHead;
+volatile uint32_t traceLimit;
+volatile uint8_t traceMode;
+
+static uint8_t overhead;
+
+// Times a burst of markers into the ring, the cost every marker adds
+void traceInit(void)
+{
+    uint32_t start;
+    uint8_t i;
+
+    if (!TRACE_ON)
+        return;
+
+    traceStart(TRACE_RING);
+    start = DWT_CYCCNT;
+    for (i = 0; i < 8; i++)
+        traceRecord(TRACE_mark, i);
+    overhead = (DWT_CYCCNT - start) / 8;
+    traceStop();
+    traceHead = 0;
+}
+
+// Clears the ring and records from now on
+void traceStart(uint8_t mode)
+{
+    if (!TRACE_ON || (mode != TRACE_RING && mode != TRACE_ONCE)) {
+        traceStop();
+        return;
+    }
+
+    traceMode = TRACE_STOPPED;
+    traceHead = 0;
+    traceLimit = mode == TRACE_ONCE ? TRACE_ENTRIES : 0xFFFFFFFF;
+    traceMode = mode;
+}
+
+void traceStop(void)
+{
+    traceMode = TRACE_STOPPED;
+}
+
+// Entries held, read them once stopped or they move underneath the reader
+uint16_t traceEntries(void)
+{
+    return min(traceHead, TRACE_CAPACITY);
+}
+
+// Oldest first. A single recording keeps the start of the ring, claims
+// refused once it was full may still have moved the head on.
+const traceEntry_t *traceEntry(uint16_t index)
+{
+    uint32_t oldest = 0;
+
+    if (traceLimit != TRACE_ENTRIES && traceHead > TRACE_CAPACITY)
+        oldest = traceHead - TRACE_CAPACITY;
+
+    return &traceRing[(oldest + index) & (TRACE_ENTRIES - 1)];
+}
+
+// Cycles one marker costs, measured by traceInit()
+uint8_t traceOverhead(void)
+{
+    return overhead;
+}
@@ -0,0 +1,164 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+// Event trace. Begin, end and instant markers stamped with the DWT cycle
+// counter go into a RAM ring, for a timeline of interrupts, tasks and DMA
+// completions that support/trace_dl.py turns into Chrome trace JSON.
+//
+// Each module's markers are compiled in with its own option, e.g.
+// make OPTIONS="TRACE_I2C TRACE_SCHED", or all of them with TRACE_ALL. A
+// marker whose module is off compiles to nothing, and the ring only takes
+// RAM when some module is on.
+//
+// An event's ID is its position in the table, support/trace_dl.py reads the
+// names from here, so new events go on the end.
+//
+//  T(name, module)
+
+#define TRACE_EVENTS(T) \
+    T(mark,                 ALL)    /* arg: caller's choice */ \
+    T(task,                 SCHED)  /* arg: callback address / 2 */ \
+    T(i2cEvent,             I2C) \
+    T(i2cError,             I2C) \
+    T(i2cTransfer,          I2C)    /* arg: device address << 8 | register */ \
+    T(uartIdle,             UART) \
+    T(uartTxDone,           UART)   /* TX DMA complete */ \
+    T(uart2,                UART)   /* arg: status register */ \
+    T(rcCapture,            RC)     /* arg: input port */ \
+    T(ppmPulse,             RC)     /* arg: pulse width in us */ \
+    T(flashErase,           FLASH)  /* arg: bytes */ \
+    T(flashProgram,         FLASH)  /* arg: bytes */
+
+#ifndef TRACE_ENTRIES
+#define TRACE_ENTRIES       128     // power of two, 8 bytes each
+#endif
+
+#if defined(TRACE_ALL) || defined(TRACE_SCHED)
+#define TRACE_SCHED_ON      1
+#else
+#define TRACE_SCHED_ON      0
+#endif
+#if defined(TRACE_ALL) || defined(TRACE_I2C)
+#define TRACE_I2C_ON        1
+#else
+#define TRACE_I2C_ON        0
+#endif
+#if defined(TRACE_ALL) || defined(TRACE_UART)
+#define TRACE_UART_ON       1
+#else
+#define TRACE_UART_ON       0
+#endif
+#if defined(TRACE_ALL) || defined(TRACE_RC)
+#define TRACE_RC_ON         1
+#else
+#define TRACE_RC_ON         0
+#endif
+#if defined(TRACE_ALL) || defined(TRACE_FLASH)
+#define TRACE_FLASH_ON      1
+#else
+#define TRACE_FLASH_ON      0
+#endif
+
+#define TRACE_ON            (TRACE_SCHED_ON || TRACE_I2C_ON || TRACE_UART_ON || TRACE_RC_ON || TRACE_FLASH_ON)
+#define TRACE_ALL_ON        TRACE_ON
+
+#define TRACE_ID(name, module) TRACE_##name,
+
+typedef enum {
+    TRACE_EVENTS(TRACE_ID)
+    TRACE_EVENT_COUNT
+} traceEvent_e;
+
+#undef TRACE_ID
+
+// Kind of marker, in the top bits of the event word
+#define TRACE_INSTANT       0x0000
+#define TRACE_BEGIN         0x4000
+#define TRACE_END           0x8000
+
+typedef struct {
+    uint32_t cycles;        // DWT_CYCCNT
+    uint16_t event;         // traceEvent_e | kind
+    uint16_t arg;
+} traceEntry_t;
+
+typedef enum {
+    TRACE_STOPPED = 0,
+    TRACE_RING,             // records until stopped, keeps the latest entries
+    TRACE_ONCE,             // records until the ring is full
+} traceMode_e;
+
+extern traceEntry_t traceRing[];
+extern volatile uint32_t traceHead;
+extern volatile uint32_t traceLimit;
+extern volatile uint8_t traceMode;
+
+// Claims the next slot with one exclusive load/store pair. An interrupt in
+// between clears the exclusive monitor on return, the store fails and the
+// claim is retried, so nesting markers never share a slot.
+static inline uint32_t traceReserve(void)
+{
+    uint32_t slot, failed;
+
+    do {
+        __ASM volatile ("ldrex %0, [%1]" : "=r" (slot) : "r" (&traceHead));
+        __ASM volatile ("strex %0, %2, [%1]" : "=&r" (failed) : "r" (&traceHead), "r" (slot + 1) : "memory");
+    } while (failed);
+
+    return slot;
+}
+
+static inline void traceRecord(uint16_t event, uint16_t arg)
+{
+    traceEntry_t *entry;
+    uint32_t slot;
+
+    if (!traceMode)
+        return;
+
+    slot = traceReserve();
+    if (slot >= traceLimit) {
+        traceMode = TRACE_STOPPED;
+        return;
+    }
+
+    entry = &traceRing[slot & (TRACE_ENTRIES - 1)];
+    entry->cycles = DWT_CYCCNT;
+    entry->event = event;
+    entry->arg = arg;
+}
+
+#define traceBegin(module, name, arg) \
+    do { if (TRACE_##module##_ON) traceRecord(TRACE_##name | TRACE_BEGIN, (arg)); } while (0)
+#define traceEnd(module, name, arg) \
+    do { if (TRACE_##module##_ON) traceRecord(TRACE_##name | TRACE_END, (arg)); } while (0)
+#define traceInstant(module, name, arg) \
+    do { if (TRACE_##module##_ON) traceRecord(TRACE_##name | TRACE_INSTANT, (arg)); } while (0)
+
+// Functions
+
+void traceInit(void);
+
+void traceStart(uint8_t mode);
+
+void traceStop(void);
+
+uint16_t traceEntries(void);
+
+const traceEntry_t *traceEntry(uint16_t index);
+
+uint8_t traceOverhead(void);
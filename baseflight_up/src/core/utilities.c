@@ -14,6 +14,7 @@
 */
 
 #include "board.h"
+#include "core/fastmath.h"
 
 #ifndef HAVE_ITOA_FUNCTION
 /*
@@ -57,7 +58,7 @@ char *itoa(int i, char *a, int r)
 
 char *ftoa(float x, char *floatString)
 {
-    dbl2stri(x, floatString, 6);
+    dbl2stri((double)x, floatString, 6);
 
     return floatString;
 }
@@ -281,7 +282,29 @@ void Quaternion2RPY(const float q[4], float *roll, float *pitch, float *yaw)
 	R23 = 2.0f * (q[2] * q[3] + q[0] * q[1]);
 	R33 = q0s - q1s - q2s + q3s;
 
-	*pitch = -asinf(-R13);	// pitch always between -pi/2 to pi/2
-	*yaw = atan2f(R12, R11);
-	*roll = atan2f(R23, R33);
-}
\ No newline at end of file
+	*pitch = fastAsin(R13);	// pitch always between -pi/2 to pi/2
+	*yaw = fastAtan2(R12, R11);
+	*roll = fastAtan2(R23, R33);
+}
+
+// ****** find roll and pitch from quaternion without inverse trig ********
+// Uses the gravity column of the rotation matrix and an odd Taylor series for asin.
+// Error is below 0.13 deg up to 45 deg of tilt and 1.2 deg at 60 deg (always under-reads).
+// Only valid upright (|roll| < 90 deg), which is all level mode cares about.
+void Quaternion2Tilt(const quat_t q, float *roll, float *pitch)
+{
+	vec3_t g;
+	float sinRoll = 0.0f, x2;
+
+	quatGravity(g, q);
+
+	// Its y and z both carry a cos(pitch) factor, normalise it away
+	x2 = g[Y] * g[Y] + g[Z] * g[Z];
+	if(x2 > 0.0f)
+		sinRoll = g[Y] * fastInvSqrt(x2);
+
+	x2 = g[X] * g[X];
+	*pitch = g[X] * (1.0f + x2 * (1.0f / 6.0f + x2 * (3.0f / 40.0f + x2 * (15.0f / 336.0f))));
+	x2 = sinRoll * sinRoll;
+	*roll = sinRoll * (1.0f + x2 * (1.0f / 6.0f + x2 * (3.0f / 40.0f + x2 * (15.0f / 336.0f))));
+}
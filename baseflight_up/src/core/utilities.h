@@ -32,3 +32,5 @@ float standardRadianFormat(float angle);
 
 void Quaternion2RPY(const float q[4], float *roll, float *pitch, float *yaw);
 
+void Quaternion2Tilt(const float q[4], float *roll, float *pitch);
+
@@ -0,0 +1,107 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#ifdef CRC_SOFTWARE
+#include <stdint.h>
+#include <string.h>
+#else
+#include "board.h"
+#endif
+
+#include "drivers/crc.h"
+
+#ifdef CRC_SOFTWARE
+
+static uint32_t crcState;
+
+// Polynomial times each nibble, four bits per step
+static const uint32_t crcNibble[16] = {
+    0x00000000, 0x04C11DB7, 0x09823B6E, 0x0D4326D9, 0x130476DC, 0x17C56B6B, 0x1A864DB2, 0x1E475005,
+    0x2608EDB8, 0x22C9F00F, 0x2F8AD6D6, 0x2B4BCB61, 0x350C9B64, 0x31CD86D3, 0x3C8EA00A, 0x384FBDBD,
+};
+
+void crcReset(void)
+{
+    crcState = 0xFFFFFFFF;
+}
+
+static inline void crcWord(uint32_t word)
+{
+    uint8_t i;
+
+    crcState ^= word;
+    for (i = 0; i < 8; i++)
+        crcState = (crcState << 4) ^ crcNibble[crcState >> 28];
+}
+
+uint32_t crcValue(void)
+{
+    return crcState;
+}
+
+#else
+
+void crcReset(void)
+{
+    CRC->CR = CRC_CR_RESET;
+}
+
+static inline void crcWord(uint32_t word)
+{
+    CRC->DR = word;
+}
+
+uint32_t crcValue(void)
+{
+    return CRC->DR;
+}
+
+#endif
+
+void crcWords(const uint32_t *words, uint32_t count)
+{
+    while (count--)
+        crcWord(*words++);
+}
+
+void crcBytes(const void *data, uint32_t len)
+{
+    const uint8_t *p = data;
+    uint32_t word;
+
+    if (!((uintptr_t)p & 3)) {
+        crcWords((const uint32_t *)p, len >> 2);
+        p += len & ~3;
+        len &= 3;
+    }
+
+    for (; len >= 4; p += 4, len -= 4) {
+        memcpy(&word, p, 4);
+        crcWord(word);
+    }
+
+    if (len) {
+        word = 0;
+        memcpy(&word, p, len);
+        crcWord(word);
+    }
+}
+
+uint32_t crc32(const void *data, uint32_t len)
+{
+    crcReset();
+    crcBytes(data, len);
+    return crcValue();
+}
@@ -0,0 +1,36 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+// CRC-32 as computed by the STM32 CRC unit: polynomial 0x04C11DB7, initial
+// value 0xFFFFFFFF, 32 bit words fed most significant bit first, no final
+// xor. Bytes are taken as little endian words and a short tail is padded
+// with zeros. Built with CRC_SOFTWARE the same values come from a table
+// driven loop, for host tools.
+//
+// There is one unit, so reset, feed and read in one go from thread level.
+
+// Functions
+
+void crcReset(void);
+
+void crcWords(const uint32_t *words, uint32_t count);
+
+void crcBytes(const void *data, uint32_t len);
+
+uint32_t crcValue(void);
+
+uint32_t crc32(const void *data, uint32_t len);
@@ -0,0 +1,65 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#include "board.h"
+#include "drivers/flash.h"
+
+// Erases the pages covering len bytes from a page aligned addr, about 20 ms
+// per page with the CPU stalled on instruction fetch
+bool flashErase(uintptr_t addr, uint16_t len)
+{
+    uintptr_t end = addr + len;
+    bool ok = true;
+
+    traceBegin(FLASH, flashErase, len);
+    FLASH_Unlock();
+    FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
+
+    for (; ok && addr < end; addr += FLASH_PAGE_BYTES) {
+        ok = FLASH_ErasePage(addr) == FLASH_COMPLETE;
+        perfCount(flashErases);
+    }
+
+    FLASH_Lock();
+    traceEnd(FLASH, flashErase, len);
+    if (!ok)
+        perfCount(flashErrors);
+    return ok;
+}
+
+// Programs len bytes, len and addr even, and reads them back
+bool flashProgram(uintptr_t addr, const void *data, uint16_t len)
+{
+    const uint8_t *src = data;
+    uint16_t i, half;
+    bool ok = true;
+
+    traceBegin(FLASH, flashProgram, len);
+    FLASH_Unlock();
+    FLASH_ClearFlag(FLASH_FLAG_EOP | FLASH_FLAG_PGERR | FLASH_FLAG_WRPRTERR);
+
+    for (i = 0; ok && i < len; i += 2) {
+        half = src[i] | (src[i + 1] << 8);
+        ok = FLASH_ProgramHalfWord(addr + i, half) == FLASH_COMPLETE;
+    }
+
+    FLASH_Lock();
+    traceEnd(FLASH, flashProgram, len);
+    perfCount(flashWrites);
+    ok = ok && !memcmp((const void *)addr, data, len);
+    if (!ok)
+        perfCount(flashErrors);
+    return ok;
+}
@@ -0,0 +1,27 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+// Internal flash, programmed in half words. Erased flash reads 0xFF.
+// support/store_sim implements the same functions on the host.
+
+#define FLASH_PAGE_BYTES    1024
+
+// Functions
+
+bool flashErase(uintptr_t addr, uint16_t len);
+
+bool flashProgram(uintptr_t addr, const void *data, uint16_t len);
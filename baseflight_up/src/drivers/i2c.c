@@ -17,22 +17,34 @@ static void i2cUnstick(void);
 
 void I2C1_ER_IRQHandler(void)
 {
+    perfCount(isrI2c);
+    traceBegin(I2C, i2cError, 0);
     i2c_er_handler();
+    traceEnd(I2C, i2cError, 0);
 }
 
 void I2C1_EV_IRQHandler(void)
 {
+    perfCount(isrI2c);
+    traceBegin(I2C, i2cEvent, 0);
     i2c_ev_handler();
+    traceEnd(I2C, i2cEvent, 0);
 }
 
-void I2C2_ER_IRQHandler(void)
+FAST_CODE void I2C2_ER_IRQHandler(void)
 {
+    perfCount(isrI2c);
+    traceBegin(I2C, i2cError, 0);
     i2c_er_handler();
+    traceEnd(I2C, i2cError, 0);
 }
 
-void I2C2_EV_IRQHandler(void)
+FAST_CODE void I2C2_EV_IRQHandler(void)
 {
+    perfCount(isrI2c);
+    traceBegin(I2C, i2cEvent, 0);
     i2c_ev_handler();
+    traceEnd(I2C, i2cEvent, 0);
 }
 
 #define I2C_DEFAULT_TIMEOUT 30000
@@ -48,8 +60,24 @@ static volatile uint8_t writing;
 static volatile uint8_t reading;
 static volatile uint8_t *write_p;
 static volatile uint8_t *read_p;
+static volatile i2cDoneFuncPtr done;   // of a read started by i2cReadStart()
 
-static void i2c_er_handler(void)
+// Ends the transfer, a read started in the background is handed back
+static FAST_CODE void finish(void)
+{
+    i2cDoneFuncPtr callback = done;
+
+    busy = 0;
+    if (callback) {
+        done = 0;
+        callback(!error);
+    }
+}
+
+// The handlers run from RAM and set the register bits directly rather than
+// branch back into the StdPeriph code in flash. Only the recovery after a
+// failed stop still calls out, to i2cInit().
+static FAST_CODE void i2c_er_handler(void)
 {
     volatile uint32_t SR1Register, SR2Register;
 
@@ -58,6 +86,7 @@ static void i2c_er_handler(void)
     if (SR1Register & 0x0F00)   //an error
     {
         error = true;
+        perfCount(i2cErrors);
         // I2C1error.error = ((SR1Register & 0x0F00) >> 8);               //save error
         // I2C1error.job = job;    //the task
     }
@@ -66,26 +95,48 @@ static void i2c_er_handler(void)
 
     {
         SR2Register = I2Cx->SR2;        //read second status register to clear ADDR if it is set (note that BTF will not be set after a NACK)
-        I2C_ITConfig(I2Cx, I2C_IT_BUF, DISABLE);        //disable the RXNE/TXE interrupt - prevent the ISR tailchaining onto the ER (hopefully)
+        I2Cx->CR2 &= ~I2C_CR2_ITBUFEN;        //disable the RXNE/TXE interrupt - prevent the ISR tailchaining onto the ER (hopefully)
         if (!(SR1Register & 0x0200) && !(I2Cx->CR1 & 0x0200))   //if we dont have an ARLO error, ensure sending of a stop
         {
             if (I2Cx->CR1 & 0x0100)     //We are currently trying to send a start, this is very bad as start,stop will hang the peripheral
             {
                 while (I2Cx->CR1 & 0x0100);     //wait for any start to finish sending
-                I2C_GenerateSTOP(I2Cx, ENABLE); //send stop to finalise bus transaction
+                I2Cx->CR1 |= I2C_CR1_STOP; //send stop to finalise bus transaction
                 while (I2Cx->CR1 & 0x0200);     //wait for stop to finish sending
+                perfCount(i2cRecoveries);
                 i2cInit(I2Cx);  //reset and configure the hardware
             } else {
-                I2C_GenerateSTOP(I2Cx, ENABLE); //stop to free up the bus
-                I2C_ITConfig(I2Cx, I2C_IT_EVT | I2C_IT_ERR, DISABLE);   //Disable EVT and ERR interrupts while bus inactive
+                I2Cx->CR1 |= I2C_CR1_STOP; //stop to free up the bus
+                I2Cx->CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);   //Disable EVT and ERR interrupts while bus inactive
             }
         }
     }
     I2Cx->SR1 &= ~0x0F00;       //reset all the error bits to clear the interrupt
+    finish();
+}
+
+// Resets the peripheral under a transfer that never ended
+static void i2cRecover(void)
+{
+    done = 0;
     busy = 0;
+    i2cErrorCount++;
+    perfCount(i2cTimeouts);
+    perfCount(i2cRecoveries);
+    i2cInit(I2Cx);
 }
 
-bool i2cWriteBuffer(uint8_t addr_, uint8_t reg_, uint8_t len_, uint8_t * data)
+// Waits out a read started in the background
+static void i2cWaitIdle(void)
+{
+    uint32_t timeout = I2C_DEFAULT_TIMEOUT;
+
+    while (busy && --timeout > 0);
+    if (timeout == 0)
+        i2cRecover();
+}
+
+static bool i2cWriteTransfer(uint8_t addr_, uint8_t reg_, uint8_t len_, uint8_t * data)
 {
     uint8_t i;
     uint8_t my_data[16];
@@ -104,6 +155,8 @@ bool i2cWriteBuffer(uint8_t addr_, uint8_t reg_, uint8_t len_, uint8_t * data)
     if (len_ > 16)
         return false;           //too long
 
+    perfCount(i2cTransfers);
+
     for (i = 0; i < len_; i++)
         my_data[i] = data[i];
 
@@ -121,6 +174,8 @@ bool i2cWriteBuffer(uint8_t addr_, uint8_t reg_, uint8_t len_, uint8_t * data)
     while (busy && --timeout > 0);
     if (timeout == 0) {
         i2cErrorCount++;
+        perfCount(i2cTimeouts);
+        perfCount(i2cRecoveries);
         i2cInit(I2Cx);          // reinit peripheral + clock out garbage
         return false;
     }
@@ -128,15 +183,29 @@ bool i2cWriteBuffer(uint8_t addr_, uint8_t reg_, uint8_t len_, uint8_t * data)
     return !error;
 }
 
+// The bus tick runs the sensor transfers from an interrupt. Transfers from
+// the main loop hold it off and wait for one it left running, so one never
+// starts over another.
+bool i2cWriteBuffer(uint8_t addr_, uint8_t reg_, uint8_t len_, uint8_t * data)
+{
+    bool ok;
+    uint32_t held = tickHold();
+
+    i2cWaitIdle();
+    traceBegin(I2C, i2cTransfer, addr_ << 8 | reg_);
+    ok = i2cWriteTransfer(addr_, reg_, len_, data);
+    traceEnd(I2C, i2cTransfer, addr_ << 8 | reg_);
+    tickRelease(held);
+    return ok;
+}
+
 bool i2cWrite(uint8_t addr_, uint8_t reg_, uint8_t data)
 {
     return i2cWriteBuffer(addr_, reg_, 1, &data);
 }
 
-bool i2cRead(uint8_t addr_, uint8_t reg_, uint8_t len, uint8_t * buf)
+static void i2cReadBegin(uint8_t addr_, uint8_t reg_, uint8_t len, uint8_t * buf)
 {
-    uint32_t timeout = I2C_DEFAULT_TIMEOUT;
-
     addr = addr_ << 1;
     reg = reg_;
     writing = 0;
@@ -147,6 +216,8 @@ bool i2cRead(uint8_t addr_, uint8_t reg_, uint8_t len, uint8_t * buf)
     busy = 1;
     error = false;
 
+    perfCount(i2cTransfers);
+
     if (!(I2Cx->CR2 & I2C_IT_EVT))      //if we are restarting the driver
     {
         if (!(I2Cx->CR1 & 0x0100))      //ensure sending a start
@@ -157,10 +228,19 @@ bool i2cRead(uint8_t addr_, uint8_t reg_, uint8_t len, uint8_t * buf)
         }
         I2C_ITConfig(I2Cx, I2C_IT_EVT | I2C_IT_ERR, ENABLE);    //allow the interrupts to fire off again
     }
+}
+
+static bool i2cReadTransfer(uint8_t addr_, uint8_t reg_, uint8_t len, uint8_t * buf)
+{
+    uint32_t timeout = I2C_DEFAULT_TIMEOUT;
+
+    i2cReadBegin(addr_, reg_, len, buf);
 
     while (busy && --timeout > 0);
     if (timeout == 0) {
         i2cErrorCount++;        // reinit peripheral + clock out garbage
+        perfCount(i2cTimeouts);
+        perfCount(i2cRecoveries);
         i2cInit(I2Cx);
         return false;
     }
@@ -168,7 +248,41 @@ bool i2cRead(uint8_t addr_, uint8_t reg_, uint8_t len, uint8_t * buf)
     return !error;
 }
 
-void i2c_ev_handler(void)
+bool i2cRead(uint8_t addr_, uint8_t reg_, uint8_t len, uint8_t * buf)
+{
+    bool ok;
+    uint32_t held = tickHold();
+
+    i2cWaitIdle();
+    traceBegin(I2C, i2cTransfer, addr_ << 8 | reg_);
+    ok = i2cReadTransfer(addr_, reg_, len, buf);
+    traceEnd(I2C, i2cTransfer, addr_ << 8 | reg_);
+    tickRelease(held);
+    return ok;
+}
+
+// Starts a read and returns, the transfer runs from the I2C interrupts and
+// calls done from them when it ends. For the bus tick, which then has the
+// CPU back while the bus is busy.
+bool i2cReadStart(uint8_t addr_, uint8_t reg_, uint8_t len, uint8_t * buf, i2cDoneFuncPtr done_)
+{
+    bool hung;
+
+    // Nothing outlasts a tick, one still running has hung. Its callback is
+    // dropped first so it can't end as the new read starts.
+    __disable_irq();
+    hung = busy;
+    done = 0;
+    __enable_irq();
+    if (hung)
+        i2cRecover();
+
+    done = done_;
+    i2cReadBegin(addr_, reg_, len, buf);
+    return true;
+}
+
+FAST_CODE void i2c_ev_handler(void)
 {
     static uint8_t subaddress_sent, final_stop; //flag to indicate if subaddess sent, flag to indicate final bus condition
     static int8_t index;        //index is signed -1==send the subaddress
@@ -178,17 +292,17 @@ void i2c_ev_handler(void)
     if (SReg_1 & 0x0001)        //we just sent a start - EV5 in ref manual
     {
         I2Cx->CR1 &= ~0x0800;   //reset the POS bit so ACK/NACK applied to the current byte
-        I2C_AcknowledgeConfig(I2Cx, ENABLE);    //make sure ACK is on
+        I2Cx->CR1 |= I2C_CR1_ACK;    //make sure ACK is on
         index = 0;              //reset the index
         if (reading && (subaddress_sent || 0xFF == reg))        //we have sent the subaddr
         {
             subaddress_sent = 1;        //make sure this is set in case of no subaddress, so following code runs correctly
             if (bytes == 2)
                 I2Cx->CR1 |= 0x0800;    //set the POS bit so NACK applied to the final byte in the two byte read
-            I2C_Send7bitAddress(I2Cx, addr, I2C_Direction_Receiver);    //send the address and set hardware mode
+            I2Cx->DR = addr | 1;    //send the address and set hardware mode
         } else                  //direction is Tx, or we havent sent the sub and rep start
         {
-            I2C_Send7bitAddress(I2Cx, addr, I2C_Direction_Transmitter); //send the address and set hardware mode
+            I2Cx->DR = addr; //send the address and set hardware mode
             if (reg != 0xFF)    //0xFF as subaddress means it will be ignored, in Tx or Rx mode
                 index = -1;     //send a subaddress
         }
@@ -199,24 +313,24 @@ void i2c_ev_handler(void)
         __DMB();                //memory fence to control hardware
         if (bytes == 1 && reading && subaddress_sent)   //we are receiving 1 byte - EV6_3
         {
-            I2C_AcknowledgeConfig(I2Cx, DISABLE);       //turn off ACK
+            I2Cx->CR1 &= ~I2C_CR1_ACK;       //turn off ACK
             __DMB();
             a = I2Cx->SR2;      //clear ADDR after ACK is turned off
-            I2C_GenerateSTOP(I2Cx, ENABLE);     //program the stop
+            I2Cx->CR1 |= I2C_CR1_STOP;     //program the stop
             final_stop = 1;
-            I2C_ITConfig(I2Cx, I2C_IT_BUF, ENABLE);     //allow us to have an EV7
+            I2Cx->CR2 |= I2C_CR2_ITBUFEN;     //allow us to have an EV7
         } else                  //EV6 and EV6_1
         {
             a = I2Cx->SR2;      //clear the ADDR here
             __DMB();
             if (bytes == 2 && reading && subaddress_sent)       //rx 2 bytes - EV6_1
             {
-                I2C_AcknowledgeConfig(I2Cx, DISABLE);   //turn off ACK
-                I2C_ITConfig(I2Cx, I2C_IT_BUF, DISABLE);        //disable TXE to allow the buffer to fill
+                I2Cx->CR1 &= ~I2C_CR1_ACK;   //turn off ACK
+                I2Cx->CR2 &= ~I2C_CR2_ITBUFEN;        //disable TXE to allow the buffer to fill
             } else if (bytes == 3 && reading && subaddress_sent)        //rx 3 bytes
-                I2C_ITConfig(I2Cx, I2C_IT_BUF, DISABLE);        //make sure RXNE disabled so we get a BTF in two bytes time
+                I2Cx->CR2 &= ~I2C_CR2_ITBUFEN;        //make sure RXNE disabled so we get a BTF in two bytes time
             else                //receiving greater than three bytes, sending subaddress, or transmitting
-                I2C_ITConfig(I2Cx, I2C_IT_BUF, ENABLE);
+                I2Cx->CR2 |= I2C_CR2_ITBUFEN;
         }
     } else if (SReg_1 & 0x004)  //Byte transfer finished - EV7_2, EV7_3 or EV8_2
     {
@@ -225,33 +339,33 @@ void i2c_ev_handler(void)
         {
             if (bytes > 2)      //EV7_2
             {
-                I2C_AcknowledgeConfig(I2Cx, DISABLE);   //turn off ACK
-                read_p[index++] = I2C_ReceiveData(I2Cx);        //read data N-2
-                I2C_GenerateSTOP(I2Cx, ENABLE); //program the Stop
+                I2Cx->CR1 &= ~I2C_CR1_ACK;   //turn off ACK
+                read_p[index++] = (uint8_t)I2Cx->DR;        //read data N-2
+                I2Cx->CR1 |= I2C_CR1_STOP; //program the Stop
                 final_stop = 1; //required to fix hardware
-                read_p[index++] = I2C_ReceiveData(I2Cx);        //read data N-1
-                I2C_ITConfig(I2Cx, I2C_IT_BUF, ENABLE); //enable TXE to allow the final EV7
+                read_p[index++] = (uint8_t)I2Cx->DR;        //read data N-1
+                I2Cx->CR2 |= I2C_CR2_ITBUFEN; //enable TXE to allow the final EV7
             } else              //EV7_3
             {
                 if (final_stop)
-                    I2C_GenerateSTOP(I2Cx, ENABLE);     //program the Stop
+                    I2Cx->CR1 |= I2C_CR1_STOP;     //program the Stop
                 else
-                    I2C_GenerateSTART(I2Cx, ENABLE);    //program a rep start
-                read_p[index++] = I2C_ReceiveData(I2Cx);        //read data N-1
-                read_p[index++] = I2C_ReceiveData(I2Cx);        //read data N
+                    I2Cx->CR1 |= I2C_CR1_START;    //program a rep start
+                read_p[index++] = (uint8_t)I2Cx->DR;        //read data N-1
+                read_p[index++] = (uint8_t)I2Cx->DR;        //read data N
                 index++;        //to show job completed
             }
         } else                  //EV8_2, which may be due to a subaddress sent or a write completion
         {
             if (subaddress_sent || (writing)) {
                 if (final_stop)
-                    I2C_GenerateSTOP(I2Cx, ENABLE);     //program the Stop
+                    I2Cx->CR1 |= I2C_CR1_STOP;     //program the Stop
                 else
-                    I2C_GenerateSTART(I2Cx, ENABLE);    //program a rep start
+                    I2Cx->CR1 |= I2C_CR1_START;    //program a rep start
                 index++;        //to show that the job is complete
             } else              //We need to send a subaddress
             {
-                I2C_GenerateSTART(I2Cx, ENABLE);        //program the repeated Start
+                I2Cx->CR1 |= I2C_CR1_START;        //program the repeated Start
                 subaddress_sent = 1;    //this is set back to zero upon completion of the current task
             }
         }
@@ -259,22 +373,22 @@ void i2c_ev_handler(void)
         }                       //we must wait for the start to clear, otherwise we get constant BTF
     } else if (SReg_1 & 0x0040) //Byte received - EV7
     {
-        read_p[index++] = I2C_ReceiveData(I2Cx);
+        read_p[index++] = (uint8_t)I2Cx->DR;
         if (bytes == (index + 3))
-            I2C_ITConfig(I2Cx, I2C_IT_BUF, DISABLE);    //disable TXE to allow the buffer to flush so we can get an EV7_2
+            I2Cx->CR2 &= ~I2C_CR2_ITBUFEN;    //disable TXE to allow the buffer to flush so we can get an EV7_2
         if (bytes == index)     //We have completed a final EV7
             index++;            //to show job is complete
     } else if (SReg_1 & 0x0080) //Byte transmitted -EV8/EV8_1
     {
         if (index != -1) {      //we dont have a subaddress to send
-            I2C_SendData(I2Cx, write_p[index++]);
+            I2Cx->DR = write_p[index++];
             if (bytes == index) //we have sent all the data
-                I2C_ITConfig(I2Cx, I2C_IT_BUF, DISABLE);        //disable TXE to allow the buffer to flush
+                I2Cx->CR2 &= ~I2C_CR2_ITBUFEN;        //disable TXE to allow the buffer to flush
         } else {
             index++;
-            I2C_SendData(I2Cx, reg);    //send the subaddress
+            I2Cx->DR = reg;    //send the subaddress
             if (reading || !bytes)      //if receiving or sending 0 bytes, flush now
-                I2C_ITConfig(I2Cx, I2C_IT_BUF, DISABLE);        //disable TXE to allow the buffer to flush
+                I2Cx->CR2 &= ~I2C_CR2_ITBUFEN;        //disable TXE to allow the buffer to flush
         }
     }
     if (index == bytes + 1)     //we have completed the current job
@@ -283,8 +397,8 @@ void i2c_ev_handler(void)
         //End of completion tasks
         subaddress_sent = 0;    //reset this here
         if (final_stop)         //If there is a final stop and no more jobs, bus is inactive, disable interrupts to prevent BTF
-            I2C_ITConfig(I2Cx, I2C_IT_EVT | I2C_IT_ERR, DISABLE);       //Disable EVT and ERR interrupts while bus inactive
-        busy = 0;
+            I2Cx->CR2 &= ~(I2C_CR2_ITEVTEN | I2C_CR2_ITERREN);       //Disable EVT and ERR interrupts while bus inactive
+        finish();
     }
 }
 
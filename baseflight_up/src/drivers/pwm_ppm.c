@@ -369,61 +369,91 @@ static pwmPortData_t *pwmInConfig(uint8_t port, pwmCallbackPtr callback, uint8_t
     return p;
 }
 
-void TIM1_CC_IRQHandler(void)
+// The capture paths run from RAM and touch the timer registers directly, a
+// StdPeriph call would be a long branch back into flash. A flag only counts
+// when its interrupt is enabled, as TIM_GetITStatus() has it. Writing zero
+// clears a flag, ones leave the rest alone.
+FAST_CODE void TIM1_CC_IRQHandler(void)
 {
+    uint16_t pending = TIM1->SR & TIM1->DIER;
     uint8_t port;
 
-    if (TIM_GetITStatus(TIM1, TIM_IT_CC1) == SET) {
+    perfCount(isrRcInput);
+
+    if (pending & TIM_IT_CC1) {
         port = PWM9;
-        TIM_ClearITPendingBit(TIM1, TIM_IT_CC1);
-        pwmPorts[port].callback(port, TIM_GetCapture1(TIM1));
-    } else if (TIM_GetITStatus(TIM1, TIM_IT_CC4) == SET) {
+        TIM1->SR = (uint16_t)~TIM_IT_CC1;
+        traceBegin(RC, rcCapture, port);
+        pwmPorts[port].callback(port, TIM1->CCR1);
+        traceEnd(RC, rcCapture, port);
+    } else if (pending & TIM_IT_CC4) {
         port = PWM10;
-        TIM_ClearITPendingBit(TIM1, TIM_IT_CC4);
-        pwmPorts[port].callback(port, TIM_GetCapture4(TIM1));
+        TIM1->SR = (uint16_t)~TIM_IT_CC4;
+        traceBegin(RC, rcCapture, port);
+        pwmPorts[port].callback(port, TIM1->CCR4);
+        traceEnd(RC, rcCapture, port);
     }
 }
 
-static void pwmTIMxHandler(TIM_TypeDef *tim, uint8_t portBase)
+static FAST_CODE void pwmTIMxHandler(TIM_TypeDef *tim, uint8_t portBase)
 {
+    uint16_t pending = tim->SR & tim->DIER;
     int8_t port;
     
+    perfCount(isrRcInput);
+
     // Generic CC handler for TIM2,3,4
-    if (TIM_GetITStatus(tim, TIM_IT_CC1) == SET) {
+    if (pending & TIM_IT_CC1) {
         port = portBase + 0;
-        TIM_ClearITPendingBit(tim, TIM_IT_CC1);
-        pwmPorts[port].callback(port, TIM_GetCapture1(tim));
-    } else if (TIM_GetITStatus(tim, TIM_IT_CC2) == SET) {
+        tim->SR = (uint16_t)~TIM_IT_CC1;
+        traceBegin(RC, rcCapture, port);
+        pwmPorts[port].callback(port, tim->CCR1);
+        traceEnd(RC, rcCapture, port);
+    } else if (pending & TIM_IT_CC2) {
         port = portBase + 1;
-        TIM_ClearITPendingBit(tim, TIM_IT_CC2);
-        pwmPorts[port].callback(port, TIM_GetCapture2(tim));
-    } else if (TIM_GetITStatus(tim, TIM_IT_CC3) == SET) {
+        tim->SR = (uint16_t)~TIM_IT_CC2;
+        traceBegin(RC, rcCapture, port);
+        pwmPorts[port].callback(port, tim->CCR2);
+        traceEnd(RC, rcCapture, port);
+    } else if (pending & TIM_IT_CC3) {
         port = portBase + 2;
-        TIM_ClearITPendingBit(tim, TIM_IT_CC3);
-        pwmPorts[port].callback(port, TIM_GetCapture3(tim));
-    } else if (TIM_GetITStatus(tim, TIM_IT_CC4) == SET) {
+        tim->SR = (uint16_t)~TIM_IT_CC3;
+        traceBegin(RC, rcCapture, port);
+        pwmPorts[port].callback(port, tim->CCR3);
+        traceEnd(RC, rcCapture, port);
+    } else if (pending & TIM_IT_CC4) {
         port = portBase + 3;
-        TIM_ClearITPendingBit(tim, TIM_IT_CC4);
-        pwmPorts[port].callback(port, TIM_GetCapture4(tim));
+        tim->SR = (uint16_t)~TIM_IT_CC4;
+        traceBegin(RC, rcCapture, port);
+        pwmPorts[port].callback(port, tim->CCR4);
+        traceEnd(RC, rcCapture, port);
     }
 }
 
-void TIM2_IRQHandler(void)
+// Flips the capture edge of a channel already set up by pwmICConfig().
+// channel is TIM_Channel_x, 4 bits apart in CCER, and the polarity values
+// are the CC1P bit.
+static FAST_CODE void pwmICPolarity(TIM_TypeDef *tim, uint8_t channel, uint16_t polarity)
+{
+    tim->CCER = (tim->CCER & ~(TIM_CCER_CC1P << channel)) | (polarity << channel);
+}
+
+FAST_CODE void TIM2_IRQHandler(void)
 {
     pwmTIMxHandler(TIM2, PWM1); // PWM1..4
 }
 
-void TIM3_IRQHandler(void)
+FAST_CODE void TIM3_IRQHandler(void)
 {
     pwmTIMxHandler(TIM3, PWM5); // PWM5..8
 }
 
-void TIM4_IRQHandler(void)
+FAST_CODE void TIM4_IRQHandler(void)
 {
     pwmTIMxHandler(TIM4, PWM11); // PWM11..14
 }
 
-static void ppmCallback(uint8_t port, uint16_t capture)
+static FAST_CODE void ppmCallback(uint8_t port, uint16_t capture)
 {
     uint16_t diff;
     static uint16_t now;
@@ -433,32 +463,46 @@ static void ppmCallback(uint8_t port, uint16_t capture)
     last = now;
     now = capture;
     diff = now - last;
+    traceInstant(RC, ppmPulse, diff);
 
     if (diff > 2700) { // Per http://www.rcgroups.com/forums/showpost.php?p=21996147&postcount=3960 "So, if you use 2.5ms or higher as being the reset for the PPM stream start, you will be fine. I use 2.7ms just to be safe."
+        if (chan >= 4) {
+            perfCount(rcFrames);
+            rcFrameTime = micros();
+        } else if (chan)
+            perfCount(rcGlitches);
         chan = 0;
     } else {
         if (diff > 750 && diff < 2250 && chan < 8) {   // 750 to 2250 ms is our 'valid' channel range
             captures[chan] = diff;
+        } else if (chan < 8) {
+            perfCount(rcGlitches);
         }
         chan++;
         failsafeCnt = 0;
     }
 }
 
-static void pwmCallback(uint8_t port, uint16_t capture)
+static FAST_CODE void pwmCallback(uint8_t port, uint16_t capture)
 {
     if (pwmPorts[port].state == 0) {
         pwmPorts[port].rise = capture;
         pwmPorts[port].state = 1;
-        pwmICConfig(timerHardware[port].tim, timerHardware[port].channel, TIM_ICPolarity_Falling);
+        pwmICPolarity(timerHardware[port].tim, timerHardware[port].channel, TIM_ICPolarity_Falling);
     } else {
         pwmPorts[port].fall = capture;
         // compute capture
         pwmPorts[port].capture = pwmPorts[port].fall - pwmPorts[port].rise;
         captures[pwmPorts[port].channel] = pwmPorts[port].capture;
+        if (pwmPorts[port].capture < 750 || pwmPorts[port].capture > 2250)
+            perfCount(rcGlitches);
+        else if (pwmPorts[port].channel == 0) {
+            perfCount(rcFrames);
+            rcFrameTime = micros();
+        }
         // switch state
         pwmPorts[port].state = 0;
-        pwmICConfig(timerHardware[port].tim, timerHardware[port].channel, TIM_ICPolarity_Rising);
+        pwmICPolarity(timerHardware[port].tim, timerHardware[port].channel, TIM_ICPolarity_Rising);
         // reset failsafe
         failsafeCnt = 0;
     }
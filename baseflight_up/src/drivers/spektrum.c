@@ -47,6 +47,8 @@ static void spektrumDataReceive(uint16_t c)
         spekFramePosition = 0;
     spekFrame[spekFramePosition] = (uint8_t)c;
     if (spekFramePosition == SPEK_FRAME_SIZE - 1) {
+        perfCount(rcFrames);
+        rcFrameTime = spekTime;
         rcFrameComplete = true;
         failsafeCnt = 0;   // clear FailSafe counter
     } else {
@@ -32,16 +32,36 @@ typedef struct gpio_config_t {
 // Cycles per microsecond
 static volatile uint32_t usTicks = 0;
 
-// Current uptime for 1kHz systick timer. will rollover after 49 days.
-// Hopefully we won't care.
+// SysTick runs at the gyro rate, it starts the bus tick. Uptime in SysTicks
+// will rollover after 24 days. Hopefully we won't care.
+#define SYSTICK_US          GYRO_PERIOD
+#define SYSTICK_PRIORITY    8       // pre-emption 2, above the tick it starts
+#define TICK_PRIORITY       15      // pre-emption 3 sub 3, the lowest
+#define TICK_BASEPRI        (TICK_PRIORITY << (8 - __NVIC_PRIO_BITS))
+
+// Fails to compile when a millisecond is not a whole number of SysTicks
+typedef char sysTickDividesMillisecond[(1000 % SYSTICK_US) ? -1 : 1];
+
 static volatile uint32_t sysTickUptime = 0;
 
+static event_callback tickCallback;
+
 // Cycle Counter
 static void cycleCounterInit(void)
 {
     RCC_ClocksTypeDef clocks;
     RCC_GetClocksFreq(&clocks);
     usTicks = clocks.SYSCLK_Frequency / 1000000;
+    
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT_CYCCNT = 0;
+    DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+}
+
+// Free running core clock count, wraps every ~60 s at 72 MHz
+uint32_t cycleCount(void)
+{
+    return DWT_CYCCNT;
 }
 
 // Coarse Timer Utilities
@@ -62,20 +82,35 @@ struct single_timer_event {
 static volatile struct single_timer_event singleEvents[TIMER_MAX_EVENTS];
 static volatile struct periodic_timer_event periodicEvents[TIMER_MAX_EVENTS];
 
+// See system.h for the order events run in
 void eventCallbacks(void)
 {
 	uint8_t i;
-    uint32_t temp;
+    uint32_t temp, elapsed, late;
+    bool ran = false;
     
 	for (i = 0; i < TIMER_MAX_EVENTS; ++i) {
 		if (singleEvents[i].callback && (micros() - singleEvents[i].start) > singleEvents[i].delay) {
 			singleEvents[i].callback();
             singleEvents[i].callback = 0;
-		} if (periodicEvents[i].callback && (micros() - periodicEvents[i].start) > periodicEvents[i].period) {
+		} if (periodicEvents[i].callback && (!ran || !periodicEvents[i].period) &&
+              (elapsed = micros() - periodicEvents[i].start) > periodicEvents[i].period) {
+            // A whole period late means a run has been skipped. Period 0
+            // is polled every pass and keeps its own time, it can't be late.
+            late = elapsed - periodicEvents[i].period;
+            if (periodicEvents[i].period) {
+                if (late >= periodicEvents[i].period)
+                    perfCount(schedOverruns);
+                perfPeak(schedLatePeak, late);
+            }
+            traceBegin(SCHED, task, (uintptr_t)periodicEvents[i].callback >> 1);
 			periodicEvents[i].callback();
+            traceEnd(SCHED, task, (uintptr_t)periodicEvents[i].callback >> 1);
             temp = periodicEvents[i].start;
 			periodicEvents[i].start = micros();
             periodicEvents[i].delta = periodicEvents[i].start - temp;
+            if (periodicEvents[i].period)
+                ran = true;
 		}
 	}
 }
@@ -111,30 +146,75 @@ void printEventDeltas(void)
     printf_min("%u\n", periodicEvents[TIMER_MAX_EVENTS - 1].delta);
 }
 
+// Last measured period of a periodic event slot, 0 for an empty slot
+uint32_t periodicEventDelta(uint8_t index)
+{
+    return periodicEvents[index].callback ? periodicEvents[index].delta : 0;
+}
+
 
 // SysTick
 void SysTick_Handler(void)
 {
     sysTickUptime++;
+    if (tickCallback)
+        SCB->ICSR = SCB_ICSR_PENDSVSET;
+}
+
+// Runs as soon as SysTick returns, ahead of the main loop but below every
+// other interrupt, so the drivers the tick waits on keep running
+void PendSV_Handler(void)
+{
+    tickCallback();
+}
+
+// Runs callback from an interrupt at the start of every SysTick, once every
+// GYRO_PERIOD whatever the main loop is doing
+void tickEvent(event_callback callback)
+{
+    tickCallback = callback;
+}
+
+// Runs the tick callback again as soon as the interrupts above it are done,
+// for a tick that waits on one of them
+void tickPend(void)
+{
+    SCB->ICSR = SCB_ICSR_PENDSVSET;
+}
+
+// Keeps the tick from starting until tickRelease(), for the main loop to use
+// what the tick uses. A tick that comes due meanwhile starts on release.
+uint32_t tickHold(void)
+{
+    uint32_t held = __get_BASEPRI();
+
+    if (!held || held > TICK_BASEPRI)
+        __set_BASEPRI(TICK_BASEPRI);
+    return held;
+}
+
+void tickRelease(uint32_t held)
+{
+    __set_BASEPRI(held);
 }
 
 
-// System Time in Microseconds
-uint32_t micros(void)
+// System Time in Microseconds, from RAM as the capture interrupts use it
+FAST_CODE uint32_t micros(void)
 {
-    register uint32_t ms, cycle_cnt;
+    register uint32_t ticks, cycle_cnt;
     do {
-        ms = sysTickUptime;
+        ticks = sysTickUptime;
         cycle_cnt = SysTick->VAL;
-    } while (ms != sysTickUptime);
-    return (ms * 1000) + (72000 - cycle_cnt) / 72;
+    } while (ticks != sysTickUptime);
+    return (ticks * SYSTICK_US) + (SYSTICK_US * 72 - cycle_cnt) / 72;
 }
 
 
 // System Time in Milliseconds
 uint32_t millis(void)
 {
-    return sysTickUptime;
+    return sysTickUptime / (1000 / SYSTICK_US);
 }
 
 
@@ -206,6 +286,7 @@ void systemInit(void)
     RCC_APB1PeriphClockCmd(RCC_APB1Periph_I2C2, ENABLE);
     RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA1, ENABLE);
     RCC_AHBPeriphClockCmd(RCC_AHBPeriph_DMA2, ENABLE);
+    RCC_AHBPeriphClockCmd(RCC_AHBPeriph_CRC, ENABLE);
     RCC_ClearFlag();
 
     // Make all GPIO in by default to save power and reduce noise
@@ -237,10 +318,12 @@ void systemInit(void)
     cycleCounterInit();
 
     // SysTick
-    SysTick_Config(SystemCoreClock / 1000);
+    SysTick_Config(SystemCoreClock / 1000000 * SYSTICK_US);
 
     LED0_OFF();
     LED1_OFF();
 
     NVIC_PriorityGroupConfig(NVIC_PriorityGroup_2);     // 2 bits for pre-emption priority, 2 bits for subpriority
+    NVIC_SetPriority(SysTick_IRQn, SYSTICK_PRIORITY);   // micros() keeps counting through the tick
+    NVIC_SetPriority(PendSV_IRQn, TICK_PRIORITY);
 }
\ No newline at end of file
@@ -15,11 +15,28 @@
 
 #pragma once
 
-#define TIMER_MAX_EVENTS 16
+#define TIMER_MAX_EVENTS 18
+
+// DWT cycle counter, not described by this CMSIS version
+#define DWT_CTRL            (*(volatile uint32_t *)0xE0001000)
+#define DWT_CYCCNT          (*(volatile uint32_t *)0xE0001004)
+#define DWT_CTRL_CYCCNTENA  0x00000001
 
 /* Course timer utilities */
 typedef void (*event_callback)(void);
 
+// eventCallbacks(), called from the main loop, runs every single event that
+// is due but only one timed periodic event a pass: the first one added with
+// its period passed. The order of periodicEvent() calls is the priority
+// order, a task waits at most for the one that was running when it came due
+// and for those added before it. Periodic events with period 0 are polled
+// on every pass.
+//
+// tickEvent() is not a task. Its callback runs from the lowest priority
+// interrupt every GYRO_PERIOD, on the SysTick grid, and pre-empts the main
+// loop. tickPend() runs it again between ticks. The main loop holds it off
+// with tickHold() while it uses what the callback uses.
+
 /* Limited to TIMER_MAX_EVENTS */
 void singleEvent(event_callback callback, uint32_t delay);
 
@@ -27,8 +44,18 @@ void periodicEvent(event_callback callback, uint32_t period);
 
 void eventCallbacks(void);
 
+void tickEvent(event_callback callback);
+
+void tickPend(void);
+
+uint32_t tickHold(void);
+
+void tickRelease(uint32_t held);
+
 void printEventDeltas(void);
 
+uint32_t periodicEventDelta(uint8_t index);
+
 void delayMicroseconds(uint32_t us);
 
 void delay(uint32_t ms);
@@ -37,6 +64,8 @@ uint32_t micros(void);
 
 uint32_t millis(void);
 
+uint32_t cycleCount(void);
+
 void failureMode(uint8_t mode);
 
 void systemReset(bool toBootloader);
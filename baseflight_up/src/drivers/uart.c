@@ -14,10 +14,19 @@
 volatile uint8_t rxBuffer[UART_BUFFER_SIZE];
 uint32_t rxDMAPos = 0;
 volatile uint8_t txBuffer[UART_BUFFER_SIZE];
-uint32_t txBufferTail = 0;
-uint32_t txBufferHead = 0;
+volatile uint32_t txBufferTail = 0;
+volatile uint32_t txBufferHead = 0;
 
-static void uartTxDMA(void)
+// Write position of a frame that has been reserved but not yet committed
+static uint32_t txFrameHead = 0;
+
+// Set by the idle line interrupt once a burst of bytes has finished arriving
+static volatile bool rxIdle = false;
+
+// The interrupt paths below run from RAM and touch the registers directly,
+// a StdPeriph call would be a long branch back into flash.
+
+static FAST_CODE void uartTxDMA(void)
 {
     DMA1_Channel4->CMAR = (uint32_t)&txBuffer[txBufferTail];
     if (txBufferHead > txBufferTail) {
@@ -28,13 +37,15 @@ static void uartTxDMA(void)
         txBufferTail = 0;
     }
 
-    DMA_Cmd(DMA1_Channel4, ENABLE);
+    DMA1_Channel4->CCR |= DMA_CCR4_EN;
 }
 
-void DMA1_Channel4_IRQHandler(void)
+FAST_CODE void DMA1_Channel4_IRQHandler(void)
 {
-    DMA_ClearITPendingBit(DMA1_IT_TC4);
-    DMA_Cmd(DMA1_Channel4, DISABLE);
+    perfCount(isrUart);
+    traceInstant(UART, uartTxDone, 0);
+    DMA1->IFCR = DMA_IFCR_CTCIF4;
+    DMA1_Channel4->CCR &= ~DMA_CCR4_EN;
 
     if (txBufferHead != txBufferTail)
         uartTxDMA();
@@ -64,6 +75,13 @@ void uartInit(uint32_t speed)
     NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
     NVIC_Init(&NVIC_InitStructure);
 
+    // RX idle line interrupt, lowest priority as it only raises a flag
+    NVIC_InitStructure.NVIC_IRQChannel = USART1_IRQn;
+    NVIC_InitStructure.NVIC_IRQChannelPreemptionPriority = 3;
+    NVIC_InitStructure.NVIC_IRQChannelSubPriority = 3;
+    NVIC_InitStructure.NVIC_IRQChannelCmd = ENABLE;
+    NVIC_Init(&NVIC_InitStructure);
+
     USART_InitStructure.USART_BaudRate = speed;
     USART_InitStructure.USART_WordLength = USART_WordLength_8b;
     USART_InitStructure.USART_StopBits = USART_StopBits_1;
@@ -105,9 +123,38 @@ void uartInit(uint32_t speed)
     DMA1_Channel4->CNDTR = 0;
     USART_DMACmd(USART1, USART_DMAReq_Tx, ENABLE);
 
+    USART_ITConfig(USART1, USART_IT_IDLE, ENABLE);
     USART_Cmd(USART1, ENABLE);
 }
 
+FAST_CODE void USART1_IRQHandler(void)
+{
+    uint16_t SR = USART1->SR;
+
+    perfCount(isrUart);
+
+    // IDLE is the only interrupt enabled. The DMA has already stored the
+    // bytes, reading SR then DR clears IDLE, and an overrun the DMA was too
+    // slow for with it
+    if (SR & USART_SR_IDLE) {
+        (void)USART1->DR;
+        if (SR & USART_FLAG_ORE)
+            perfCount(uartRxOverruns);
+        traceInstant(UART, uartIdle, SR);
+        rxIdle = true;
+    }
+}
+
+// True once per burst of received bytes, consumed by the caller
+bool uartRxIdle(void)
+{
+    if (!rxIdle)
+        return false;
+
+    rxIdle = false;
+    return true;
+}
+
 uint16_t uartAvailable(void)
 {
     return (DMA_GetCurrDataCounter(DMA1_Channel5) != rxDMAPos) ? true : false;
@@ -123,6 +170,7 @@ uint8_t uartRead(void)
     uint8_t ch;
 
     ch = rxBuffer[UART_BUFFER_SIZE - rxDMAPos];
+    perfCount(uartRxRead);
     // go back around the buffer
     if (--rxDMAPos == 0)
         rxDMAPos = UART_BUFFER_SIZE;
@@ -130,22 +178,91 @@ uint8_t uartRead(void)
     return ch;
 }
 
+// Ring index of the next byte uartRead() will return, bytes stay valid in
+// rxBuffer until the DMA wraps round to them again
+uint16_t uartRxIndex(void)
+{
+    return UART_BUFFER_SIZE - rxDMAPos;
+}
+
+uint8_t uartRxAt(uint16_t index)
+{
+    return rxBuffer[index & (UART_BUFFER_SIZE - 1)];
+}
+
 uint8_t uartReadPoll(void)
 {
     while (!uartAvailable()); // wait for some bytes
     return uartRead();
 }
 
+// Bytes queued plus bytes the DMA has not clocked out yet. The DMA interrupt
+// restarts the transfer and moves the tail on together, so CNDTR is only
+// trusted when the tail read either side of it is the same. Once the pair is
+// taken the interrupt can only free bytes, so the count errs high.
+static uint32_t uartTxUsed(void)
+{
+    uint32_t tail, inFlight;
+
+    do {
+        tail = txBufferTail;
+        inFlight = (DMA1_Channel4->CCR & 1) ? DMA1_Channel4->CNDTR : 0;
+    } while (tail != txBufferTail);
+
+    return ((txBufferHead - tail) & (UART_BUFFER_SIZE - 1)) + inFlight;
+}
+
+uint16_t uartTxFree(void)
+{
+    return UART_BUFFER_SIZE - 1 - uartTxUsed();
+}
+
 void uartWrite(uint8_t ch)
 {
+    // Full, drop the byte rather than wait on the DMA or overwrite queued bytes
+    if (!uartTxFree()) {
+        perfCount(uartTxOverflows);
+        return;
+    }
+
     txBuffer[txBufferHead] = ch;
-    txBufferHead = (txBufferHead + 1) % UART_BUFFER_SIZE;
+    perfCount(uartTxBytes);
+    txBufferHead = (txBufferHead + 1) & (UART_BUFFER_SIZE - 1);
 
     // if DMA wasn't enabled, fire it up
     if (!(DMA1_Channel4->CCR & 1))
         uartTxDMA();
 }
 
+// Frame writes: claim len bytes, fill them in place with uartFramePut() and
+// publish them with a single DMA start in uartFrameCommit(). Nothing is
+// visible to the DMA until the commit, so an abandoned frame costs nothing.
+bool uartFrameBegin(uint16_t len)
+{
+    if (len > uartTxFree()) {
+        perfCount(uartTxOverflows);
+        return false;
+    }
+
+    txFrameHead = txBufferHead;
+    return true;
+}
+
+void uartFramePut(uint8_t ch)
+{
+    txBuffer[txFrameHead] = ch;
+    txFrameHead = (txFrameHead + 1) & (UART_BUFFER_SIZE - 1);
+}
+
+void uartFrameCommit(void)
+{
+    perfAdd(uartTxBytes, (txFrameHead - txBufferHead) & (UART_BUFFER_SIZE - 1));
+    txBufferHead = txFrameHead;
+
+    if (!(DMA1_Channel4->CCR & 1))
+        uartTxDMA();
+}
+
 void uartPrint(char *str)
 {
     while (*str)
@@ -208,26 +325,40 @@ void uart2Write(uint8_t ch)
     if (uart2RxOnly)
         return;
 
+    // Full, drop the byte rather than the whole buffer
+    if ((tx2BufferHead + 1) % UART2_BUFFER_SIZE == tx2BufferTail) {
+        perfCount(uart2TxOverflows);
+        return;
+    }
+
     tx2Buffer[tx2BufferHead] = ch;
     tx2BufferHead = (tx2BufferHead + 1) % UART2_BUFFER_SIZE;
 
     USART_ITConfig(USART2, USART_IT_TXE, ENABLE);
 }
 
-void USART2_IRQHandler(void)
+FAST_CODE void USART2_IRQHandler(void)
 {
     uint16_t SR = USART2->SR;
 
-    if (SR & USART_IT_RXNE) {
+    perfCount(isrUart2);
+    traceBegin(UART, uart2, SR);
+
+    if (SR & USART_FLAG_ORE)
+        perfCount(uart2RxOverruns);
+    if (SR & USART_SR_RXNE) {
+        perfCount(uart2RxBytes);
         if (uart2Callback)
-            uart2Callback(USART_ReceiveData(USART2));
+            uart2Callback(USART2->DR & 0x01FF);
     }
     if (SR & USART_FLAG_TXE) {
         if (tx2BufferTail != tx2BufferHead) {
             USART2->DR = tx2Buffer[tx2BufferTail];
             tx2BufferTail = (tx2BufferTail + 1) % UART2_BUFFER_SIZE;
         } else {
-            USART_ITConfig(USART2, USART_IT_TXE, DISABLE);
+            USART2->CR1 &= ~USART_CR1_TXEIE;
         }
     }
+
+    traceEnd(UART, uart2, SR);
 }
\ No newline at end of file
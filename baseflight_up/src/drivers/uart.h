@@ -12,8 +12,17 @@ uint16_t uartAvailable(void);
 bool uartTransmitEmpty(void);
 uint8_t uartRead(void);
 uint8_t uartReadPoll(void);
+bool uartRxIdle(void);
+uint16_t uartRxIndex(void);
+uint8_t uartRxAt(uint16_t index);
 void uartWrite(uint8_t ch);
 void uartPrint(char *str);
+uint16_t uartTxFree(void);
+
+// No uartWrite() between begin and commit
+bool uartFrameBegin(uint16_t len);
+void uartFramePut(uint8_t ch);
+void uartFrameCommit(void);
 
 // USART2 (
 void uart2Init(uint32_t speed, uartReceiveCallbackPtr func, bool rxOnly);
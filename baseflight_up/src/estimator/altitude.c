@@ -31,6 +31,7 @@ void updateAltitude(void)
     hcsr04_get_distance(&sonarAltitude);
     altHistTab[altHistIdx] = sonarAltitude / 10;
 #else
+    baroCalculate();
     altHistTab[altHistIdx] = sensorData.baroAltitude / 10;
 #endif
     altHigh += altHistTab[altHistIdx];
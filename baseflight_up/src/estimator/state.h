@@ -54,7 +54,8 @@ typedef struct {
 	 float q[4]; // quaternion of sensor frame relative to auxiliary frame
 	 
 	 // Entries for storing processed sensor data
-	 float gyro[3];
+	 float gyro[3];     // averaged each actuator cycle by updateRateGyro()
+	 uint32_t gyroTime; // micros() the averaged gyro samples stand for
 	 
 	 float accel[3];
 	 	 
@@ -66,4 +67,23 @@ typedef struct {
 
 extern AHRS_StateData stateData;
 
-void updateAttitude(void);
\ No newline at end of file
+// Everything updateAttitude() carries from one call to the next
+typedef struct {
+    AHRS_StateData state;
+    filterChain_t accelFilter[3];
+    float attitudeGyro[3];
+    float errInt[3];
+    uint32_t last;
+} attitudeSnapshot_t;
+
+void initAttitude(void);
+
+void updateAttitude(void);
+
+void updateEulerAngles(void);
+
+void updateRateGyro(void);
+
+void attitudeSave(attitudeSnapshot_t *snapshot);
+
+void attitudeRestore(const attitudeSnapshot_t *snapshot);
\ No newline at end of file
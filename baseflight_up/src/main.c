@@ -19,14 +19,22 @@
 #include "actuator/pid.h"
 #include "actuator/stabilisation.h"
 
+#include "core/blackbox.h"
 #include "core/command.h"
+#include "core/crashlog.h"
+#include "core/latency.h"
 #include "core/serial.h"
+#include "core/stack.h"
+#include "core/telemetry.h"
 
 #include "drivers/adc.h"
 #include "drivers/i2c.h"
 #include "drivers/pwm_ppm.h"
 #include "drivers/spektrum.h"
 
+#include "sensors/bus_sched.h"
+#include "sensors/dyn_notch.h"
+
 uint32_t cycleTime;
 
 void highSpeedTelemetry(void);
@@ -37,14 +45,18 @@ int main(void)
 {
     drv_pwm_config_t pwm_params;
     
+    stackInit();
     systemInit();
     
     checkFirstTime(false);
     readEEPROM();
+    blackboxInit();
+    crashlogInit();
+    traceInit();
     
     adcInit();
     i2cInit(I2C2);
-    uartInit(115200);
+    uartInit(SERIAL_BAUD);
     
     sensorsInit();
     
@@ -78,6 +90,10 @@ int main(void)
     pwmInit(&pwm_params);
 
     initPIDs();
+    initAttitude();
+    initStabilisation();
+    if(cfg.dynNotchEnable)
+        dynNotchInit();
     
 #ifdef THESIS
     uart2Init(9600, currentDataReceive, true);
@@ -87,19 +103,41 @@ int main(void)
     if(cfg.gyroBiasOnStartup)
         computeGyroRTBias();
     
-    periodicEvent(gyroSample, 500);
+    // Everything on I2C2 is read from one tick, the gyro at the start of
+    // every tick and the rest in the gaps, see sensors/bus_sched.h. Accel is
+    // averaged down to the attitude rate and the MPU6050 filters it at 44 Hz,
+    // 500 Hz loses nothing and leaves the CPU to the loops.
+    busSchedAdd("gyro", gyroStartSample, gyroSample, GYRO_PERIOD, I2C_READ_US(6));
     if(sensorsGet(SENSOR_ACC))
-        periodicEvent(accelSample, 500);
+        busSchedAdd("accel", accelStartSample, accelSample, 2000, I2C_READ_US(6));
     if(sensorsGet(SENSOR_MAG))
-        periodicEvent(magSample, 20000);
-    periodicEvent(updateAttitude, 3000);
-    periodicEvent(updateActuators, 4000);
+        busSchedAdd("mag", magStartSample, magSample, 20000, I2C_READ_US(6));
+    if(sensorsGet(SENSOR_BARO))
+        busSchedAdd("baro", 0, baroUpdate, 2000, I2C_READ_US(3));
+    busSchedAdd("temp", 0, temperatureSample, 1000000, I2C_READ_US(2));
+    busSchedPlan(GYRO_PERIOD);
+    tickEvent(busSchedTick);
+    
+    // In priority order, see eventCallbacks()
+    if(cfg.dynNotchEnable)
+        periodicEvent(dynNotchUpdate, DYN_NOTCH_SLICE_PERIOD);
+    // Outer loops follow the estimate they close on, each right after it,
+    // and feed a rate loop that runs faster than either
+    periodicEvent(updateAttitude, ATTITUDE_PERIOD);
+    periodicEvent(updateRateSetpoints, ATTITUDE_PERIOD);
+    periodicEvent(updateActuators, ACTUATOR_PERIOD);
     periodicEvent(updateCommands, 20000);
-    if(sensorsGet(SENSOR_BARO) || sensorsGet(SENSOR_SONAR))
-        periodicEvent(updateAltitude, 40000);
+    if(sensorsGet(SENSOR_BARO) || sensorsGet(SENSOR_SONAR)) {
+        periodicEvent(updateAltitude, ALTITUDE_PERIOD);
+        periodicEvent(updateThrottleSetpoint, ALTITUDE_PERIOD);
+    }
     periodicEvent(serialCom, 20000);
+    periodicEvent(telemetryUpdate, TELEMETRY_PERIOD);
     periodicEvent(statusLED, 100000);
     periodicEvent(computeGyroTCBias, 1000000);
+    periodicEvent(updateParams, PARAMS_PERIOD);
+    periodicEvent(blackboxUpdate, BLACKBOX_PERIOD);
+    periodicEvent(blackboxProgram, 0);
     if(featureGet(FEATURE_VBAT))
         periodicEvent(batterySample, 40000);
         
@@ -111,6 +149,13 @@ int main(void)
     while (1)
     {
         eventCallbacks();
+        
+        // Parse MSP as soon as a request has landed rather than waiting
+        // for the next serialCom slot
+        if (uartRxIdle())
+            serialCom();
+        
+        stackCheck();
     }
     
     return 0;
@@ -144,10 +189,15 @@ void updateActuators(void)
     cycleTime = now - last;
     last = now;
     
+    updateProfile();
+    updateRateGyro();
     stabilisation();
     mixTable();
     writeServos();
     writeMotors(); 
+    latencyUpdate();
+    blackboxLog();
+    crashlogRecord();
 }
 
 
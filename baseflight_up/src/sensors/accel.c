@@ -21,14 +21,16 @@
 void accelCalibration(void)
 {
     uint16_t samples;
+    int16_t sample[3];
     int32_t accelSum[3] = { 0, 0, 0 };
 
+    // Its own buffer, the bus tick keeps sampling into sensorData
     for (samples = 0; samples < CALIBRATION_SAMPLES; ++samples) {
-        accel.read(sensorData.accel);
+        accel.read(sample);
 
-        accelSum[XAXIS] += sensorData.accel[XAXIS];
-        accelSum[YAXIS] += sensorData.accel[YAXIS];
-        accelSum[ZAXIS] += sensorData.accel[ZAXIS];
+        accelSum[XAXIS] += sample[XAXIS];
+        accelSum[YAXIS] += sample[YAXIS];
+        accelSum[ZAXIS] += sample[ZAXIS];
         
         if(!(samples % 250))
             LED0_TOGGLE();
@@ -15,33 +15,57 @@
 
 #include "board.h"
 
+static volatile bool fresh;     // a pressure read since the last baroCalculate()
+
+// Conversion state machine, called from its bus slot. Each step waits out
+// the conversion the previous one started, a slot before then is skipped.
+// Only the transfers run here, the slot is costed for one 3 byte read.
 void baroUpdate(void)
 {
     static uint8_t state = 0;
-    int32_t pressure;
+    static uint32_t start, wait;
+
+    if (micros() - start < wait)
+        return;
 
     switch (state) {
         case 0:
             baro.start_ut();
             state++;
-            singleEvent(baroUpdate, baro.ut_delay);
+            wait = baro.ut_delay;
             break;
         case 1:
             baro.get_ut();
             state++;
-            singleEvent(baroUpdate, 500);
+            wait = 500;
             break;
         case 2:
             baro.start_up();
             state++;
-            singleEvent(baroUpdate, baro.up_delay);
+            wait = baro.up_delay;
             break;
         case 3:
             baro.get_up();
-            pressure = baro.calculate();
-            sensorData.baroAltitude = (1.0f - pow(pressure / 101325.0f, 0.190295f)) * 4433000.0f; // centimeter
+            fresh = true;
             state = 0;
-            singleEvent(baroUpdate, baro.repeat_delay);
+            wait = baro.repeat_delay;
             break;
     }
+
+    start = micros();
+}
+
+// Compensation and pressure to altitude for the last read, from
+// updateAltitude(). The temperature may be a conversion newer than the
+// pressure by then, it changes far too slowly for that to matter.
+void baroCalculate(void)
+{
+    int32_t pressure;
+
+    if (!fresh)
+        return;
+    fresh = false;
+
+    pressure = baro.calculate();
+    sensorData.baroAltitude = (1.0f - pow(pressure / 101325.0f, 0.190295f)) * 4433000.0f; // centimeter
 }
\ No newline at end of file
@@ -15,4 +15,6 @@
 
 #pragma once
 
-void baroUpdate(void);
\ No newline at end of file
+void baroUpdate(void);
+
+void baroCalculate(void);
\ No newline at end of file
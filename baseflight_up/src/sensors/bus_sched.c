@@ -0,0 +1,269 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+// No board.h, this also builds on the host against support/bus_sim
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "drivers/system.h"
+#include "sensors/bus_sched.h"
+
+// Fails to compile when BUS_FRAME_TICKS is not a power of two
+typedef char busFrameTicksPowerOfTwo[(BUS_FRAME_TICKS & (BUS_FRAME_TICKS - 1)) ? -1 : 1];
+
+static busClient_t clients[BUS_MAX_CLIENTS];
+static uint8_t clientCount;
+
+busSchedStats_t busSchedStats;
+
+static uint8_t plan[BUS_FRAME_TICKS];       // clients after the first, bit 0 is client 1
+static uint16_t load[BUS_FRAME_TICKS];      // planned bus time, us
+static uint16_t tickLength;
+static uint8_t tick;
+
+// The running tick, bit i is client i
+static uint32_t tickDue;
+static uint8_t pending;                     // reads still to run
+static uint8_t carried;                     // reads that did not fit, for the next tick
+static int8_t reading = -1;                 // client whose transfer is running
+static volatile bool finished, finishedOk;
+
+// Clients go in by priority, the first one is read at the start of every tick
+bool busSchedAdd(const char *name, busStartFuncPtr start, busSampleFuncPtr sample, uint32_t period, uint16_t cost)
+{
+    busClient_t *client;
+
+    if (clientCount == BUS_MAX_CLIENTS)
+        return false;
+
+    client = &clients[clientCount++];
+    client->name = name;
+    client->start = start;
+    client->sample = sample;
+    client->period = period;
+    client->cost = cost;
+    client->ticks = 0;
+    client->offset = 0;
+    return true;
+}
+
+static bool fits(uint8_t offset, uint8_t ticks, uint16_t cost, uint16_t room)
+{
+    uint8_t i;
+
+    for (i = offset; i < BUS_FRAME_TICKS; i += ticks)
+        if (load[i] + cost > room)
+            return false;
+
+    return true;
+}
+
+static void place(uint8_t index, uint8_t offset, uint8_t ticks)
+{
+    uint8_t i;
+
+    clients[index].offset = offset;
+    clients[index].ticks = ticks;
+    for (i = offset; i < BUS_FRAME_TICKS; i += ticks) {
+        plan[i] |= 1 << (index - 1);
+        load[i] += clients[index].cost;
+    }
+}
+
+// Plans the frame for ticks of tick us. Returns false when some client fits
+// nowhere even once a frame. It is then put in the least loaded tick and
+// that tick overruns.
+bool busSchedPlan(uint16_t tick_)
+{
+    uint16_t room = tick_ - BUS_GUARD_US;
+    uint8_t order[BUS_MAX_CLIENTS];
+    uint8_t i, j, ticks, offset, best;
+    bool ok = true;
+
+    tickLength = tick_;
+    tick = 0;
+    pending = carried = 0;
+    reading = -1;
+    // The first tick on the grid after now
+    busSchedStats.due = micros() / tick_ * tick_ + tick_;
+    for (i = 0; i < BUS_FRAME_TICKS; i++) {
+        plan[i] = 0;
+        load[i] = clientCount ? clients[0].cost : 0;
+    }
+    if (!clientCount)
+        return true;
+
+    clients[0].ticks = 1;
+    clients[0].offset = 0;
+
+    // Shortest period first, ties keep the order they were added in
+    for (i = 1; i < clientCount; i++) {
+        for (j = i; j > 1 && clients[order[j - 1]].period > clients[i].period; j--)
+            order[j] = order[j - 1];
+        order[j] = i;
+    }
+
+    for (i = 1; i < clientCount; i++) {
+        busClient_t *client = &clients[order[i]];
+
+        for (ticks = 1; ticks < BUS_FRAME_TICKS && (uint32_t)ticks * 2 * tick_ <= client->period; ticks *= 2)
+            ;
+
+        for (; ticks; ticks = ticks < BUS_FRAME_TICKS ? ticks * 2 : 0) {
+            for (offset = 0; offset < ticks; offset++)
+                if (fits(offset, ticks, client->cost, room))
+                    break;
+            if (offset < ticks)
+                break;
+        }
+
+        if (!ticks) {
+            for (best = 0, j = 1; j < BUS_FRAME_TICKS; j++)
+                if (load[j] < load[best])
+                    best = j;
+            offset = best;
+            ticks = BUS_FRAME_TICKS;
+            ok = false;
+        }
+
+        place(order[i], offset, ticks);
+    }
+
+    return ok;
+}
+
+// Runs the reads left in the tick in order. One that would run into the
+// next gyro read waits for the next tick instead. A read started in the
+// background ends the step, busSchedDone() runs the next one.
+static void step(void)
+{
+    uint8_t i, bit;
+
+    for (i = 0, bit = 1; pending >= bit; i++, bit <<= 1) {
+        if (!(pending & bit))
+            continue;
+        pending &= ~bit;
+        if (i && micros() - tickDue + clients[i].cost > (uint32_t)tickLength - BUS_GUARD_US) {
+            carried |= bit;
+            continue;
+        }
+        finished = false;
+        if (clients[i].start && clients[i].start()) {
+            reading = i;
+            return;
+        }
+        clients[i].sample();
+    }
+}
+
+// Called every SysTick and after every read started in the background.
+// Carries on the running tick, then starts the next once it is due, the
+// gyro read first. A tick started late may not have room left for its other
+// reads.
+void busSchedTick(void)
+{
+    int8_t done = reading;
+    bool ok = finishedOk;
+    uint32_t late;
+
+    // The next read starts before this one is converted, the bus need not
+    // wait on the CPU
+    if (done >= 0 && finished) {
+        reading = -1;
+        step();
+        if (ok)
+            clients[done].sample();
+    }
+
+    late = micros() - busSchedStats.due;
+    if (!clientCount || (int32_t)late < 0)
+        return;
+
+    // Nothing outlasts a tick, a transfer still running has hung and what
+    // was left waits for this one
+    if (reading >= 0) {
+        reading = -1;
+        busSchedStats.abandoned++;
+    }
+    carried |= pending & ~1;
+
+    if (late > busSchedStats.latePeak)
+        busSchedStats.latePeak = late;
+
+    tickDue = busSchedStats.due;
+    pending = 1 | plan[tick] << 1 | carried;
+    carried = 0;
+    tick = (tick + 1) & (BUS_FRAME_TICKS - 1);
+
+    // Whole ticks missed are dropped rather than run back to back
+    busSchedStats.due += tickLength;
+    if (late >= tickLength) {
+        busSchedStats.skipped += late / tickLength;
+        busSchedStats.due += late / tickLength * tickLength;
+    }
+
+    step();
+}
+
+// The end of a transfer a client's start() began, from the I2C interrupt
+void busSchedDone(bool ok)
+{
+    finishedOk = ok;
+    finished = true;
+    tickPend();
+}
+
+// us the bus is free for before the next tick is due, 0 while a read runs
+// in the background or once the tick is due
+uint32_t busSchedUntilDue(void)
+{
+    int32_t left = busSchedStats.due - micros();
+
+    if (reading >= 0)
+        return 0;
+
+    return left > 0 ? left : 0;
+}
+
+uint8_t busSchedClients(void)
+{
+    return clientCount;
+}
+
+const busClient_t *busSchedClient(uint8_t index)
+{
+    return &clients[index];
+}
+
+// Planned bus time of a tick in the frame, us
+uint16_t busSchedTickLoad(uint8_t tick_)
+{
+    return load[tick_ & (BUS_FRAME_TICKS - 1)];
+}
+
+// Share of the bus the plan uses, in 0.1%
+uint16_t busSchedUtilisation(void)
+{
+    uint32_t used = 0;
+    uint8_t i;
+
+    if (!tickLength)
+        return 0;
+
+    for (i = 0; i < BUS_FRAME_TICKS; i++)
+        used += load[i];
+
+    return used * 1000 / ((uint32_t)BUS_FRAME_TICKS * tickLength);
+}
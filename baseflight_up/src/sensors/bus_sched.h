@@ -0,0 +1,96 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+// Sensor bus schedule. Every sensor on I2C2 is read from busSchedTick(),
+// run once per gyro period from the SysTick interrupt, see tickEvent(). Each
+// tick reads the gyro first, then only the other reads planned into that
+// tick. The reads are planned into a repeating frame of BUS_FRAME_TICKS
+// ticks. Nothing can take the bus ahead of the gyro, and a tick's reads end
+// before the next gyro read is due. The ticks keep to the SysTick grid of
+// micros() and pre-empt whatever main loop task is running.
+//
+// A client whose start() begins its read in the background leaves the CPU
+// to the main loop while the bus is busy. busSchedDone(), from the I2C
+// interrupt, brings the tick back to convert it and start the next read.
+// Clients without one, the baro and temperature, hold the CPU for their
+// whole transfer.
+//
+// busSchedPlan() places the other clients shortest period first. Each gets
+// the first offset where all of its ticks still have room. Periods are
+// rounded down to a power of two ticks, so the plan reads each client at
+// least at its requested rate. A client that fits nowhere at the requested
+// rate is tried at half the rate, and so on up to once a frame. The first
+// client added is the gyro.
+//
+// The plan is not what a client gets. A tick starts late by the interrupts
+// above it, by a main loop transfer holding it off, see tickHold(), and by a
+// flash write, which stalls everything. Reads that no longer fit wait for a
+// later tick and a tick started a whole tick late is dropped. support/bus_sim
+// bounds the lateness and the rate each client loses.
+
+#define BUS_MAX_CLIENTS     6
+#define BUS_FRAME_TICKS     64      // power of two, the longest client period
+#define BUS_GUARD_US        50      // left free in every tick
+
+// Bus time of one transfer at 400 kHz, 2.5 us a bit. A register read is a
+// start, address, register, repeated start, address, the data with acks and
+// a stop. A write has no repeated start or second address.
+#define I2C_OVERHEAD_US     10      // driver setup and interrupt latency
+#define I2C_READ_US(bytes)  ((29 + 9 * (bytes)) * 5 / 2 + I2C_OVERHEAD_US)
+#define I2C_WRITE_US(bytes) ((20 + 9 * (bytes)) * 5 / 2 + I2C_OVERHEAD_US)
+
+typedef bool (* busStartFuncPtr)(void);
+typedef void (* busSampleFuncPtr)(void);
+
+typedef struct {
+    const char *name;
+    busStartFuncPtr start;      // starts a read and returns true, or 0
+    busSampleFuncPtr sample;    // uses what start() read, or does the transfers
+    uint32_t period;            // us, requested
+    uint16_t cost;              // us, the longest bus time of one call
+    uint8_t ticks;              // planned period in ticks, 0 when unplanned
+    uint8_t offset;             // planned first tick in the frame
+} busClient_t;
+
+typedef struct {
+    uint32_t due;               // us, when the running tick was due
+    uint32_t latePeak;          // us, latest a tick started, cleared by the reader
+    uint32_t skipped;           // ticks lost to a tick starting a whole tick late
+    uint32_t abandoned;         // transfers still running at the next tick
+} busSchedStats_t;
+
+extern busSchedStats_t busSchedStats;
+
+// Functions
+
+bool busSchedAdd(const char *name, busStartFuncPtr start, busSampleFuncPtr sample, uint32_t period, uint16_t cost);
+
+bool busSchedPlan(uint16_t tick);
+
+void busSchedTick(void);
+
+void busSchedDone(bool ok);
+
+uint32_t busSchedUntilDue(void);
+
+uint8_t busSchedClients(void);
+
+const busClient_t *busSchedClient(uint8_t index);
+
+uint16_t busSchedTickLoad(uint8_t tick);
+
+uint16_t busSchedUtilisation(void);
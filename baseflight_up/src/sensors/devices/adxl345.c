@@ -54,15 +54,19 @@
 
 #define DATA_RATE_1600      0x0E
 
+static void adxl345Convert(const uint8_t *buffer, int16_t *values)
+{
+    values[YAXIS] = -(buffer[0] + (buffer[1] << 8));
+    values[XAXIS] = -(buffer[2] + (buffer[3] << 8));
+    values[ZAXIS] = -(buffer[4] + (buffer[5] << 8));
+}
+
 void adxl345Read(int16_t *values)
 {
     uint8_t buffer[6];
 
     i2cRead(ADXL345_ADDRESS, ADXL345_DATAX0, 6, buffer);
-
-    values[YAXIS] = -(buffer[0] + (buffer[1] << 8));
-    values[XAXIS] = -(buffer[2] + (buffer[3] << 8));
-    values[ZAXIS] = -(buffer[4] + (buffer[5] << 8));
+    adxl345Convert(buffer, values);
 }
 
 uint8_t adxl345Detect(accel_t *accel)
@@ -74,6 +78,9 @@ uint8_t adxl345Detect(accel_t *accel)
     
     accel->init = adxl345Init;
     accel->read = adxl345Read;
+    accel->addr = ADXL345_ADDRESS;
+    accel->reg = ADXL345_DATAX0;
+    accel->convert = adxl345Convert;
     
     return true;
 }
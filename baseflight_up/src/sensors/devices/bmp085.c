@@ -19,6 +19,7 @@ static uint16_t convOverrun = 0;
 // EXTI14 for BMP085 End of Conversion Interrupt
 void EXTI15_10_IRQHandler(void)
 {
+    perfCount(isrExti);
     if (EXTI_GetITStatus(EXTI_Line14) == SET) {
         EXTI_ClearITPendingBit(EXTI_Line14);
         convDone = true;
@@ -24,6 +24,8 @@ void ECHO_EXTI_IRQHandler(void)
 {
     static uint32_t timing_start;
     uint32_t timing_stop;
+
+    perfCount(isrExti);
     if(GPIO_ReadInputDataBit(GPIOB, echo_pin) != 0)
         timing_start = micros();
     else 
@@ -32,12 +32,9 @@
 #include "board.h"
 #include "drivers/i2c.h"
 
-#define HMC5883_ADDRESS 0x1E
-
 #define HMC5883_CONFIG_REG_A    0x00
 #define HMC5883_CONFIG_REG_B    0x01
 #define HMC5883_MODE_REG        0x02
-#define HMC5883_DATA_X_MSB_REG  0x03
 #define HMC5883_STATUS_REG      0x09
 
 //#define SENSOR_CONFIG 0x18  // 1 Sample average, 75 Hz
@@ -67,7 +64,11 @@ void hmc5883Read(int16_t *values)
     uint8_t buf[6];
 
     i2cRead(HMC5883_ADDRESS, HMC5883_DATA_X_MSB_REG, 6, buf);
+    hmc5883Convert(buf, values);
+}
 
+void hmc5883Convert(const uint8_t *buf, int16_t *values)
+{
     values[XAXIS] = -(buf[0] << 8 | buf[1]);
     // the Z registers comes before the Y registers in the HMC5883L
     values[ZAXIS] = -(buf[2] << 8 | buf[3]);
@@ -85,6 +86,9 @@ bool hmc5883Detect(mag_t *mag)
         
     mag->init = hmc5883Init;
     mag->read = hmc5883Read;
+    mag->addr = HMC5883_ADDRESS;
+    mag->reg = HMC5883_DATA_X_MSB_REG;
+    mag->convert = hmc5883Convert;
 
     return true;
 }
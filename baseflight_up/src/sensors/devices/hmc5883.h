@@ -1,5 +1,9 @@
 #pragma once
 
+#define HMC5883_ADDRESS         0x1E
+#define HMC5883_DATA_X_MSB_REG  0x03
+
 void hmc5883Read(int16_t *values);
+void hmc5883Convert(const uint8_t *buf, int16_t *values);
 bool hmc5883Detect(mag_t *mag);
 void hmc5883Init(void);
@@ -51,6 +51,7 @@ static uint8_t device_id;
 
 static void mma8452Init(void);
 static void mma8452Read(int16_t *accelData);
+static void mma8452Convert(const uint8_t *buf, int16_t *accelData);
 static void mma8452Align(int16_t *accelData);
 
 bool mma8452Detect(accel_t *acc)
@@ -64,6 +65,9 @@ bool mma8452Detect(accel_t *acc)
 
     acc->init = mma8452Init;
     acc->read = mma8452Read;
+    acc->addr = MMA8452_ADDRESS;
+    acc->reg = MMA8452_OUT_X_MSB;
+    acc->convert = mma8452Convert;
     device_id = sig;
     return true;
 }
@@ -88,6 +92,11 @@ static void mma8452Read(int16_t *accelData)
     uint8_t buf[6];
 
     i2cRead(MMA8452_ADDRESS, MMA8452_OUT_X_MSB, 6, buf);
+    mma8452Convert(buf, accelData);
+}
+
+static void mma8452Convert(const uint8_t *buf, int16_t *accelData)
+{
     accelData[1] = (buf[0] << 8) | buf[1];
     accelData[0] = (buf[2] << 8) | buf[3];
     accelData[2] = (buf[4] << 8) | buf[5];
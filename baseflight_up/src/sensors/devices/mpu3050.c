@@ -51,6 +51,8 @@ static void mpu3050Init(void);
 
 static void mpu3050GyroRead(int16_t* values);
 
+static void mpu3050GyroConvert(const uint8_t *buf, int16_t *values);
+
 static void mpu3050TempRead(float* temperature);
 
 void mpu3050GyroRead(int16_t *values)
@@ -59,7 +61,11 @@ void mpu3050GyroRead(int16_t *values)
 
     // Get data from device
     i2cRead(MPU3050_ADDRESS, MPU3050_GYRO_OUT, 6, buf);
+    mpu3050GyroConvert(buf, values);
+}
 
+void mpu3050GyroConvert(const uint8_t *buf, int16_t *values)
+{
     values[XAXIS] = ((buf[0] << 8) | buf[1]);
     values[YAXIS] = ((buf[2] << 8) | buf[3]);
     values[ZAXIS] = -((buf[4] << 8) | buf[5]);
@@ -86,6 +92,9 @@ uint8_t mpu3050Detect(gyro_t *gyro)
     gyro->init = mpu3050Init;
     gyro->read = mpu3050GyroRead;
     gyro->temperature = mpu3050TempRead;
+    gyro->addr = MPU3050_ADDRESS;
+    gyro->reg = MPU3050_GYRO_OUT;
+    gyro->convert = mpu3050GyroConvert;
     
     return true;
 }
@@ -0,0 +1,178 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#include "board.h"
+#include "core/filters.h"
+#include "sensors/dyn_notch.h"
+
+/*
+ * Dynamic gyro notch
+ *
+ * Raw gyro samples feed a per axis ring buffer. dynNotchUpdate() works on
+ * one axis at a time and does one step per call: window and load, then one
+ * butterfly stage per call, then a peak search. The strongest peak between
+ * dynNotchMinHz and dynNotchMaxHz retunes that axis' notch, which runs in
+ * fixed point on every raw sample before it is accumulated.
+ */
+
+#define BIN_HZ          ((float)FFT_SAMPLE_HZ / FFT_SIZE)
+
+#define SLICE_LOAD      0
+#define SLICE_PEAK      (FFT_SIZE_LOG2 + 1)
+
+// Peak must stand this far above the band average to move the notch
+#define PEAK_THRESHOLD  2
+
+static int16_t samples[3][FFT_SIZE];
+static uint8_t sampleHead;
+static int32_t decimationAccum[3];
+static uint8_t decimationCount;
+
+static int32_t workRe[FFT_SIZE];
+static int32_t workIm[FFT_SIZE];
+static uint8_t workAxis;
+static uint8_t slice;
+
+static biquadFilterQ_t notch[3];
+static float centreHz[3];
+
+static uint16_t spectrum[FFT_BINS];
+static uint8_t spectrumAxis;
+
+bool dynNotchRunning;
+
+dynNotchStats_t dynNotchStats;
+
+static void retune(uint8_t axis)
+{
+    biquadFilter_t design;
+
+    biquadFilterInitNotch(&design, centreHz[axis], centreHz[axis] * cfg.dynNotchCutoffPercent / 100.0f, DYN_NOTCH_SAMPLE_HZ);
+    // The bus tick applies the notch, it must not see half a set of coefficients
+    __disable_irq();
+    biquadFilterUpdateQ(&notch[axis], &design);
+    __enable_irq();
+}
+
+void dynNotchInit(void)
+{
+    uint8_t i;
+
+    fftInit();
+
+    // Start at the top of the band until a peak has been found
+    for (i = 0; i < 3; i++) {
+        centreHz[i] = cfg.dynNotchMaxHz;
+        retune(i);
+    }
+
+    dynNotchRunning = true;
+}
+
+// Called at the gyro rate with bias corrected samples, filters them in place
+void dynNotchApply(int32_t *sample)
+{
+    uint8_t i;
+
+    for (i = 0; i < 3; i++)
+        decimationAccum[i] += sample[i];
+
+    if (++decimationCount == DYN_NOTCH_DECIMATION) {
+        for (i = 0; i < 3; i++) {
+            samples[i][sampleHead] = constrain(decimationAccum[i] / DYN_NOTCH_DECIMATION, -32767, 32767);
+            decimationAccum[i] = 0;
+        }
+        sampleHead = (sampleHead + 1) & (FFT_SIZE - 1);
+        decimationCount = 0;
+    }
+
+    for (i = 0; i < 3; i++)
+        sample[i] = biquadFilterApplyQ(&notch[i], sample[i]);
+}
+
+static void findPeak(void)
+{
+    uint16_t minBin = constrain(cfg.dynNotchMinHz / BIN_HZ, 1, FFT_BINS - 2);
+    uint16_t maxBin = constrain(cfg.dynNotchMaxHz / BIN_HZ, minBin + 1, FFT_BINS - 2);
+    uint16_t k, peakBin = 0;
+    uint32_t mag, sum = 0, peak = 0;
+    float y0, y1, y2, denom, delta = 0.0f, freq;
+
+    for (k = 0; k < FFT_BINS; k++) {
+        mag = fftMagnitude(workRe[k], workIm[k]) >> 8; // drop the Q8 fraction
+        spectrum[k] = mag > 0xFFFF ? 0xFFFF : mag;
+    }
+    spectrumAxis = workAxis;
+
+    for (k = minBin; k <= maxBin; k++) {
+        sum += spectrum[k];
+        if (spectrum[k] > peak) {
+            peak = spectrum[k];
+            peakBin = k;
+        }
+    }
+
+    if (!peakBin || peak * (maxBin - minBin + 1) < PEAK_THRESHOLD * sum)
+        return;
+
+    // Parabolic interpolation between neighbouring bins
+    y0 = spectrum[peakBin - 1];
+    y1 = spectrum[peakBin];
+    y2 = spectrum[peakBin + 1];
+    denom = y0 - 2.0f * y1 + y2;
+    if (denom != 0.0f)
+        delta = 0.5f * (y0 - y2) / denom;
+
+    freq = (peakBin + delta) * BIN_HZ;
+    freq = constrain(freq, cfg.dynNotchMinHz, cfg.dynNotchMaxHz);
+
+    centreHz[workAxis] += 0.5f * (freq - centreHz[workAxis]);
+    retune(workAxis);
+}
+
+// Scheduler slice, see DYN_NOTCH_SLICE_PERIOD
+void dynNotchUpdate(void)
+{
+    uint32_t start = cycleCount();
+
+    if (slice == SLICE_LOAD) {
+        fftLoad(workRe, workIm, samples[workAxis], sampleHead);
+        slice++;
+    } else if (slice < SLICE_PEAK) {
+        fftStage(workRe, workIm, slice - 1);
+        slice++;
+    } else {
+        findPeak();
+        workAxis = (workAxis + 1) % 3;
+        slice = SLICE_LOAD;
+    }
+
+    dynNotchStats.cycles = cycleCount() - start;
+    dynNotchStats.maxCycles = max(dynNotchStats.maxCycles, dynNotchStats.cycles);
+    if (dynNotchStats.cycles > DYN_NOTCH_SLICE_BUDGET)
+        dynNotchStats.overBudget++;
+}
+
+uint16_t dynNotchCentre(uint8_t axis)
+{
+    return centreHz[axis];
+}
+
+// Magnitudes of the last completed transform, FFT_BINS entries
+const uint16_t *dynNotchSpectrum(uint8_t *axis)
+{
+    *axis = spectrumAxis;
+    return spectrum;
+}
@@ -0,0 +1,52 @@
+/*
+    BaseflightPlus U.P
+    Copyright (C) 2012 Scott Driessens
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+*/
+
+#pragma once
+
+#include "core/fft.h"
+
+// Gyro samples are decimated before the FFT, FFT_SIZE at this rate gives
+// FFT_SAMPLE_HZ / FFT_SIZE Hz per bin
+#define DYN_NOTCH_DECIMATION    2
+#define DYN_NOTCH_SAMPLE_HZ     (1000000 / GYRO_PERIOD)
+#define FFT_SAMPLE_HZ           (DYN_NOTCH_SAMPLE_HZ / DYN_NOTCH_DECIMATION)
+
+// One FFT stage per call, keep this well under the gyro period
+#define DYN_NOTCH_SLICE_PERIOD  1000
+#define DYN_NOTCH_SLICE_BUDGET  (GYRO_PERIOD / 5 * 72)  // cycles, 100 us at 72 MHz
+
+typedef struct {
+    uint32_t cycles;        // the last slice, bus ticks that came meanwhile included
+    uint32_t maxCycles;
+    uint32_t overBudget;    // slices over DYN_NOTCH_SLICE_BUDGET
+} dynNotchStats_t;
+
+extern dynNotchStats_t dynNotchStats;
+
+// Set once dynNotchInit() has designed the notches and the samples may go
+// through them. dynNotchEnable is only read at boot.
+extern bool dynNotchRunning;
+
+// Functions
+
+void dynNotchInit(void);
+
+void dynNotchApply(int32_t *sample);
+
+void dynNotchUpdate(void);
+
+uint16_t dynNotchCentre(uint8_t axis);
+
+const uint16_t *dynNotchSpectrum(uint8_t *axis);
@@ -18,9 +18,9 @@
 
 #define CALIBRATION_SAMPLES 2000
 
+// From the temperature the bus tick last read, see temperatureSample()
 void computeGyroTCBias(void)
 {   
-    gyro.temperature(&sensorData.gyroTemperature);
     sensorParams.gyroTCBias[ROLL]    = cfg.gyroTCBiasSlope[ROLL] * sensorData.gyroTemperature + cfg.gyroTCBiasIntercept[ROLL];
     sensorParams.gyroTCBias[PITCH]   = cfg.gyroTCBiasSlope[PITCH] * sensorData.gyroTemperature + cfg.gyroTCBiasIntercept[PITCH];
     sensorParams.gyroTCBias[YAW]     = cfg.gyroTCBiasSlope[YAW] * sensorData.gyroTemperature + cfg.gyroTCBiasIntercept[YAW];
@@ -30,10 +30,15 @@ void computeGyroTCBias(void)
 //
 // From Aeroquad
 // http://code.google.com/p/aeroquad/source/browse/trunk/AeroQuad
+//
+// The calibrations read into their own buffers, the bus tick keeps sampling
+// into sensorData while they run.
 
 void gyroTempCalibration(void)
 {
     uint16_t i;
+    int16_t sample[3];
+    float temperature;
 
     float bias1[3] = { 0.0f, 0.0f, 0.0f };
     float temperature1 = 0.0f;
@@ -46,12 +51,12 @@ void gyroTempCalibration(void)
     // Get samples at temperature1
     uartPrint("\nFirst Point: \n");
     for (i = 0; i < CALIBRATION_SAMPLES; i++) {
-        gyro.read(sensorData.gyro);
-        gyro.temperature(&sensorData.gyroTemperature);
-        bias1[ROLL]     += sensorData.gyro[ROLL];
-        bias1[PITCH]    += sensorData.gyro[PITCH];
-        bias1[YAW]      += sensorData.gyro[YAW];
-        temperature1    += sensorData.gyroTemperature;
+        gyro.read(sample);
+        gyro.temperature(&temperature);
+        bias1[ROLL]     += sample[ROLL];
+        bias1[PITCH]    += sample[PITCH];
+        bias1[YAW]      += sample[YAW];
+        temperature1    += temperature;
         delay(1);
     }
     
@@ -70,19 +75,19 @@ void gyroTempCalibration(void)
     while (i++ < 450 && !uartAvailable()) {
         delay(1000);
         LED0_TOGGLE();
-        gyro.temperature(&sensorData.gyroTemperature);
-        printf_min("T: %f\n", sensorData.gyroTemperature);
+        gyro.temperature(&temperature);
+        printf_min("T: %f\n", temperature);
     }
     
     // Get samples at temperature2
     uartPrint("\nSecond Point: \n");
     for (i = 0; i < CALIBRATION_SAMPLES; i++) {
-        gyro.read(sensorData.gyro);
-        gyro.temperature(&sensorData.gyroTemperature);
-        bias2[ROLL]     += sensorData.gyro[ROLL];
-        bias2[PITCH]    += sensorData.gyro[PITCH];
-        bias2[YAW]      += sensorData.gyro[YAW];
-        temperature2    += sensorData.gyroTemperature;
+        gyro.read(sample);
+        gyro.temperature(&temperature);
+        bias2[ROLL]     += sample[ROLL];
+        bias2[PITCH]    += sample[PITCH];
+        bias2[YAW]      += sample[YAW];
+        temperature2    += temperature;
         delay(1);
     }
 
@@ -111,15 +116,17 @@ void gyroTempCalibration(void)
 void computeGyroRTBias(void)
 {
     uint16_t i;
+    int16_t sample[3];
     int32_t gyroSum[3] = { 0, 0, 0 };
 
     for (i = 0; i < CALIBRATION_SAMPLES; ++i) {
-        gyro.read(sensorData.gyro);
+        gyro.read(sample);
+        temperatureSample();
         computeGyroTCBias();
 
-        gyroSum[ROLL]   += sensorData.gyro[ROLL] - (int32_t)sensorParams.gyroTCBias[ROLL];
-        gyroSum[PITCH]  += sensorData.gyro[PITCH] - (int32_t)sensorParams.gyroTCBias[PITCH];
-        gyroSum[YAW]    += sensorData.gyro[YAW] - (int32_t)sensorParams.gyroTCBias[YAW];
+        gyroSum[ROLL]   += sample[ROLL] - (int32_t)sensorParams.gyroTCBias[ROLL];
+        gyroSum[PITCH]  += sample[PITCH] - (int32_t)sensorParams.gyroTCBias[PITCH];
+        gyroSum[YAW]    += sample[YAW] - (int32_t)sensorParams.gyroTCBias[YAW];
         
         if(!(i % 250))
             LED0_TOGGLE();
@@ -22,25 +22,27 @@ void magCalibration(void)
     int16_t maxMag[3];
     uint8_t i;
     uint16_t samples;
+    int16_t sample[3];
     
-    mag.read(sensorData.mag);
+    // Its own buffer, the bus tick keeps sampling into sensorData
+    mag.read(sample);
     
     for(i = 0; i < 3; ++i) {
-        minMag[i] = sensorData.mag[i];
-        maxMag[i] = sensorData.mag[i];
+        minMag[i] = sample[i];
+        maxMag[i] = sample[i];
     }
 
     LED0_ON();
     LED1_OFF();
     for(samples = 0; samples < 500; ++samples) {
-        mag.read(sensorData.mag);
+        mag.read(sample);
         
         for(i = 0; i < 3; ++i) {
-            if(sensorData.mag[i] > maxMag[i]) {
-                maxMag[i] = sensorData.mag[i];
+            if(sample[i] > maxMag[i]) {
+                maxMag[i] = sample[i];
             }
-            if(sensorData.mag[i] < minMag[i]) {
-                minMag[i] = sensorData.mag[i];
+            if(sample[i] < minMag[i]) {
+                minMag[i] = sample[i];
             }
             delay(20);
         }   
@@ -16,8 +16,14 @@
 #include "board.h"
 
 #include "drivers/adc.h"
+#include "sensors/bus_sched.h"
+#include "sensors/dyn_notch.h"
 #include "sensors/sensors.h"
 
+#if defined(FIXED_SENSORS) && !defined(FIXED_MPU6050)
+#warning "FIXED_SENSORS has no binding for this target, see sensors.h, sensors are probed at boot"
+#endif
+
 RawSensorData sensorData;
 SensorParameters sensorParams;
 static uint32_t enabledSensors = 0;
@@ -27,6 +33,9 @@ baro_t baro;
 gyro_t gyro;
 mag_t mag;
 
+// Raw reads the bus tick started, converted by the sample functions
+static uint8_t accelBuf[6], gyroBuf[6], magBuf[6];
+
 void batterySample(void)
 {
     static uint8_t ind;
@@ -48,10 +57,18 @@ void batterySample(void)
     */
 }
 
+// Each start function begins its read in the background and the sample
+// function uses it once busSchedDone() has it. When start returns false the
+// sample function does the whole read.
+bool accelStartSample(void)
+{
+    return accelStart(accelBuf, busSchedDone);
+}
+
 void accelSample(void)
 {   
     uint8_t i;
-    accel.read(sensorData.accel);
+    accelConvert(accelBuf, sensorData.accel);
     
     for(i = 0; i < 3; ++i)
         sensorData.accelAccum[i] += sensorData.accel[i] - cfg.accelBias[i];
@@ -59,21 +76,46 @@ void accelSample(void)
     sensorData.accelSamples++;
 }
 
+bool gyroStartSample(void)
+{
+    return gyroStart(gyroBuf, busSchedDone);
+}
+
 void gyroSample(void)
 {   
     uint8_t i;
-    gyro.read(sensorData.gyro);
+    int32_t sample[3];
+    uint32_t now = micros();
+    gyroConvert(gyroBuf, sensorData.gyro);
+    
+    if(!sensorData.rateGyroSamples)
+        sensorData.rateGyroTime = now;
+    sensorData.rateGyroTimeOffsets += now - sensorData.rateGyroTime;
     
     for(i = 0; i < 3; ++i)
-        sensorData.gyroAccum[i] += sensorData.gyro[i] - sensorParams.gyroRTBias[i];
+        sample[i] = sensorData.gyro[i] - sensorParams.gyroRTBias[i];
+    
+    if(dynNotchRunning)
+        dynNotchApply(sample);
+    
+    for(i = 0; i < 3; ++i) {
+        sensorData.gyroAccum[i] += sample[i];
+        sensorData.rateGyroAccum[i] += sample[i];
+    }
         
     sensorData.gyroSamples++;
+    sensorData.rateGyroSamples++;
+}
+
+bool magStartSample(void)
+{
+    return magStart(magBuf, busSchedDone);
 }
 
 void magSample(void)
 {
     uint8_t i;
-    mag.read(sensorData.mag);
+    magConvert(magBuf, sensorData.mag);
     
     for(i = 0; i < 3; ++i)
         sensorData.magAccum[i] += sensorData.mag[i] - cfg.magBias[i];
@@ -81,7 +123,13 @@ void magSample(void)
     sensorData.magSamples++;
 }
 
-void zeroSensorAccumulators(void)
+// Read on the bus once a frame, for computeGyroTCBias()
+void temperatureSample(void)
+{
+    gyro.temperature(&sensorData.gyroTemperature);
+}
+
+static void zeroSensorAccumulators(void)
 {
     uint8_t i;
     
@@ -96,6 +144,44 @@ void zeroSensorAccumulators(void)
     sensorData.magSamples = 0;
 }
 
+static void zeroRateGyroAccumulator(void)
+{
+    uint8_t i;
+    
+    for(i = 0; i < 3; ++i)
+        sensorData.rateGyroAccum[i] = 0;
+    
+    sensorData.rateGyroSamples = 0;
+    sensorData.rateGyroTimeOffsets = 0;
+}
+
+// The bus tick adds to the accumulators from an interrupt. These copy them
+// to the caller and clear them with it held off, so no sample is lost or
+// counted in one sum but not the other.
+void takeSensorAccumulators(RawSensorData *taken)
+{
+    __disable_irq();
+    memcpy(taken->gyroAccum, sensorData.gyroAccum, sizeof(sensorData.gyroAccum));
+    memcpy(taken->accelAccum, sensorData.accelAccum, sizeof(sensorData.accelAccum));
+    memcpy(taken->magAccum, sensorData.magAccum, sizeof(sensorData.magAccum));
+    taken->gyroSamples = sensorData.gyroSamples;
+    taken->accelSamples = sensorData.accelSamples;
+    taken->magSamples = sensorData.magSamples;
+    zeroSensorAccumulators();
+    __enable_irq();
+}
+
+void takeRateGyroAccumulator(RawSensorData *taken)
+{
+    __disable_irq();
+    memcpy(taken->rateGyroAccum, sensorData.rateGyroAccum, sizeof(sensorData.rateGyroAccum));
+    taken->rateGyroSamples = sensorData.rateGyroSamples;
+    taken->rateGyroTime = sensorData.rateGyroTime;
+    taken->rateGyroTimeOffsets = sensorData.rateGyroTimeOffsets;
+    zeroRateGyroAccumulator();
+    __enable_irq();
+}
+
 
 bool sensorsGet(uint32_t mask)
 {
@@ -120,7 +206,15 @@ uint32_t sensorsMask(void)
 void sensorsInit(void)
 {
     zeroSensorAccumulators();
+    zeroRateGyroAccumulator();
     
+#ifdef FIXED_MPU6050
+    // Bound at compile time, the only question is whether it answers. An
+    // MPU3050 answering instead is an early board this image can't drive.
+    if(!mpu6050Detect(&gyro, &accel, cfg.mpu6050Scale))
+        failureMode(mpu3050Detect(&gyro) ? 4 : 3);
+    sensorsSet(SENSOR_ACC);
+#else
     // TODO allow user to select hardware if there are multiple choices
     
     if(mpu6050Detect(&gyro, &accel, cfg.mpu6050Scale)) {
@@ -137,6 +231,7 @@ void sensorsInit(void)
     if(mma8452Detect(&accel)) {
         sensorsSet(SENSOR_ACC);
     }
+#endif
     
     gyro.init();
     
@@ -155,8 +250,7 @@ void sensorsInit(void)
     }
 #else
     if (ms5611Detect(&baro) || bmp085Detect(&baro)) {
-        sensorsSet(SENSOR_BARO);
-        singleEvent(baroUpdate, baro.repeat_delay); // Begin baro conversion state machine
+        sensorsSet(SENSOR_BARO);    // read from its bus slot, see main()
     }
 #endif
           
@@ -45,6 +45,12 @@ typedef struct {
     int32_t gyroAccum[3];
     
     uint8_t gyroSamples;
+    
+    // The same samples again for the rate loop, taken each actuator cycle
+    int32_t rateGyroAccum[3];
+    uint8_t rateGyroSamples;
+    uint32_t rateGyroTime;          // micros() of the first sample in rateGyroAccum
+    uint32_t rateGyroTimeOffsets;   // sum of every sample's micros() after rateGyroTime
 
     int16_t accel[3];
     
@@ -72,24 +78,34 @@ typedef void (* sensorFuncPtr)(void);                   // sensor init prototype
 typedef void (* sensorReadFuncPtr)(int16_t *data);          // sensor read and align prototype
 typedef void (* sensorReadFloatFuncPtr)(float *data);
 typedef int32_t (* baroCalculateFuncPtr)(void);             // baro calculation (returns altitude in cm based on static data collected)
+typedef void (* sensorConvertFuncPtr)(const uint8_t *buf, int16_t *data);   // align a raw 6 byte read
 
+// read() is the whole read. The bus tick instead starts the 6 byte read at
+// addr and reg itself and converts the bytes once it is done. A driver that
+// can't be read that way leaves convert 0.
 typedef struct
 {
     sensorFuncPtr init;
     sensorReadFuncPtr read;
     sensorReadFloatFuncPtr temperature;
+    uint8_t addr, reg;
+    sensorConvertFuncPtr convert;
 } gyro_t;
 
 typedef struct
 {
     sensorFuncPtr init;
     sensorReadFuncPtr read;
+    uint8_t addr, reg;
+    sensorConvertFuncPtr convert;
 } accel_t;
 
 typedef struct
 {
     sensorFuncPtr init;
     sensorReadFuncPtr read;
+    uint8_t addr, reg;
+    sensorConvertFuncPtr convert;
 } mag_t;
 
 typedef struct
@@ -104,6 +120,46 @@ typedef struct
     baroCalculateFuncPtr calculate;
 } baro_t;
 
+// Sensor binding. Normally every driver is probed at boot and the sampling
+// tasks call it through the structs above. OPTIONS=FIXED_SENSORS binds the
+// sensors the target is built with instead, the tasks call the driver
+// directly and its align code inlines into them. The structs are still
+// filled for the calibration routines. Targets without a binding here
+// keep probing.
+//
+// The NAZE binding is for rev5 and later boards, with an MPU6050. Earlier
+// ones carry an MPU3050 with an ADXL345 or MMA8452 and need a probing
+// build, sensorsInit() stops them with failureMode(4). FY90Q has no
+// binding. It builds the same probing drivers, and the board's own analog
+// sensors have no driver in this tree, so there is nothing fixed to bind.
+
+#if defined(FIXED_SENSORS) && defined(NAZE)
+#define FIXED_MPU6050       // gyro and accel
+#define FIXED_HMC5883       // when fitted, magSample only runs if detected
+#endif
+
+#ifdef FIXED_MPU6050
+#define gyroRead(data)              mpu6050ReadGyro(data)
+#define gyroStart(buf, done)        i2cReadStart(MPU6050_ADDRESS, MPU_RA_GYRO_XOUT_H, 6, buf, done)
+#define gyroConvert(buf, data)      mpu6050ConvertGyro(buf, data)
+#define accelStart(buf, done)       i2cReadStart(MPU6050_ADDRESS, MPU_RA_ACCEL_XOUT_H, 6, buf, done)
+#define accelConvert(buf, data)     mpu6050ConvertAccel(buf, data)
+#else
+#define gyroRead(data)              gyro.read(data)
+#define gyroStart(buf, done)        (gyro.convert && i2cReadStart(gyro.addr, gyro.reg, 6, buf, done))
+#define gyroConvert(buf, data)      (gyro.convert ? gyro.convert(buf, data) : gyro.read(data))
+#define accelStart(buf, done)       (accel.convert && i2cReadStart(accel.addr, accel.reg, 6, buf, done))
+#define accelConvert(buf, data)     (accel.convert ? accel.convert(buf, data) : accel.read(data))
+#endif
+
+#ifdef FIXED_HMC5883
+#define magStart(buf, done)         i2cReadStart(HMC5883_ADDRESS, HMC5883_DATA_X_MSB_REG, 6, buf, done)
+#define magConvert(buf, data)       hmc5883Convert(buf, data)
+#else
+#define magStart(buf, done)         (mag.convert && i2cReadStart(mag.addr, mag.reg, 6, buf, done))
+#define magConvert(buf, data)       (mag.convert ? mag.convert(buf, data) : mag.read(data))
+#endif
+
 // External Variables
 
 extern RawSensorData sensorData;
@@ -116,11 +172,17 @@ extern mag_t mag;
 
 // Functions
 
+bool magStartSample(void);
 void magSample(void);
+bool accelStartSample(void);
 void accelSample(void);
+bool gyroStartSample(void);
 void gyroSample(void);
+void temperatureSample(void);
 void batterySample(void);
-void zeroSensorAccumulators(void);
+void takeSensorAccumulators(RawSensorData *taken);
+
+void takeRateGyroAccumulator(RawSensorData *taken);
 
 bool sensorsGet(uint32_t mask);
 void sensorsSet(uint32_t mask);
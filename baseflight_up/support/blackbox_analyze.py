@@ -0,0 +1,671 @@
+# Blackbox log analyzer
+# Decodes a log saved by blackbox_dl.py, format in src/core/blackbox.h, and
+# turns it into tuning data:
+#
+#   <prefix>_spectrum.csv   gyro noise power spectral density per axis (Welch)
+#   <prefix>_step.csv       rate loop step response per axis, estimated by
+#                           deconvolving the rate setpoint out of the gyro
+#   <prefix>_summary.json   sessions, timing, tracking error, noise peaks,
+#                           step response figures and motor saturation
+#
+# Motors are saturated when mixTable() has clipped them to minthrottle or
+# maxthrottle, pass the board's values if they are not the defaults.
+#
+# The log is decoded a block of chunks at a time with numpy, so memory use
+# does not grow with its length. --csv also writes every frame at full rate.
+# --synth writes a synthetic log of the given size in MB to check the tool
+# and time it. Needs numpy.
+#
+# usage: python blackbox_analyze.py <log> [--out prefix] [--csv file]
+#               [--min-throttle us] [--max-throttle us]
+#        python blackbox_analyze.py --synth <log> [--size MB]
+
+import argparse
+import json
+import os
+import sys
+import time
+
+import numpy as np
+
+CHUNK_SIZE = 512            # BLACKBOX_CHUNK_SIZE
+CHUNK_HEADER = 2
+BLOCK_CHUNKS = 2048         # chunks decoded at a time
+ACTUATOR_PERIOD = 2000      # us, written in the 'H' frame, only used by --synth
+VERSION = 1
+
+FRAME_H, FRAME_I, FRAME_P, FRAME_E = (ord(c) for c in "HIPE")
+
+# Field columns, the motor count is whatever is left over in the 'H' field count
+TIME = 0
+GYRO = slice(1, 4)
+ACCEL = slice(4, 7)
+SETPOINT = slice(7, 10)
+PID_TERMS = slice(10, 19)
+MOTOR = 19
+RC_CHANNELS = 8
+AXES = ["roll", "pitch", "yaw"]
+
+
+def field_names(fields):
+    motors = fields - MOTOR - RC_CHANNELS
+    names = ["time"]
+    for group in ["gyro", "acc", "sp"]:
+        names += ["%s_%s" % (group, axis) for axis in AXES]
+    for axis in AXES:
+        names += ["%s_%s" % (term, axis) for term in "pid"]
+    names += ["motor%d" % i for i in range(motors)]
+    names += ["rc%d" % i for i in range(RC_CHANNELS)]
+    return names
+
+
+def wrap32(x):
+    return ((x + 2 ** 31) & 0xFFFFFFFF) - 2 ** 31
+
+
+class Header:
+    def __init__(self, raw):
+        raw = [int(b) for b in raw]
+        self.version, self.fields, self.divider = raw[0], raw[1], raw[2]
+        self.period = raw[3] | raw[4] << 8
+        self.rate = 1e6 / (self.period * max(self.divider, 1))
+
+
+# Decoding
+#
+# A block of chunks is decoded without a per byte loop: the bytes below 0x80
+# end a varint, so the ends give every token of the block at once and
+# np.add.reduceat() assembles them. Type bytes are below 0x80 too and come out
+# as one byte tokens. A chunk holding only 'I' and 'P' frames is then a whole
+# number of 1 + fields token frames; those are checked and sliced out in bulk,
+# only chunks with an 'H' or 'E' in them are walked frame by frame.
+
+def tokenize(payload):
+    last = np.flatnonzero(payload < 0x80)
+    if not len(last):
+        return np.zeros(0, np.int64), np.zeros(0, np.uint32)
+    payload = payload[:last[-1] + 1]
+    starts = np.empty(len(last), np.int64)
+    starts[0] = 0
+    starts[1:] = last[:-1] + 1
+
+    # Byte position inside its varint, a fifth byte's spare bits shift out of
+    # the u32 the same way they do on the board
+    within = np.ones(len(payload), np.int32)
+    within[starts] = 1 - np.diff(starts, prepend=0).astype(np.int32)
+    within[0] = 0
+    within = np.cumsum(within, dtype=np.int32)
+    shift = np.minimum(within, 4).astype(np.uint32) * np.uint32(7)
+    values = np.add.reduceat((payload & 0x7F).astype(np.uint32) << shift, starts, dtype=np.uint32)
+    return starts, values
+
+
+def walk(tokens, starts, payload, first, end, fields, frames, marks):
+    t = first
+    while t < end:
+        kind = tokens[t]
+        if kind == FRAME_I or kind == FRAME_P:
+            if t + 1 + fields > end:
+                break
+            frames.append((t, kind == FRAME_I))
+            t += 1 + fields
+        elif kind == FRAME_H:
+            at = starts[t]
+            marks.append((t, Header(payload[at + 1:at + 6])))
+            t = int(np.searchsorted(starts, at + 6))
+        elif kind == FRAME_E:
+            marks.append((t, None))
+            t += 1
+        else:
+            break   # lost, pick up again at the next chunk
+
+
+def decode_block(raw, fields):
+    """Decodes whole chunks, returns the data frames as absolute values, the
+    per frame intra flags and their token positions, the 'H'/'E' marks and
+    False once an unwritten chunk has ended the log."""
+    chunks = raw.reshape(-1, CHUNK_SIZE)
+    used = chunks[:, 0].astype(np.int64) | chunks[:, 1].astype(np.int64) << 8
+    bad = np.flatnonzero(used > CHUNK_SIZE - CHUNK_HEADER)
+    more = not len(bad)
+    if len(bad):
+        chunks, used = chunks[:bad[0]], used[:bad[0]]
+
+    payload = chunks[:, CHUNK_HEADER:][np.arange(CHUNK_SIZE - CHUNK_HEADER) < used[:, None]]
+    starts, tokens = tokenize(payload)
+    chunk_start = np.searchsorted(starts, np.cumsum(used) - used)
+    chunk_end = np.append(chunk_start[1:], len(tokens))
+    count = chunk_end - chunk_start
+
+    # Bulk path, chunks that split evenly into frames starting 'I' then 'P's
+    stride = 1 + fields
+    per_chunk = np.where(count % stride == 0, count // stride, 0)
+    index = np.arange(per_chunk.sum())
+    pos = np.repeat(chunk_start, per_chunk) + (index - np.repeat(np.cumsum(per_chunk) - per_chunk, per_chunk)) * stride
+    kind = tokens[pos] if len(pos) else np.zeros(0, np.uint32)
+    ok = (kind == FRAME_I) | (kind == FRAME_P)
+    first = np.cumsum(per_chunk) - per_chunk
+    bulk = per_chunk > 0
+    chunk_ok = np.zeros(len(chunks), bool)
+    if bulk.any():
+        chunk_ok[bulk] = np.minimum.reduceat(ok, first[bulk]) & (kind[first[bulk]] == FRAME_I)
+    keep = np.repeat(chunk_ok, per_chunk)
+    pos, intra = pos[keep], kind[keep] == FRAME_I
+
+    # Everything else frame by frame
+    slow, marks = [], []
+    for c in np.flatnonzero(~chunk_ok & (count > 0)):
+        walk(tokens, starts, payload, int(chunk_start[c]), int(chunk_end[c]), fields, slow, marks)
+    if slow:
+        pos = np.concatenate([pos, np.array([s[0] for s in slow], np.int64)])
+        intra = np.concatenate([intra, np.array([s[1] for s in slow], bool)])
+        order = np.argsort(pos, kind="stable")
+        pos, intra = pos[order], intra[order]
+
+    if not len(pos):
+        return np.zeros((0, fields), np.int64), intra, pos, marks, more
+
+    # Zig-zag, then the deltas summed up from the last intra frame, all in u32
+    # so the sums wrap like the differences did
+    token = (tokens >> np.uint32(1)) ^ (np.uint32(0) - (tokens & np.uint32(1)))
+    values = token[pos[:, None] + 1 + np.arange(fields)]
+    rows = np.arange(len(pos))
+    base = np.maximum.accumulate(np.where(intra, rows, -1))
+    valid = base >= 0
+    if not valid.all():
+        values, intra, pos, base = values[valid], intra[valid], pos[valid], base[valid]
+        base -= np.flatnonzero(valid)[0]
+    total = np.cumsum(values, axis=0, dtype=np.uint32)
+    values = (total - total[base] + values[base]).view(np.int32).astype(np.int64)
+    return values, intra, pos, marks, more
+
+
+def read_log(path):
+    """Yields (session, header, frames) runs in log order, frames being the
+    absolute field values of consecutive frames of one session."""
+    with open(path, "rb") as f:
+        first = f.read(CHUNK_HEADER + 6)
+        if len(first) < CHUNK_HEADER + 6 or first[CHUNK_HEADER] != FRAME_H:
+            raise ValueError("%s does not start with a blackbox session" % path)
+        header = Header(first[CHUNK_HEADER + 1:])
+        fields = header.fields
+        f.seek(0)
+
+        session = -1
+        while True:
+            data = f.read(CHUNK_SIZE * BLOCK_CHUNKS)
+            data = data[:len(data) - len(data) % CHUNK_SIZE]
+            if not data:
+                return
+            values, intra, pos, marks, more = decode_block(np.frombuffer(data, np.uint8), fields)
+
+            # Split the block where sessions start
+            at = 0
+            for token, mark in marks:
+                end = int(np.searchsorted(pos, token))
+                if end > at and session >= 0:
+                    yield session, header, values[at:end]
+                at = end
+                if mark is not None:
+                    if mark.fields != fields:
+                        raise ValueError("session with %d fields, the log started with %d" % (mark.fields, fields))
+                    header = mark
+                    session += 1
+            if len(values) > at and session >= 0:
+                yield session, header, values[at:]
+            if not more:
+                return
+
+
+# Analysis
+
+class Windows:
+    """Cuts a stream of samples into overlapping windows across blocks"""
+
+    def __init__(self, length, hop):
+        self.length, self.hop = length, hop
+        self.buf = None
+
+    def reset(self):
+        self.buf = None
+
+    def feed(self, x):
+        self.buf = x if self.buf is None else np.concatenate([self.buf, x])
+        count = (len(self.buf) - self.length) // self.hop + 1
+        if count <= 0:
+            return None
+        windows = self.buf[np.arange(count)[:, None] * self.hop + np.arange(self.length)]
+        self.buf = self.buf[count * self.hop:]
+        return windows
+
+
+def tukey(length, alpha=0.5):
+    w = np.ones(length)
+    edge = int(alpha * (length - 1) / 2)
+    if edge:
+        ramp = 0.5 * (1 - np.cos(np.pi * np.arange(edge) / edge))
+        w[:edge], w[-edge:] = ramp, ramp[::-1]
+    return w
+
+
+class Analyzer:
+    def __init__(self, args):
+        self.args = args
+        self.rate = None
+        self.sessions = []
+        self.frames = 0
+        self.session = None
+
+    def start(self, session, header):
+        a = self.args
+        if self.rate is None:
+            self.rate = header.rate
+            self.fields = header.fields
+            self.motors = header.fields - MOTOR - RC_CHANNELS
+            self.nperseg = a.nperseg
+            self.welch = Windows(a.nperseg, a.nperseg // 2)
+            self.hann = np.hanning(a.nperseg)
+            self.psd = np.zeros((a.nperseg // 2 + 1, 3))
+            self.segments = 0
+            length = max(int(a.step_window * self.rate), 8)
+            self.step_len = max(int(a.step_length * self.rate), 2)
+            self.steps = Windows(length, length // 2)
+            self.step_taper = tukey(length)
+            self.step_sum = np.zeros((self.step_len, 3))
+            self.step_count = np.zeros(3, np.int64)
+            self.sq = np.zeros(3)
+            self.err_sq = np.zeros(3)
+            self.at_max = np.zeros(self.motors, np.int64)
+            self.at_min = np.zeros(self.motors, np.int64)
+            self.motor_used = np.zeros(self.motors, bool)
+            self.saturated = 0
+            self.authority = 0
+            self.events = 0
+            self.longest = 0
+        self.matched = header.rate == self.rate
+        self.welch.reset()
+        self.steps.reset()
+        self.run = 0
+        self.last_time = None
+        self.session = {"index": session, "frames": 0, "duration_s": 0.0, "rate_hz": round(header.rate, 3),
+                        "divider": header.divider, "period_us": header.period, "gaps": 0}
+        self.period = 1e6 / header.rate
+        self.sessions.append(self.session)
+
+    def feed(self, values):
+        a = self.args
+        s = self.session
+        n = len(values)
+        s["frames"] += n
+        self.frames += n
+
+        # Time, unwrapped, a gap is a frame dropped by the writer
+        t = values[:, TIME] & 0xFFFFFFFF
+        prev = t[0] if self.last_time is None else self.last_time
+        dt = (np.diff(t, prepend=prev)) & 0xFFFFFFFF
+        s["duration_s"] += dt.sum() / 1e6
+        s["gaps"] += int((dt > 1.5 * self.period).sum())
+        self.last_time = t[-1]
+
+        gyro = values[:, GYRO].astype(np.float64)
+        setpoint = values[:, SETPOINT].astype(np.float64)
+        self.sq += (gyro ** 2).sum(0)
+        self.err_sq += ((setpoint - gyro) ** 2).sum(0)
+
+        # Motors clipped by mixTable(), both ends at once means the mixer ran
+        # out of authority
+        motors = values[:, MOTOR:MOTOR + self.motors]
+        self.motor_used |= (motors > 0).any(0)
+        high = motors >= a.max_throttle
+        low = (motors <= a.min_throttle) & (motors > 0)
+        self.at_max += high.sum(0)
+        self.at_min += low.sum(0)
+        any_high = high.any(1)
+        self.saturated += int(any_high.sum())
+        self.authority += int((any_high & low.any(1)).sum())
+        self.count_runs(any_high)
+
+        if not self.matched:
+            return
+
+        windows = self.welch.feed(gyro)
+        if windows is not None:
+            windows = windows - windows.mean(1, keepdims=True)
+            spectrum = np.fft.rfft(windows * self.hann[None, :, None], axis=1)
+            self.psd += (np.abs(spectrum) ** 2).sum(0)
+            self.segments += len(windows)
+
+        windows = self.steps.feed(np.concatenate([setpoint, gyro], axis=1))
+        if windows is not None:
+            self.step_response(windows)
+
+    def count_runs(self, flags):
+        if not len(flags):
+            return
+        edges = np.flatnonzero(np.diff(np.concatenate([[False], flags, [False]]).astype(np.int8)))
+        begins, ends = edges[::2], edges[1::2]
+        lengths = ends - begins
+        if len(begins) and begins[0] == 0 and self.run:
+            lengths[0] += self.run
+            self.events -= 1
+        self.events += len(begins)
+        if len(lengths):
+            self.longest = max(self.longest, int(lengths.max()))
+        self.run = int(lengths[-1]) if len(ends) and ends[-1] == len(flags) else 0
+
+    # Wiener deconvolution of each window, setpoint in, gyro out, the impulse
+    # response integrated to a step. Windows without enough stick movement
+    # mostly carry noise and are left out.
+    def step_response(self, windows):
+        taper = self.step_taper[None, :]
+        for axis in range(3):
+            sp = windows[:, :, axis] * taper
+            gy = windows[:, :, 3 + axis] * taper
+            active = np.abs(sp).max(1) >= self.args.step_threshold
+            if not active.any():
+                continue
+            sp, gy = sp[active], gy[active]
+            s = np.fft.rfft(sp, axis=1)
+            g = np.fft.rfft(gy, axis=1)
+            power = np.abs(s) ** 2
+            h = g * np.conj(s) / (power + 1e-3 * power.mean(1, keepdims=True))
+            impulse = np.fft.irfft(h, n=sp.shape[1], axis=1)
+            self.step_sum[:, axis] += np.cumsum(impulse[:, :self.step_len], axis=1).sum(0)
+            self.step_count[axis] += int(active.sum())
+
+    def results(self):
+        summary = {"frames": self.frames, "sessions": self.sessions}
+        if not self.frames:
+            return summary, None, None
+
+        frames = max(self.frames, 1)
+        freq = np.fft.rfftfreq(self.nperseg, 1 / self.rate)
+        psd = None
+        if self.segments:
+            psd = 2 * self.psd / (self.segments * self.rate * (self.hann ** 2).sum())
+            psd[0] /= 2
+        step = self.step_sum / np.maximum(self.step_count, 1)
+        step_time = np.arange(self.step_len) * 1000 / self.rate
+
+        gyro = {}
+        for i, axis in enumerate(AXES):
+            entry = {"rms": round(float(np.sqrt(self.sq[i] / frames)), 1),
+                     "tracking_error_rms": round(float(np.sqrt(self.err_sq[i] / frames)), 1)}
+            if psd is not None:
+                band = freq >= self.args.noise_floor_hz
+                peak = np.argmax(np.where(band, psd[:, i], -1))
+                entry["noise_peak_hz"] = round(float(freq[peak]), 2)
+                entry["noise_peak_psd"] = round(float(psd[peak, i]), 3)
+            gyro[axis] = entry
+        summary["gyro"] = gyro
+        summary["spectrum"] = {"segments": self.segments, "nperseg": self.nperseg,
+                               "resolution_hz": round(self.rate / self.nperseg, 4)}
+
+        steps = {}
+        for i, axis in enumerate(AXES):
+            entry = {"windows": int(self.step_count[i])}
+            if self.step_count[i]:
+                entry.update(step_figures(step[:, i], step_time))
+            steps[axis] = entry
+        summary["step"] = steps
+
+        used = np.flatnonzero(self.motor_used)
+        period_ms = 1000 / self.rate
+        summary["motors"] = {
+            "min_throttle": self.args.min_throttle,
+            "max_throttle": self.args.max_throttle,
+            "at_max_pct": {int(m): round(100.0 * self.at_max[m] / frames, 3) for m in used},
+            "at_min_pct": {int(m): round(100.0 * self.at_min[m] / frames, 3) for m in used},
+            "saturated_pct": round(100.0 * self.saturated / frames, 3),
+            "no_authority_pct": round(100.0 * self.authority / frames, 3),
+            "saturation_events": self.events,
+            "longest_saturation_ms": round(self.longest * period_ms, 1),
+        }
+        return summary, (freq, psd), (step_time, step)
+
+
+def step_figures(step, t):
+    steady = float(step[int(len(step) * 0.8):].mean())
+    if abs(steady) < 1e-6:
+        return {"steady": round(steady, 3)}
+
+    def crossing(level):
+        above = np.flatnonzero(step >= level * steady if steady > 0 else step <= level * steady)
+        return round(float(t[above[0]]), 1) if len(above) else None
+
+    rise = [crossing(0.1), crossing(0.9)]
+    return {"steady": round(steady, 3),
+            "latency_ms": crossing(0.5),
+            "rise_ms": round(rise[1] - rise[0], 1) if None not in rise else None,
+            "overshoot_pct": round(100.0 * (float(step.max() if steady > 0 else step.min()) / steady - 1), 1)}
+
+
+def analyze(args):
+    analyzer = Analyzer(args)
+    dump = None
+    if args.csv:
+        dump = open(args.csv, "w")
+    started = time.time()
+    current = None
+    try:
+        for session, header, values in read_log(args.log):
+            if session != current:
+                analyzer.start(session, header)
+                current = session
+                if dump and dump.tell() == 0:
+                    dump.write("session," + ",".join(field_names(header.fields)) + "\n")
+            analyzer.feed(values)
+            if dump:
+                np.savetxt(dump, np.column_stack([np.full(len(values), session), values]), fmt="%d", delimiter=",")
+    finally:
+        if dump:
+            dump.close()
+    elapsed = time.time() - started
+
+    summary, spectrum, step = analyzer.results()
+    size = os.path.getsize(args.log)
+    summary = dict({"log": args.log, "bytes": size, "decode_s": round(elapsed, 3)}, **summary)
+
+    prefix = args.out or os.path.splitext(args.log)[0]
+    if spectrum and spectrum[1] is not None:
+        np.savetxt(prefix + "_spectrum.csv", np.column_stack(spectrum[0:1] + (spectrum[1],)),
+                   fmt="%.6g", delimiter=",", header="freq_hz,roll,pitch,yaw", comments="")
+    if step:
+        np.savetxt(prefix + "_step.csv", np.column_stack((step[0], step[1])),
+                   fmt="%.6g", delimiter=",", header="time_ms,roll,pitch,yaw", comments="")
+    with open(prefix + "_summary.json", "w") as f:
+        json.dump(summary, f, indent=2)
+
+    print("%u frames in %u sessions, %.1f MB in %.2f s (%.1f MB/s)" %
+          (summary["frames"], len(summary["sessions"]), size / 1e6, elapsed, size / 1e6 / max(elapsed, 1e-9)))
+    for axis in AXES if "gyro" in summary else []:
+        g, s = summary["gyro"][axis], summary["step"][axis]
+        print("%-5s rms %7.1f  error %7.1f  peak %6s Hz  step %s" %
+              (axis, g["rms"], g["tracking_error_rms"], g.get("noise_peak_hz", "-"),
+               ", ".join("%s %s" % (k, v) for k, v in s.items())))
+    if "motors" in summary:
+        m = summary["motors"]
+        print("motors saturated %.2f%% of frames, %u times, longest %.0f ms, no authority %.2f%%" %
+              (m["saturated_pct"], m["saturation_events"], m["longest_saturation_ms"], m["no_authority_pct"]))
+    print("written %s_summary.json" % prefix)
+    return 0
+
+
+# Synthetic log, a quad flying stick steps. The gyro follows the setpoint
+# through a delayed second order response with a motor noise tone on top.
+
+def zigzag(v):
+    v = v.astype(np.int64)
+    return ((v << 1) ^ (v >> 31)) & 0xFFFFFFFF
+
+
+def varint_lengths(z):
+    return 1 + (z >= 1 << 7) + (z >= 1 << 14) + (z >= 1 << 21) + (z >= 1 << 28)
+
+
+def pack_session(values, divider):
+    """Lays out one session the way blackboxLog() does: 'H', frames that never
+    span chunks with an intra frame first in each, 'E', then the chunk closed"""
+    zi = zigzag(values)
+    zp = zigzag(wrap32(np.diff(values, axis=0, prepend=values[:1])))
+    li, lp = varint_lengths(zi), varint_lengths(zp)
+    size_i, size_p = 1 + li.sum(1), 1 + lp.sum(1)
+
+    room = CHUNK_SIZE - CHUNK_HEADER
+    n = len(values)
+    chunk = np.empty(n, np.int64)
+    offset = np.empty(n, np.int64)
+    intra = np.empty(n, bool)
+    c, fill, first = 0, 6, True
+    si, sp = size_i.tolist(), size_p.tolist()
+    for k in range(n):
+        size = si[k] if first or fill == 0 else sp[k]
+        if fill + size > room:
+            c, fill = c + 1, 0
+            size = si[k]
+        intra[k] = first or fill == 0
+        chunk[k], offset[k] = c, fill
+        fill += size
+        first = False
+    if fill + 1 > room:
+        c, fill = c + 1, 0
+    end_chunk, end_offset = c, fill
+
+    out = np.full((c + 1, CHUNK_SIZE), 0xFF, np.uint8)
+    flat = out.reshape(-1)
+    header = [FRAME_H, VERSION, values.shape[1], divider, ACTUATOR_PERIOD & 0xFF, ACTUATOR_PERIOD >> 8]
+    flat[CHUNK_HEADER:CHUNK_HEADER + 6] = header
+    at = chunk * CHUNK_SIZE + CHUNK_HEADER + offset
+    flat[at] = np.where(intra, FRAME_I, FRAME_P)
+    flat[end_chunk * CHUNK_SIZE + CHUNK_HEADER + end_offset] = FRAME_E
+
+    z = np.where(intra[:, None], zi, zp).reshape(-1)
+    lengths = np.where(intra[:, None], li, lp)
+    starts = (at[:, None] + 1 + np.cumsum(lengths, axis=1) - lengths).reshape(-1)
+    lengths = lengths.reshape(-1)
+    within = np.arange(lengths.sum()) - np.repeat(np.cumsum(lengths) - lengths, lengths)
+    z = np.repeat(z, lengths)
+    byte = (z >> (7 * within)) & 0x7F
+    byte |= np.where(within < np.repeat(lengths, lengths) - 1, 0x80, 0)
+    flat[np.repeat(starts, lengths) + within] = byte
+
+    ends = np.bincount(chunk, weights=np.where(intra, size_i, size_p), minlength=c + 1).astype(np.int64)
+    ends[0] += 6
+    ends[end_chunk] += 1
+    out[:, 0], out[:, 1] = ends & 0xFF, ends >> 8
+    return out.tobytes()
+
+
+def second_order(rate, hz, damping, delay_s, taps):
+    dt = 1 / rate
+    w = 2 * np.pi * hz
+    x = v = 0.0
+    h = np.zeros(taps)
+    lag = int(round(delay_s * rate))
+    for k in range(lag, taps):
+        u = 1.0 if k == lag else 0.0
+        a = w * w * (u / dt - x) - 2 * damping * w * v
+        v += a * dt
+        x += v * dt
+        h[k] = x
+    return h / h.sum()
+
+
+def synth_session(rng, frames, divider, start_us, fields):
+    rate = 1e6 / (ACTUATOR_PERIOD * divider)
+    motors = fields - MOTOR - RC_CHANNELS
+    values = np.zeros((frames, fields), np.int64)
+    values[:, TIME] = start_us + np.arange(frames) * ACTUATOR_PERIOD * divider
+
+    # Stick steps held for 0.2 .. 1 s, softened like the rc smoothing does
+    setpoint = np.zeros((frames, 3))
+    limit = [4000, 4000, 2000]
+    for axis in range(3):
+        holds = np.maximum((rng.uniform(0.2, 1.0, frames // 10 + 2) * rate).astype(np.int64), 1)
+        levels = rng.uniform(-limit[axis], limit[axis], len(holds)) * (rng.random(len(holds)) < 0.6)
+        setpoint[:, axis] = np.repeat(levels, holds)[:frames]
+    smooth = np.ones(3) / 3
+    setpoint = np.column_stack([np.convolve(setpoint[:, i], smooth)[:frames] for i in range(3)])
+
+    h = second_order(rate, 12.0, 0.55, 0.012, int(rate * 0.5))
+    t = np.arange(frames) / rate
+    tone = 0.4 * rate * (1 + 0.05 * np.sin(2 * np.pi * 0.1 * t))
+    noise = 60 * np.sin(2 * np.pi * np.cumsum(tone) / rate)
+    gyro = np.column_stack([np.convolve(setpoint[:, i], h)[:frames] for i in range(3)])
+    gyro += noise[:, None] + rng.normal(0, 25, (frames, 3))
+
+    values[:, GYRO] = np.round(gyro)
+    values[:, ACCEL] = np.round(rng.normal(0, 40, (frames, 3)) + [0, 0, 981])
+    values[:, SETPOINT] = np.round(setpoint)
+    error = setpoint - gyro
+    terms = np.zeros((frames, 9))
+    terms[:, 0::3] = 0.02 * error * 10
+    terms[:, 1::3] = np.cumsum(error, axis=0) * 1e-4 * 10
+    terms[:, 2::3] = -np.diff(gyro, axis=0, prepend=gyro[:1]) * 0.05 * 10
+    values[:, PID_TERMS] = np.round(terms)
+
+    # Quad X mix clipped like mixTable(), the throttle wanders up into the limits
+    throttle = 1450 + 300 * np.sin(2 * np.pi * t / 40) + rng.normal(0, 5, frames)
+    pid = terms.reshape(frames, 3, 3).sum(2) / 10
+    mix = np.array([[-1, 1, -1], [-1, -1, 1], [1, 1, 1], [1, -1, -1]])
+    motor = throttle[:, None] + pid @ mix.T
+    motor = np.clip(motor - np.maximum(motor.max(1, keepdims=True) - 1850, 0), 1150, 1850)
+    values[:, MOTOR:MOTOR + 4] = np.round(motor)
+    rc = values[:, MOTOR + motors:]
+    rc[:, 0:2] = 1500 + np.round(setpoint[:, 0:2] / 8)
+    rc[:, 2] = np.round(throttle)
+    rc[:, 3] = 1500 + np.round(setpoint[:, 2] / 4)
+    rc[:, 4:] = 1000
+    return values
+
+
+def synth(args):
+    rng = np.random.default_rng(1)
+    fields = 1 + 9 + 9 + args.motors + RC_CHANNELS
+    divider = args.divider
+    rate = 1e6 / (ACTUATOR_PERIOD * divider)
+    target = int(args.size * 1e6)
+    written, start_us = 0, 0
+    with open(args.synth, "wb") as f:
+        while written < target:
+            frames = int(rate * rng.uniform(300, 900))
+            values = synth_session(rng, frames, divider, start_us, fields)
+            values[:, TIME] = wrap32(values[:, TIME])
+            data = pack_session(values, divider)
+            f.write(data[:-(-(target - written) // CHUNK_SIZE) * CHUNK_SIZE])
+            written += len(data)
+            start_us += frames * ACTUATOR_PERIOD * divider + 30 * 10 ** 6
+    print("wrote %s, %.1f MB at %.1f Hz" % (args.synth, min(written, target) / 1e6, rate))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Blackbox log analyzer")
+    parser.add_argument("log", nargs="?", help="log saved by blackbox_dl.py")
+    parser.add_argument("--out", help="output file prefix, the log name by default")
+    parser.add_argument("--csv", help="also write every decoded frame to this file")
+    parser.add_argument("--min-throttle", type=int, default=1150, help="cfg.minThrottle")
+    parser.add_argument("--max-throttle", type=int, default=1850, help="cfg.maxThrottle")
+    parser.add_argument("--nperseg", type=int, default=256, help="Welch segment length in frames")
+    parser.add_argument("--noise-floor-hz", type=float, default=20.0,
+                        help="ignore noise peaks below this, where stick movement is")
+    parser.add_argument("--step-window", type=float, default=2.0, help="deconvolution window in s")
+    parser.add_argument("--step-length", type=float, default=0.5, help="step response length in s")
+    parser.add_argument("--step-threshold", type=float, default=500.0,
+                        help="setpoint in mrad/s a window needs to be used")
+    parser.add_argument("--synth", metavar="LOG", help="write a synthetic log instead")
+    parser.add_argument("--size", type=float, default=100.0, help="synthetic log size in MB")
+    parser.add_argument("--divider", type=int, default=1, help="synthetic log blackbox_divider")
+    parser.add_argument("--motors", type=int, default=12, help="synthetic log MAX_MOTORS")
+    args = parser.parse_args()
+
+    if args.synth:
+        return synth(args)
+    if not args.log:
+        parser.print_usage()
+        return 1
+    return analyze(args)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,119 @@
+# Blackbox download
+# Reads the flight log off the board over MSP and saves it as the raw run
+# of chunks described in src/core/blackbox.h, blackbox_analyze.py reads it.
+# Needs pyserial.
+#
+# usage: python blackbox_dl.py <port> <file> [baud] [erase]
+#
+# erase clears the log on the board once it has been saved.
+
+import struct
+import sys
+import serial
+
+MSP_BLACKBOX_INFO = 124
+MSP_BLACKBOX_READ = 125
+MSP_BLACKBOX_ERASE = 222
+
+READ_SIZE = 128
+RETRIES = 5
+
+STATES = ["idle", "recording", "erasing", "full"]
+
+
+def request(cmd, payload=b""):
+    frame = bytearray(b"$M<")
+    frame.append(len(payload))
+    frame.append(cmd)
+    frame += payload
+    checksum = 0
+    for b in frame[3:]:
+        checksum ^= b
+    frame.append(checksum)
+    return bytes(frame)
+
+
+def read_reply(ser, cmd):
+    header = ser.read(5)
+    if len(header) < 5 or header[:3] != b"$M>":
+        return None
+    size = header[3]
+    body = ser.read(size + 1)
+    if len(body) < size + 1 or header[4] != cmd:
+        return None
+    checksum = size ^ cmd
+    for b in body[:size]:
+        checksum ^= b
+    if checksum != body[size]:
+        return None
+    return body[:size]
+
+
+def exchange(ser, cmd, payload=b""):
+    for attempt in range(RETRIES):
+        ser.reset_input_buffer()
+        ser.write(request(cmd, payload))
+        reply = read_reply(ser, cmd)
+        if reply is not None:
+            return reply
+    raise IOError("no reply to MSP %d" % cmd)
+
+
+# CRC-32/MPEG-2 over little endian words, the tail zero padded, as the STM32
+# CRC unit computes it in drivers/crc.c
+def crc32_stm32(data):
+    data = bytes(data) + b"\0" * (-len(data) % 4)
+    crc = 0xFFFFFFFF
+    for (word,) in struct.iter_unpack("<I", data):
+        crc ^= word
+        for i in range(32):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else crc << 1
+            crc &= 0xFFFFFFFF
+    return crc
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("usage: blackbox_dl.py <port> <file> [baud] [erase]")
+        return 1
+
+    port = sys.argv[1]
+    path = sys.argv[2]
+    baud = int(sys.argv[3]) if len(sys.argv) > 3 else 115200
+    erase = len(sys.argv) > 4 and sys.argv[4] == "erase"
+
+    ser = serial.Serial(port=port, baudrate=baud, timeout=0.5)
+
+    info = exchange(ser, MSP_BLACKBOX_INFO)
+    state, size, used, frames, dropped, cycles, max_cycles = struct.unpack("<BIIIIHH", info)
+    print("%s, %u of %u bytes, %u frames, %u dropped, %u cycles/frame (max %u)" %
+          (STATES[state], used, size, frames, dropped, cycles, max_cycles))
+
+    log = bytearray()
+    while len(log) < used:
+        for attempt in range(RETRIES):
+            reply = exchange(ser, MSP_BLACKBOX_READ, struct.pack("<IB", len(log), READ_SIZE))
+            offset = struct.unpack_from("<I", reply)[0]
+            data = reply[4:-4]
+            crc = struct.unpack_from("<I", reply, len(reply) - 4)[0]
+            if offset == len(log) and data and crc == crc32_stm32(data):
+                break
+        else:
+            raise IOError("bad read at %u" % len(log))
+        log += data
+        sys.stdout.write("\r%u%%" % (100 * len(log) // used))
+        sys.stdout.flush()
+
+    with open(path, "wb") as f:
+        f.write(log)
+    print("\rsaved %u bytes to %s" % (len(log), path))
+
+    if erase:
+        exchange(ser, MSP_BLACKBOX_ERASE)
+        print("erasing")
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,574 @@
+/*
+ * Host model of the I2C sensor schedule in src/sensors/bus_sched.c
+ *
+ * Runs the firmware's tasks over simulated time, every sensor read taking
+ * its bus time at 400 kHz plus 5 to 15 us of driver overhead. It runs
+ * twice: once with the sensors as independent main loop tasks, as they were
+ * before the schedule, and once as main() sets it up now. There the bus
+ * tick runs from the SysTick interrupt and pre-empts the main loop, after 1
+ * to 3 us of interrupt entry, except while a flash write stalls the CPU.
+ * The gyro, accel and mag reads run in the background, the tick starts them
+ * and takes them back once the I2C interrupts have read the last byte.
+ * The main loop tasks are every periodicEvent() main() registers, in its
+ * order. They only take CPU time, their costs are rough and move both runs
+ * alike. blackboxProgram() stands in for the recorder at the default
+ * divider and programs flash as blackbox.c does.
+ *
+ * Reports how late each gyro read starts and how much of that it spent
+ * behind another sensor's transfer, and how late and how often each task
+ * ran. The schedule must never hold the gyro behind another read, and with
+ * the bus alone every client must get the reads it was planned. With every
+ * task running it must stay within the bounds below.
+ *
+ * usage: bus_sim [seconds] [seed]
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "drivers/system.h"
+#include "sensors/bus_sched.h"
+
+#define TICK_US         500     // GYRO_PERIOD
+#define MAX_TASKS       16
+
+// A tick starts late only by the interrupt entry, the flash writes that
+// could stall it are never started that close to one
+#define LATE_MAX_US     50      // a tenth of a tick
+#define GYRO_MIN_PCT    99      // of the reads it gets with the bus alone
+#define CLIENT_MIN_PCT  99
+
+// blackboxProgram() with the recorder running at the default divider, 3.3 KB/s.
+// Every half word stalls the CPU for 40 to 70 us and must end before the
+// next tick is due. Two chunk buffers of backlog is all it has.
+#define RECORDER_BYTES_S    3300
+#define PROGRAM_HALF_US     80
+#define BACKLOG_MAX         (2 * 512)
+
+typedef struct {
+    const char *name;
+    void (*fn)(void);
+    uint32_t period;            // us
+    uint64_t start;             // ns, as periodicEvent() keeps it
+    uint64_t lateMax;           // ns past its period when it ran
+    uint32_t runs, overruns;    // overruns were a whole period late
+} task_t;
+
+typedef struct {
+    uint64_t lateMax, lateSum;
+    uint64_t behindMax, behindSum;
+    uint32_t behindCount, count;
+} gyroStats_t;
+
+static uint64_t now;            // ns
+static uint64_t due;            // when the running task became due
+static uint32_t *period;        // the running task's period, for the baro
+static uint64_t otherEnd;       // end of the last transfer that was not the gyro
+static uint64_t busy;           // ns the bus was in use
+static gyroStats_t gyroStats;
+static uint32_t reads[5];       // gyro, accel, mag, baro, temp
+static uint64_t tickMax;        // latest a tick's reads ended after it was due, ns
+static uint64_t tickTime;       // ns spent in bus ticks and their I2C interrupts
+static bool scheduled;          // gyro due times come from the schedule
+static uint64_t tickDue;        // ns, when the running tick was due
+
+// SysTick, PendSV and the I2C interrupts, see tickEvent() and i2cReadStart()
+static bool ticking;            // the bus tick is an interrupt
+static bool inTick;
+static bool pended;
+static uint64_t nextTick;       // ns, the next SysTick
+static bool transferring;       // a read started in the background
+static uint64_t transferEnd;
+static uint8_t transferBytes;
+static uint64_t stolen;         // ns of I2C interrupts the main loop still owes
+
+uint32_t micros(void)
+{
+    return now / 1000;
+}
+
+void tickPend(void)
+{
+    pended = true;
+}
+
+static void ended(uint64_t end)
+{
+    if (scheduled && end - tickDue > tickMax)
+        tickMax = end - tickDue;
+}
+
+// Takes the interrupts that are due, then the tick if they pended it
+static void interrupts(void)
+{
+    uint64_t start;
+
+    if (transferring && transferEnd <= now) {
+        // The byte interrupts came while it ran and only the last one holds
+        // up the tick, the rest are taken from the main loop
+        transferring = false;
+        ended(transferEnd);
+        now += 2000;
+        stolen += (transferBytes + 4) * 2000;
+        tickTime += (transferBytes + 5) * 2000;
+        busSchedDone(true);
+    }
+    if (nextTick <= now) {
+        pended = true;
+        nextTick += TICK_US * 1000;
+        if (nextTick + TICK_US * 1000 <= now)
+            nextTick = now - now % (TICK_US * 1000);
+    }
+    if (pended) {
+        pended = false;
+        start = now;
+        now += (1 + rand() % 3) * 1000;
+        inTick = true;
+        if ((int32_t)(micros() - busSchedStats.due) >= 0)
+            tickDue = (uint64_t)busSchedStats.due * 1000;
+        busSchedTick();
+        inTick = false;
+        tickTime += now - start;
+    }
+}
+
+// CPU time, interrupts that fall due take the CPU first
+static void spend(uint64_t ns)
+{
+    uint64_t next;
+
+    if (!inTick) {
+        ns += stolen;
+        stolen = 0;
+    }
+    while (ticking && !inTick) {
+        next = transferring && transferEnd < nextTick ? transferEnd : nextTick;
+        if (!pended && now + ns < next)
+            break;
+        if (next > now && !pended) {
+            ns -= next - now;
+            now = next;
+        }
+        interrupts();
+    }
+    now += ns;
+}
+
+// A flash write stalls every fetch, interrupts included
+static uint64_t overlaps;
+
+static void stall(uint64_t ns)
+{
+    if (ticking && (now + ns > nextTick || transferring))
+        overlaps++;
+    now += ns;
+    spend(0);
+}
+
+static uint64_t transferTime(uint8_t bytes, bool read)
+{
+    uint32_t bits = read ? 29 + 9 * bytes : 20 + 9 * bytes;
+    uint64_t t = bits * 2500 + (5 + rand() % 11) * 1000;
+
+    busy += t;
+    return t;
+}
+
+// Holds the CPU for the whole transfer
+static void transfer(uint8_t bytes, bool read)
+{
+    now += transferTime(bytes, read);
+    ended(now);
+}
+
+// Starts it and returns, see interrupts()
+static bool startTransfer(uint8_t bytes)
+{
+    transferring = true;
+    transferBytes = bytes;
+    transferEnd = now + transferTime(bytes, true);
+    return true;
+}
+
+static void gyroLate(uint64_t gyroDue)
+{
+    uint64_t late = now - gyroDue, behind = 0;
+
+    if (otherEnd > gyroDue)
+        behind = otherEnd - gyroDue < late ? otherEnd - gyroDue : late;
+
+    gyroStats.count++;
+    gyroStats.lateSum += late;
+    if (late > gyroStats.lateMax)
+        gyroStats.lateMax = late;
+    if (behind) {
+        gyroStats.behindCount++;
+        gyroStats.behindSum += behind;
+        if (behind > gyroStats.behindMax)
+            gyroStats.behindMax = behind;
+    }
+}
+
+// Before: every sensor a main loop task of its own, reads hold the CPU
+static void gyroTask(void)
+{
+    gyroLate(due);
+    transfer(6, true);
+    spend((5 + rand() % 6) * 1000);     // notch and accumulate
+    reads[0]++;
+}
+
+static void other(uint8_t bytes, bool read, uint8_t client)
+{
+    transfer(bytes, read);
+    otherEnd = now;
+    reads[client]++;
+}
+
+static void accelTask(void)
+{
+    other(6, true, 1);
+}
+
+static void magTask(void)
+{
+    other(6, true, 2);
+}
+
+// After: the tick starts the 6 byte reads and has them back once done
+static bool gyroStartSample(void)
+{
+    gyroLate(tickDue);
+    return startTransfer(6);
+}
+
+static void gyroSample(void)
+{
+    spend((5 + rand() % 6) * 1000);
+    reads[0]++;
+}
+
+static bool accelStartSample(void)
+{
+    startTransfer(6);
+    otherEnd = transferEnd;
+    return true;
+}
+
+static void accelSample(void)
+{
+    reads[1]++;
+}
+
+static bool magStartSample(void)
+{
+    startTransfer(6);
+    otherEnd = transferEnd;
+    return true;
+}
+
+static void magSample(void)
+{
+    reads[2]++;
+}
+
+static void temperatureSample(void)
+{
+    other(2, true, 4);
+}
+
+// MS5611 conversions, as baroUpdate() steps through them
+static uint8_t baroState;
+static uint64_t baroStart;
+static uint32_t baroWait;
+
+static uint32_t baroStep(void)
+{
+    static const uint32_t waits[4] = { 10000, 500, 10000, 4000 };
+    uint8_t state = baroState;
+
+    other(state & 1 ? 3 : 1, state & 1, 3);
+    baroState = (state + 1) & 3;
+    return waits[state];
+}
+
+// Before: a chain of single events, modelled as a task that sets its period
+static void baroEvent(void)
+{
+    *period = baroStep();
+}
+
+// After: called from its bus slot, skips until the conversion is done
+static void baroUpdate(void)
+{
+    if (now - baroStart < (uint64_t)baroWait * 1000)
+        return;
+    baroWait = baroStep();
+    baroStart = now;
+}
+
+static uint64_t recorderOwed;       // bytes * 1000000 waiting for flash
+static uint64_t recorderLast;
+static uint32_t recorderDeferred, recorderBacklog;
+
+static void blackboxProgram(void)
+{
+    static bool waiting;
+
+    spend(1000);
+    recorderOwed += (now - recorderLast) / 1000 * RECORDER_BYTES_S;
+    recorderLast = now;
+    if (recorderOwed / 1000000 > recorderBacklog)
+        recorderBacklog = recorderOwed / 1000000;
+    if (recorderOwed < 2000000)
+        return;
+
+    if (busSchedUntilDue() < PROGRAM_HALF_US) {
+        if (!waiting)
+            recorderDeferred++;
+        waiting = true;
+        return;
+    }
+    waiting = false;
+    stall((40 + rand() % 31) * 1000);
+    recorderOwed -= 2000000;
+}
+
+// CPU only stand-ins for the rest of the main loop
+#define CPU_TASK(name, us) \
+    static void name(void) { spend(((us) * 3 / 4 + rand() % ((us) / 2 + 1)) * 1000); }
+
+CPU_TASK(dynNotchUpdate, 60)
+CPU_TASK(updateAttitude, 250)
+CPU_TASK(updateRateSetpoints, 80)
+CPU_TASK(updateActuators, 350)
+CPU_TASK(updateCommands, 150)
+CPU_TASK(updateAltitude, 200)           // with baroCalculate()
+CPU_TASK(updateThrottleSetpoint, 30)
+CPU_TASK(serialCom, 100)
+CPU_TASK(telemetryUpdate, 40)
+CPU_TASK(statusLED, 5)
+CPU_TASK(computeGyroTCBias, 10)
+CPU_TASK(updateParams, 2)               // armed, it returns straight away
+CPU_TASK(blackboxUpdate, 4)             // nothing to close or erase armed
+CPU_TASK(batterySample, 20)
+
+static void run(task_t *tasks, uint8_t count, uint32_t seconds)
+{
+    uint64_t end = (uint64_t)seconds * 1000000000;
+    uint64_t pass, late;
+    uint8_t i;
+
+    now = otherEnd = busy = tickMax = tickTime = overlaps = 0;
+    nextTick = TICK_US * 1000;
+    pended = transferring = false;
+    stolen = 0;
+    baroState = 0;
+    baroStart = 0;
+    baroWait = 0;
+    recorderOwed = recorderLast = 0;
+    recorderDeferred = recorderBacklog = 0;
+    gyroStats = (gyroStats_t){ 0 };
+    for (i = 0; i < 5; i++)
+        reads[i] = 0;
+    for (i = 0; i < count; i++) {
+        tasks[i].start = 0;
+        tasks[i].lateMax = 0;
+        tasks[i].runs = tasks[i].overruns = 0;
+    }
+
+    // eventCallbacks(), a task runs once more than its period has passed and
+    // only the first timed one due runs in a pass
+    while (now < end) {
+        pass = now;
+        for (i = 0; i < count; i++) {
+            if (now - tasks[i].start > (uint64_t)tasks[i].period * 1000) {
+                due = tasks[i].start + (uint64_t)tasks[i].period * 1000;
+                late = now - due;
+                // Period 0 is polled, it can't be late
+                if (tasks[i].period && late >= (uint64_t)tasks[i].period * 1000)
+                    tasks[i].overruns++;
+                if (tasks[i].period && late > tasks[i].lateMax)
+                    tasks[i].lateMax = late;
+                tasks[i].runs++;
+                period = &tasks[i].period;
+                tasks[i].fn();
+                tasks[i].start = now;
+                if (tasks[i].period)
+                    break;
+            }
+        }
+        if (now == pass)
+            spend(1000);
+    }
+}
+
+static void report(const char *name, uint32_t seconds)
+{
+    printf("%s: gyro late max %u us, mean %u us, behind another read %u of %u times, max %u us\n", name,
+           (uint32_t)(gyroStats.lateMax / 1000), (uint32_t)(gyroStats.lateSum / gyroStats.count / 1000),
+           gyroStats.behindCount, gyroStats.count, (uint32_t)(gyroStats.behindMax / 1000));
+    printf("  reads/s gyro %u, accel %u, mag %u, baro %u, temp %u, bus %u.%u%% busy\n",
+           reads[0] / seconds, reads[1] / seconds, reads[2] / seconds, reads[3] / seconds, reads[4] / seconds,
+           (uint32_t)(busy * 1000 / ((uint64_t)seconds * 1000000000)) / 10,
+           (uint32_t)(busy * 1000 / ((uint64_t)seconds * 1000000000)) % 10);
+}
+
+static void reportTasks(task_t *tasks, uint8_t count, uint32_t seconds)
+{
+    uint8_t i;
+
+    for (i = 0; i < count; i++)
+        printf("  %-10s every %7u us, ran %5u/s, late max %5u us, %u overruns\n", tasks[i].name,
+               tasks[i].period, tasks[i].runs / seconds, (uint32_t)(tasks[i].lateMax / 1000),
+               tasks[i].overruns);
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t seconds = argc > 1 ? atoi(argv[1]) : 60;
+    uint32_t ticks, expected, alone[5];
+    const busClient_t *client;
+    bool planned, ok = true;
+    uint8_t i;
+
+    task_t before[MAX_TASKS] = {
+        { "gyro", gyroTask, TICK_US },
+        { "dynNotch", dynNotchUpdate, 1000 },
+        { "accel", accelTask, 500 },
+        { "mag", magTask, 20000 },
+        { "attitude", updateAttitude, 3000 },
+        { "setpoints", updateRateSetpoints, 3000 },
+        { "actuators", updateActuators, 2000 },
+        { "commands", updateCommands, 20000 },
+        { "serial", serialCom, 20000 },
+        { "telemetry", telemetryUpdate, 5000 },
+        { "baro", baroEvent, 4000 },
+    };
+    // As main() registers them on a NAZE with a mag, baro and battery
+    task_t after[MAX_TASKS] = {
+        { "dynNotch", dynNotchUpdate, 1000 },
+        { "attitude", updateAttitude, 3000 },
+        { "setpoints", updateRateSetpoints, 3000 },
+        { "actuators", updateActuators, 2000 },
+        { "commands", updateCommands, 20000 },
+        { "altitude", updateAltitude, 40000 },
+        { "throttle", updateThrottleSetpoint, 40000 },
+        { "serial", serialCom, 20000 },
+        { "telemetry", telemetryUpdate, 5000 },
+        { "statusLED", statusLED, 100000 },
+        { "gyroTC", computeGyroTCBias, 1000000 },
+        { "params", updateParams, 100000 },
+        { "blackbox", blackboxUpdate, 2000 },
+        { "program", blackboxProgram, 0 },
+        { "battery", batterySample, 40000 },
+    };
+
+    busSchedAdd("gyro", gyroStartSample, gyroSample, TICK_US, I2C_READ_US(6));
+    busSchedAdd("accel", accelStartSample, accelSample, 2000, I2C_READ_US(6));
+    busSchedAdd("mag", magStartSample, magSample, 20000, I2C_READ_US(6));
+    busSchedAdd("baro", 0, baroUpdate, 2000, I2C_READ_US(3));
+    busSchedAdd("temp", 0, temperatureSample, 1000000, I2C_READ_US(2));
+    planned = busSchedPlan(TICK_US);
+
+    printf("plan: %u ticks of %u us, %u.%u%% of the bus%s\n", BUS_FRAME_TICKS, TICK_US,
+           busSchedUtilisation() / 10, busSchedUtilisation() % 10, planned ? "" : ", overcommitted");
+    for (i = 0; i < busSchedClients(); i++) {
+        client = busSchedClient(i);
+        printf("  %-6s every %5u us from tick %2u, %u us\n", client->name, client->ticks * TICK_US,
+               client->offset, client->cost);
+    }
+    for (i = 0; i < BUS_FRAME_TICKS; i++) {
+        if (busSchedTickLoad(i) > TICK_US - BUS_GUARD_US) {
+            printf("tick %u planned %u us, over %u\n", i, busSchedTickLoad(i), TICK_US - BUS_GUARD_US);
+            ok = false;
+        }
+    }
+
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+    run(before, 11, seconds);
+    report("independent tasks", seconds);
+
+    // The bus on its own, every tick on time, must give exactly the plan
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+    now = 0;
+    busSchedPlan(TICK_US);
+    scheduled = ticking = true;
+    run(after, 0, seconds);
+    report("bus schedule, bus only", seconds);
+    printf("  longest tick %u us of %u, %u ticks skipped\n", (uint32_t)(tickMax / 1000), TICK_US,
+           busSchedStats.skipped);
+
+    // Its reads end before the next tick is due
+    if (gyroStats.behindCount || busSchedStats.skipped || tickMax > (uint64_t)TICK_US * 1000) {
+        printf("ticks overran with nothing else running\n");
+        ok = false;
+    }
+
+    // Every slot taken, the baro only reads in some of its own and the
+    // temperature once a frame
+    ticks = reads[0];
+    for (i = 0; i < 5; i++)
+        alone[i] = reads[i];
+    for (i = 1; i < busSchedClients(); i++) {
+        client = busSchedClient(i);
+        expected = (ticks - client->offset + client->ticks - 1) / client->ticks;
+        if (i != 3 && (reads[i] + 1 < expected || reads[i] > expected + 1)) {
+            printf("%s: %u reads in %u ticks, planned %u\n", client->name, reads[i], ticks, expected);
+            ok = false;
+        }
+    }
+
+    // Every task running, the recorder included
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+    now = 0;
+    busSchedStats.skipped = busSchedStats.abandoned = 0;
+    busSchedPlan(TICK_US);
+    run(after, 15, seconds);
+    report("bus schedule, every task", seconds);
+    printf("  longest tick %u us of %u, %u ticks skipped, %u reads abandoned, ticks take %u%% of the CPU\n",
+           (uint32_t)(tickMax / 1000), TICK_US, busSchedStats.skipped, busSchedStats.abandoned,
+           (uint32_t)(tickTime * 100 / ((uint64_t)seconds * 1000000000)));
+    printf("  recorder %u B/s, %u waits for the bus, backlog max %u bytes\n", RECORDER_BYTES_S,
+           recorderDeferred, recorderBacklog);
+    reportTasks(after, 15, seconds);
+
+    if (gyroStats.behindCount) {
+        printf("gyro read held behind another read\n");
+        ok = false;
+    }
+    if (gyroStats.lateMax > LATE_MAX_US * 1000) {
+        printf("gyro read %u us late, bound %u\n", (uint32_t)(gyroStats.lateMax / 1000), LATE_MAX_US);
+        ok = false;
+    }
+    for (i = 0; i < busSchedClients(); i++) {
+        if ((uint64_t)reads[i] * 100 < (uint64_t)alone[i] * (i ? CLIENT_MIN_PCT : GYRO_MIN_PCT)) {
+            printf("%s: %u reads, %u with the bus alone, bound %u%%\n", busSchedClient(i)->name, reads[i],
+                   alone[i], i ? CLIENT_MIN_PCT : GYRO_MIN_PCT);
+            ok = false;
+        }
+    }
+    if (busSchedStats.skipped || busSchedStats.abandoned) {
+        printf("ticks overran\n");
+        ok = false;
+    }
+    if (overlaps) {
+        printf("%u flash writes ran into a tick or a read\n", (uint32_t)overlaps);
+        ok = false;
+    }
+    if (recorderBacklog > BACKLOG_MAX) {
+        printf("recorder fell behind by more than its two chunk buffers\n");
+        ok = false;
+    }
+    for (i = 0; i < 15; i++) {
+        if (after[i].overruns) {
+            printf("%s ran a whole period late %u times\n", after[i].name, after[i].overruns);
+            ok = false;
+        }
+    }
+
+    printf(ok ? "schedule holds\n" : "schedule FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,131 @@
+# Crash recorder download
+# Reads the frozen crash recorder snapshot over MSP and writes it as CSV, one
+# row per control loop, oldest first. The frame layout is crashFrame_t in
+# src/core/crashlog.h. Needs pyserial.
+#
+# usage: python crashlog_dl.py <port> <file.csv> [baud] [clear]
+#
+# clear starts a new recording once the snapshot has been saved.
+
+import struct
+import sys
+import serial
+
+MSP_CRASHLOG_INFO = 126
+MSP_CRASHLOG_READ = 127
+MSP_CRASHLOG_CONTROL = 223
+
+READ_FRAMES = 7
+RETRIES = 5
+
+STATES = ["recording", "triggered", "frozen"]
+TRIGGERS = ["arm", "disarm", "failsafe", "i2c", "msp", "reset"]
+
+
+def request(cmd, payload=b""):
+    frame = bytearray(b"$M<")
+    frame.append(len(payload))
+    frame.append(cmd)
+    frame += payload
+    checksum = 0
+    for b in frame[3:]:
+        checksum ^= b
+    frame.append(checksum)
+    return bytes(frame)
+
+
+def read_reply(ser, cmd):
+    header = ser.read(5)
+    if len(header) < 5 or header[:3] != b"$M>":
+        return None
+    size = header[3]
+    body = ser.read(size + 1)
+    if len(body) < size + 1 or header[4] != cmd:
+        return None
+    checksum = size ^ cmd
+    for b in body[:size]:
+        checksum ^= b
+    if checksum != body[size]:
+        return None
+    return body[:size]
+
+
+def exchange(ser, cmd, payload=b""):
+    for attempt in range(RETRIES):
+        ser.reset_input_buffer()
+        ser.write(request(cmd, payload))
+        reply = read_reply(ser, cmd)
+        if reply is not None:
+            return reply
+    raise IOError("no reply to MSP %d" % cmd)
+
+
+# CRC-32/MPEG-2 over little endian words, as the STM32 CRC unit computes it
+def crc32_stm32(data, crc=0xFFFFFFFF):
+    data = bytes(data) + b"\0" * (-len(data) % 4)
+    for (word,) in struct.iter_unpack("<I", data):
+        crc ^= word
+        for i in range(32):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else crc << 1
+            crc &= 0xFFFFFFFF
+    return crc
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("usage: crashlog_dl.py <port> <file.csv> [baud] [clear]")
+        return 1
+
+    port = sys.argv[1]
+    path = sys.argv[2]
+    baud = int(sys.argv[3]) if len(sys.argv) > 3 else 115200
+    clear = len(sys.argv) > 4 and sys.argv[4] == "clear"
+
+    ser = serial.Serial(port=port, baudrate=baud, timeout=0.5)
+
+    info = exchange(ser, MSP_CRASHLOG_INFO)
+    state, trigger, trigger_ms, frames, capacity, frame_size, motors = struct.unpack("<BBIHHBB", info)
+    names = [TRIGGERS[i] for i in range(len(TRIGGERS)) if trigger & (1 << i)]
+    print("%s, %s trigger at %u ms, %u of %u frames" %
+          (STATES[state], "/".join(names) or "no", trigger_ms, frames, capacity))
+    if state != 2:
+        print("warning: not frozen, the frames move while they are read")
+
+    layout = "<9h%dBBB" % motors
+    rows = []
+    while len(rows) < frames:
+        for attempt in range(RETRIES):
+            reply = exchange(ser, MSP_CRASHLOG_READ, struct.pack("<HB", len(rows), READ_FRAMES))
+            first, count = struct.unpack_from("<HB", reply)
+            data = reply[3:-4]
+            crc = struct.unpack_from("<I", reply, len(reply) - 4)[0]
+            check = 0xFFFFFFFF
+            for i in range(count):
+                check = crc32_stm32(data[i * frame_size:(i + 1) * frame_size], check)
+            if first == len(rows) and count and len(data) == count * frame_size and crc == check:
+                break
+        else:
+            raise IOError("bad read at frame %u" % len(rows))
+        for i in range(count):
+            rows.append(struct.unpack_from(layout, data, i * frame_size))
+
+    with open(path, "w") as f:
+        f.write("gyro_roll,gyro_pitch,gyro_yaw,err_roll,err_pitch,err_yaw,"
+                "pid_roll,pid_pitch,pid_yaw,%s,cycle_us,armed,failsafe,level\n" %
+                ",".join("motor%d" % i for i in range(motors)))
+        for row in rows:
+            values = list(row[:9]) + [1000 + 4 * m for m in row[9:9 + motors]]
+            flags = row[10 + motors]
+            values += [32 * row[9 + motors], flags & 1, (flags >> 1) & 1, (flags >> 2) & 1]
+            f.write(",".join(str(v) for v in values) + "\n")
+    print("saved %u frames to %s" % (len(rows), path))
+
+    if clear:
+        exchange(ser, MSP_CRASHLOG_CONTROL, b"\x01")
+        print("recording again")
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,32 @@
+/*
+ * Host stand-in for src/board.h, only what sensors/dyn_notch.c and
+ * core/fft.c use. The Makefile puts this directory ahead of src.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <x86intrin.h>
+
+#include "baseflight_proto.h"
+#include "core/utilities.h"
+
+typedef struct {
+    uint8_t dynNotchEnable;
+    uint16_t dynNotchMinHz;
+    uint16_t dynNotchMaxHz;
+    uint8_t dynNotchCutoffPercent;
+} config_t;
+
+extern config_t cfg;
+
+// Nothing interrupts the model
+#define __disable_irq()
+#define __enable_irq()
+
+// The host's time stamp counter stands in for the DWT cycle counter
+static inline uint32_t cycleCount(void)
+{
+    return __rdtsc();
+}
@@ -0,0 +1,183 @@
+/*
+ * Host model of the dynamic gyro notch in src/sensors/dyn_notch.c
+ *
+ * Feeds synthetic gyro counts through dynNotchApply() at the gyro rate and
+ * runs dynNotchUpdate() at its slice period, as the firmware does. Each axis
+ * gets slow stick motion, a motor tone with its second harmonic and white
+ * noise. The tone either holds still or sweeps, as it does with throttle.
+ *
+ * Checks that every axis' notch centre follows the tone, that the tone comes
+ * out well attenuated and that the stick motion passes through unchanged.
+ * With no tone the notch must leave the motion alone.
+ *
+ * usage: dyn_notch_sim [seed]
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "board.h"
+#include "sensors/dyn_notch.h"
+
+#define SAMPLE_HZ       DYN_NOTCH_SAMPLE_HZ
+#define UPDATE_SAMPLES  (DYN_NOTCH_SLICE_PERIOD / GYRO_PERIOD)
+#define MOTION_HZ       3.0
+#define MOTION_COUNTS   400.0
+#define NOISE_COUNTS    60
+#define SETTLE_SECONDS  1.0     // tracking is only checked after this
+#define MEASURE_SECONDS 0.5     // gains are taken over the end of the run
+#define MAX_SLICES      20000
+#define SLICE_QUANTILE  0.999   // the host takes interrupts of its own
+
+config_t cfg;
+
+typedef struct {
+    const char *name;
+    double startHz, endHz;      // tone, swept linearly over the run
+    double counts;              // 0 for no tone
+    double seconds;
+    double maxTrackHz;          // largest centre error allowed after settling
+    double minToneDb;           // attenuation the tone must see at the end
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+    { "tone 180 Hz",            180.0, 180.0, 800.0, 3.0, 8.0,  20.0 },
+    { "tone 320 Hz",            320.0, 320.0, 800.0, 3.0, 8.0,  20.0 },
+    { "sweep 120 to 350 Hz",    120.0, 350.0, 800.0, 4.0, 20.0, 10.0 },
+    { "sweep 350 to 150 Hz",    350.0, 150.0, 800.0, 4.0, 20.0, 10.0 },
+    { "no tone",                0.0,   0.0,   0.0,   3.0, 0.0,  0.0 },
+};
+
+static const double axisGain[3] = { 1.0, 0.7, 0.4 };
+
+static bool ok = true;
+
+static uint32_t sliceCycles[MAX_SLICES];
+static uint32_t slices;
+
+static void check(bool pass, const char *what, double value, const char *unit)
+{
+    printf("  %-28s %8.2f %s%s\n", what, value, unit, pass ? "" : "  FAIL");
+    if (!pass)
+        ok = false;
+}
+
+static int compareCycles(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+// Gain in dB of a component, from its correlation with the input over the window
+static double gainDb(double re, double im, double counts, uint32_t samples)
+{
+    return 20.0 * log10(2.0 * sqrt(re * re + im * im) / samples / counts);
+}
+
+static void run(const scenario_t *s)
+{
+    uint32_t total = s->seconds * SAMPLE_HZ;
+    uint32_t settle = SETTLE_SECONDS * SAMPLE_HZ;
+    uint32_t measure = total - MEASURE_SECONDS * SAMPLE_HZ;
+    double motionRe[3] = { 0 }, motionIm[3] = { 0 }, toneRe[3] = { 0 }, toneIm[3] = { 0 };
+    double t, hz = s->startHz, phase = 0.0, tone, track = 0.0, worst = 0.0, db;
+    int32_t sample[3];
+    uint32_t n;
+    uint8_t i;
+
+    printf("%s\n", s->name);
+    dynNotchInit();
+
+    for (n = 0; n < total; n++) {
+        t = (double)n / SAMPLE_HZ;
+        hz = s->startHz + (s->endHz - s->startHz) * n / total;
+        phase += 2.0 * M_PI * hz / SAMPLE_HZ;
+        tone = s->counts * (sin(phase) + 0.3 * sin(2.0 * phase));
+
+        for (i = 0; i < 3; i++)
+            sample[i] = lrint(MOTION_COUNTS * sin(2.0 * M_PI * MOTION_HZ * t + i) + axisGain[i] * tone +
+                              rand() % (2 * NOISE_COUNTS + 1) - NOISE_COUNTS);
+
+        dynNotchApply(sample);
+        if (n % UPDATE_SAMPLES == 0) {
+            dynNotchUpdate();
+            if (slices < MAX_SLICES)
+                sliceCycles[slices++] = dynNotchStats.cycles;
+        }
+
+        if (s->counts && n >= settle) {
+            for (i = 0; i < 3; i++) {
+                track = fabs(dynNotchCentre(i) - hz);
+                if (track > worst)
+                    worst = track;
+            }
+        }
+
+        if (n >= measure) {
+            for (i = 0; i < 3; i++) {
+                motionRe[i] += sample[i] * sin(2.0 * M_PI * MOTION_HZ * t + i);
+                motionIm[i] += sample[i] * cos(2.0 * M_PI * MOTION_HZ * t + i);
+                toneRe[i] += sample[i] * sin(phase);
+                toneIm[i] += sample[i] * cos(phase);
+            }
+        }
+    }
+
+    printf("  centre %u %u %u Hz, tone ends at %.0f Hz\n", dynNotchCentre(0), dynNotchCentre(1),
+           dynNotchCentre(2), hz);
+    if (s->counts)
+        check(worst <= s->maxTrackHz, "worst centre error", worst, "Hz");
+
+    for (i = 0; i < 3; i++) {
+        char what[40];
+
+        db = gainDb(motionRe[i], motionIm[i], MOTION_COUNTS, total - measure);
+        snprintf(what, sizeof(what), "axis %u stick motion", i);
+        check(fabs(db) <= 0.5, what, db, "dB");
+        if (s->counts) {
+            db = gainDb(toneRe[i], toneIm[i], axisGain[i] * s->counts, total - measure);
+            snprintf(what, sizeof(what), "axis %u tone", i);
+            check(-db >= s->minToneDb, what, db, "dB");
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint8_t i;
+
+    srand(argc > 1 ? atoi(argv[1]) : 1);
+
+    cfg.dynNotchEnable = 1;
+    cfg.dynNotchMinHz = 80;
+    cfg.dynNotchMaxHz = 400;
+    cfg.dynNotchCutoffPercent = 75;
+
+    // sensors.c only filters through the notches once they are designed
+    if (dynNotchRunning) {
+        printf("notch running before dynNotchInit()\n");
+        ok = false;
+    }
+
+    for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+        run(&scenarios[i]);
+
+    // dynNotchStats as 'status' shows it, counted in host cycles. The host
+    // is much quicker than the F103, so this only catches a slice that does
+    // far too much.
+    qsort(sliceCycles, slices, sizeof(sliceCycles[0]), compareCycles);
+    printf("slices: median %u host cycles, %.1f%% under %u, max %u, budget %u, %u over\n",
+           sliceCycles[slices / 2], SLICE_QUANTILE * 100.0, sliceCycles[(uint32_t)(slices * SLICE_QUANTILE)],
+           dynNotchStats.maxCycles, DYN_NOTCH_SLICE_BUDGET, dynNotchStats.overBudget);
+    if (sliceCycles[(uint32_t)(slices * SLICE_QUANTILE)] > DYN_NOTCH_SLICE_BUDGET) {
+        printf("slices over budget\n");
+        ok = false;
+    }
+
+    printf(ok ? "notch follows\n" : "notch FAILED\n");
+    return ok ? 0 : 1;
+}
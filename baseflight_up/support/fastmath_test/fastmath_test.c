@@ -0,0 +1,202 @@
+/*
+ * Host accuracy and timing tests for src/core/fastmath.h
+ *
+ * Sweeps each approximation densely over the input range the header gives
+ * a bound for and holds the worst error against that bound, the reference
+ * being libm in double. Then times the approximation against the newlib
+ * style float call it replaces. The host has an FPU so the timings only
+ * show the shape, 'bench math' on the target gives the cycles.
+ *
+ * usage: fastmath_test
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "core/fastmath.h"
+
+#define STEPS       2000000
+#define TIME_CALLS  20000000
+
+static bool ok = true;
+
+static void check(const char *what, double worst, double bound)
+{
+    printf("%-40s %10.3g  < %g%s\n", what, worst, bound, worst < bound ? "" : "  FAIL");
+    if (worst >= bound)
+        ok = false;
+}
+
+static void testInvSqrt(void)
+{
+    double worst = 0.0, err, x;
+    uint32_t n;
+
+    // Ten decades, the AHRS sees squared norms from noise to several g
+    for (n = 0; n < STEPS; n++) {
+        x = pow(10.0, -5.0 + 10.0 * n / STEPS);
+        err = fabs(fastInvSqrt(x) * sqrt(x) - 1.0);
+        if (err > worst)
+            worst = err;
+    }
+    check("fastInvSqrt relative error, 1e-5..1e5", worst, 5e-6);
+}
+
+static void testAtan2(void)
+{
+    double worst = 0.0, err, a;
+    float y, x;
+    uint32_t n;
+
+    // Around the circle at a few radii, every octant and the axes
+    for (n = 0; n < STEPS; n++) {
+        a = -M_PI + 2.0 * M_PI * n / STEPS;
+        y = (n % 3 + 0.5) * sin(a);
+        x = (n % 3 + 0.5) * cos(a);
+        err = fabs(fastAtan2(y, x) - atan2(y, x));
+        if (err > M_PI)
+            err = 2.0 * M_PI - err;
+        if (err > worst)
+            worst = err;
+    }
+    check("fastAtan2 absolute error, rad", worst, 1.2e-5);
+}
+
+static void testAsin(void)
+{
+    double worst = 0.0, err;
+    float x;
+    uint32_t n;
+
+    for (n = 0; n <= STEPS; n++) {
+        x = -1.0 + 2.0 * n / STEPS;
+        err = fabs(fastAsin(x) - asin(x));
+        if (err > worst)
+            worst = err;
+    }
+    check("fastAsin absolute error, rad, |x| <= 1", worst, 2e-5);
+}
+
+static void testSinCos(void)
+{
+    double worstSin = 0.0, worstCos = 0.0, err;
+    float x;
+    uint32_t n;
+
+    for (n = 0; n <= STEPS; n++) {
+        x = -2.0 * M_PI + 4.0 * M_PI * n / STEPS;
+        err = fabs(fastSin(x) - sin(x));
+        if (err > worstSin)
+            worstSin = err;
+        err = fabs(fastCos(x) - cos(x));
+        if (err > worstCos)
+            worstCos = err;
+    }
+    check("fastSin absolute error, |x| <= 2 PI", worstSin, 1e-6);
+    check("fastCos absolute error, |x| <= 2 PI", worstCos, 1e-6);
+}
+
+// Random attitudes, gravity from quatGravity() against the earth z axis
+// turned into the body frame in double, q* (0, 0, 0, 1) q
+static void testVectors(void)
+{
+    double worstGrav = 0.0, worstNorm = 0.0, worstCross = 0.0, err, d[4], len, scale, w, x, y, z;
+    quat_t q;
+    vec3_t g, v, c;
+    uint32_t n;
+    uint8_t i;
+
+    srand(1);
+    for (n = 0; n < STEPS / 10; n++) {
+        for (i = 0, len = 0.0; i < 4; i++) {
+            d[i] = 2.0 * rand() / RAND_MAX - 1.0;
+            len += d[i] * d[i];
+        }
+        // Off unit length as integration leaves them
+        scale = 1.0 + 0.01 * rand() / RAND_MAX;
+        for (i = 0; i < 4; i++)
+            q[i] = d[i] / sqrt(len) * scale;
+        quatNormalise(q);
+        quatGravity(g, q);
+
+        len = sqrt(len);
+        w = d[0] / len;
+        x = d[1] / len;
+        y = d[2] / len;
+        z = d[3] / len;
+        err = fabs(g[X] - 2.0 * (x * z - w * y)) + fabs(g[Y] - 2.0 * (y * z + w * x)) +
+              fabs(g[Z] - (1.0 - 2.0 * (x * x + y * y)));
+        if (err > worstGrav)
+            worstGrav = err;
+
+        v[X] = 2.0 * rand() / RAND_MAX - 1.0;
+        v[Y] = 2.0 * rand() / RAND_MAX - 1.0;
+        v[Z] = 1e-3 + (double)rand() / RAND_MAX;
+        vec3Cross(c, v, g);
+        err = fabs(vec3Dot(c, v)) + fabs(vec3Dot(c, g));
+        if (err > worstCross)
+            worstCross = err;
+        vec3Normalise(v);
+        err = fabs(sqrt(vec3Dot(v, v)) - 1.0);
+        if (err > worstNorm)
+            worstNorm = err;
+    }
+    check("quatGravity error, sum over axes", worstGrav, 2e-5);
+    check("vec3Cross dot either input", worstCross, 1e-6);
+    check("vec3Normalise length error", worstNorm, 5e-6);
+}
+
+// Each call's input depends on the last result so neither can be hoisted
+static volatile float sink;
+
+static double nsPerCall(float (*fn)(float), float x)
+{
+    struct timespec start, end;
+    float acc = 0.0f;
+    uint32_t n;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (n = 0; n < TIME_CALLS; n++)
+        acc += fn(x + acc * 1e-9f);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    sink = acc;
+
+    return ((end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec)) / TIME_CALLS;
+}
+
+static float fastInvSqrtCall(float x) { return fastInvSqrt(x); }
+static float libInvSqrtCall(float x) { return 1.0f / sqrtf(x); }
+static float fastAtan2Call(float x) { return fastAtan2(x, 0.7f); }
+static float libAtan2Call(float x) { return atan2f(x, 0.7f); }
+static float fastAsinCall(float x) { return fastAsin(x); }
+static float libAsinCall(float x) { return asinf(x); }
+static float fastSinCall(float x) { return fastSin(x); }
+static float libSinCall(float x) { return sinf(x); }
+
+static void timing(const char *name, float (*fast)(float), float (*lib)(float), float x)
+{
+    double fastNs = nsPerCall(fast, x), libNs = nsPerCall(lib, x);
+
+    printf("%-12s %6.2f ns, libm %6.2f ns\n", name, fastNs, libNs);
+}
+
+int main(void)
+{
+    testInvSqrt();
+    testAtan2();
+    testAsin();
+    testSinCos();
+    testVectors();
+
+    timing("invsqrt", fastInvSqrtCall, libInvSqrtCall, 2.5f);
+    timing("atan2", fastAtan2Call, libAtan2Call, 0.3f);
+    timing("asin", fastAsinCall, libAsinCall, 0.3f);
+    timing("sin", fastSinCall, libSinCall, 1.1f);
+
+    printf(ok ? "fast math within bounds\n" : "fast math FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,230 @@
+/*
+ * Host frequency response tests for src/core/filters.c
+ *
+ * Drives each filter with sines at the rates the firmware runs them at and
+ * measures the steady state gain by correlating the output with the input
+ * frequency. The designs are checked against what they promise: unity gain
+ * in the passband, -3 dB at the low pass cutoff, a deep null at the notch
+ * centre and -3 dB at its cutoff. The chain builder is checked to leave out
+ * sections it cannot build, and the fixed point biquad to track the float one.
+ *
+ * usage: filter_test
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "core/fastmath.h"
+#include "core/filters.h"
+
+#define SETTLE_PERIODS  200
+#define MEASURE_PERIODS 200
+
+static bool ok = true;
+
+static void check(bool pass, const char *what, double value, double lo, double hi)
+{
+    printf("%-44s %9.3f  [%.3f, %.3f]%s\n", what, value, lo, hi, pass ? "" : "  FAIL");
+    if (!pass)
+        ok = false;
+}
+
+static void range(const char *what, double value, double lo, double hi)
+{
+    check(value >= lo && value <= hi, what, value, lo, hi);
+}
+
+typedef float (*applyFuncPtr)(void *filter, float input);
+
+static float pt1Apply(void *filter, float input)
+{
+    return pt1FilterApply(filter, input);
+}
+
+static float biquadApply(void *filter, float input)
+{
+    return biquadFilterApply(filter, input);
+}
+
+static float chainApply(void *filter, float input)
+{
+    return filterChainApply(filter, input);
+}
+
+// Gain in dB of a sine at hz through a filter called at sampleHz
+static double gainDb(applyFuncPtr apply, void *filter, double hz, double sampleHz)
+{
+    uint32_t settle = SETTLE_PERIODS * sampleHz / hz;
+    uint32_t measure = MEASURE_PERIODS * sampleHz / hz;
+    double re = 0.0, im = 0.0, w = 2.0 * M_PI * hz / sampleHz;
+    uint32_t n;
+    float y;
+
+    if (settle < 2000)
+        settle = 2000;
+    for (n = 0; n < settle + measure; n++) {
+        y = apply(filter, sin(w * n));
+        if (!isfinite(y))
+            return NAN;
+        if (n >= settle) {
+            re += y * sin(w * n);
+            im += y * cos(w * n);
+        }
+    }
+
+    return 20.0 * log10(2.0 * sqrt(re * re + im * im) / measure);
+}
+
+static void testPt1(float cutoffHz, float sampleHz)
+{
+    pt1Filter_t pt1;
+    char what[64];
+
+    // Backward Euler moves the corner down as it nears Nyquist, never up
+    pt1FilterInit(&pt1, cutoffHz, sampleHz);
+    snprintf(what, sizeof(what), "pt1 %g/%g Hz, dB at %g Hz", cutoffHz, sampleHz, cutoffHz / 10);
+    range(what, gainDb(pt1Apply, &pt1, cutoffHz / 10, sampleHz), -0.2, 0.0);
+    pt1FilterInit(&pt1, cutoffHz, sampleHz);
+    snprintf(what, sizeof(what), "pt1 %g/%g Hz, dB at cutoff", cutoffHz, sampleHz);
+    range(what, gainDb(pt1Apply, &pt1, cutoffHz, sampleHz), -5.5, -2.9);
+}
+
+static void testLpf(float cutoffHz, float sampleHz)
+{
+    biquadFilter_t biquad;
+    char what[64];
+
+    biquadFilterInitLPF(&biquad, cutoffHz, sampleHz);
+    snprintf(what, sizeof(what), "biquad %g/%g Hz, dB at %g Hz", cutoffHz, sampleHz, cutoffHz / 10);
+    range(what, gainDb(biquadApply, &biquad, cutoffHz / 10, sampleHz), -0.05, 0.05);
+    biquadFilterInitLPF(&biquad, cutoffHz, sampleHz);
+    snprintf(what, sizeof(what), "biquad %g/%g Hz, dB at cutoff", cutoffHz, sampleHz);
+    range(what, gainDb(biquadApply, &biquad, cutoffHz, sampleHz), -3.2, -2.8);
+    // Second order, at least 10 dB more per octave than at the corner
+    biquadFilterInitLPF(&biquad, cutoffHz, sampleHz);
+    snprintf(what, sizeof(what), "biquad %g/%g Hz, dB at %g Hz", cutoffHz, sampleHz, cutoffHz * 2);
+    if (cutoffHz * 2 < sampleHz / 2)
+        range(what, gainDb(biquadApply, &biquad, cutoffHz * 2, sampleHz), -60.0, -13.0);
+}
+
+static void testNotch(float centreHz, float cutoffHz, float sampleHz)
+{
+    biquadFilter_t biquad;
+    char what[80];
+
+    biquadFilterInitNotch(&biquad, centreHz, cutoffHz, sampleHz);
+    snprintf(what, sizeof(what), "notch %g-%g/%g Hz, dB at centre", cutoffHz, centreHz, sampleHz);
+    range(what, gainDb(biquadApply, &biquad, centreHz, sampleHz), -200.0, -40.0);
+    biquadFilterInitNotch(&biquad, centreHz, cutoffHz, sampleHz);
+    snprintf(what, sizeof(what), "notch %g-%g/%g Hz, dB at cutoff", cutoffHz, centreHz, sampleHz);
+    range(what, gainDb(biquadApply, &biquad, cutoffHz, sampleHz), -3.2, -2.8);
+    biquadFilterInitNotch(&biquad, centreHz, cutoffHz, sampleHz);
+    snprintf(what, sizeof(what), "notch %g-%g/%g Hz, dB at %g Hz", cutoffHz, centreHz, sampleHz, centreHz / 8);
+    range(what, gainDb(biquadApply, &biquad, centreHz / 8, sampleHz), -0.3, 0.05);
+}
+
+static void testChain(void)
+{
+    filterConfig_t config = { FILTER_NONE, 0, 100, 0 };
+    filterChain_t chain;
+
+    // Notch with its cutoff unset, as 'set gyroNotchHz=100' leaves it
+    filterChainInit(&chain, &config, 250.0f);
+    range("chain notch 100 Hz, cutoff unset, stages", chain.count, 1, 1);
+    range("chain notch 100 Hz, cutoff unset, dB at centre", gainDb(chainApply, &chain, 100.0, 250.0),
+          -200.0, -40.0);
+    filterChainReset(&chain);
+    range("chain notch 100 Hz, cutoff unset, dB at 75 Hz", gainDb(chainApply, &chain, 75.0, 250.0),
+          -3.2, -2.8);
+
+    config.notchCutoffHz = 100;
+    filterChainInit(&chain, &config, 250.0f);
+    range("chain notch cutoff at centre, stages", chain.count, 0, 0);
+
+    config.notchHz = 125;
+    config.notchCutoffHz = 90;
+    filterChainInit(&chain, &config, 250.0f);
+    range("chain notch at Nyquist, stages", chain.count, 0, 0);
+
+    config = (filterConfig_t){ FILTER_BIQUAD, 200, 0, 0 };
+    filterChainInit(&chain, &config, 250.0f);
+    range("chain low pass above Nyquist, stages", chain.count, 0, 0);
+
+    config = (filterConfig_t){ FILTER_PT1, 90, 0, 0 };
+    filterChainInit(&chain, &config, 250.0f);
+    range("chain pt1 90 Hz, stages", chain.count, 1, 1);
+
+    config = (filterConfig_t){ FILTER_BIQUAD, 30, 80, 60 };
+    filterChainInit(&chain, &config, 333.0f);
+    range("chain biquad 30 Hz + notch 80 Hz, stages", chain.count, 2, 2);
+    range("chain biquad 30 Hz + notch 80 Hz, dB at 3 Hz", gainDb(chainApply, &chain, 3.0, 333.0),
+          -0.3, 0.05);
+    filterChainReset(&chain);
+    range("chain biquad 30 Hz + notch 80 Hz, dB at 80 Hz", gainDb(chainApply, &chain, 80.0, 333.0),
+          -200.0, -60.0);
+}
+
+// The dynamic notch runs the Q2.29 section on raw gyro counts. Both sections
+// are held against the same coefficients run in double. The fixed point one
+// rounds its output to a count every sample and the poles feed that back, so
+// it may be off by a few counts.
+static void testFixedPoint(float centreHz, float cutoffHz, float sampleHz)
+{
+    biquadFilter_t biquad;
+    biquadFilterQ_t biquadQ;
+    double w, x, ref, d1 = 0.0, d2 = 0.0, err, worst = 0.0, worstQ = 0.0;
+    uint32_t n;
+    char what[64];
+
+    biquadFilterInitNotch(&biquad, centreHz, cutoffHz, sampleHz);
+    biquadFilterInitQ(&biquadQ, &biquad);
+
+    // Broadband, a sum of sines up to Nyquist at full gyro scale
+    for (n = 0; n < 20000; n++) {
+        w = 2.0 * M_PI * n / sampleHz;
+        x = lrint(12000.0 * sin(w * 37.0) + 8000.0 * sin(w * centreHz) + 6000.0 * sin(w * sampleHz * 0.45));
+        ref = biquad.b0 * x + d1;
+        d1 = biquad.b1 * x - biquad.a1 * ref + d2;
+        d2 = biquad.b2 * x - biquad.a2 * ref;
+        err = fabs(biquadFilterApply(&biquad, x) - ref);
+        if (err > worst)
+            worst = err;
+        err = fabs(biquadFilterApplyQ(&biquadQ, x) - ref);
+        if (err > worstQ)
+            worstQ = err;
+    }
+
+    snprintf(what, sizeof(what), "notch %g Hz float vs double, counts", centreHz);
+    range(what, worst, 0.0, 2.0);
+    snprintf(what, sizeof(what), "notch %g Hz Q2.29 vs double, counts", centreHz);
+    range(what, worstQ, 0.0, 4.0);
+}
+
+int main(void)
+{
+    // Accel and the outer D terms at the attitude rate, gyro and the rate D
+    // terms at the actuator rate, and at half of it for the corners closer
+    // to Nyquist
+    testPt1(20.0f, 250.0f);
+    testPt1(90.0f, 250.0f);
+    testPt1(20.0f, 500.0f);
+    testPt1(90.0f, 500.0f);
+    testPt1(160.0f, 333.3f);
+    testLpf(20.0f, 250.0f);
+    testLpf(60.0f, 250.0f);
+    testLpf(60.0f, 500.0f);
+    testLpf(100.0f, 333.3f);
+    testNotch(100.0f, 75.0f, 250.0f);
+    testNotch(150.0f, 110.0f, 500.0f);
+    testNotch(60.0f, 40.0f, 333.3f);
+    testNotch(200.0f, 150.0f, 2000.0f);
+    testNotch(400.0f, 300.0f, 2000.0f);
+    testChain();
+    testFixedPoint(200.0f, 150.0f, 2000.0f);
+    testFixedPoint(450.0f, 340.0f, 2000.0f);
+
+    printf(ok ? "filters pass\n" : "filters FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,110 @@
+# MSP round trip latency
+# Sends a request, waits for the complete reply and times the round trip.
+# Needs pyserial.
+#
+# usage: python msp_latency.py <port> [baud] [count] [cmd|gcs|multi]
+#
+# gcs times a ground station refresh as separate requests, multi times the
+# same refresh as one MSP_MULTIPLE request, and both report refreshes/s.
+
+import sys
+import time
+import serial
+
+MSP_IDENT = 100
+MSP_STATUS = 101
+MSP_RAW_IMU = 102
+MSP_MOTOR = 104
+MSP_RC = 105
+MSP_ATTITUDE = 108
+MSP_ALTITUDE = 109
+MSP_BAT = 110
+MSP_MULTIPLE = 230
+
+GCS_REFRESH = [MSP_STATUS, MSP_RAW_IMU, MSP_ATTITUDE, MSP_ALTITUDE,
+               MSP_RC, MSP_MOTOR, MSP_BAT]
+
+
+def request(cmd, payload=b""):
+    frame = bytearray(b"$M<")
+    frame.append(len(payload))
+    frame.append(cmd)
+    frame += payload
+    checksum = 0
+    for b in frame[3:]:
+        checksum ^= b
+    frame.append(checksum)
+    return bytes(frame)
+
+
+def read_reply(ser, cmd):
+    # Header, size and command
+    header = ser.read(5)
+    if len(header) < 5 or header[:3] != b"$M>":
+        return False
+    size = header[3]
+    body = ser.read(size + 1)
+    if len(body) < size + 1 or header[4] != cmd:
+        return False
+    checksum = size ^ cmd
+    for b in body[:size]:
+        checksum ^= b
+    return checksum == body[size]
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("usage: msp_latency.py <port> [baud] [count] [cmd|gcs|multi]")
+        return 1
+
+    port = sys.argv[1]
+    baud = int(sys.argv[2]) if len(sys.argv) > 2 else 115200
+    count = int(sys.argv[3]) if len(sys.argv) > 3 else 1000
+    mode = sys.argv[4] if len(sys.argv) > 4 else str(MSP_IDENT)
+
+    # Each cycle is a list of (frame, cmd) exchanged one after the other
+    if mode == "gcs":
+        cycle = [(request(c), c) for c in GCS_REFRESH]
+    elif mode == "multi":
+        cycle = [(request(MSP_MULTIPLE, bytes(GCS_REFRESH)), MSP_MULTIPLE)]
+    else:
+        cycle = [(request(int(mode)), int(mode))]
+
+    ser = serial.Serial(port=port, baudrate=baud, timeout=0.5)
+    ser.reset_input_buffer()
+
+    times = []
+    errors = 0
+    for i in range(count):
+        start = time.perf_counter()
+        ok = True
+        for frame, cmd in cycle:
+            ser.write(frame)
+            ok = read_reply(ser, cmd) and ok
+        elapsed = time.perf_counter() - start
+        if ok:
+            times.append(elapsed * 1000.0)
+        else:
+            errors += 1
+            ser.reset_input_buffer()
+
+    ser.close()
+
+    if not times:
+        print("no replies, %d errors" % errors)
+        return 1
+
+    times.sort()
+    n = len(times)
+    print("%s, %d cycles, %d errors" % (mode, n, errors))
+    print("min  %7.3f ms" % times[0])
+    print("avg  %7.3f ms" % (sum(times) / n))
+    print("p50  %7.3f ms" % times[n // 2])
+    print("p99  %7.3f ms" % times[min(n - 1, int(n * 0.99))])
+    print("max  %7.3f ms" % times[-1])
+    print("rate %7.1f /s" % (1000.0 * n / sum(times)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,89 @@
+# Generates the parameter name perfect hash used by src/core/params.c
+#
+# usage: python params_hash.py <params.h> <params_hash.h>
+#
+# Hash and displace: names are split into buckets by a first hash, then each
+# bucket, largest first, gets the smallest seed that puts all of its names on
+# free slots. The hash must match paramHash() in params.c.
+
+import re
+import sys
+
+MAX_SEED = 0xFFFF
+
+
+def fnv1a(name, seed):
+    h = (2166136261 ^ seed) & 0xFFFFFFFF
+    for c in name.lower().encode("ascii"):
+        h ^= c
+        h = (h * 16777619) & 0xFFFFFFFF
+    return h
+
+
+def read_names(path):
+    text = open(path).read()
+    table = text[text.index("#define PARAM_TABLE(P)"):]
+    table = table[:table.index("\n\n")]
+    return re.findall(r"^\s*P\((\w+),", table, re.M)
+
+
+def build(names):
+    count = len(names)
+    buckets = max(1, (count + 3) // 4)
+
+    members = [[] for i in range(buckets)]
+    for i, name in enumerate(names):
+        members[fnv1a(name, 0) % buckets].append(i)
+
+    seeds = [0] * buckets
+    slots = [None] * count
+    order = sorted(range(buckets), key=lambda b: -len(members[b]))
+
+    for b in order:
+        if not members[b]:
+            continue
+        for seed in range(1, MAX_SEED + 1):
+            taken = [fnv1a(names[i], seed) % count for i in members[b]]
+            if len(set(taken)) == len(taken) and all(slots[s] is None for s in taken):
+                break
+        else:
+            raise SystemExit("no seed found for bucket %d" % b)
+        seeds[b] = seed
+        for i, s in zip(members[b], taken):
+            slots[s] = i
+
+    return seeds, slots
+
+
+def row(values, per_line):
+    lines = []
+    for i in range(0, len(values), per_line):
+        lines.append("    " + ", ".join(str(v) for v in values[i:i + per_line]) + ",")
+    return "\n".join(lines)
+
+
+def main():
+    if len(sys.argv) != 3:
+        print("usage: params_hash.py <params.h> <params_hash.h>")
+        return 1
+
+    names = read_names(sys.argv[1])
+    lower = [n.lower() for n in names]
+    if len(set(lower)) != len(lower):
+        raise SystemExit("parameter names must be unique ignoring case")
+
+    seeds, slots = build(names)
+
+    out = open(sys.argv[2], "w")
+    out.write("// Generated by support/params_hash.py from core/params.h, do not edit\n\n")
+    out.write("#pragma once\n\n")
+    out.write("#define PARAM_HASH_COUNT    %d\n" % len(names))
+    out.write("#define PARAM_HASH_BUCKETS  %d\n\n" % len(seeds))
+    out.write("static const uint16_t paramHashSeed[PARAM_HASH_BUCKETS] = {\n%s\n};\n\n" % row(seeds, 12))
+    out.write("static const uint8_t paramHashSlot[PARAM_HASH_COUNT] = {\n%s\n};\n" % row(slots, 16))
+    out.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,86 @@
+# Static RAM per module
+# Sums the .data, .fastcode, .bss and .noinit input sections of a GNU ld map
+# file by the object they came from, largest first. .fastcode is the code
+# FAST_CODE puts in RAM. The Makefile runs it after every link and writes the
+# result next to the ELF.
+#
+# usage: python ram_report.py <file.map> [obj dir]
+
+import os
+import re
+import sys
+
+SECTIONS = (".data", ".fastcode", ".bss", ".noinit")
+
+# " .bss.cliBuffer  0x20000a00  0x30 obj/NAZE/core/cli.o", the name may be
+# on a line of its own when it is long
+INPUT = re.compile(r"^ (\S+)?\s+0x([0-9a-f]+)\s+0x([0-9a-f]+)\s+(\S.*)$")
+OUTPUT = re.compile(r"^(\.\w+)\s")
+
+
+def module(path, base):
+    path = path.strip().replace("\\", "/")
+    if "(" in path:     # archive member, libc.a(lib_a-impure.o)
+        return os.path.basename(path.split("(")[0])
+    if base and base in path:
+        path = path[path.index(base) + len(base):]
+    return re.sub(r"\.o$", "", path.lstrip("/"))
+
+
+def report(lines, base):
+    sizes = {}
+    section = None
+    pending = None
+    in_map = False
+
+    for line in lines:
+        line = line.rstrip("\n")
+        if line.startswith("Linker script and memory map"):
+            in_map = True
+            continue
+        if not in_map:
+            continue
+
+        m = OUTPUT.match(line)
+        if m:
+            section = m.group(1) if m.group(1) in SECTIONS else None
+            continue
+        if section is None:
+            continue
+
+        if re.match(r"^ \S+$", line):
+            pending = line.strip()
+            continue
+        m = INPUT.match(line)
+        if m and (m.group(1) or pending):
+            size = int(m.group(3), 16)
+            name = module(m.group(4), base)
+            if size and not name.startswith("*"):
+                entry = sizes.setdefault(name, dict.fromkeys(SECTIONS, 0))
+                entry[section] += size
+        pending = None
+
+    return sizes
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("usage: ram_report.py <file.map> [obj dir]")
+        return 1
+
+    base = sys.argv[2].replace("\\", "/").rstrip("/") + "/" if len(sys.argv) > 2 else None
+    with open(sys.argv[1]) as f:
+        sizes = report(f, base)
+
+    rows = sorted(sizes.items(), key=lambda item: -sum(item[1].values()))
+    totals = dict((s, sum(entry[s] for entry in sizes.values())) for s in SECTIONS)
+
+    print("%-40s %7s %7s %7s %7s %7s" % ("module", "data", "fast", "bss", "noinit", "total"))
+    for name, entry in rows:
+        print("%-40s %7u %7u %7u %7u %7u" % ((name,) + tuple(entry[s] for s in SECTIONS) + (sum(entry.values()),)))
+    print("%-40s %7u %7u %7u %7u %7u" % (("total",) + tuple(totals[s] for s in SECTIONS) + (sum(totals.values()),)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,255 @@
+/*
+ * Host conformance tests for src/core/softfloat.c
+ *
+ * Calls the runtime's helpers by name and compares every result bit for
+ * bit with the host's IEEE single precision arithmetic, which rounds to
+ * nearest even and keeps subnormals as the runtime promises. Any NaN matches
+ * any NaN since payloads are not kept. Square root is checked against the
+ * double root rounded to float, which is exact. Float to int is checked
+ * against the ARM rules: truncate, saturate and NaN gives zero.
+ *
+ * Operands are the special values crossed with each other, then random bit
+ * patterns shaped to reach the rounding, cancellation, subnormal and
+ * overflow paths.
+ *
+ * usage: softfloat_test [millions of random operands per op] [seed]
+ */
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+float __aeabi_fadd(float a, float b);
+float __aeabi_fsub(float a, float b);
+float __aeabi_frsub(float a, float b);
+float __aeabi_fmul(float a, float b);
+float __aeabi_fdiv(float a, float b);
+float __aeabi_i2f(int32_t a);
+float __aeabi_ui2f(uint32_t a);
+float __aeabi_l2f(int64_t a);
+float __aeabi_ul2f(uint64_t a);
+int32_t __aeabi_f2iz(float a);
+uint32_t __aeabi_f2uiz(float a);
+float sqrtf(float x);
+
+#define MAX_REPORTS 5
+
+static const uint32_t specials[] = {
+    0x00000000, 0x80000000,                 // zeros
+    0x00000001, 0x80000001, 0x00000002,     // smallest subnormals
+    0x007FFFFF, 0x807FFFFF, 0x00400000,     // largest subnormal, half way
+    0x00800000, 0x80800000, 0x00800001,     // smallest normals
+    0x3F800000, 0xBF800000, 0x3F800001, 0x3F7FFFFF,     // one and its neighbours
+    0x40000000, 0x3F000000, 0x40490FDB,     // two, a half, pi
+    0x4B000000, 0x4B800000, 0x4EFFFFFF,     // 2^23, 2^24, below 2^31
+    0x4F000000, 0xCF000000, 0x4F800000,     // 2^31, -2^31, 2^32
+    0x7F7FFFFF, 0xFF7FFFFF, 0x7F000000,     // largest finite
+    0x7F800000, 0xFF800000,                 // infinities
+    0x7FC00000, 0xFFC00000, 0x7F800001, 0x7FA00000,     // quiet and signalling NaNs
+};
+
+#define SPECIALS (sizeof(specials) / sizeof(specials[0]))
+
+static uint64_t state;
+
+// xorshift64*, rand() is too short for 64 bit conversions
+static uint64_t random64(void)
+{
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return state * 0x2545F4914F6CDD1Dull;
+}
+
+static uint32_t random32(void)
+{
+    return random64() >> 32;
+}
+
+static float toFloat(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static uint32_t toBits(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+// Mostly finite numbers, biased to small exponents, to the subnormals and to
+// sharing an exponent with a so sums cancel and quotients land on ties
+static uint32_t operand(uint32_t a)
+{
+    uint32_t r = random32(), kind = r & 7, sign = random32() & 0x80000000u;
+
+    switch (kind) {
+    case 0:
+        return r;
+    case 1:
+        return specials[r % SPECIALS] ^ (random32() & 0x80000000u);
+    case 2:
+        return sign | (random32() & 0x007FFFFF);
+    case 3:
+        // Same exponent as a, few significant bits so results are often exact
+        return sign | (a & 0x7F800000) | (random32() & 0x007F0000);
+    case 4:
+        return (a ^ sign) + (random32() & 0xF) - 8;
+    case 5:
+        return sign | ((0x60 + random32() % 0x40) << 23) | (random32() & 0x007FFFFF);
+    default:
+        return sign | ((random32() % 0xFF) << 23) | (random32() & 0x007FFFFF);
+    }
+}
+
+typedef struct {
+    const char *name;
+    uint64_t count, failures;
+} result_t;
+
+static bool same(float x, float y)
+{
+    return (isnan(x) && isnan(y)) || toBits(x) == toBits(y);
+}
+
+static void fail(result_t *r, uint64_t a, uint64_t b, uint64_t got, uint64_t want)
+{
+    if (r->failures++ < MAX_REPORTS)
+        printf("  %s(0x%llx, 0x%llx) = 0x%llx, want 0x%llx\n", r->name, (unsigned long long)a,
+               (unsigned long long)b, (unsigned long long)got, (unsigned long long)want);
+}
+
+static void binary(result_t *r, uint32_t a, uint32_t b)
+{
+    float x = toFloat(a), y = toFloat(b), got, want;
+
+    r->count++;
+    if (!strcmp(r->name, "fadd")) {
+        got = __aeabi_fadd(x, y);
+        want = x + y;
+    } else if (!strcmp(r->name, "fsub")) {
+        got = __aeabi_fsub(x, y);
+        want = x - y;
+    } else if (!strcmp(r->name, "frsub")) {
+        got = __aeabi_frsub(x, y);
+        want = y - x;
+    } else if (!strcmp(r->name, "fmul")) {
+        got = __aeabi_fmul(x, y);
+        want = x * y;
+    } else {
+        got = __aeabi_fdiv(x, y);
+        want = x / y;
+    }
+
+    if (!same(got, want))
+        fail(r, a, b, toBits(got), toBits(want));
+}
+
+static void root(result_t *r, uint32_t a)
+{
+    float x = toFloat(a), got = sqrtf(x), want = x < 0.0f ? NAN : (float)sqrt((double)x);
+
+    r->count++;
+    if (!same(got, want))
+        fail(r, a, 0, toBits(got), toBits(want));
+}
+
+static void toInt(result_t *r, uint32_t a)
+{
+    double x = toFloat(a);
+    int32_t want = isnan(x) ? 0 : x >= 2147483648.0 ? INT32_MAX : x <= -2147483649.0 ? INT32_MIN : (int32_t)x;
+    uint32_t wantU = isnan(x) || x <= -1.0 ? 0 : x >= 4294967296.0 ? UINT32_MAX : (uint32_t)x;
+
+    r[0].count++;
+    if (__aeabi_f2iz(x) != want)
+        fail(&r[0], a, 0, (uint32_t)__aeabi_f2iz(x), (uint32_t)want);
+    r[1].count++;
+    if (__aeabi_f2uiz(x) != wantU)
+        fail(&r[1], a, 0, __aeabi_f2uiz(x), wantU);
+}
+
+// Integers around the 24 bit mantissa and the rounding ties above it
+static void fromInt(result_t *r, uint64_t v)
+{
+    uint32_t v32 = v;
+
+    r[0].count++;
+    if (!same(__aeabi_i2f(v32), (float)(int32_t)v32))
+        fail(&r[0], v32, 0, toBits(__aeabi_i2f(v32)), toBits((float)(int32_t)v32));
+    r[1].count++;
+    if (!same(__aeabi_ui2f(v32), (float)v32))
+        fail(&r[1], v32, 0, toBits(__aeabi_ui2f(v32)), toBits((float)v32));
+    r[2].count++;
+    if (!same(__aeabi_l2f(v), (float)(int64_t)v))
+        fail(&r[2], v, 0, toBits(__aeabi_l2f(v)), toBits((float)(int64_t)v));
+    r[3].count++;
+    if (!same(__aeabi_ul2f(v), (float)v))
+        fail(&r[3], v, 0, toBits(__aeabi_ul2f(v)), toBits((float)v));
+}
+
+static uint64_t integer(void)
+{
+    uint64_t v = random64();
+
+    // A random length, so every exponent is reached
+    return v >> (random32() % 64);
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t millions = argc > 1 ? strtoull(argv[1], NULL, 0) : 10, n;
+    result_t binaries[] = { { "fadd" }, { "fsub" }, { "frsub" }, { "fmul" }, { "fdiv" } };
+    result_t roots = { "sqrtf" };
+    result_t toInts[] = { { "f2iz" }, { "f2uiz" } };
+    result_t fromInts[] = { { "i2f" }, { "ui2f" }, { "l2f" }, { "ul2f" } };
+    uint32_t a, i, j, k;
+    bool ok = true;
+
+    state = argc > 2 ? strtoull(argv[2], NULL, 0) : 1;
+    if (!state)
+        state = 1;
+
+    for (i = 0; i < SPECIALS; i++) {
+        for (j = 0; j < SPECIALS; j++)
+            for (k = 0; k < 5; k++)
+                binary(&binaries[k], specials[i], specials[j]);
+        root(&roots, specials[i]);
+        toInt(toInts, specials[i]);
+    }
+
+    for (n = 0; n < millions * 1000000; n++) {
+        a = operand(0x3F800000);
+        for (k = 0; k < 5; k++)
+            binary(&binaries[k], a, operand(a));
+        root(&roots, a);
+        toInt(toInts, a);
+        fromInt(fromInts, integer());
+    }
+
+    for (k = 0; k < 5; k++)
+        ok &= !binaries[k].failures;
+    ok &= !roots.failures && !toInts[0].failures && !toInts[1].failures;
+    for (k = 0; k < 4; k++)
+        ok &= !fromInts[k].failures;
+
+    for (k = 0; k < 5; k++)
+        printf("%-6s %llu checked, %llu wrong\n", binaries[k].name, (unsigned long long)binaries[k].count,
+               (unsigned long long)binaries[k].failures);
+    printf("%-6s %llu checked, %llu wrong\n", roots.name, (unsigned long long)roots.count,
+           (unsigned long long)roots.failures);
+    for (k = 0; k < 2; k++)
+        printf("%-6s %llu checked, %llu wrong\n", toInts[k].name, (unsigned long long)toInts[k].count,
+               (unsigned long long)toInts[k].failures);
+    for (k = 0; k < 4; k++)
+        printf("%-6s %llu checked, %llu wrong\n", fromInts[k].name, (unsigned long long)fromInts[k].count,
+               (unsigned long long)fromInts[k].failures);
+
+    printf(ok ? "runtime conforms\n" : "runtime FAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,257 @@
+/*
+ * Host simulation of the config store in src/core/store.c
+ *
+ * Provides flashErase() and flashProgram() over a RAM image of the store
+ * sectors, with power cuts injected part way through programs and erases.
+ * After every cut the store is loaded again as it would be at boot and must
+ * hold either the last completed write or the one that was cut. Erase counts
+ * per page give the wear compared with rewriting one page on every save.
+ *
+ * Half words and pages also fail to program or erase now and then, as the read back or the
+ * status flags report them on the target. A failed program leaves the half
+ * words before the bad one written and that one partly, a failed erase leaves
+ * the page partly erased. A write that reports failure must leave the old or
+ * the new data loadable, and the store must count every failure once. A
+ * second pass fails one half word or page in 500, so whole writes fail too.
+ *
+ * usage: store_sim [saves] [seed]
+ */
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "core/store.h"
+#include "drivers/flash.h"
+
+#define BLOB_SIZE       860     // sizeof(config_t) on the target
+#define SIM_BYTES       (STORE_SECTORS * STORE_SECTOR_SIZE)
+#define SIM_PAGES       (SIM_BYTES / FLASH_PAGE_BYTES)
+
+static uint8_t simFlash[SIM_BYTES] __attribute__((aligned(4)));
+uintptr_t simFlashBase;
+
+static uint32_t pageErases[SIM_PAGES];
+static int32_t cutAfter = -1;   // flash operations left before power is cut
+static jmp_buf powerCut;
+static uint32_t faultRate;      // one flash operation in this many fails, 0 never
+static uint32_t faults;         // failures reported to the store
+
+static bool fault(void)
+{
+    if (!faultRate || rand() % faultRate)
+        return false;
+
+    faults++;
+    return true;
+}
+
+static void tick(void)
+{
+    if (cutAfter >= 0 && cutAfter-- == 0)
+        longjmp(powerCut, 1);
+}
+
+bool flashErase(uintptr_t addr, uint16_t len)
+{
+    uint32_t off = addr - simFlashBase;
+    uint32_t end = off + len, i;
+
+    for (; off < end; off += FLASH_PAGE_BYTES) {
+        pageErases[off / FLASH_PAGE_BYTES]++;
+        if (fault()) {
+            for (i = 0; i < FLASH_PAGE_BYTES; i++)
+                if (rand() & 1)
+                    simFlash[off + i] = 0xFF;
+            return false;
+        }
+        if (cutAfter == 0) {
+            // Erase cut short, part of the page reads erased
+            for (i = 0; i < FLASH_PAGE_BYTES; i++)
+                if (rand() & 1)
+                    simFlash[off + i] = 0xFF;
+        }
+        tick();
+        memset(simFlash + off, 0xFF, FLASH_PAGE_BYTES);
+    }
+
+    return true;
+}
+
+bool flashProgram(uintptr_t addr, const void *data, uint16_t len)
+{
+    const uint8_t *src = data;
+    uint32_t off = addr - simFlashBase;
+    uint16_t i;
+
+    for (i = 0; i < len; i += 2) {
+        if (simFlash[off + i] != 0xFF || simFlash[off + i + 1] != 0xFF) {
+            printf("program over unerased flash at %u\n", off + i);
+            exit(1);
+        }
+        if (fault()) {
+            simFlash[off + i] = src[i] | rand();
+            simFlash[off + i + 1] = src[i + 1] | rand();
+            return false;
+        }
+        if (cutAfter == 0) {
+            // Half word cut short, only some of its bits cleared
+            simFlash[off + i] = src[i] | rand();
+            simFlash[off + i + 1] = src[i + 1] | rand();
+        }
+        tick();
+        simFlash[off + i] = src[i];
+        simFlash[off + i + 1] = src[i + 1];
+    }
+
+    return true;
+}
+
+static void mutate(uint8_t *blob)
+{
+    uint16_t i, n, at;
+
+    switch (rand() % 10) {
+    case 0:
+        // Everything changes, like a defaults reset
+        for (i = 0; i < BLOB_SIZE; i++)
+            blob[i] = rand();
+        break;
+    case 1:
+    case 2:
+        // A few scattered parameters
+        for (n = 1 + rand() % 6; n; n--)
+            blob[rand() % BLOB_SIZE] = rand();
+        break;
+    default:
+        // Stick trim, one float
+        at = 4 * (rand() % (BLOB_SIZE / 4));
+        for (i = 0; i < 4; i++)
+            blob[at + i] = rand();
+        break;
+    }
+}
+
+static uint8_t committed[BLOB_SIZE], pending[BLOB_SIZE], loaded[BLOB_SIZE];
+
+// Boots again and checks the store holds the old or the new data
+static bool reload(uint32_t n, const char *why)
+{
+    if (!storeLoad(loaded, BLOB_SIZE)) {
+        printf("save %u: nothing loaded after %s\n", n, why);
+        return false;
+    }
+    if (memcmp(loaded, committed, BLOB_SIZE) && memcmp(loaded, pending, BLOB_SIZE)) {
+        printf("save %u: loaded neither the old nor the new data after %s\n", n, why);
+        return false;
+    }
+    memcpy(committed, loaded, BLOB_SIZE);
+    return true;
+}
+
+static bool run(uint32_t saves, uint32_t *cuts, uint32_t *failed)
+{
+    volatile uint32_t n;
+
+    for (n = 0; n < saves; n++) {
+        memcpy(pending, committed, BLOB_SIZE);
+        mutate(pending);
+
+        cutAfter = (rand() % 8 == 0) ? rand() % 400 : -1;
+        if (!setjmp(powerCut)) {
+            if (rand() % 50 == 0) {
+                memcpy(pending, committed, BLOB_SIZE);
+                if (!storeCompact()) {
+                    cutAfter = -1;
+                    (*failed)++;
+                    if (!reload(n, "a failed compaction"))
+                        return false;
+                    continue;
+                }
+            } else if (!storeWrite(pending, BLOB_SIZE)) {
+                cutAfter = -1;
+                (*failed)++;
+                if (!faultRate) {
+                    printf("write %u failed\n", n);
+                    return false;
+                }
+                if (!reload(n, "a failed write"))
+                    return false;
+                continue;
+            }
+            cutAfter = -1;
+            memcpy(committed, pending, BLOB_SIZE);
+            continue;
+        }
+
+        // Power was cut, boot again
+        (*cuts)++;
+        cutAfter = -1;
+        if (!reload(n, "power cut"))
+            return false;
+    }
+
+    // Clean boot at the end
+    if (!storeLoad(loaded, BLOB_SIZE) || memcmp(loaded, committed, BLOB_SIZE)) {
+        printf("final load mismatch\n");
+        return false;
+    }
+
+    if (storeStats.failures != faults) {
+        printf("store counted %u failures, %u were reported\n", storeStats.failures, faults);
+        return false;
+    }
+
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t saves = argc > 1 ? atoi(argv[1]) : 100000;
+    uint32_t i, cuts = 0, failed = 0, maxErase = 0, totalErase = 0, before;
+
+    srand(argc > 2 ? atoi(argv[2]) : 1);
+    simFlashBase = (uintptr_t)simFlash;
+    memset(simFlash, 0xFF, sizeof(simFlash));
+
+    // First boot, nothing stored
+    if (storeLoad(loaded, BLOB_SIZE)) {
+        printf("loaded from blank flash\n");
+        return 1;
+    }
+    for (i = 0; i < BLOB_SIZE; i++)
+        committed[i] = rand();
+    if (!storeWrite(committed, BLOB_SIZE)) {
+        printf("first write failed\n");
+        return 1;
+    }
+
+    faultRate = 20000;
+    if (!run(saves, &cuts, &failed))
+        return 1;
+
+    for (i = 0; i < SIM_PAGES; i++) {
+        totalErase += pageErases[i];
+        if (pageErases[i] > maxErase)
+            maxErase = pageErases[i];
+    }
+
+    printf("%u saves, %u power cuts, %u flash failures, all recovered\n", saves, cuts, faults);
+    printf("page erases: max %u, mean %u over %u pages\n", maxErase, totalErase / SIM_PAGES, SIM_PAGES);
+    printf("single page rewrite: %u erases of one page\n", saves);
+    printf("delta records %u, sector erases %u\n", storeStats.records, storeStats.erases);
+
+    // Failing flash, whole writes fail and must leave the old data
+    faultRate = 500;
+    cuts = failed = 0;
+    before = faults;
+    if (!run(saves / 10, &cuts, &failed))
+        return 1;
+
+    printf("failing flash: %u saves, %u power cuts, %u flash failures, %u writes failed, all recovered\n",
+           saves / 10, cuts, faults - before, failed);
+    return 0;
+}
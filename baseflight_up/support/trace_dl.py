@@ -0,0 +1,199 @@
+# Event trace download
+# Reads the event trace ring over MSP and writes it as Chrome trace JSON, for
+# chrome://tracing or ui.perfetto.dev. Event names come from TRACE_EVENTS in
+# src/core/trace.h. Needs pyserial to download.
+#
+# usage: python trace_dl.py <port> <file.json> [baud] [ring|once]
+#        python trace_dl.py --convert <file.bin> <file.json>
+#
+# ring or once starts a new recording once the trace has been saved. The raw
+# entries are also saved next to the JSON as <file>.bin for --convert. With
+# --elf <firmware.elf> task markers are named after their callback.
+
+import json
+import os
+import re
+import struct
+import subprocess
+import sys
+
+MSP_TRACE_INFO = 129
+MSP_TRACE_READ = 130
+MSP_TRACE_CONTROL = 224
+
+READ_ENTRIES = 23
+RETRIES = 5
+
+MODES = ["stopped", "recording", "recording once"]
+KINDS = {0x0000: "i", 0x4000: "B", 0x8000: "E"}
+HEADER = struct.Struct("<4sBB")   # magic, core MHz, overhead cycles
+
+
+def request(cmd, payload=b""):
+    frame = bytearray(b"$M<")
+    frame.append(len(payload))
+    frame.append(cmd)
+    frame += payload
+    checksum = 0
+    for b in frame[3:]:
+        checksum ^= b
+    frame.append(checksum)
+    return bytes(frame)
+
+
+def read_reply(ser, cmd):
+    header = ser.read(5)
+    if len(header) < 5 or header[:3] != b"$M>":
+        return None
+    size = header[3]
+    body = ser.read(size + 1)
+    if len(body) < size + 1 or header[4] != cmd:
+        return None
+    checksum = size ^ cmd
+    for b in body[:size]:
+        checksum ^= b
+    if checksum != body[size]:
+        return None
+    return body[:size]
+
+
+def exchange(ser, cmd, payload=b""):
+    for attempt in range(RETRIES):
+        ser.reset_input_buffer()
+        ser.write(request(cmd, payload))
+        reply = read_reply(ser, cmd)
+        if reply is not None:
+            return reply
+    raise IOError("no reply to MSP %d" % cmd)
+
+
+# CRC-32/MPEG-2 over little endian words, as the STM32 CRC unit computes it
+def crc32_stm32(data, crc=0xFFFFFFFF):
+    data = bytes(data) + b"\0" * (-len(data) % 4)
+    for (word,) in struct.iter_unpack("<I", data):
+        crc ^= word
+        for i in range(32):
+            crc = ((crc << 1) ^ 0x04C11DB7) if crc & 0x80000000 else crc << 1
+            crc &= 0xFFFFFFFF
+    return crc
+
+
+def event_table():
+    path = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "src", "core", "trace.h")
+    text = open(path).read()
+    table = text[text.index("#define TRACE_EVENTS(T)"):]
+    return re.findall(r"T\((\w+),\s*(\w+)\)", table)
+
+
+def elf_symbols(path):
+    symbols = {}
+    out = subprocess.check_output(["arm-none-eabi-nm", path]).decode()
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[1] in "tT":
+            symbols[(int(parts[0], 16) >> 1) & 0xFFFF] = parts[2]
+    return symbols
+
+
+def download(ser):
+    info = exchange(ser, MSP_TRACE_INFO)
+    mode, entries, capacity, overhead, mhz = struct.unpack("<BHHBB", info)
+    print("%s, %u of %u entries, %u cycles per marker" % (MODES[mode], entries, capacity, overhead))
+    if not capacity:
+        raise IOError("no trace module built in, build with OPTIONS=TRACE_ALL or TRACE_<module>")
+    if mode:
+        exchange(ser, MSP_TRACE_CONTROL, b"\x00")
+
+    data = bytearray()
+    while len(data) < entries * 8:
+        first = len(data) // 8
+        for attempt in range(RETRIES):
+            reply = exchange(ser, MSP_TRACE_READ, struct.pack("<HB", first, READ_ENTRIES))
+            at, count = struct.unpack_from("<HB", reply)
+            chunk = reply[3:-4]
+            crc = struct.unpack_from("<I", reply, len(reply) - 4)[0]
+            if at == first and count and len(chunk) == count * 8 and crc == crc32_stm32(chunk):
+                break
+        else:
+            raise IOError("bad read at entry %u" % first)
+        data += chunk
+    return HEADER.pack(b"TRC1", mhz, overhead) + bytes(data)
+
+
+def convert(raw, symbols=None):
+    magic, mhz, overhead = HEADER.unpack_from(raw)
+    if magic != b"TRC1":
+        raise ValueError("not a trace dump")
+    names = event_table()
+    entries = list(struct.iter_unpack("<IHH", raw[HEADER.size:]))
+
+    # Unwrap the 32 bit cycle stamps. Entries are in claim order, an interrupt
+    # can stamp just ahead of the marker it preempted, so the steps are taken
+    # as signed and the events sorted afterwards.
+    events, cycles, previous = [], 0, None
+    for stamp, word, arg in entries:
+        if previous is not None:
+            step = (stamp - previous) & 0xFFFFFFFF
+            cycles += step - (1 << 32) if step & 0x80000000 else step
+        previous = stamp
+        event, kind = word & 0x3FFF, word & 0xC000
+        name, module = names[event] if event < len(names) else ("event%d" % event, "?")
+        if name == "task":
+            name = (symbols or {}).get(arg, "task@0x%08x" % (0x08000000 | (arg << 1)))
+        events.append({"name": name, "cat": module.lower(), "ph": KINDS.get(kind, "i"),
+                       "ts": cycles / float(mhz), "pid": 1, "tid": event, "args": {"arg": arg}})
+        if kind == 0:
+            events[-1]["s"] = "t"
+
+    if events:
+        start = min(e["ts"] for e in events)
+        for e in events:
+            e["ts"] = round(e["ts"] - start, 3)
+    events.sort(key=lambda e: e["ts"])
+
+    # One track per event so begin/end pairs always nest
+    for event, (name, module) in enumerate(names):
+        events.append({"name": "thread_name", "ph": "M", "pid": 1, "tid": event,
+                       "args": {"name": "%s/%s" % (module.lower(), name)}})
+    events.append({"name": "process_name", "ph": "M", "pid": 1, "args": {"name": "baseflight"}})
+    return {"traceEvents": events, "displayTimeUnit": "ns",
+            "otherData": {"core_mhz": mhz, "cycles_per_marker": overhead, "entries": len(entries)}}
+
+
+def main():
+    args = sys.argv[1:]
+    symbols = None
+    if "--elf" in args:
+        i = args.index("--elf")
+        symbols = elf_symbols(args[i + 1])
+        del args[i:i + 2]
+
+    if len(args) == 3 and args[0] == "--convert":
+        raw = open(args[1], "rb").read()
+        path = args[2]
+    elif len(args) >= 2:
+        import serial
+        port, path = args[0], args[1]
+        baud = int(args[2]) if len(args) > 2 else 115200
+        restart = args[3] if len(args) > 3 else None
+        ser = serial.Serial(port=port, baudrate=baud, timeout=0.5)
+        raw = download(ser)
+        with open(os.path.splitext(path)[0] + ".bin", "wb") as f:
+            f.write(raw)
+        if restart in ("ring", "once"):
+            exchange(ser, MSP_TRACE_CONTROL, b"\x01" if restart == "ring" else b"\x02")
+            print("recording again")
+    else:
+        print("usage: trace_dl.py <port> <file.json> [baud] [ring|once]")
+        print("       trace_dl.py --convert <file.bin> <file.json>")
+        return 1
+
+    trace = convert(raw, symbols)
+    with open(path, "w") as f:
+        json.dump(trace, f)
+    print("saved %u events to %s" % (trace["otherData"]["entries"], path))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())